@@ -0,0 +1,402 @@
+// Copyright Paul Dardeau, 2016
+// Base64Codec.cpp
+
+#include <string.h>
+
+#include "Base64Codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace lachepas;
+
+static const char ENCODE_TABLE[] =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// value of each character, or 64 for anything outside the alphabet
+static const uint8_t DECODE_TABLE[256] = {
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
+   52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+   64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+   15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
+   64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+   41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+   64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
+};
+
+//******************************************************************************
+
+static size_t EncodeScalar(const uint8_t* input, size_t length, char* output) {
+   char* out = output;
+   size_t i = 0;
+
+   for (; i + 2 < length; i += 3) {
+      const uint32_t group = ((uint32_t) input[i] << 16) |
+                             ((uint32_t) input[i + 1] << 8) |
+                             (uint32_t) input[i + 2];
+      *out++ = ENCODE_TABLE[(group >> 18) & 0x3F];
+      *out++ = ENCODE_TABLE[(group >> 12) & 0x3F];
+      *out++ = ENCODE_TABLE[(group >> 6) & 0x3F];
+      *out++ = ENCODE_TABLE[group & 0x3F];
+   }
+
+   if (i < length) {
+      *out++ = ENCODE_TABLE[input[i] >> 2];
+      if (i == length - 1) {
+         *out++ = ENCODE_TABLE[(input[i] & 0x3) << 4];
+         *out++ = '=';
+      } else {
+         *out++ = ENCODE_TABLE[((input[i] & 0x3) << 4) | (input[i + 1] >> 4)];
+         *out++ = ENCODE_TABLE[(input[i + 1] & 0xF) << 2];
+      }
+      *out++ = '=';
+   }
+
+   return out - output;
+}
+
+//******************************************************************************
+
+static size_t DecodeScalar(const uint8_t* input, size_t length, uint8_t* output) {
+   // only the run of valid characters is decoded; padding or anything else
+   // ends the input
+   size_t valid = 0;
+   while (valid < length && DECODE_TABLE[input[valid]] < 64) {
+      ++valid;
+   }
+
+   uint8_t* out = output;
+   const uint8_t* in = input;
+
+   for (; valid >= 4; valid -= 4, in += 4) {
+      const uint32_t group = ((uint32_t) DECODE_TABLE[in[0]] << 18) |
+                             ((uint32_t) DECODE_TABLE[in[1]] << 12) |
+                             ((uint32_t) DECODE_TABLE[in[2]] << 6) |
+                             (uint32_t) DECODE_TABLE[in[3]];
+      *out++ = (uint8_t) (group >> 16);
+      *out++ = (uint8_t) (group >> 8);
+      *out++ = (uint8_t) group;
+   }
+
+   // a single leftover character carries no complete byte and is ignored
+   if (valid > 1) {
+      *out++ = (uint8_t) (DECODE_TABLE[in[0]] << 2 | DECODE_TABLE[in[1]] >> 4);
+   }
+   if (valid > 2) {
+      *out++ = (uint8_t) (DECODE_TABLE[in[1]] << 4 | DECODE_TABLE[in[2]] >> 2);
+   }
+
+   return out - output;
+}
+
+#ifdef BASE64_X86
+
+// The SIMD kernels use the usual multiply-shift arrangement: a byte shuffle
+// puts each 3 byte group into a 32-bit lane, multiplies move the four 6-bit
+// fields into separate bytes, and a small shuffle table maps each field to
+// its character by range (A-Z, a-z, 0-9, '+', '/'). Decoding reverses it,
+// classifying each character by its high and low nibbles so that a block
+// containing anything outside the alphabet is rejected as a whole and left
+// to the scalar code.
+
+//******************************************************************************
+
+__attribute__((target("ssse3")))
+static inline __m128i EncodeLanesSsse3(__m128i in) {
+   in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                          4, 5, 3, 4, 1, 2, 0, 1));
+   const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+   const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+   const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+   const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+   const __m128i indices = _mm_or_si128(t1, t3);
+
+   __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+   const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+   result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+   const __m128i shiftTable =
+      _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+   result = _mm_shuffle_epi8(shiftTable, result);
+
+   return _mm_add_epi8(result, indices);
+}
+
+//******************************************************************************
+
+__attribute__((target("avx2")))
+static inline __m256i EncodeLanesAvx2(__m256i in) {
+   in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                                4, 5, 3, 4, 1, 2, 0, 1,
+                                                10, 11, 9, 10, 7, 8, 6, 7,
+                                                4, 5, 3, 4, 1, 2, 0, 1));
+   const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+   const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+   const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+   const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+   const __m256i indices = _mm256_or_si256(t1, t3);
+
+   __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+   const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+   result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+
+   const __m256i shiftTable = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+   result = _mm256_shuffle_epi8(shiftTable, result);
+
+   return _mm256_add_epi8(result, indices);
+}
+
+//******************************************************************************
+
+// encodes 12 bytes (reads 16) into 16 characters
+__attribute__((target("ssse3")))
+static void EncodeBlockSsse3(const uint8_t* input, char* output) {
+   const __m128i in = _mm_loadu_si128((const __m128i*) input);
+   _mm_storeu_si128((__m128i*) output, EncodeLanesSsse3(in));
+}
+
+//******************************************************************************
+
+// encodes 24 bytes (reads 28) into 32 characters
+__attribute__((target("avx2")))
+static void EncodeBlockAvx2(const uint8_t* input, char* output) {
+   const __m128i lo = _mm_loadu_si128((const __m128i*) input);
+   const __m128i hi = _mm_loadu_si128((const __m128i*) (input + 12));
+   const __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+   _mm256_storeu_si256((__m256i*) output, EncodeLanesAvx2(in));
+}
+
+//******************************************************************************
+
+// decodes 16 characters into 12 bytes, or returns false (writing nothing)
+// if any of them is outside the alphabet
+__attribute__((target("ssse3")))
+static bool DecodeBlockSsse3(const uint8_t* input, uint8_t* output) {
+   const __m128i in = _mm_loadu_si128((const __m128i*) input);
+   const __m128i lowMask = _mm_set1_epi8(0x0f);
+   const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), lowMask);
+   const __m128i loNibbles = _mm_and_si128(in, lowMask);
+
+   const __m128i loTable =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+   const __m128i hiTable =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+   const __m128i rollTable =
+      _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                    0, 0, 0, 0, 0, 0, 0, 0);
+
+   const __m128i lo = _mm_shuffle_epi8(loTable, loNibbles);
+   const __m128i hi = _mm_shuffle_epi8(hiTable, hiNibbles);
+   const __m128i invalid = _mm_and_si128(lo, hi);
+   if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xffff) {
+      return false;
+   }
+
+   const __m128i isSlash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+   const __m128i roll = _mm_shuffle_epi8(rollTable, _mm_add_epi8(isSlash, hiNibbles));
+   const __m128i values = _mm_add_epi8(in, roll);
+
+   const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+   __m128i out = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+   out = _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                             14, 13, 12, -1, -1, -1, -1));
+
+   _mm_storel_epi64((__m128i*) output, out);
+   const uint32_t tail = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+   ::memcpy(output + 8, &tail, sizeof(tail));
+
+   return true;
+}
+
+//******************************************************************************
+
+// decodes 32 characters into 24 bytes, or returns false (writing nothing)
+// if any of them is outside the alphabet
+__attribute__((target("avx2")))
+static bool DecodeBlockAvx2(const uint8_t* input, uint8_t* output) {
+   const __m256i in = _mm256_loadu_si256((const __m256i*) input);
+   const __m256i lowMask = _mm256_set1_epi8(0x0f);
+   const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), lowMask);
+   const __m256i loNibbles = _mm256_and_si256(in, lowMask);
+
+   const __m256i loTable = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+   const __m256i hiTable = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+   const __m256i rollTable = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                    0, 0, 0, 0, 0, 0, 0, 0));
+
+   const __m256i lo = _mm256_shuffle_epi8(loTable, loNibbles);
+   const __m256i hi = _mm256_shuffle_epi8(hiTable, hiNibbles);
+   if (!_mm256_testz_si256(lo, hi)) {
+      return false;
+   }
+
+   const __m256i isSlash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+   const __m256i roll = _mm256_shuffle_epi8(rollTable,
+                                            _mm256_add_epi8(isSlash, hiNibbles));
+   const __m256i values = _mm256_add_epi8(in, roll);
+
+   const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+   __m256i out = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+   out = _mm256_shuffle_epi8(out, _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+   out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+   _mm_storeu_si128((__m128i*) output, _mm256_castsi256_si128(out));
+   _mm_storel_epi64((__m128i*) (output + 16), _mm256_extracti128_si256(out, 1));
+
+   return true;
+}
+
+#endif
+
+//******************************************************************************
+
+static bool HaveSsse3() {
+#ifdef BASE64_X86
+   static const bool haveSsse3 = __builtin_cpu_supports("ssse3");
+   return haveSsse3;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+static bool HaveAvx2() {
+#ifdef BASE64_X86
+   static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+   return haveAvx2;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+const char* Base64Codec::implementationName() {
+   if (HaveAvx2()) {
+      return "avx2";
+   } else if (HaveSsse3()) {
+      return "ssse3";
+   } else {
+      return "portable";
+   }
+}
+
+//******************************************************************************
+
+size_t Base64Codec::encodedLength(size_t length) {
+   return ((length + 2) / 3) * 4;
+}
+
+//******************************************************************************
+
+size_t Base64Codec::maxDecodedLength(size_t length) {
+   return ((length + 3) / 4) * 3;
+}
+
+//******************************************************************************
+
+size_t Base64Codec::encode(const uint8_t* input, size_t length, char* output) {
+   size_t consumed = 0;
+   size_t produced = 0;
+
+#ifdef BASE64_X86
+   // the vector loads read 4 bytes past each group, so the kernels stop
+   // while that much input still remains
+   if (HaveAvx2()) {
+      while (length - consumed >= 28) {
+         EncodeBlockAvx2(input + consumed, output + produced);
+         consumed += 24;
+         produced += 32;
+      }
+   }
+
+   if (HaveSsse3()) {
+      while (length - consumed >= 16) {
+         EncodeBlockSsse3(input + consumed, output + produced);
+         consumed += 12;
+         produced += 16;
+      }
+   }
+#endif
+
+   return produced + EncodeScalar(input + consumed,
+                                  length - consumed,
+                                  output + produced);
+}
+
+//******************************************************************************
+
+size_t Base64Codec::decode(const char* input, size_t length, uint8_t* output) {
+   const uint8_t* in = (const uint8_t*) input;
+   size_t consumed = 0;
+   size_t produced = 0;
+
+#ifdef BASE64_X86
+   if (HaveAvx2()) {
+      while (length - consumed >= 32 &&
+             DecodeBlockAvx2(in + consumed, output + produced)) {
+         consumed += 32;
+         produced += 24;
+      }
+   }
+
+   if (HaveSsse3()) {
+      while (length - consumed >= 16 &&
+             DecodeBlockSsse3(in + consumed, output + produced)) {
+         consumed += 16;
+         produced += 12;
+      }
+   }
+#endif
+
+   return produced + DecodeScalar(in + consumed,
+                                  length - consumed,
+                                  output + produced);
+}
+
+//******************************************************************************
+
+void Base64Codec::encode(const uint8_t* input, size_t length, string& output) {
+   output.resize(encodedLength(length));
+   if (!output.empty()) {
+      output.resize(encode(input, length, &output[0]));
+   }
+}
+
+//******************************************************************************
+
+void Base64Codec::decode(const char* input, size_t length, string& output) {
+   output.resize(maxDecodedLength(length));
+   if (!output.empty()) {
+      output.resize(decode(input, length, (uint8_t*) &output[0]));
+   }
+}
+
+//******************************************************************************
+
@@ -0,0 +1,84 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BASE64CODEC_H
+#define LACHEPAS_BASE64CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+
+namespace lachepas {
+
+/**
+ * Base64 encoder and decoder (standard alphabet, '=' padding) that works on
+ * caller-provided buffers. Full 24 (or 12) byte groups are handled with AVX2
+ * (or SSSE3) when the processor has it, chosen at run time, and the rest with
+ * a table-driven scalar loop. Output is byte-for-byte what the Apache codec
+ * formerly used here produced, including decoding stopping quietly at the
+ * first character outside the alphabet (such as '=').
+ */
+class Base64Codec {
+
+public:
+   /**
+    *
+    * @param length number of bytes to encode
+    * @return number of characters produced by encode (no terminator)
+    */
+   static size_t encodedLength(size_t length);
+
+   /**
+    *
+    * @param length number of characters to decode
+    * @return size of output buffer needed by decode
+    */
+   static size_t maxDecodedLength(size_t length);
+
+   /**
+    * Encodes length bytes into output, which must hold encodedLength(length)
+    * characters
+    * @param input
+    * @param length
+    * @param output
+    * @return number of characters written
+    */
+   static size_t encode(const uint8_t* input, size_t length, char* output);
+
+   /**
+    * Decodes up to length characters into output, which must hold
+    * maxDecodedLength(length) bytes
+    * @param input
+    * @param length
+    * @param output
+    * @return number of bytes written
+    */
+   static size_t decode(const char* input, size_t length, uint8_t* output);
+
+   /**
+    * Encodes into a string, reusing its capacity
+    * @param input
+    * @param length
+    * @param output
+    */
+   static void encode(const uint8_t* input, size_t length, std::string& output);
+
+   /**
+    * Decodes into a string, reusing its capacity
+    * @param input
+    * @param length
+    * @param output
+    */
+   static void decode(const char* input, size_t length, std::string& output);
+
+   /**
+    *
+    * @return name of the selected kernel ("avx2", "ssse3" or "portable")
+    */
+   static const char* implementationName();
+};
+
+}
+
+#endif
+
@@ -0,0 +1,145 @@
+// Copyright Paul Dardeau, 2016
+// BinaryFile.cpp
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "BinaryFile.h"
+
+using namespace std;
+using namespace lachepas;
+
+static const uint32_t FNV_PRIME = 16777619U;
+
+//******************************************************************************
+
+void BinaryFile::putUint16(char* p, uint16_t value) {
+   p[0] = static_cast<char>(value & 0xff);
+   p[1] = static_cast<char>((value >> 8) & 0xff);
+}
+
+//******************************************************************************
+
+void BinaryFile::putUint32(char* p, uint32_t value) {
+   putUint16(p, static_cast<uint16_t>(value & 0xffff));
+   putUint16(p + 2, static_cast<uint16_t>(value >> 16));
+}
+
+//******************************************************************************
+
+void BinaryFile::putUint64(char* p, uint64_t value) {
+   putUint32(p, static_cast<uint32_t>(value & 0xffffffff));
+   putUint32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+//******************************************************************************
+
+uint16_t BinaryFile::getUint16(const char* p) {
+   return static_cast<uint16_t>(static_cast<uint8_t>(p[0]) |
+                                (static_cast<uint8_t>(p[1]) << 8));
+}
+
+//******************************************************************************
+
+uint32_t BinaryFile::getUint32(const char* p) {
+   return static_cast<uint32_t>(getUint16(p)) |
+          (static_cast<uint32_t>(getUint16(p + 2)) << 16);
+}
+
+//******************************************************************************
+
+uint64_t BinaryFile::getUint64(const char* p) {
+   return static_cast<uint64_t>(getUint32(p)) |
+          (static_cast<uint64_t>(getUint32(p + 4)) << 32);
+}
+
+//******************************************************************************
+
+uint32_t BinaryFile::checksum(const char* data,
+                              size_t length,
+                              uint32_t checksum) {
+   for (size_t i = 0; i < length; ++i) {
+      checksum ^= static_cast<uint8_t>(data[i]);
+      checksum *= FNV_PRIME;
+   }
+   return checksum;
+}
+
+//******************************************************************************
+
+bool BinaryFile::writeFully(int fd, const char* data, size_t length) {
+   while (length > 0) {
+      const ssize_t bytesWritten = ::write(fd, data, length);
+      if (bytesWritten > 0) {
+         data += bytesWritten;
+         length -= bytesWritten;
+      } else if ((bytesWritten == -1) && (errno == EINTR)) {
+         continue;
+      } else {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BinaryFile::pwriteFully(int fd,
+                             const char* data,
+                             size_t length,
+                             uint64_t offset) {
+   while (length > 0) {
+      const ssize_t bytesWritten = ::pwrite(fd, data, length, offset);
+      if (bytesWritten > 0) {
+         data += bytesWritten;
+         length -= bytesWritten;
+         offset += bytesWritten;
+      } else if ((bytesWritten == -1) && (errno == EINTR)) {
+         continue;
+      } else {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BinaryFile::preadFully(int fd,
+                            char* data,
+                            size_t length,
+                            uint64_t offset) {
+   while (length > 0) {
+      const ssize_t bytesRead = ::pread(fd, data, length, offset);
+      if (bytesRead > 0) {
+         data += bytesRead;
+         length -= bytesRead;
+         offset += bytesRead;
+      } else if ((bytesRead == -1) && (errno == EINTR)) {
+         continue;
+      } else {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BinaryFile::syncDirectory(const string& dirPath) {
+   const int fd = ::open(dirPath.c_str(), O_RDONLY);
+   if (fd == -1) {
+      return false;
+   }
+
+   const bool success = (::fsync(fd) == 0);
+   ::close(fd);
+   return success;
+}
+
+//******************************************************************************
+
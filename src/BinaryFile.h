@@ -0,0 +1,62 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BINARYFILE_H
+#define LACHEPAS_BINARYFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+
+namespace lachepas {
+
+/**
+ * Helpers for the node's binary files (pack files, indexes, logs). All
+ * integers are stored little endian.
+ */
+class BinaryFile {
+
+public:
+   static void putUint16(char* p, uint16_t value);
+   static void putUint32(char* p, uint32_t value);
+   static void putUint64(char* p, uint64_t value);
+   static uint16_t getUint16(const char* p);
+   static uint32_t getUint32(const char* p);
+   static uint64_t getUint64(const char* p);
+
+   /**
+    * FNV-1a checksum, which can be computed in pieces by passing the
+    * previous result as the starting value
+    * @param data
+    * @param length
+    * @param checksum
+    * @return
+    */
+   static uint32_t checksum(const char* data,
+                            size_t length,
+                            uint32_t checksum = CHECKSUM_INITIAL_VALUE);
+
+   static bool writeFully(int fd, const char* data, size_t length);
+   static bool pwriteFully(int fd,
+                           const char* data,
+                           size_t length,
+                           uint64_t offset);
+   static bool preadFully(int fd,
+                          char* data,
+                          size_t length,
+                          uint64_t offset);
+
+   /**
+    * Makes changes to a directory's entries (new or renamed files) durable
+    * @param dirPath
+    * @return
+    */
+   static bool syncDirectory(const std::string& dirPath);
+
+   static const uint32_t CHECKSUM_INITIAL_VALUE = 2166136261U;
+};
+
+}
+
+#endif
+
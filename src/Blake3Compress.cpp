@@ -0,0 +1,521 @@
+// Copyright Paul Dardeau, 2016
+// Blake3Compress.cpp
+
+#include <string.h>
+
+#include "Blake3Compress.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLAKE3_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace lachepas;
+
+const uint32_t Blake3Compress::IV[8] = {
+   0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+   0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+static const uint8_t MSG_SCHEDULE[7][16] = {
+   {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+   {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+   {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+   {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+   {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+   {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+   {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+// The quarter-round and round are written once as macros over the vector
+// operations ADD, XOR and ROTR so that the portable code and each SIMD kernel
+// share exactly the same (easily checked) schedule.
+#define BLAKE3_G(v, a, b, c, d, x, y) \
+   v[a] = ADD(ADD(v[a], v[b]), x);   \
+   v[d] = ROTR(XOR(v[d], v[a]), 16); \
+   v[c] = ADD(v[c], v[d]);           \
+   v[b] = ROTR(XOR(v[b], v[c]), 12); \
+   v[a] = ADD(ADD(v[a], v[b]), y);   \
+   v[d] = ROTR(XOR(v[d], v[a]), 8);  \
+   v[c] = ADD(v[c], v[d]);           \
+   v[b] = ROTR(XOR(v[b], v[c]), 7);
+
+#define BLAKE3_ROUND(v, m, r)                                           \
+   BLAKE3_G(v, 0, 4,  8, 12, m[MSG_SCHEDULE[r][0]],  m[MSG_SCHEDULE[r][1]])  \
+   BLAKE3_G(v, 1, 5,  9, 13, m[MSG_SCHEDULE[r][2]],  m[MSG_SCHEDULE[r][3]])  \
+   BLAKE3_G(v, 2, 6, 10, 14, m[MSG_SCHEDULE[r][4]],  m[MSG_SCHEDULE[r][5]])  \
+   BLAKE3_G(v, 3, 7, 11, 15, m[MSG_SCHEDULE[r][6]],  m[MSG_SCHEDULE[r][7]])  \
+   BLAKE3_G(v, 0, 5, 10, 15, m[MSG_SCHEDULE[r][8]],  m[MSG_SCHEDULE[r][9]])  \
+   BLAKE3_G(v, 1, 6, 11, 12, m[MSG_SCHEDULE[r][10]], m[MSG_SCHEDULE[r][11]]) \
+   BLAKE3_G(v, 2, 7,  8, 13, m[MSG_SCHEDULE[r][12]], m[MSG_SCHEDULE[r][13]]) \
+   BLAKE3_G(v, 3, 4,  9, 14, m[MSG_SCHEDULE[r][14]], m[MSG_SCHEDULE[r][15]])
+
+#define BLAKE3_ROUNDS(v, m) \
+   BLAKE3_ROUND(v, m, 0)    \
+   BLAKE3_ROUND(v, m, 1)    \
+   BLAKE3_ROUND(v, m, 2)    \
+   BLAKE3_ROUND(v, m, 3)    \
+   BLAKE3_ROUND(v, m, 4)    \
+   BLAKE3_ROUND(v, m, 5)    \
+   BLAKE3_ROUND(v, m, 6)
+
+//******************************************************************************
+
+static inline uint32_t Load32(const uint8_t* p) {
+   return ((uint32_t) p[0]) |
+          ((uint32_t) p[1] << 8) |
+          ((uint32_t) p[2] << 16) |
+          ((uint32_t) p[3] << 24);
+}
+
+//******************************************************************************
+
+static inline void Store32(uint8_t* p, uint32_t w) {
+   p[0] = (uint8_t) w;
+   p[1] = (uint8_t) (w >> 8);
+   p[2] = (uint8_t) (w >> 16);
+   p[3] = (uint8_t) (w >> 24);
+}
+
+//******************************************************************************
+
+static inline uint32_t Rotr32(uint32_t w, int c) {
+   return (w >> c) | (w << (32 - c));
+}
+
+//******************************************************************************
+
+static void CompressPortable(const uint32_t cv[8],
+                             const uint8_t block[Blake3Compress::BLOCK_LEN],
+                             uint8_t blockLen,
+                             uint64_t counter,
+                             uint8_t flags,
+                             uint32_t v[16]) {
+   uint32_t m[16];
+   for (int i = 0; i < 16; ++i) {
+      m[i] = Load32(block + (4 * i));
+   }
+
+   for (int i = 0; i < 8; ++i) {
+      v[i] = cv[i];
+   }
+
+   v[8]  = Blake3Compress::IV[0];
+   v[9]  = Blake3Compress::IV[1];
+   v[10] = Blake3Compress::IV[2];
+   v[11] = Blake3Compress::IV[3];
+   v[12] = (uint32_t) counter;
+   v[13] = (uint32_t) (counter >> 32);
+   v[14] = blockLen;
+   v[15] = flags;
+
+#define ADD(a, b) ((a) + (b))
+#define XOR(a, b) ((a) ^ (b))
+#define ROTR(a, c) Rotr32((a), (c))
+   BLAKE3_ROUNDS(v, m)
+#undef ADD
+#undef XOR
+#undef ROTR
+}
+
+//******************************************************************************
+
+void Blake3Compress::compressInPlace(uint32_t cv[8],
+                                     const uint8_t block[BLOCK_LEN],
+                                     uint8_t blockLen,
+                                     uint64_t counter,
+                                     uint8_t flags) {
+   uint32_t v[16];
+   CompressPortable(cv, block, blockLen, counter, flags, v);
+
+   for (int i = 0; i < 8; ++i) {
+      cv[i] = v[i] ^ v[i + 8];
+   }
+}
+
+//******************************************************************************
+
+void Blake3Compress::compressXof(const uint32_t cv[8],
+                                 const uint8_t block[BLOCK_LEN],
+                                 uint8_t blockLen,
+                                 uint64_t counter,
+                                 uint8_t flags,
+                                 uint8_t out[2 * OUT_LEN]) {
+   uint32_t v[16];
+   CompressPortable(cv, block, blockLen, counter, flags, v);
+
+   for (int i = 0; i < 8; ++i) {
+      Store32(out + (4 * i), v[i] ^ v[i + 8]);
+      Store32(out + (4 * (i + 8)), v[i + 8] ^ cv[i]);
+   }
+}
+
+//******************************************************************************
+
+void Blake3Compress::loadKeyWords(const uint8_t bytes[KEY_LEN],
+                                  uint32_t words[8]) {
+   for (int i = 0; i < 8; ++i) {
+      words[i] = Load32(bytes + (4 * i));
+   }
+}
+
+//******************************************************************************
+
+void Blake3Compress::storeCvWords(const uint32_t words[8],
+                                  uint8_t bytes[OUT_LEN]) {
+   for (int i = 0; i < 8; ++i) {
+      Store32(bytes + (4 * i), words[i]);
+   }
+}
+
+//******************************************************************************
+
+static void HashOnePortable(const uint8_t* input,
+                            size_t blocks,
+                            const uint32_t key[8],
+                            uint64_t counter,
+                            uint8_t flags,
+                            uint8_t flagsStart,
+                            uint8_t flagsEnd,
+                            uint8_t* out) {
+   uint32_t cv[8];
+   ::memcpy(cv, key, sizeof(cv));
+
+   uint8_t blockFlags = flags | flagsStart;
+
+   for (size_t b = 0; b < blocks; ++b) {
+      if (b == (blocks - 1)) {
+         blockFlags |= flagsEnd;
+      }
+
+      Blake3Compress::compressInPlace(cv,
+                                      input + (b * Blake3Compress::BLOCK_LEN),
+                                      Blake3Compress::BLOCK_LEN,
+                                      counter,
+                                      blockFlags);
+      blockFlags = flags;
+   }
+
+   Blake3Compress::storeCvWords(cv, out);
+}
+
+//******************************************************************************
+
+#ifdef BLAKE3_X86
+
+// Each kernel transposes the next block of every input into one vector per
+// message word (lane i holds input i), runs the rounds on all lanes at once
+// and transposes the resulting chaining values back out. The transposes are
+// done in registers with unpack/permute so the loads stay full width.
+
+static inline void Transpose4Sse2(__m128i r[4]) {
+   const __m128i ab01 = _mm_unpacklo_epi32(r[0], r[1]);
+   const __m128i ab23 = _mm_unpackhi_epi32(r[0], r[1]);
+   const __m128i cd01 = _mm_unpacklo_epi32(r[2], r[3]);
+   const __m128i cd23 = _mm_unpackhi_epi32(r[2], r[3]);
+
+   r[0] = _mm_unpacklo_epi64(ab01, cd01);
+   r[1] = _mm_unpackhi_epi64(ab01, cd01);
+   r[2] = _mm_unpacklo_epi64(ab23, cd23);
+   r[3] = _mm_unpackhi_epi64(ab23, cd23);
+}
+
+//******************************************************************************
+
+static inline __m128i Rotr128(__m128i a, int c) {
+   if (c == 16) {
+      return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xB1), 0xB1);
+   }
+
+   return _mm_or_si128(_mm_srli_epi32(a, c), _mm_slli_epi32(a, 32 - c));
+}
+
+//******************************************************************************
+
+static void HashFourSse2(const uint8_t* const* inputs,
+                         size_t blocks,
+                         const uint32_t key[8],
+                         const uint64_t* counters,
+                         uint8_t flags,
+                         uint8_t flagsStart,
+                         uint8_t flagsEnd,
+                         uint8_t* out) {
+   __m128i h[8];
+   __m128i m[16];
+   __m128i v[16];
+
+   for (int i = 0; i < 8; ++i) {
+      h[i] = _mm_set1_epi32((int) key[i]);
+   }
+
+   const __m128i counterLow =
+      _mm_setr_epi32((int) counters[0], (int) counters[1],
+                     (int) counters[2], (int) counters[3]);
+   const __m128i counterHigh =
+      _mm_setr_epi32((int) (counters[0] >> 32), (int) (counters[1] >> 32),
+                     (int) (counters[2] >> 32), (int) (counters[3] >> 32));
+
+   uint8_t blockFlags = flags | flagsStart;
+
+   for (size_t b = 0; b < blocks; ++b) {
+      if (b == (blocks - 1)) {
+         blockFlags |= flagsEnd;
+      }
+
+      const size_t offset = b * Blake3Compress::BLOCK_LEN;
+      for (int g = 0; g < 4; ++g) {
+         for (int lane = 0; lane < 4; ++lane) {
+            m[(4 * g) + lane] =
+               _mm_loadu_si128((const __m128i*) (inputs[lane] + offset + (16 * g)));
+         }
+         Transpose4Sse2(&m[4 * g]);
+      }
+
+      for (int i = 0; i < 8; ++i) {
+         v[i] = h[i];
+      }
+
+      v[8]  = _mm_set1_epi32((int) Blake3Compress::IV[0]);
+      v[9]  = _mm_set1_epi32((int) Blake3Compress::IV[1]);
+      v[10] = _mm_set1_epi32((int) Blake3Compress::IV[2]);
+      v[11] = _mm_set1_epi32((int) Blake3Compress::IV[3]);
+      v[12] = counterLow;
+      v[13] = counterHigh;
+      v[14] = _mm_set1_epi32(Blake3Compress::BLOCK_LEN);
+      v[15] = _mm_set1_epi32(blockFlags);
+
+#define ADD(a, b) _mm_add_epi32((a), (b))
+#define XOR(a, b) _mm_xor_si128((a), (b))
+#define ROTR(a, c) Rotr128((a), (c))
+      BLAKE3_ROUNDS(v, m)
+#undef ADD
+#undef XOR
+#undef ROTR
+
+      for (int i = 0; i < 8; ++i) {
+         h[i] = _mm_xor_si128(v[i], v[i + 8]);
+      }
+
+      blockFlags = flags;
+   }
+
+   Transpose4Sse2(&h[0]);
+   Transpose4Sse2(&h[4]);
+
+   for (int lane = 0; lane < 4; ++lane) {
+      uint8_t* cv = out + (lane * Blake3Compress::OUT_LEN);
+      _mm_storeu_si128((__m128i*) cv, h[lane]);
+      _mm_storeu_si128((__m128i*) (cv + 16), h[4 + lane]);
+   }
+}
+
+//******************************************************************************
+
+__attribute__((target("avx2")))
+static inline void Transpose8Avx2(__m256i r[8]) {
+   const __m256i ab0145 = _mm256_unpacklo_epi32(r[0], r[1]);
+   const __m256i ab2367 = _mm256_unpackhi_epi32(r[0], r[1]);
+   const __m256i cd0145 = _mm256_unpacklo_epi32(r[2], r[3]);
+   const __m256i cd2367 = _mm256_unpackhi_epi32(r[2], r[3]);
+   const __m256i ef0145 = _mm256_unpacklo_epi32(r[4], r[5]);
+   const __m256i ef2367 = _mm256_unpackhi_epi32(r[4], r[5]);
+   const __m256i gh0145 = _mm256_unpacklo_epi32(r[6], r[7]);
+   const __m256i gh2367 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+   const __m256i abcd04 = _mm256_unpacklo_epi64(ab0145, cd0145);
+   const __m256i abcd15 = _mm256_unpackhi_epi64(ab0145, cd0145);
+   const __m256i abcd26 = _mm256_unpacklo_epi64(ab2367, cd2367);
+   const __m256i abcd37 = _mm256_unpackhi_epi64(ab2367, cd2367);
+   const __m256i efgh04 = _mm256_unpacklo_epi64(ef0145, gh0145);
+   const __m256i efgh15 = _mm256_unpackhi_epi64(ef0145, gh0145);
+   const __m256i efgh26 = _mm256_unpacklo_epi64(ef2367, gh2367);
+   const __m256i efgh37 = _mm256_unpackhi_epi64(ef2367, gh2367);
+
+   r[0] = _mm256_permute2x128_si256(abcd04, efgh04, 0x20);
+   r[1] = _mm256_permute2x128_si256(abcd15, efgh15, 0x20);
+   r[2] = _mm256_permute2x128_si256(abcd26, efgh26, 0x20);
+   r[3] = _mm256_permute2x128_si256(abcd37, efgh37, 0x20);
+   r[4] = _mm256_permute2x128_si256(abcd04, efgh04, 0x31);
+   r[5] = _mm256_permute2x128_si256(abcd15, efgh15, 0x31);
+   r[6] = _mm256_permute2x128_si256(abcd26, efgh26, 0x31);
+   r[7] = _mm256_permute2x128_si256(abcd37, efgh37, 0x31);
+}
+
+//******************************************************************************
+
+__attribute__((target("avx2")))
+static inline __m256i Rotr256(__m256i a, int c) {
+   // rotations by whole bytes are a single byte shuffle
+   if (c == 16) {
+      return _mm256_shuffle_epi8(a,
+         _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                         13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+   } else if (c == 8) {
+      return _mm256_shuffle_epi8(a,
+         _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+                         12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+   }
+
+   return _mm256_or_si256(_mm256_srli_epi32(a, c), _mm256_slli_epi32(a, 32 - c));
+}
+
+//******************************************************************************
+
+__attribute__((target("avx2")))
+static void HashEightAvx2(const uint8_t* const* inputs,
+                          size_t blocks,
+                          const uint32_t key[8],
+                          const uint64_t* counters,
+                          uint8_t flags,
+                          uint8_t flagsStart,
+                          uint8_t flagsEnd,
+                          uint8_t* out) {
+   alignas(32) uint32_t low[8];
+   alignas(32) uint32_t high[8];
+   __m256i h[8];
+   __m256i m[16];
+   __m256i v[16];
+
+   for (int i = 0; i < 8; ++i) {
+      h[i] = _mm256_set1_epi32((int) key[i]);
+      low[i] = (uint32_t) counters[i];
+      high[i] = (uint32_t) (counters[i] >> 32);
+   }
+
+   const __m256i counterLow = _mm256_load_si256((const __m256i*) low);
+   const __m256i counterHigh = _mm256_load_si256((const __m256i*) high);
+
+   uint8_t blockFlags = flags | flagsStart;
+
+   for (size_t b = 0; b < blocks; ++b) {
+      if (b == (blocks - 1)) {
+         blockFlags |= flagsEnd;
+      }
+
+      const size_t offset = b * Blake3Compress::BLOCK_LEN;
+      for (int g = 0; g < 2; ++g) {
+         for (int lane = 0; lane < 8; ++lane) {
+            m[(8 * g) + lane] =
+               _mm256_loadu_si256((const __m256i*) (inputs[lane] + offset + (32 * g)));
+         }
+         Transpose8Avx2(&m[8 * g]);
+      }
+
+      for (int i = 0; i < 8; ++i) {
+         v[i] = h[i];
+      }
+
+      v[8]  = _mm256_set1_epi32((int) Blake3Compress::IV[0]);
+      v[9]  = _mm256_set1_epi32((int) Blake3Compress::IV[1]);
+      v[10] = _mm256_set1_epi32((int) Blake3Compress::IV[2]);
+      v[11] = _mm256_set1_epi32((int) Blake3Compress::IV[3]);
+      v[12] = counterLow;
+      v[13] = counterHigh;
+      v[14] = _mm256_set1_epi32(Blake3Compress::BLOCK_LEN);
+      v[15] = _mm256_set1_epi32(blockFlags);
+
+#define ADD(a, b) _mm256_add_epi32((a), (b))
+#define XOR(a, b) _mm256_xor_si256((a), (b))
+#define ROTR(a, c) Rotr256((a), (c))
+      BLAKE3_ROUNDS(v, m)
+#undef ADD
+#undef XOR
+#undef ROTR
+
+      for (int i = 0; i < 8; ++i) {
+         h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+      }
+
+      blockFlags = flags;
+   }
+
+   Transpose8Avx2(h);
+
+   for (int lane = 0; lane < 8; ++lane) {
+      _mm256_storeu_si256((__m256i*) (out + (lane * Blake3Compress::OUT_LEN)),
+                          h[lane]);
+   }
+}
+
+#endif
+
+//******************************************************************************
+
+static bool HaveAvx2() {
+#ifdef BLAKE3_X86
+   static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+   return haveAvx2;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+int Blake3Compress::simdDegree() {
+#ifdef BLAKE3_X86
+   return HaveAvx2() ? 8 : 4;
+#else
+   return 1;
+#endif
+}
+
+//******************************************************************************
+
+const char* Blake3Compress::implementationName() {
+#ifdef BLAKE3_X86
+   return HaveAvx2() ? "avx2" : "sse2";
+#else
+   return "portable";
+#endif
+}
+
+//******************************************************************************
+
+void Blake3Compress::hashMany(const uint8_t* const* inputs,
+                              size_t numInputs,
+                              size_t blocks,
+                              const uint32_t key[8],
+                              const uint64_t* counters,
+                              uint8_t flags,
+                              uint8_t flagsStart,
+                              uint8_t flagsEnd,
+                              uint8_t* out) {
+   if (blocks == 0) {
+      return;
+   }
+
+#ifdef BLAKE3_X86
+   if (HaveAvx2()) {
+      while (numInputs >= 8) {
+         HashEightAvx2(inputs, blocks, key, counters,
+                       flags, flagsStart, flagsEnd, out);
+         inputs += 8;
+         counters += 8;
+         numInputs -= 8;
+         out += 8 * OUT_LEN;
+      }
+   }
+
+   while (numInputs >= 4) {
+      HashFourSse2(inputs, blocks, key, counters,
+                   flags, flagsStart, flagsEnd, out);
+      inputs += 4;
+      counters += 4;
+      numInputs -= 4;
+      out += 4 * OUT_LEN;
+   }
+#endif
+
+   while (numInputs > 0) {
+      HashOnePortable(inputs[0], blocks, key, counters[0],
+                      flags, flagsStart, flagsEnd, out);
+      ++inputs;
+      ++counters;
+      --numInputs;
+      out += OUT_LEN;
+   }
+}
+
+//******************************************************************************
+
@@ -0,0 +1,118 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLAKE3COMPRESS_H
+#define LACHEPAS_BLAKE3COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace lachepas {
+
+/**
+ * The BLAKE3 compression function. Besides the single-block functions used
+ * for the tree structure, hashMany compresses many equal-length inputs at
+ * once, one input per SIMD lane (AVX2: 8 lanes, SSE2: 4 lanes, chosen at
+ * run time), which is where nearly all of the hashing time goes.
+ */
+class Blake3Compress {
+
+public:
+   static const int BLOCK_LEN = 64;
+   static const int CHUNK_LEN = 1024;
+   static const int OUT_LEN = 32;
+   static const int KEY_LEN = 32;
+   static const int MAX_SIMD_DEGREE = 8;
+
+   static const uint8_t CHUNK_START = 1 << 0;
+   static const uint8_t CHUNK_END   = 1 << 1;
+   static const uint8_t PARENT      = 1 << 2;
+   static const uint8_t ROOT        = 1 << 3;
+   static const uint8_t KEYED_HASH  = 1 << 4;
+
+   static const uint32_t IV[8];
+
+   /**
+    * Compresses one block, replacing cv with the new chaining value
+    * @param cv chaining value (input and output)
+    * @param block
+    * @param blockLen number of meaningful bytes in block
+    * @param counter chunk counter (or output block counter for the root)
+    * @param flags
+    */
+   static void compressInPlace(uint32_t cv[8],
+                               const uint8_t block[BLOCK_LEN],
+                               uint8_t blockLen,
+                               uint64_t counter,
+                               uint8_t flags);
+
+   /**
+    * Compresses one block and produces the full 64 byte output used for
+    * root (extendable) output
+    * @param cv
+    * @param block
+    * @param blockLen
+    * @param counter
+    * @param flags
+    * @param out receives 64 bytes
+    */
+   static void compressXof(const uint32_t cv[8],
+                           const uint8_t block[BLOCK_LEN],
+                           uint8_t blockLen,
+                           uint64_t counter,
+                           uint8_t flags,
+                           uint8_t out[2 * OUT_LEN]);
+
+   /**
+    * Hashes numInputs inputs of (blocks * BLOCK_LEN) bytes each, writing one
+    * 32 byte chaining value per input to out
+    * @param inputs
+    * @param numInputs
+    * @param blocks number of 64 byte blocks in every input
+    * @param key starting chaining value
+    * @param counters counter for each input
+    * @param flags flags applied to every block
+    * @param flagsStart extra flags for the first block
+    * @param flagsEnd extra flags for the last block
+    * @param out
+    */
+   static void hashMany(const uint8_t* const* inputs,
+                        size_t numInputs,
+                        size_t blocks,
+                        const uint32_t key[8],
+                        const uint64_t* counters,
+                        uint8_t flags,
+                        uint8_t flagsStart,
+                        uint8_t flagsEnd,
+                        uint8_t* out);
+
+   /**
+    *
+    * @return number of inputs hashed in parallel by the selected kernel
+    */
+   static int simdDegree();
+
+   /**
+    *
+    * @return name of the selected kernel ("avx2", "sse2" or "portable")
+    */
+   static const char* implementationName();
+
+   /**
+    *
+    * @param bytes
+    * @param words
+    */
+   static void loadKeyWords(const uint8_t bytes[KEY_LEN], uint32_t words[8]);
+
+   /**
+    *
+    * @param words
+    * @param bytes
+    */
+   static void storeCvWords(const uint32_t words[8], uint8_t bytes[OUT_LEN]);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,428 @@
+// Copyright Paul Dardeau, 2016
+// Blake3Hasher.cpp
+
+#include <string.h>
+
+#include "Blake3Hasher.h"
+
+using namespace std;
+using namespace lachepas;
+
+// number of whole chunks handed to hashMany at a time by update
+static const size_t CHUNK_BATCH = 2 * Blake3Compress::MAX_SIMD_DEGREE;
+
+//******************************************************************************
+
+static unsigned int PopCount(uint64_t x) {
+   return static_cast<unsigned int>(__builtin_popcountll(x));
+}
+
+//******************************************************************************
+
+Blake3Hasher::Blake3Hasher() :
+   m_chunkCounter(0),
+   m_chunkBufferLength(0),
+   m_blocksCompressed(0),
+   m_cvStackLength(0),
+   m_flags(0) {
+   ::memcpy(m_key, Blake3Compress::IV, sizeof(m_key));
+   reset();
+}
+
+//******************************************************************************
+
+Blake3Hasher::Blake3Hasher(const uint8_t key[Blake3Compress::KEY_LEN]) :
+   m_chunkCounter(0),
+   m_chunkBufferLength(0),
+   m_blocksCompressed(0),
+   m_cvStackLength(0),
+   m_flags(Blake3Compress::KEYED_HASH) {
+   Blake3Compress::loadKeyWords(key, m_key);
+   reset();
+}
+
+//******************************************************************************
+
+Blake3Hasher::~Blake3Hasher() {
+}
+
+//******************************************************************************
+
+const string& Blake3Hasher::getAlgorithm() const {
+   return ALGORITHM_BLAKE3;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::reset() {
+   resetChunk(0);
+   m_cvStackLength = 0;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::resetChunk(uint64_t chunkCounter) {
+   ::memcpy(m_chunkCv, m_key, sizeof(m_chunkCv));
+   m_chunkCounter = chunkCounter;
+   ::memset(m_chunkBuffer, 0, sizeof(m_chunkBuffer));
+   m_chunkBufferLength = 0;
+   m_blocksCompressed = 0;
+}
+
+//******************************************************************************
+
+size_t Blake3Hasher::chunkLength() const {
+   return (Blake3Compress::BLOCK_LEN * static_cast<size_t>(m_blocksCompressed)) +
+          m_chunkBufferLength;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::chunkUpdate(const uint8_t* input, size_t length) {
+   if (m_chunkBufferLength > 0) {
+      size_t take = Blake3Compress::BLOCK_LEN - m_chunkBufferLength;
+      if (take > length) {
+         take = length;
+      }
+      ::memcpy(m_chunkBuffer + m_chunkBufferLength, input, take);
+      m_chunkBufferLength += static_cast<uint8_t>(take);
+      input += take;
+      length -= take;
+
+      // the final block of a chunk is compressed only at output time
+      if (length > 0) {
+         const uint8_t startFlag =
+            (m_blocksCompressed == 0) ? Blake3Compress::CHUNK_START : 0;
+         Blake3Compress::compressInPlace(m_chunkCv,
+                                         m_chunkBuffer,
+                                         Blake3Compress::BLOCK_LEN,
+                                         m_chunkCounter,
+                                         m_flags | startFlag);
+         ++m_blocksCompressed;
+         m_chunkBufferLength = 0;
+         ::memset(m_chunkBuffer, 0, sizeof(m_chunkBuffer));
+      }
+   }
+
+   while (length > static_cast<size_t>(Blake3Compress::BLOCK_LEN)) {
+      const uint8_t startFlag =
+         (m_blocksCompressed == 0) ? Blake3Compress::CHUNK_START : 0;
+      Blake3Compress::compressInPlace(m_chunkCv,
+                                      input,
+                                      Blake3Compress::BLOCK_LEN,
+                                      m_chunkCounter,
+                                      m_flags | startFlag);
+      ++m_blocksCompressed;
+      input += Blake3Compress::BLOCK_LEN;
+      length -= Blake3Compress::BLOCK_LEN;
+   }
+
+   if (length > 0) {
+      ::memcpy(m_chunkBuffer + m_chunkBufferLength, input, length);
+      m_chunkBufferLength += static_cast<uint8_t>(length);
+   }
+}
+
+//******************************************************************************
+
+void Blake3Hasher::chunkOutput(Output& output) const {
+   const uint8_t startFlag =
+      (m_blocksCompressed == 0) ? Blake3Compress::CHUNK_START : 0;
+   ::memcpy(output.cv, m_chunkCv, sizeof(output.cv));
+   ::memcpy(output.block, m_chunkBuffer, sizeof(output.block));
+   output.counter = m_chunkCounter;
+   output.blockLen = m_chunkBufferLength;
+   output.flags = m_flags | startFlag | Blake3Compress::CHUNK_END;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::parentOutput(const uint8_t* parentBlock,
+                                Output& output) const {
+   ::memcpy(output.cv, m_key, sizeof(output.cv));
+   ::memcpy(output.block, parentBlock, sizeof(output.block));
+   output.counter = 0;
+   output.blockLen = Blake3Compress::BLOCK_LEN;
+   output.flags = m_flags | Blake3Compress::PARENT;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::outputChainingValue(const Output& output,
+                                       uint8_t cv[Blake3Compress::OUT_LEN]) const {
+   uint32_t words[8];
+   ::memcpy(words, output.cv, sizeof(words));
+   Blake3Compress::compressInPlace(words,
+                                   output.block,
+                                   output.blockLen,
+                                   output.counter,
+                                   output.flags);
+   Blake3Compress::storeCvWords(words, cv);
+}
+
+//******************************************************************************
+
+void Blake3Hasher::mergeCvStack(uint64_t totalChunks) {
+   // Merging is lazy: a completed subtree is only folded into its parent
+   // once more input is known to follow, since the root has to be
+   // compressed with a different flag.
+   const unsigned int postMergeStackLength = PopCount(totalChunks);
+
+   while (m_cvStackLength > postMergeStackLength) {
+      uint8_t* parentNode =
+         &m_cvStack[(m_cvStackLength - 2) * Blake3Compress::OUT_LEN];
+      Output output;
+      parentOutput(parentNode, output);
+      outputChainingValue(output, parentNode);
+      --m_cvStackLength;
+   }
+}
+
+//******************************************************************************
+
+void Blake3Hasher::pushCv(const uint8_t cv[Blake3Compress::OUT_LEN],
+                          uint64_t chunkCounter) {
+   mergeCvStack(chunkCounter);
+   ::memcpy(&m_cvStack[m_cvStackLength * Blake3Compress::OUT_LEN],
+            cv,
+            Blake3Compress::OUT_LEN);
+   ++m_cvStackLength;
+}
+
+//******************************************************************************
+
+void Blake3Hasher::addChunkChainingValues(const uint8_t* cvs,
+                                          size_t numChunks) {
+   for (size_t i = 0; i < numChunks; ++i) {
+      pushCv(cvs + (i * Blake3Compress::OUT_LEN), m_chunkCounter);
+      ++m_chunkCounter;
+   }
+
+   resetChunk(m_chunkCounter);
+}
+
+//******************************************************************************
+
+void Blake3Hasher::reduceSubtree(uint8_t* cvs, size_t numChunks) {
+   // Each level of parent nodes is hashed with hashMany as well; otherwise
+   // the one-at-a-time parent compressions become a large share of the cost.
+   const uint8_t* inputs[CHUNK_BATCH / 2];
+   uint64_t counters[CHUNK_BATCH / 2];
+   uint8_t parents[(CHUNK_BATCH / 2) * Blake3Compress::OUT_LEN];
+
+   while (numChunks > 1) {
+      const size_t numParents = numChunks / 2;
+
+      for (size_t i = 0; i < numParents; ++i) {
+         inputs[i] = cvs + (i * Blake3Compress::BLOCK_LEN);
+         counters[i] = 0;
+      }
+
+      Blake3Compress::hashMany(inputs,
+                               numParents,
+                               1,
+                               m_key,
+                               counters,
+                               m_flags | Blake3Compress::PARENT,
+                               0,
+                               0,
+                               parents);
+      ::memcpy(cvs, parents, numParents * Blake3Compress::OUT_LEN);
+      numChunks = numParents;
+   }
+}
+
+//******************************************************************************
+
+void Blake3Hasher::update(const void* data, size_t length) {
+   const uint8_t* input = static_cast<const uint8_t*>(data);
+
+   // finish any partial chunk left over from the last call
+   if (chunkLength() > 0) {
+      size_t take = Blake3Compress::CHUNK_LEN - chunkLength();
+      if (take > length) {
+         take = length;
+      }
+      chunkUpdate(input, take);
+      input += take;
+      length -= take;
+
+      if (length == 0) {
+         return;
+      }
+
+      Output output;
+      uint8_t chunkCv[Blake3Compress::OUT_LEN];
+      chunkOutput(output);
+      outputChainingValue(output, chunkCv);
+      pushCv(chunkCv, m_chunkCounter);
+      resetChunk(m_chunkCounter + 1);
+   }
+
+   // Whole chunks go through hashMany a batch at a time. At least one byte
+   // is always held back because the last chunk may turn out to be the root.
+   const uint8_t* inputs[CHUNK_BATCH];
+   uint64_t counters[CHUNK_BATCH];
+   uint8_t cvs[CHUNK_BATCH * Blake3Compress::OUT_LEN];
+
+   while (length > static_cast<size_t>(Blake3Compress::CHUNK_LEN)) {
+      size_t numChunks = (length - 1) / Blake3Compress::CHUNK_LEN;
+      if (numChunks > CHUNK_BATCH) {
+         numChunks = CHUNK_BATCH;
+      }
+
+      for (size_t i = 0; i < numChunks; ++i) {
+         inputs[i] = input + (i * Blake3Compress::CHUNK_LEN);
+         counters[i] = m_chunkCounter + i;
+      }
+
+      Blake3Compress::hashMany(inputs,
+                               numChunks,
+                               Blake3Compress::CHUNK_LEN / Blake3Compress::BLOCK_LEN,
+                               m_key,
+                               counters,
+                               m_flags,
+                               Blake3Compress::CHUNK_START,
+                               Blake3Compress::CHUNK_END,
+                               cvs);
+      if ((numChunks == CHUNK_BATCH) &&
+          ((m_chunkCounter % CHUNK_BATCH) == 0)) {
+         // a complete, aligned subtree that cannot be the root
+         reduceSubtree(cvs, numChunks);
+         pushCv(cvs, m_chunkCounter);
+         resetChunk(m_chunkCounter + numChunks);
+      } else {
+         addChunkChainingValues(cvs, numChunks);
+      }
+
+      input += numChunks * Blake3Compress::CHUNK_LEN;
+      length -= numChunks * Blake3Compress::CHUNK_LEN;
+   }
+
+   if (length > 0) {
+      chunkUpdate(input, length);
+      mergeCvStack(m_chunkCounter);
+   }
+}
+
+//******************************************************************************
+
+void Blake3Hasher::finalize(uint8_t* out, size_t outLength) {
+   Output output;
+
+   if (m_cvStackLength == 0) {
+      chunkOutput(output);
+   } else {
+      size_t cvsRemaining;
+
+      if (chunkLength() > 0) {
+         cvsRemaining = m_cvStackLength;
+         chunkOutput(output);
+      } else {
+         // update always leaves input in the chunk state, but if it is
+         // empty the top two stack entries form the first parent
+         cvsRemaining = m_cvStackLength - 2;
+         parentOutput(&m_cvStack[cvsRemaining * Blake3Compress::OUT_LEN],
+                      output);
+      }
+
+      while (cvsRemaining > 0) {
+         --cvsRemaining;
+         uint8_t parentBlock[Blake3Compress::BLOCK_LEN];
+         ::memcpy(parentBlock,
+                  &m_cvStack[cvsRemaining * Blake3Compress::OUT_LEN],
+                  Blake3Compress::OUT_LEN);
+         outputChainingValue(output, parentBlock + Blake3Compress::OUT_LEN);
+         parentOutput(parentBlock, output);
+      }
+   }
+
+   uint64_t outputBlockCounter = 0;
+   uint8_t wideBuffer[2 * Blake3Compress::OUT_LEN];
+
+   while (outLength > 0) {
+      Blake3Compress::compressXof(output.cv,
+                                  output.block,
+                                  output.blockLen,
+                                  outputBlockCounter,
+                                  output.flags | Blake3Compress::ROOT,
+                                  wideBuffer);
+      size_t take = sizeof(wideBuffer);
+      if (take > outLength) {
+         take = outLength;
+      }
+      ::memcpy(out, wideBuffer, take);
+      out += take;
+      outLength -= take;
+      ++outputBlockCounter;
+   }
+}
+
+//******************************************************************************
+
+string Blake3Hasher::finalHex() {
+   uint8_t digest[Blake3Compress::OUT_LEN];
+   finalize(digest, sizeof(digest));
+   return toHexString(digest, sizeof(digest));
+}
+
+//******************************************************************************
+
+void Blake3Hasher::hashBuffers(const char* const* buffers,
+                               const size_t* lengths,
+                               size_t numBuffers,
+                               vector<string>& digests) {
+   digests.resize(numBuffers);
+
+   // Every whole chunk except the last of each buffer is independent of
+   // everything else, so the chunks of all buffers are hashed together.
+   // This keeps all SIMD lanes busy even when the buffers are small.
+   vector<const uint8_t*> inputs;
+   vector<uint64_t> counters;
+   vector<size_t> firstChunk(numBuffers + 1, 0);
+
+   for (size_t i = 0; i < numBuffers; ++i) {
+      const uint8_t* buffer = reinterpret_cast<const uint8_t*>(buffers[i]);
+      const size_t numChunks =
+         (lengths[i] > 0) ? (lengths[i] - 1) / Blake3Compress::CHUNK_LEN : 0;
+
+      firstChunk[i] = inputs.size();
+      for (size_t j = 0; j < numChunks; ++j) {
+         inputs.push_back(buffer + (j * Blake3Compress::CHUNK_LEN));
+         counters.push_back(j);
+      }
+   }
+   firstChunk[numBuffers] = inputs.size();
+
+   vector<uint8_t> cvs(inputs.size() * Blake3Compress::OUT_LEN);
+
+   if (!inputs.empty()) {
+      Blake3Compress::hashMany(&inputs[0],
+                               inputs.size(),
+                               Blake3Compress::CHUNK_LEN / Blake3Compress::BLOCK_LEN,
+                               m_key,
+                               &counters[0],
+                               m_flags,
+                               Blake3Compress::CHUNK_START,
+                               Blake3Compress::CHUNK_END,
+                               &cvs[0]);
+   }
+
+   for (size_t i = 0; i < numBuffers; ++i) {
+      const size_t numChunks = firstChunk[i + 1] - firstChunk[i];
+      const size_t consumed = numChunks * Blake3Compress::CHUNK_LEN;
+
+      reset();
+      if (numChunks > 0) {
+         addChunkChainingValues(&cvs[firstChunk[i] * Blake3Compress::OUT_LEN],
+                                numChunks);
+      }
+      update(buffers[i] + consumed, lengths[i] - consumed);
+      digests[i] = finalHex();
+   }
+
+   reset();
+}
+
+//******************************************************************************
+
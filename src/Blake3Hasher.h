@@ -0,0 +1,122 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLAKE3HASHER_H
+#define LACHEPAS_BLAKE3HASHER_H
+
+#include <stdint.h>
+
+#include "ContentHasher.h"
+#include "Blake3Compress.h"
+
+
+namespace lachepas {
+
+/**
+ * BLAKE3 (default and keyed modes). Input is split into 1 KB chunks that
+ * form a binary tree; runs of whole chunks are hashed together with
+ * Blake3Compress::hashMany so a single large buffer uses every SIMD lane, and
+ * hashBuffers does the same across the chunks of many separate buffers.
+ */
+class Blake3Hasher : public ContentHasher {
+
+public:
+   /**
+    * Default constructor (unkeyed hashing)
+    */
+   Blake3Hasher();
+
+   /**
+    * Constructs a hasher for keyed hashing (a MAC/PRF)
+    * @param key 32 byte key
+    */
+   explicit Blake3Hasher(const uint8_t key[Blake3Compress::KEY_LEN]);
+
+   /**
+    * Destructor
+    */
+   ~Blake3Hasher();
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getAlgorithm() const;
+
+   /**
+    *
+    */
+   void reset();
+
+   /**
+    *
+    * @param data
+    * @param length
+    */
+   void update(const void* data, size_t length);
+
+   /**
+    *
+    * @return
+    */
+   std::string finalHex();
+
+   /**
+    * Completes the hash, producing any number of output bytes
+    * @param out
+    * @param outLength
+    */
+   void finalize(uint8_t* out, size_t outLength);
+
+   /**
+    *
+    * @param buffers
+    * @param lengths
+    * @param numBuffers
+    * @param digests
+    */
+   void hashBuffers(const char* const* buffers,
+                    const size_t* lengths,
+                    size_t numBuffers,
+                    std::vector<std::string>& digests);
+
+
+private:
+   struct Output {
+      uint32_t cv[8];
+      uint8_t block[Blake3Compress::BLOCK_LEN];
+      uint64_t counter;
+      uint8_t blockLen;
+      uint8_t flags;
+   };
+
+   void resetChunk(uint64_t chunkCounter);
+   size_t chunkLength() const;
+   void chunkUpdate(const uint8_t* input, size_t length);
+   void chunkOutput(Output& output) const;
+   void parentOutput(const uint8_t* parentBlock, Output& output) const;
+   void outputChainingValue(const Output& output, uint8_t cv[Blake3Compress::OUT_LEN]) const;
+   void mergeCvStack(uint64_t totalChunks);
+   void pushCv(const uint8_t cv[Blake3Compress::OUT_LEN], uint64_t chunkCounter);
+   void addChunkChainingValues(const uint8_t* cvs, size_t numChunks);
+   void reduceSubtree(uint8_t* cvs, size_t numChunks);
+
+   static const int MAX_DEPTH = 54;
+
+   uint32_t m_key[8];
+   uint32_t m_chunkCv[8];
+   uint64_t m_chunkCounter;
+   uint8_t m_chunkBuffer[Blake3Compress::BLOCK_LEN];
+   uint8_t m_cvStack[(MAX_DEPTH + 1) * Blake3Compress::OUT_LEN];
+   uint8_t m_chunkBufferLength;
+   uint8_t m_blocksCompressed;
+   uint8_t m_cvStackLength;
+   uint8_t m_flags;
+
+   // not available
+   Blake3Hasher(const Blake3Hasher&);
+   Blake3Hasher& operator=(const Blake3Hasher&);
+};
+
+}
+
+#endif
+
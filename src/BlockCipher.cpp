@@ -0,0 +1,409 @@
+// Copyright Paul Dardeau, 2016
+// BlockCipher.cpp
+
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+#include "BlockCipher.h"
+#include "Blake3Hasher.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+static const int AES_BLOCK_LEN = 16;
+
+// context string for deriving the IV key from the encryption key
+static const char IV_KEY_CONTEXT[] = "lachepas block cipher iv";
+
+const string BlockCipher::CIPHER_AES256_ECB = "aes-256-ecb";
+const string BlockCipher::CIPHER_AES256_CTR = "aes-256-ctr";
+const string BlockCipher::CIPHER_AES256_GCM = "aes-256-gcm";
+const string BlockCipher::DEFAULT_CIPHER    = BlockCipher::CIPHER_AES256_GCM;
+
+//******************************************************************************
+
+bool BlockCipher::isValidCipher(const string& cipher) {
+   return (cipher == CIPHER_AES256_ECB) ||
+          (cipher == CIPHER_AES256_CTR) ||
+          (cipher == CIPHER_AES256_GCM);
+}
+
+//******************************************************************************
+
+BlockCipher::BlockCipher() :
+   m_ivLength(0),
+   m_tagLength(0) {
+   m_keyContexts[ENCRYPT] = nullptr;
+   m_keyContexts[DECRYPT] = nullptr;
+   ::memset(m_ivKey, 0, sizeof(m_ivKey));
+}
+
+//******************************************************************************
+
+BlockCipher::~BlockCipher() {
+   for (int direction = ENCRYPT; direction <= DECRYPT; ++direction) {
+      for (auto ctx : m_idleContexts[direction]) {
+         ::EVP_CIPHER_CTX_free(ctx);
+      }
+
+      // freeing a context with a NULL pointer is a no-op
+      ::EVP_CIPHER_CTX_free(m_keyContexts[direction]);
+   }
+
+   ::OPENSSL_cleanse(m_ivKey, sizeof(m_ivKey));
+}
+
+//******************************************************************************
+
+bool BlockCipher::init(const string& cipher, const string& encryptionKey) {
+   if (m_keyContexts[ENCRYPT] != nullptr) {
+      Logger::error("block cipher already initialized");
+      return false;
+   }
+
+   const EVP_CIPHER* evpCipher = nullptr;
+
+   if (cipher == CIPHER_AES256_ECB) {
+      evpCipher = ::EVP_aes_256_ecb();
+      m_ivLength = 0;
+      m_tagLength = 0;
+   } else if (cipher == CIPHER_AES256_CTR) {
+      evpCipher = ::EVP_aes_256_ctr();
+      m_ivLength = AES_BLOCK_LEN;
+      m_tagLength = 0;
+   } else if (cipher == CIPHER_AES256_GCM) {
+      evpCipher = ::EVP_aes_256_gcm();
+      m_ivLength = 12;
+      m_tagLength = 16;
+   } else {
+      Logger::error(string("unsupported cipher '") + cipher + "'");
+      return false;
+   }
+
+   if (encryptionKey.length() < KEY_LEN) {
+      Logger::error("encryption key must be 32 bytes");
+      return false;
+   }
+
+   // same key bytes as have always been used for the vaults
+   uint8_t key[KEY_LEN];
+   ::memset(key, 0, sizeof(key));
+   ::strncpy((char*) key, encryptionKey.c_str(), KEY_LEN);
+
+   // ECB decrypts with a different key schedule, so each direction has
+   // its own expanded key
+   m_keyContexts[ENCRYPT] = ::EVP_CIPHER_CTX_new();
+   m_keyContexts[DECRYPT] = ::EVP_CIPHER_CTX_new();
+   bool success = (m_keyContexts[ENCRYPT] != nullptr) &&
+                  (m_keyContexts[DECRYPT] != nullptr) &&
+                  ::EVP_EncryptInit_ex(m_keyContexts[ENCRYPT],
+                                       evpCipher, nullptr, key, nullptr) &&
+                  ::EVP_DecryptInit_ex(m_keyContexts[DECRYPT],
+                                       evpCipher, nullptr, key, nullptr) &&
+                  ::EVP_CIPHER_CTX_set_padding(m_keyContexts[ENCRYPT], 0) &&
+                  ::EVP_CIPHER_CTX_set_padding(m_keyContexts[DECRYPT], 0);
+
+   if (success) {
+      // IVs come from a separate key so the AES key is used for nothing else
+      Blake3Hasher keyHasher(key);
+      keyHasher.update(IV_KEY_CONTEXT, ::strlen(IV_KEY_CONTEXT));
+      keyHasher.finalize(m_ivKey, KEY_LEN);
+      m_cipher = cipher;
+   } else {
+      Logger::error("unable to initialize cipher context");
+      ::EVP_CIPHER_CTX_free(m_keyContexts[ENCRYPT]);
+      ::EVP_CIPHER_CTX_free(m_keyContexts[DECRYPT]);
+      m_keyContexts[ENCRYPT] = nullptr;
+      m_keyContexts[DECRYPT] = nullptr;
+   }
+
+   ::OPENSSL_cleanse(key, sizeof(key));
+
+   return success;
+}
+
+//******************************************************************************
+
+const string& BlockCipher::getCipher() const {
+   return m_cipher;
+}
+
+//******************************************************************************
+
+EVP_CIPHER_CTX* BlockCipher::acquireContext(Direction direction) {
+   {
+      lock_guard<mutex> lock(m_mutex);
+      vector<EVP_CIPHER_CTX*>& idleContexts = m_idleContexts[direction];
+      if (!idleContexts.empty()) {
+         EVP_CIPHER_CTX* ctx = idleContexts.back();
+         idleContexts.pop_back();
+         return ctx;
+      }
+   }
+
+   // copying the context copies the expanded key rather than redoing it
+   EVP_CIPHER_CTX* ctx = ::EVP_CIPHER_CTX_new();
+   if ((ctx != nullptr) &&
+       !::EVP_CIPHER_CTX_copy(ctx, m_keyContexts[direction])) {
+      ::EVP_CIPHER_CTX_free(ctx);
+      ctx = nullptr;
+   }
+
+   return ctx;
+}
+
+//******************************************************************************
+
+void BlockCipher::releaseContext(Direction direction, EVP_CIPHER_CTX* ctx) {
+   lock_guard<mutex> lock(m_mutex);
+   m_idleContexts[direction].push_back(ctx);
+}
+
+//******************************************************************************
+
+void BlockCipher::deriveIv(const string& plainText,
+                           uint8_t* iv,
+                           size_t ivLength) const {
+   Blake3Hasher ivHasher(m_ivKey);
+   ivHasher.update(plainText.data(), plainText.size());
+   ivHasher.finalize(iv, ivLength);
+}
+
+//******************************************************************************
+
+bool BlockCipher::encrypt(const string& plainText,
+                          string& cipherText,
+                          int& padCharCount) {
+   padCharCount = 0;
+
+   if (m_keyContexts[ENCRYPT] == nullptr) {
+      Logger::error("block cipher not initialized");
+      return false;
+   }
+
+   EVP_CIPHER_CTX* ctx = acquireContext(ENCRYPT);
+   if (ctx == nullptr) {
+      Logger::error("unable to create cipher context");
+      return false;
+   }
+
+   bool success;
+
+   if (m_ivLength == 0) {
+      success = encryptEcb(ctx, plainText, cipherText, padCharCount);
+   } else {
+      success = encryptStream(ctx, plainText, cipherText);
+   }
+
+   releaseContext(ENCRYPT, ctx);
+
+   if (!success) {
+      Logger::error(string("unable to encrypt block with ") + m_cipher);
+      cipherText.clear();
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool BlockCipher::encryptEcb(EVP_CIPHER_CTX* ctx,
+                             const string& plainText,
+                             string& cipherText,
+                             int& padCharCount) {
+   // the final partial (or, for an empty block, only) 16 bytes are padded
+   // with zeros, as the original per-16-byte encryption did
+   const size_t length = plainText.size();
+   const size_t fullLength = length - (length % AES_BLOCK_LEN);
+   const size_t tailLength = length - fullLength;
+   const bool padded = (tailLength > 0) || (length == 0);
+
+   padCharCount = padded ? (AES_BLOCK_LEN - (int) tailLength) : 0;
+   cipherText.resize(fullLength + (padded ? AES_BLOCK_LEN : 0));
+
+   uint8_t* out = (uint8_t*) &cipherText[0];
+   int outLength = 0;
+
+   if (!::EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nullptr)) {
+      return false;
+   }
+
+   if (fullLength > 0) {
+      if (!::EVP_EncryptUpdate(ctx,
+                               out,
+                               &outLength,
+                               (const uint8_t*) plainText.data(),
+                               (int) fullLength)) {
+         return false;
+      }
+   }
+
+   if (padded) {
+      uint8_t lastBlock[AES_BLOCK_LEN];
+      int lastLength = 0;
+      ::memset(lastBlock, 0, sizeof(lastBlock));
+      ::memcpy(lastBlock, plainText.data() + fullLength, tailLength);
+
+      if (!::EVP_EncryptUpdate(ctx,
+                               out + fullLength,
+                               &lastLength,
+                               lastBlock,
+                               AES_BLOCK_LEN)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BlockCipher::encryptStream(EVP_CIPHER_CTX* ctx,
+                                const string& plainText,
+                                string& cipherText) {
+   const size_t length = plainText.size();
+   cipherText.resize(m_ivLength + length + m_tagLength);
+
+   uint8_t* iv = (uint8_t*) &cipherText[0];
+   uint8_t* out = iv + m_ivLength;
+   int outLength = 0;
+   int finalLength = 0;
+
+   deriveIv(plainText, iv, m_ivLength);
+
+   // only the IV changes; the expanded key in the context is kept
+   if (!::EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, iv)) {
+      return false;
+   }
+
+   if ((length > 0) &&
+       !::EVP_EncryptUpdate(ctx,
+                            out,
+                            &outLength,
+                            (const uint8_t*) plainText.data(),
+                            (int) length)) {
+      return false;
+   }
+
+   if (!::EVP_EncryptFinal_ex(ctx, out + outLength, &finalLength)) {
+      return false;
+   }
+
+   if (m_tagLength > 0) {
+      if (!::EVP_CIPHER_CTX_ctrl(ctx,
+                                 EVP_CTRL_GCM_GET_TAG,
+                                 (int) m_tagLength,
+                                 out + length)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BlockCipher::decrypt(string& block, int padCharCount) {
+   if (m_keyContexts[DECRYPT] == nullptr) {
+      Logger::error("block cipher not initialized");
+      return false;
+   }
+
+   EVP_CIPHER_CTX* ctx = acquireContext(DECRYPT);
+   if (ctx == nullptr) {
+      Logger::error("unable to create cipher context");
+      return false;
+   }
+
+   bool success;
+
+   if (m_ivLength == 0) {
+      success = decryptEcb(ctx, block, padCharCount);
+   } else {
+      success = decryptStream(ctx, block);
+   }
+
+   releaseContext(DECRYPT, ctx);
+
+   if (!success) {
+      Logger::error(string("unable to decrypt block with ") + m_cipher);
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool BlockCipher::decryptEcb(EVP_CIPHER_CTX* ctx,
+                             string& block,
+                             int padCharCount) {
+   const size_t length = block.size();
+
+   if ((length == 0) ||
+       ((length % AES_BLOCK_LEN) != 0) ||
+       (padCharCount < 0) ||
+       (padCharCount > AES_BLOCK_LEN)) {
+      return false;
+   }
+
+   uint8_t* data = (uint8_t*) &block[0];
+   int outLength = 0;
+
+   if (!::EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nullptr) ||
+       !::EVP_DecryptUpdate(ctx, data, &outLength, data, (int) length)) {
+      return false;
+   }
+
+   block.resize(length - padCharCount);
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BlockCipher::decryptStream(EVP_CIPHER_CTX* ctx, string& block) {
+   if (block.size() < (m_ivLength + m_tagLength)) {
+      return false;
+   }
+
+   const size_t length = block.size() - m_ivLength - m_tagLength;
+   uint8_t* iv = (uint8_t*) &block[0];
+   uint8_t* data = iv + m_ivLength;
+   int outLength = 0;
+   int finalLength = 0;
+
+   if (!::EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, iv)) {
+      return false;
+   }
+
+   if ((length > 0) &&
+       !::EVP_DecryptUpdate(ctx, data, &outLength, data, (int) length)) {
+      return false;
+   }
+
+   if (m_tagLength > 0) {
+      if (!::EVP_CIPHER_CTX_ctrl(ctx,
+                                 EVP_CTRL_GCM_SET_TAG,
+                                 (int) m_tagLength,
+                                 data + length)) {
+         return false;
+      }
+   }
+
+   // for GCM this is where the tag is checked
+   if (!::EVP_DecryptFinal_ex(ctx, data + outLength, &finalLength)) {
+      return false;
+   }
+
+   // drop the tag, then slide the plaintext over the IV
+   block.resize(m_ivLength + length);
+   block.erase(0, m_ivLength);
+
+   return true;
+}
+
+//******************************************************************************
+
@@ -0,0 +1,131 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLOCKCIPHER_H
+#define LACHEPAS_BLOCKCIPHER_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+
+namespace lachepas {
+
+/**
+ * Encrypts and decrypts blocks with AES-256 through OpenSSL EVP, which uses
+ * AES-NI when the processor has it. The key is expanded once in init and
+ * shared by every block (each thread works on its own copy of the expanded
+ * key context, so encrypt and decrypt may be called concurrently).
+ *
+ * CTR and GCM take a per-block IV derived from the block contents with a
+ * keyed BLAKE3 hash, so identical blocks still encrypt identically and are
+ * stored once, while different blocks never share a keystream. The IV is
+ * stored ahead of the ciphertext (and the GCM tag after it). The cipher a
+ * vault's blocks were encrypted with is recorded with the vault.
+ */
+class BlockCipher {
+
+public:
+   static const std::string CIPHER_AES256_ECB;  // legacy, zero padded
+   static const std::string CIPHER_AES256_CTR;
+   static const std::string CIPHER_AES256_GCM;
+   static const std::string DEFAULT_CIPHER;
+
+   static const int KEY_LEN = 32;
+
+   /**
+    *
+    * @param cipher
+    * @return boolean indicating whether the cipher is supported
+    */
+   static bool isValidCipher(const std::string& cipher);
+
+   /**
+    * Default constructor
+    */
+   BlockCipher();
+
+   /**
+    * Destructor
+    */
+   ~BlockCipher();
+
+   /**
+    * Selects the cipher and expands the key (the first KEY_LEN bytes of
+    * encryptionKey)
+    * @param cipher
+    * @param encryptionKey
+    * @return
+    */
+   bool init(const std::string& cipher, const std::string& encryptionKey);
+
+   /**
+    *
+    * @return name of the cipher
+    */
+   const std::string& getCipher() const;
+
+   /**
+    * Encrypts one block. The output is sized once and written in place,
+    * reusing the capacity of cipherText.
+    * @param plainText
+    * @param cipherText receives the IV, ciphertext and tag (as applicable)
+    * @param padCharCount receives the number of padding bytes added (ECB)
+    * @return
+    */
+   bool encrypt(const std::string& plainText,
+                std::string& cipherText,
+                int& padCharCount);
+
+   /**
+    * Decrypts one block in place, removing the IV, tag and padding. For GCM
+    * the tag is checked and a block that fails it is rejected.
+    * @param block ciphertext on input, plaintext on output
+    * @param padCharCount number of padding bytes added by encrypt (ECB)
+    * @return
+    */
+   bool decrypt(std::string& block, int padCharCount);
+
+
+private:
+   enum Direction {
+      ENCRYPT = 0,
+      DECRYPT = 1
+   };
+
+   EVP_CIPHER_CTX* acquireContext(Direction direction);
+   void releaseContext(Direction direction, EVP_CIPHER_CTX* ctx);
+   void deriveIv(const std::string& plainText,
+                 uint8_t* iv,
+                 size_t ivLength) const;
+   bool encryptEcb(EVP_CIPHER_CTX* ctx,
+                   const std::string& plainText,
+                   std::string& cipherText,
+                   int& padCharCount);
+   bool encryptStream(EVP_CIPHER_CTX* ctx,
+                      const std::string& plainText,
+                      std::string& cipherText);
+   bool decryptEcb(EVP_CIPHER_CTX* ctx,
+                   std::string& block,
+                   int padCharCount);
+   bool decryptStream(EVP_CIPHER_CTX* ctx, std::string& block);
+
+   std::string m_cipher;
+   std::mutex m_mutex;
+   std::vector<EVP_CIPHER_CTX*> m_idleContexts[2];  // by direction
+   EVP_CIPHER_CTX* m_keyContexts[2];                // by direction
+   uint8_t m_ivKey[KEY_LEN];
+   size_t m_ivLength;
+   size_t m_tagLength;
+
+   // not available
+   BlockCipher(const BlockCipher&);
+   BlockCipher& operator=(const BlockCipher&);
+};
+
+}
+
+#endif
+
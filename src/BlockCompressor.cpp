@@ -0,0 +1,233 @@
+// Copyright Paul Dardeau, 2016
+// BlockCompressor.cpp
+
+#include <limits.h>
+
+#include <lz4.h>
+#include <zstd.h>
+
+#include "BlockCompressor.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+const string BlockCompressor::COMPRESSION_LZ4     = "lz4";
+const string BlockCompressor::COMPRESSION_ZSTD    = "zstd";
+const string BlockCompressor::DEFAULT_COMPRESSION = BlockCompressor::COMPRESSION_LZ4;
+
+//******************************************************************************
+
+bool BlockCompressor::isValidCompression(const string& compression) {
+   return (compression == COMPRESSION_LZ4) ||
+          (compression == COMPRESSION_ZSTD);
+}
+
+//******************************************************************************
+
+BlockCompressor::BlockCompressor() :
+   m_level(0),
+   m_zstd(false) {
+}
+
+//******************************************************************************
+
+BlockCompressor::~BlockCompressor() {
+   for (auto ctx : m_idleCompressContexts) {
+      ::ZSTD_freeCCtx(ctx);
+   }
+
+   for (auto ctx : m_idleDecompressContexts) {
+      ::ZSTD_freeDCtx(ctx);
+   }
+}
+
+//******************************************************************************
+
+bool BlockCompressor::init(const string& compression, int level) {
+   if (!m_compression.empty()) {
+      Logger::error("block compressor already initialized");
+      return false;
+   }
+
+   if (compression == COMPRESSION_LZ4) {
+      m_zstd = false;
+      m_level = 0;
+   } else if (compression == COMPRESSION_ZSTD) {
+      if ((level != 0) &&
+          ((level < ::ZSTD_minCLevel()) || (level > ::ZSTD_maxCLevel()))) {
+         Logger::error(string("unsupported zstd level ") + to_string(level));
+         return false;
+      }
+
+      m_zstd = true;
+      m_level = (level != 0) ? level : DEFAULT_ZSTD_LEVEL;
+   } else {
+      Logger::error(string("unsupported compression '") + compression + "'");
+      return false;
+   }
+
+   m_compression = compression;
+
+   return true;
+}
+
+//******************************************************************************
+
+const string& BlockCompressor::getCompression() const {
+   return m_compression;
+}
+
+//******************************************************************************
+
+ZSTD_CCtx* BlockCompressor::acquireCompressContext() {
+   {
+      lock_guard<mutex> lock(m_mutex);
+      if (!m_idleCompressContexts.empty()) {
+         ZSTD_CCtx* ctx = m_idleCompressContexts.back();
+         m_idleCompressContexts.pop_back();
+         return ctx;
+      }
+   }
+
+   return ::ZSTD_createCCtx();
+}
+
+//******************************************************************************
+
+void BlockCompressor::releaseCompressContext(ZSTD_CCtx* ctx) {
+   lock_guard<mutex> lock(m_mutex);
+   m_idleCompressContexts.push_back(ctx);
+}
+
+//******************************************************************************
+
+ZSTD_DCtx* BlockCompressor::acquireDecompressContext() {
+   {
+      lock_guard<mutex> lock(m_mutex);
+      if (!m_idleDecompressContexts.empty()) {
+         ZSTD_DCtx* ctx = m_idleDecompressContexts.back();
+         m_idleDecompressContexts.pop_back();
+         return ctx;
+      }
+   }
+
+   return ::ZSTD_createDCtx();
+}
+
+//******************************************************************************
+
+void BlockCompressor::releaseDecompressContext(ZSTD_DCtx* ctx) {
+   lock_guard<mutex> lock(m_mutex);
+   m_idleDecompressContexts.push_back(ctx);
+}
+
+//******************************************************************************
+
+bool BlockCompressor::compress(const string& input, string& output) {
+   if (m_compression.empty()) {
+      Logger::error("block compressor not initialized");
+      return false;
+   }
+
+   if (m_zstd) {
+      ZSTD_CCtx* ctx = acquireCompressContext();
+      if (ctx == nullptr) {
+         Logger::error("unable to create compression context");
+         return false;
+      }
+
+      output.resize(::ZSTD_compressBound(input.size()));
+      const size_t rc = ::ZSTD_compressCCtx(ctx,
+                                            &output[0],
+                                            output.size(),
+                                            input.data(),
+                                            input.size(),
+                                            m_level);
+      releaseCompressContext(ctx);
+
+      if (::ZSTD_isError(rc)) {
+         Logger::error(string("zstd compression failed: ") +
+                       ::ZSTD_getErrorName(rc));
+         output.clear();
+         return false;
+      }
+
+      output.resize(rc);
+   } else {
+      if (input.size() > INT_MAX) {
+         Logger::error("block too large for lz4");
+         return false;
+      }
+
+      // the LZ4 state lives on the stack, so there is nothing to reuse
+      const int inputLength = static_cast<int>(input.size());
+      output.resize(::LZ4_compressBound(inputLength));
+      const int rc = ::LZ4_compress_default(input.data(),
+                                            &output[0],
+                                            inputLength,
+                                            static_cast<int>(output.size()));
+
+      if (rc <= 0) {
+         Logger::error("lz4 compression failed");
+         output.clear();
+         return false;
+      }
+
+      output.resize(rc);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool BlockCompressor::decompress(const string& input,
+                                 size_t originalSize,
+                                 string& output) {
+   if (m_compression.empty()) {
+      Logger::error("block compressor not initialized");
+      return false;
+   }
+
+   output.resize(originalSize);
+
+   // a block that does not come out at exactly its original size is corrupt
+   bool success;
+
+   if (m_zstd) {
+      ZSTD_DCtx* ctx = acquireDecompressContext();
+      if (ctx == nullptr) {
+         Logger::error("unable to create decompression context");
+         return false;
+      }
+
+      const size_t rc = ::ZSTD_decompressDCtx(ctx,
+                                              &output[0],
+                                              output.size(),
+                                              input.data(),
+                                              input.size());
+      releaseDecompressContext(ctx);
+      success = !::ZSTD_isError(rc) && (rc == originalSize);
+   } else {
+      if ((input.size() > INT_MAX) || (originalSize > INT_MAX)) {
+         return false;
+      }
+
+      const int rc = ::LZ4_decompress_safe(input.data(),
+                                           &output[0],
+                                           static_cast<int>(input.size()),
+                                           static_cast<int>(originalSize));
+      success = (rc >= 0) && (static_cast<size_t>(rc) == originalSize);
+   }
+
+   if (!success) {
+      output.clear();
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
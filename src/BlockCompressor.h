@@ -0,0 +1,107 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLOCKCOMPRESSOR_H
+#define LACHEPAS_BLOCKCOMPRESSOR_H
+
+#include <stddef.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// zstd's context types (zstd.h is only needed by the implementation)
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+
+
+namespace lachepas {
+
+/**
+ * Compresses and decompresses blocks with LZ4 (fast) or zstd (smaller, at a
+ * configurable level). Blocks are compressed before they are encrypted. The
+ * zstd contexts are kept and reused from block to block, and each thread
+ * works on its own context, so compress and decompress may be called
+ * concurrently. The codec a vault's blocks were compressed with is recorded
+ * with the vault; the level is not needed to decompress.
+ */
+class BlockCompressor {
+
+public:
+   static const std::string COMPRESSION_LZ4;
+   static const std::string COMPRESSION_ZSTD;
+   static const std::string DEFAULT_COMPRESSION;
+
+   static const int DEFAULT_ZSTD_LEVEL = 3;
+
+   /**
+    *
+    * @param compression
+    * @return boolean indicating whether the codec is supported
+    */
+   static bool isValidCompression(const std::string& compression);
+
+   /**
+    * Default constructor
+    */
+   BlockCompressor();
+
+   /**
+    * Destructor
+    */
+   ~BlockCompressor();
+
+   /**
+    * Selects the codec and level
+    * @param compression
+    * @param level zstd level (0 selects DEFAULT_ZSTD_LEVEL; ignored by LZ4)
+    * @return
+    */
+   bool init(const std::string& compression, int level);
+
+   /**
+    *
+    * @return name of the codec
+    */
+   const std::string& getCompression() const;
+
+   /**
+    * Compresses one block, reusing the capacity of output
+    * @param input
+    * @param output
+    * @return
+    */
+   bool compress(const std::string& input, std::string& output);
+
+   /**
+    * Decompresses one block, reusing the capacity of output
+    * @param input
+    * @param originalSize size of the block before it was compressed
+    * @param output
+    * @return false if the block is corrupt or not originalSize bytes
+    */
+   bool decompress(const std::string& input,
+                   size_t originalSize,
+                   std::string& output);
+
+
+private:
+   ZSTD_CCtx* acquireCompressContext();
+   void releaseCompressContext(ZSTD_CCtx* ctx);
+   ZSTD_DCtx* acquireDecompressContext();
+   void releaseDecompressContext(ZSTD_DCtx* ctx);
+
+   std::string m_compression;
+   std::mutex m_mutex;
+   std::vector<ZSTD_CCtx*> m_idleCompressContexts;
+   std::vector<ZSTD_DCtx*> m_idleDecompressContexts;
+   int m_level;
+   bool m_zstd;
+
+   // not available
+   BlockCompressor(const BlockCompressor&);
+   BlockCompressor& operator=(const BlockCompressor&);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,189 @@
+// Copyright Paul Dardeau, 2016
+// BlockPlacement.cpp
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "BlockPlacement.h"
+
+// multipliers of the block hash (from xxHash64)
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+// FNV-1a, for hashing node names and placement keys
+#define FNV64_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV64_PRIME        0x100000001B3ULL
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+   return (value << bits) | (value >> (64 - bits));
+}
+
+//******************************************************************************
+
+// spreads every input bit over the whole result (splitmix64 finalizer)
+static inline uint64_t mix(uint64_t value) {
+   value ^= value >> 30;
+   value *= 0xBF58476D1CE4E5B9ULL;
+   value ^= value >> 27;
+   value *= 0x94D049BB133111EBULL;
+   value ^= value >> 31;
+   return value;
+}
+
+//******************************************************************************
+
+static uint64_t hashString(const string& s) {
+   uint64_t hash = FNV64_OFFSET_BASIS;
+   for (const char ch : s) {
+      hash ^= static_cast<uint8_t>(ch);
+      hash *= FNV64_PRIME;
+   }
+   return mix(hash);
+}
+
+//******************************************************************************
+
+string BlockPlacement::placementKeyForBlock(const string& data) {
+   const char* p = data.data();
+   const size_t length = data.size();
+   size_t i = 0;
+
+   // four independent lanes, so a block hashes at several bytes per cycle
+   uint64_t lanes[4] = { PRIME64_1, PRIME64_2, 0, PRIME64_1 * PRIME64_2 };
+
+   for (; i + 32 <= length; i += 32) {
+      for (int lane = 0; lane < 4; ++lane) {
+         uint64_t word;
+         ::memcpy(&word, p + i + (lane * 8), sizeof(word));
+         lanes[lane] = rotateLeft(lanes[lane] + (word * PRIME64_2), 31) *
+                       PRIME64_1;
+      }
+   }
+
+   uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) +
+                   rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+   hash += length;
+
+   for (; i < length; ++i) {
+      hash = (hash ^ static_cast<uint8_t>(p[i])) * PRIME64_1;
+   }
+
+   char key[17];
+   ::snprintf(key, sizeof(key), "%016llx", (unsigned long long) mix(hash));
+   return string(key);
+}
+
+//******************************************************************************
+
+BlockPlacement::BlockPlacement() {
+}
+
+//******************************************************************************
+
+BlockPlacement::~BlockPlacement() {
+}
+
+//******************************************************************************
+
+void BlockPlacement::clear() {
+   m_nodeSeeds.clear();
+   m_nodeCapacities.clear();
+}
+
+//******************************************************************************
+
+void BlockPlacement::addNode(const string& nodeName, int capacity) {
+   m_nodeSeeds.push_back(hashString(nodeName));
+   m_nodeCapacities.push_back((capacity > 1) ? capacity : 1);
+}
+
+//******************************************************************************
+
+int BlockPlacement::getNodeCount() const {
+   return m_nodeSeeds.size();
+}
+
+//******************************************************************************
+
+double BlockPlacement::scoreForNode(uint64_t keyHash, int nodeIndex) const {
+   // a uniform value in (0, 1) for the pair. capacity / -ln(u) makes the
+   // chance of a node scoring highest proportional to its capacity.
+   const uint64_t pairHash = mix(keyHash ^ m_nodeSeeds[nodeIndex]);
+   const double u = ((pairHash >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+   return m_nodeCapacities[nodeIndex] / -::log(u);
+}
+
+//******************************************************************************
+
+void BlockPlacement::nodesForBlock(const string& placementKey,
+                                   int copyCount,
+                                   vector<int>& nodeIndexes) const {
+   nodeIndexes.clear();
+
+   const int numNodes = m_nodeSeeds.size();
+   const uint64_t keyHash = hashString(placementKey);
+
+   vector<pair<double, int>> scores;
+   scores.reserve(numNodes);
+   for (int i = 0; i < numNodes; ++i) {
+      scores.push_back(make_pair(scoreForNode(keyHash, i), i));
+   }
+
+   if ((copyCount <= 0) || (copyCount > numNodes)) {
+      copyCount = numNodes;
+   }
+
+   partial_sort(scores.begin(),
+                scores.begin() + copyCount,
+                scores.end(),
+                [](const pair<double, int>& a, const pair<double, int>& b) {
+                   return a.first > b.first;
+                });
+
+   for (int i = 0; i < copyCount; ++i) {
+      nodeIndexes.push_back(scores[i].second);
+   }
+}
+
+//******************************************************************************
+
+bool BlockPlacement::isPlacedOn(const string& placementKey,
+                                int copyCount,
+                                int nodeIndex) const {
+   const int numNodes = m_nodeSeeds.size();
+
+   if ((nodeIndex < 0) || (nodeIndex >= numNodes)) {
+      return false;
+   }
+
+   if ((copyCount <= 0) || (copyCount >= numNodes)) {
+      return true;
+   }
+
+   // the node holds the block if fewer than copyCount nodes outscore it
+   const uint64_t keyHash = hashString(placementKey);
+   const double nodeScore = scoreForNode(keyHash, nodeIndex);
+   int numHigher = 0;
+
+   for (int i = 0; i < numNodes; ++i) {
+      if ((i != nodeIndex) && (scoreForNode(keyHash, i) > nodeScore)) {
+         if (++numHigher >= copyCount) {
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
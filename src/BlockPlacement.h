@@ -0,0 +1,101 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLOCKPLACEMENT_H
+#define LACHEPAS_BLOCKPLACEMENT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Decides which storage nodes hold each block when a directory keeps fewer
+ * copies than there are nodes. Placement uses weighted rendezvous hashing:
+ * every node scores every block from the block's placement key and the
+ * node's name, scaled by the node's capacity, and the highest scoring nodes
+ * hold the block. A node's share of the blocks is proportional to its
+ * capacity. Adding or removing a node only moves the blocks it gains or
+ * loses; every other block stays where it is.
+ *
+ * The placement key is taken from the block's contents before compression
+ * and encryption, so it is the same for every vault no matter how the vault
+ * stores its blocks.
+ */
+class BlockPlacement {
+
+public:
+   /**
+    * Computes the placement key of a block
+    * @param data contents of the block (before compression and encryption)
+    * @return 16 hex characters
+    */
+   static std::string placementKeyForBlock(const std::string& data);
+
+   /**
+    * Default constructor (no nodes)
+    */
+   BlockPlacement();
+
+   /**
+    * Destructor
+    */
+   ~BlockPlacement();
+
+   /**
+    * Removes all nodes
+    */
+   void clear();
+
+   /**
+    * Adds a node. Nodes are identified by the order in which they are added.
+    * @param nodeName
+    * @param capacity relative share of the blocks (values below 1 count as 1)
+    */
+   void addNode(const std::string& nodeName, int capacity);
+
+   /**
+    *
+    * @return
+    */
+   int getNodeCount() const;
+
+   /**
+    * Finds the nodes that hold a block
+    * @param placementKey
+    * @param copyCount number of nodes (0 or more than the number of nodes
+    * means every node)
+    * @param nodeIndexes receives the nodes, best first
+    */
+   void nodesForBlock(const std::string& placementKey,
+                      int copyCount,
+                      std::vector<int>& nodeIndexes) const;
+
+   /**
+    *
+    * @param placementKey
+    * @param copyCount
+    * @param nodeIndex
+    * @return whether the node is one of the nodes that hold the block
+    */
+   bool isPlacedOn(const std::string& placementKey,
+                   int copyCount,
+                   int nodeIndex) const;
+
+
+private:
+   double scoreForNode(uint64_t keyHash, int nodeIndex) const;
+
+   std::vector<uint64_t> m_nodeSeeds;    // from the node names
+   std::vector<double> m_nodeCapacities;
+
+   // not available
+   BlockPlacement(const BlockPlacement&);
+   BlockPlacement& operator=(const BlockPlacement&);
+};
+
+}
+
+#endif
+
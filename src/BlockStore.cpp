@@ -0,0 +1,137 @@
+// Copyright Paul Dardeau, 2016
+// BlockStore.cpp
+
+#include "BlockStore.h"
+#include "GFS.h"
+
+using namespace std;
+using namespace lachepas;
+
+const string BlockStore::ENGINE_FILES = "files";
+const string BlockStore::ENGINE_PACK  = "pack";
+
+static const string ZERO = "0";
+
+static const unsigned int DEFAULT_GROUP_COMMIT_BATCH_SIZE = 32;
+
+//******************************************************************************
+
+bool BlockStore::isValidEngine(const string& engine) {
+   return (engine == ENGINE_FILES) || (engine == ENGINE_PACK);
+}
+
+//******************************************************************************
+
+string BlockStore::directoryForIdentifier(const string& uniqueIdentifier) {
+   string dirName;
+   int digitsFound = 0;
+
+   for (const char ch : uniqueIdentifier) {
+      if (ch >= '0' && ch <= '9') {
+         ++digitsFound;
+
+         // is it a leading 0?
+         if ((ch == '0') && (0 == digitsFound)) {
+            // don't put it
+         } else {
+            dirName += ch;
+         }
+
+         if (digitsFound == 2) {
+            break;
+         }
+      }
+   }
+
+   if (dirName.empty()) {
+      dirName = "00";
+   } else {
+      if (dirName.length() == 1) {
+         // add a leading zero
+         dirName.insert(0, ZERO);
+      }
+   }
+
+   return dirName;
+}
+
+//******************************************************************************
+
+BlockStore::BlockStore() :
+   m_verifyReadBack(false),
+   m_groupCommit(false),
+   m_groupCommitBatchSize(DEFAULT_GROUP_COMMIT_BATCH_SIZE),
+   m_groupCommitMaxDelay(0) {
+}
+
+//******************************************************************************
+
+BlockStore::~BlockStore() {
+}
+
+//******************************************************************************
+
+bool BlockStore::fileUniqueIdentifier(const string& directory,
+                                      const string& fileName,
+                                      string& uniqueIdentifier,
+                                      const string& hashAlgorithm) {
+   string fileContents;
+   if (!retrieveFileContents(directory, fileName, fileContents)) {
+      return false;
+   }
+
+   uniqueIdentifier = GFS::uniqueIdentifierForString(fileContents,
+                                                     hashAlgorithm);
+   return !uniqueIdentifier.empty();
+}
+
+//******************************************************************************
+
+void BlockStore::setVerifyReadBack(bool verifyReadBack) {
+   m_verifyReadBack = verifyReadBack;
+}
+
+//******************************************************************************
+
+bool BlockStore::getVerifyReadBack() const {
+   return m_verifyReadBack;
+}
+
+//******************************************************************************
+
+void BlockStore::setGroupCommit(bool groupCommit) {
+   m_groupCommit = groupCommit;
+}
+
+//******************************************************************************
+
+bool BlockStore::getGroupCommit() const {
+   return m_groupCommit;
+}
+
+//******************************************************************************
+
+void BlockStore::setGroupCommitBatchSize(unsigned int batchSize) {
+   m_groupCommitBatchSize = batchSize;
+}
+
+//******************************************************************************
+
+unsigned int BlockStore::getGroupCommitBatchSize() const {
+   return m_groupCommitBatchSize;
+}
+
+//******************************************************************************
+
+void BlockStore::setGroupCommitMaxDelay(unsigned int maxDelayMillis) {
+   m_groupCommitMaxDelay = maxDelayMillis;
+}
+
+//******************************************************************************
+
+unsigned int BlockStore::getGroupCommitMaxDelay() const {
+   return m_groupCommitMaxDelay;
+}
+
+//******************************************************************************
+
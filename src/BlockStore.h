@@ -0,0 +1,224 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLOCKSTORE_H
+#define LACHEPAS_BLOCKSTORE_H
+
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Storage engine used by GFSServer to hold blocks. Blocks are named by their
+ * unique identifier and are reference counted: adding a block that is
+ * already stored adds a reference, and deleting removes one (the data goes
+ * away with the last reference). The directory of a block is derived from
+ * its identifier and is returned to clients, who pass it back on later
+ * requests.
+ */
+class BlockStore {
+
+public:
+   static const std::string ENGINE_FILES;
+   static const std::string ENGINE_PACK;
+
+   /**
+    *
+    * @param engine
+    * @return boolean indicating whether the storage engine name is known
+    */
+   static bool isValidEngine(const std::string& engine);
+
+   /**
+    * Determines the directory that holds a block
+    * @param uniqueIdentifier
+    * @return two digit directory name
+    */
+   static std::string directoryForIdentifier(const std::string& uniqueIdentifier);
+
+   /**
+    * Default constructor
+    */
+   BlockStore();
+
+   /**
+    * Destructor
+    */
+   virtual ~BlockStore();
+
+   /**
+    * Opens the store, recovering it if it wasn't closed cleanly
+    * @param baseDir
+    * @return
+    */
+   virtual bool open(const std::string& baseDir) = 0;
+
+   /**
+    * Flushes and closes the store
+    */
+   virtual void close() = 0;
+
+   /**
+    *
+    * @param listDirectories
+    * @return
+    */
+   virtual bool dirList(std::vector<std::string>& listDirectories) = 0;
+
+   /**
+    * Stores a block, or adds a reference if it's already stored. The
+    * identifier is computed as the block is written and must match the one
+    * supplied. Returns only once the block is on stable storage.
+    * @param fileName
+    * @param fileContents
+    * @param directory receives the directory of the block
+    * @param uniqueIdentifier identifier supplied by the client (replaced by
+    * the node's identifier on success)
+    * @param hashAlgorithm
+    * @return
+    */
+   virtual bool fileAdd(const std::string& fileName,
+                        const std::string& fileContents,
+                        std::string& directory,
+                        std::string& uniqueIdentifier,
+                        const std::string& hashAlgorithm) = 0;
+
+   /**
+    * Removes a reference to a block, deleting it with the last reference
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   virtual bool fileDelete(const std::string& directory,
+                           const std::string& fileName) = 0;
+
+   /**
+    * Adds a reference to a block that is already stored, without its
+    * contents. Fails if the block isn't stored (the caller then sends it
+    * with fileAdd).
+    * @param fileName
+    * @param directory receives the directory of the block
+    * @param uniqueIdentifier
+    * @return
+    */
+   virtual bool fileAddReference(const std::string& fileName,
+                                 std::string& directory,
+                                 const std::string& uniqueIdentifier) = 0;
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   virtual bool fileExists(const std::string& directory,
+                           const std::string& fileName) = 0;
+
+   /**
+    * Checks which of many blocks are stored, using only in-memory state
+    * (no per-block filesystem access)
+    * @param fileNames
+    * @param stored receives, for each name, whether the block is stored
+    */
+   virtual void filesExist(const std::vector<std::string>& fileNames,
+                           std::vector<bool>& stored) = 0;
+
+   /**
+    *
+    * @param directory
+    * @param listFiles
+    * @return
+    */
+   virtual bool fileList(const std::string& directory,
+                         std::vector<std::string>& listFiles) = 0;
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @param fileContents
+    * @return
+    */
+   virtual bool retrieveFileContents(const std::string& directory,
+                                     const std::string& fileName,
+                                     std::string& fileContents) = 0;
+
+   /**
+    * Computes the identifier of a stored block from its stored contents
+    * @param directory
+    * @param fileName
+    * @param uniqueIdentifier
+    * @param hashAlgorithm
+    * @return
+    */
+   virtual bool fileUniqueIdentifier(const std::string& directory,
+                                     const std::string& fileName,
+                                     std::string& uniqueIdentifier,
+                                     const std::string& hashAlgorithm);
+
+   /**
+    * Sets whether each block is read back and verified after it is written
+    * @param verifyReadBack
+    */
+   void setVerifyReadBack(bool verifyReadBack);
+
+   /**
+    *
+    * @return
+    */
+   bool getVerifyReadBack() const;
+
+   /**
+    * Sets whether block writes are acknowledged after a sync shared with
+    * other writes instead of a sync of their own. Stores that always
+    * group their syncs ignore this.
+    * @param groupCommit
+    */
+   void setGroupCommit(bool groupCommit);
+
+   /**
+    *
+    * @return
+    */
+   bool getGroupCommit() const;
+
+   /**
+    * Sets how many writes a group commit waits for before syncing
+    * @param batchSize
+    */
+   void setGroupCommitBatchSize(unsigned int batchSize);
+
+   /**
+    *
+    * @return
+    */
+   unsigned int getGroupCommitBatchSize() const;
+
+   /**
+    * Sets the longest a group commit waits for its batch to fill
+    * @param maxDelayMillis
+    */
+   void setGroupCommitMaxDelay(unsigned int maxDelayMillis);
+
+   /**
+    *
+    * @return
+    */
+   unsigned int getGroupCommitMaxDelay() const;
+
+
+private:
+   bool m_verifyReadBack;
+   bool m_groupCommit;
+   unsigned int m_groupCommitBatchSize;
+   unsigned int m_groupCommitMaxDelay;
+
+   // not available
+   BlockStore(const BlockStore&);
+   BlockStore& operator=(const BlockStore&);
+};
+
+}
+
+#endif
+
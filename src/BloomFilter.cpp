@@ -0,0 +1,91 @@
+// Copyright Paul Dardeau, 2016
+// BloomFilter.cpp
+
+#include "BloomFilter.h"
+#include "BinaryFile.h"
+
+using namespace std;
+using namespace lachepas;
+
+// 10 bits per key and 7 probes gives a false positive rate of about 1%
+static const uint64_t BITS_PER_KEY    = 10;
+static const unsigned int NUM_PROBES  = 7;
+static const uint32_t SECOND_SEED     = 0x5bd1e995;
+
+//******************************************************************************
+
+BloomFilter::BloomFilter() :
+   m_numBits(0),
+   m_keyCount(0),
+   m_capacity(0) {
+}
+
+//******************************************************************************
+
+void BloomFilter::reset(size_t expectedKeys) {
+   if (expectedKeys < 64) {
+      expectedKeys = 64;
+   }
+
+   m_numBits = expectedKeys * BITS_PER_KEY;
+   m_bits.assign((m_numBits + 63) / 64, 0);
+   m_numBits = m_bits.size() * 64;
+   m_keyCount = 0;
+   m_capacity = expectedKeys;
+}
+
+//******************************************************************************
+
+void BloomFilter::add(const string& key) {
+   if (m_numBits == 0) {
+      return;
+   }
+
+   // double hashing: probe i is h1 + i * h2
+   const uint64_t h1 = BinaryFile::checksum(key.data(), key.length());
+   const uint64_t h2 =
+      BinaryFile::checksum(key.data(), key.length(), SECOND_SEED) | 1;
+
+   for (unsigned int i = 0; i < NUM_PROBES; ++i) {
+      const uint64_t bit = (h1 + i * h2) % m_numBits;
+      m_bits[bit / 64] |= (1ULL << (bit % 64));
+   }
+
+   ++m_keyCount;
+}
+
+//******************************************************************************
+
+bool BloomFilter::mayContain(const string& key) const {
+   if (m_numBits == 0) {
+      return false;
+   }
+
+   const uint64_t h1 = BinaryFile::checksum(key.data(), key.length());
+   const uint64_t h2 =
+      BinaryFile::checksum(key.data(), key.length(), SECOND_SEED) | 1;
+
+   for (unsigned int i = 0; i < NUM_PROBES; ++i) {
+      const uint64_t bit = (h1 + i * h2) % m_numBits;
+      if ((m_bits[bit / 64] & (1ULL << (bit % 64))) == 0) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+size_t BloomFilter::getKeyCount() const {
+   return m_keyCount;
+}
+
+//******************************************************************************
+
+size_t BloomFilter::getCapacity() const {
+   return m_capacity;
+}
+
+//******************************************************************************
+
@@ -0,0 +1,70 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BLOOMFILTER_H
+#define LACHEPAS_BLOOMFILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Fixed-size Bloom filter over strings. mayContain never returns false for a
+ * key that was added; with the filter sized for the number of keys actually
+ * added, about 1% of other keys also return true. Keys can't be removed, so
+ * owners rebuild the filter when enough of its keys have gone away.
+ */
+class BloomFilter {
+
+public:
+   /**
+    * Default constructor (empty filter that contains nothing)
+    */
+   BloomFilter();
+
+   /**
+    * Clears the filter and sizes it for the expected number of keys
+    * @param expectedKeys
+    */
+   void reset(size_t expectedKeys);
+
+   /**
+    *
+    * @param key
+    */
+   void add(const std::string& key);
+
+   /**
+    *
+    * @param key
+    * @return false if the key has definitely not been added
+    */
+   bool mayContain(const std::string& key) const;
+
+   /**
+    *
+    * @return number of keys added since the last reset
+    */
+   size_t getKeyCount() const;
+
+   /**
+    *
+    * @return number of keys the filter was sized for
+    */
+   size_t getCapacity() const;
+
+
+private:
+   std::vector<uint64_t> m_bits;
+   uint64_t m_numBits;
+   size_t m_keyCount;
+   size_t m_capacity;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,208 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_BOUNDEDQUEUE_H
+#define LACHEPAS_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+namespace lachepas {
+
+/**
+ * Fixed-capacity FIFO queue for handing work between threads. Producers block
+ * while the queue is full and consumers block while it is empty, so the
+ * capacity caps how much work can be in flight between two stages.
+ */
+template <typename T>
+class BoundedQueue {
+
+public:
+   /**
+    *
+    * @param capacity maximum number of items held before push blocks
+    */
+   explicit BoundedQueue(std::size_t capacity);
+
+   /**
+    * Adds an item, waiting for room if the queue is full
+    * @param item the item to add
+    * @return false if the queue was closed (item not added)
+    */
+   bool push(T&& item);
+
+   /**
+    * Adds an item, waiting for room if the queue is full
+    * @param item the item to add
+    * @return false if the queue was closed (item not added)
+    */
+   bool push(const T& item);
+
+   /**
+    * Removes the oldest item, waiting for one to arrive if the queue is empty
+    * @param item receives the removed item
+    * @return false once the queue is closed and fully drained
+    */
+   bool pop(T& item);
+
+   /**
+    * Removes the oldest item if one is available without waiting
+    * @param item receives the removed item
+    * @return true if an item was removed
+    */
+   bool tryPop(T& item);
+
+   /**
+    * Closes the queue. Pending items may still be popped, but further
+    * pushes fail and waiting threads are released.
+    */
+   void close();
+
+   /**
+    *
+    * @return
+    */
+   bool isClosed() const;
+
+   /**
+    *
+    * @return
+    */
+   std::size_t size() const;
+
+   /**
+    *
+    * @return
+    */
+   std::size_t capacity() const;
+
+
+private:
+   mutable std::mutex m_mutex;
+   std::condition_variable m_notEmpty;
+   std::condition_variable m_notFull;
+   std::deque<T> m_items;
+   std::size_t m_capacity;
+   bool m_closed;
+
+   // not available
+   BoundedQueue(const BoundedQueue&);
+   BoundedQueue& operator=(const BoundedQueue&);
+};
+
+//******************************************************************************
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(std::size_t capacity) :
+   m_capacity(capacity > 0 ? capacity : 1),
+   m_closed(false) {
+}
+
+//******************************************************************************
+
+template <typename T>
+bool BoundedQueue<T>::push(T&& item) {
+   std::unique_lock<std::mutex> lock(m_mutex);
+   m_notFull.wait(lock, [this] {
+      return m_closed || (m_items.size() < m_capacity);
+   });
+
+   if (m_closed) {
+      return false;
+   }
+
+   m_items.push_back(std::move(item));
+   lock.unlock();
+   m_notEmpty.notify_one();
+   return true;
+}
+
+//******************************************************************************
+
+template <typename T>
+bool BoundedQueue<T>::push(const T& item) {
+   T copy(item);
+   return push(std::move(copy));
+}
+
+//******************************************************************************
+
+template <typename T>
+bool BoundedQueue<T>::pop(T& item) {
+   std::unique_lock<std::mutex> lock(m_mutex);
+   m_notEmpty.wait(lock, [this] {
+      return m_closed || !m_items.empty();
+   });
+
+   if (m_items.empty()) {
+      // closed and drained
+      return false;
+   }
+
+   item = std::move(m_items.front());
+   m_items.pop_front();
+   lock.unlock();
+   m_notFull.notify_one();
+   return true;
+}
+
+//******************************************************************************
+
+template <typename T>
+bool BoundedQueue<T>::tryPop(T& item) {
+   std::unique_lock<std::mutex> lock(m_mutex);
+   if (m_items.empty()) {
+      return false;
+   }
+
+   item = std::move(m_items.front());
+   m_items.pop_front();
+   lock.unlock();
+   m_notFull.notify_one();
+   return true;
+}
+
+//******************************************************************************
+
+template <typename T>
+void BoundedQueue<T>::close() {
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+   }
+
+   m_notEmpty.notify_all();
+   m_notFull.notify_all();
+}
+
+//******************************************************************************
+
+template <typename T>
+bool BoundedQueue<T>::isClosed() const {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   return m_closed;
+}
+
+//******************************************************************************
+
+template <typename T>
+std::size_t BoundedQueue<T>::size() const {
+   std::lock_guard<std::mutex> lock(m_mutex);
+   return m_items.size();
+}
+
+//******************************************************************************
+
+template <typename T>
+std::size_t BoundedQueue<T>::capacity() const {
+   return m_capacity;
+}
+
+//******************************************************************************
+
+}
+
+#endif
+
@@ -0,0 +1,205 @@
+// Copyright Paul Dardeau, 2016
+// CompressionPolicy.cpp
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "CompressionPolicy.h"
+
+// bytes of a block examined by the probe, taken as evenly spaced slices
+#define PROBE_SLICE_SIZE  128
+#define PROBE_SLICES        8
+#define PROBE_SAMPLE_SIZE (PROBE_SLICE_SIZE * PROBE_SLICES)
+
+// above this entropy (bits per byte) a block is taken to be compressed data.
+// a 1 KB sample of random bytes measures about 7.8 rather than 8.
+#define INCOMPRESSIBLE_ENTROPY 7.2
+
+// consecutive blocks that did not compress before the rest of the file
+// is stored as is
+#define BACKOFF_RUN 8
+
+// an extension is treated as incompressible after this many blocks when
+// fewer than 1 in INCOMPRESSIBLE_RATIO of them compressed
+#define MIN_HISTORY_BLOCKS   16
+#define INCOMPRESSIBLE_RATIO 10
+
+// histories are halved when they reach this many blocks
+#define MAX_HISTORY_BLOCKS 4096
+
+// longest extension remembered (longer ones are not file types)
+#define MAX_EXTENSION_LENGTH 16
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+double CompressionPolicy::sampleEntropy(const char* data, size_t length) {
+   if (length == 0) {
+      return 0.0;
+   }
+
+   // c * log2(c) for every count a sample can produce
+   static const vector<double> countLogs = [] {
+      vector<double> table(PROBE_SAMPLE_SIZE + 1, 0.0);
+      for (size_t count = 1; count <= PROBE_SAMPLE_SIZE; ++count) {
+         table[count] = count * ::log2((double) count);
+      }
+      return table;
+   }();
+
+   // four histograms, so runs of the same byte do not wait on one counter
+   uint16_t counts[4][256];
+   ::memset(counts, 0, sizeof(counts));
+
+   const uint8_t* bytes = (const uint8_t*) data;
+   size_t sampled;
+
+   if (length <= PROBE_SAMPLE_SIZE) {
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4) {
+         ++counts[0][bytes[i]];
+         ++counts[1][bytes[i + 1]];
+         ++counts[2][bytes[i + 2]];
+         ++counts[3][bytes[i + 3]];
+      }
+      for (; i < length; ++i) {
+         ++counts[0][bytes[i]];
+      }
+      sampled = length;
+   } else {
+      const size_t stride = (length - PROBE_SLICE_SIZE) / (PROBE_SLICES - 1);
+      for (size_t slice = 0; slice < PROBE_SLICES; ++slice) {
+         const uint8_t* sliceBytes = bytes + (slice * stride);
+         for (size_t i = 0; i < PROBE_SLICE_SIZE; i += 4) {
+            ++counts[0][sliceBytes[i]];
+            ++counts[1][sliceBytes[i + 1]];
+            ++counts[2][sliceBytes[i + 2]];
+            ++counts[3][sliceBytes[i + 3]];
+         }
+      }
+      sampled = PROBE_SAMPLE_SIZE;
+   }
+
+   // H = log2(n) - sum(c * log2(c)) / n
+   double sumCountLogs = 0.0;
+   for (int i = 0; i < 256; ++i) {
+      sumCountLogs += countLogs[counts[0][i] + counts[1][i] +
+                                counts[2][i] + counts[3][i]];
+   }
+
+   return ::log2((double) sampled) - (sumCountLogs / sampled);
+}
+
+//******************************************************************************
+
+bool CompressionPolicy::isWorthwhile(size_t originalSize,
+                                     size_t compressedSize) {
+   return compressedSize <= (originalSize - (originalSize / 16));
+}
+
+//******************************************************************************
+
+string CompressionPolicy::extensionForPath(const string& filePath) {
+   const string::size_type posSlash = filePath.find_last_of('/');
+   const string::size_type posName =
+      (posSlash == string::npos) ? 0 : posSlash + 1;
+   const string::size_type posDot = filePath.find_last_of('.');
+
+   // a leading dot marks a hidden file rather than an extension
+   if ((posDot == string::npos) ||
+       (posDot <= posName) ||
+       (filePath.length() - posDot - 1 > MAX_EXTENSION_LENGTH)) {
+      return string();
+   }
+
+   string extension = filePath.substr(posDot + 1);
+   for (auto& ch : extension) {
+      ch = ::tolower((unsigned char) ch);
+   }
+
+   return extension;
+}
+
+//******************************************************************************
+
+void CompressionPolicy::mergeHistory(CompressionHistory& history,
+                                     const CompressionHistory& fileHistory) {
+   history.blocksProbed += fileHistory.blocksProbed;
+   history.blocksCompressed += fileHistory.blocksCompressed;
+
+   while (history.blocksProbed > MAX_HISTORY_BLOCKS) {
+      history.blocksProbed /= 2;
+      history.blocksCompressed /= 2;
+   }
+}
+
+//******************************************************************************
+
+CompressionPolicy::CompressionPolicy(const CompressionHistory& history) :
+   m_blocksProbed(0),
+   m_blocksCompressed(0),
+   m_incompressibleRun(0),
+   m_backedOff(false) {
+   // one more block that does not compress is enough to back off
+   if ((history.blocksProbed >= MIN_HISTORY_BLOCKS) &&
+       (history.blocksCompressed * INCOMPRESSIBLE_RATIO < history.blocksProbed)) {
+      m_incompressibleRun = BACKOFF_RUN - 1;
+   }
+}
+
+//******************************************************************************
+
+CompressionPolicy::~CompressionPolicy() {
+}
+
+//******************************************************************************
+
+bool CompressionPolicy::shouldCompress(const string& block) {
+   if (m_backedOff) {
+      return false;
+   }
+
+   if (sampleEntropy(block.data(), block.size()) > INCOMPRESSIBLE_ENTROPY) {
+      recordOutcome(false);
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void CompressionPolicy::recordOutcome(bool compressed) {
+   ++m_blocksProbed;
+
+   if (compressed) {
+      ++m_blocksCompressed;
+      m_incompressibleRun = 0;
+   } else if (++m_incompressibleRun >= BACKOFF_RUN) {
+      m_backedOff = true;
+   }
+}
+
+//******************************************************************************
+
+bool CompressionPolicy::hasBackedOff() const {
+   return m_backedOff;
+}
+
+//******************************************************************************
+
+CompressionHistory CompressionPolicy::getFileHistory() const {
+   CompressionHistory fileHistory;
+   fileHistory.blocksProbed = m_blocksProbed;
+   fileHistory.blocksCompressed = m_blocksCompressed;
+   return fileHistory;
+}
+
+//******************************************************************************
+
@@ -0,0 +1,129 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_COMPRESSIONPOLICY_H
+#define LACHEPAS_COMPRESSIONPOLICY_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <string>
+
+
+namespace lachepas {
+
+/**
+ * How blocks of one kind of file (by file name extension) have compressed,
+ * kept across runs
+ */
+struct CompressionHistory {
+   int blocksProbed;
+   int blocksCompressed;
+
+   CompressionHistory() :
+      blocksProbed(0),
+      blocksCompressed(0) {
+   }
+};
+
+/**
+ * Decides block by block whether compressing the blocks of one file is worth
+ * the CPU. Each block is first checked with a cheap probe (the byte entropy
+ * of a sample of the block), so data that is already compressed (JPEG,
+ * video, archives) is stored as is without running the compressor on it.
+ * After a run of blocks that did not compress, the rest of the file is
+ * stored as is without probing. A file whose extension has rarely compressed
+ * in earlier runs backs off after its first such block.
+ *
+ * The transform workers of the send pipeline share one policy per file, so
+ * its methods may be called concurrently.
+ */
+class CompressionPolicy {
+
+public:
+   /**
+    * Estimates how compressible a block is from a sample of its bytes
+    * @param data
+    * @param length
+    * @return entropy in bits per byte (0 to 8; 8 is random data)
+    */
+   static double sampleEntropy(const char* data, size_t length);
+
+   /**
+    * Tells whether compression saved enough to be worth keeping (it must
+    * save at least 1/16 of the block)
+    * @param originalSize
+    * @param compressedSize
+    * @return
+    */
+   static bool isWorthwhile(size_t originalSize, size_t compressedSize);
+
+   /**
+    * Extracts the (lower case) extension from a file path
+    * @param filePath
+    * @return extension without the dot, or empty if there is none
+    */
+   static std::string extensionForPath(const std::string& filePath);
+
+   /**
+    * Adds the outcomes of one file to the history of its extension, aging
+    * older outcomes so the history follows changes in the files
+    * @param history the history of the extension
+    * @param fileHistory the outcomes of one file
+    */
+   static void mergeHistory(CompressionHistory& history,
+                            const CompressionHistory& fileHistory);
+
+   /**
+    *
+    * @param history earlier outcomes for the file's extension
+    */
+   explicit CompressionPolicy(const CompressionHistory& history);
+
+   /**
+    * Destructor
+    */
+   ~CompressionPolicy();
+
+   /**
+    * Probes a block. A block turned down by the probe counts as one that
+    * did not compress; otherwise the caller compresses it and reports the
+    * outcome with recordOutcome.
+    * @param block
+    * @return false to store the block as is
+    */
+   bool shouldCompress(const std::string& block);
+
+   /**
+    * Records whether a block that passed the probe compressed well enough
+    * to be stored compressed
+    * @param compressed
+    */
+   void recordOutcome(bool compressed);
+
+   /**
+    *
+    * @return whether the rest of the file is being stored as is
+    */
+   bool hasBackedOff() const;
+
+   /**
+    *
+    * @return outcomes for this file so far
+    */
+   CompressionHistory getFileHistory() const;
+
+
+private:
+   std::atomic<int> m_blocksProbed;
+   std::atomic<int> m_blocksCompressed;
+   std::atomic<int> m_incompressibleRun;
+   std::atomic<bool> m_backedOff;
+
+   // not available
+   CompressionPolicy(const CompressionPolicy&);
+   CompressionPolicy& operator=(const CompressionPolicy&);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,76 @@
+// Copyright Paul Dardeau, 2016
+// ContentHasher.cpp
+
+#include "ContentHasher.h"
+#include "SHA1Hasher.h"
+#include "Blake3Hasher.h"
+
+using namespace std;
+using namespace lachepas;
+
+const string ContentHasher::ALGORITHM_SHA1    = "sha1";
+const string ContentHasher::ALGORITHM_BLAKE3  = "blake3";
+const string ContentHasher::DEFAULT_ALGORITHM = ContentHasher::ALGORITHM_BLAKE3;
+
+//******************************************************************************
+
+bool ContentHasher::isValidAlgorithm(const string& algorithm) {
+   return (algorithm == ALGORITHM_SHA1) || (algorithm == ALGORITHM_BLAKE3);
+}
+
+//******************************************************************************
+
+ContentHasher* ContentHasher::create(const string& algorithm) {
+   if (algorithm == ALGORITHM_BLAKE3) {
+      return new Blake3Hasher();
+   } else if (algorithm == ALGORITHM_SHA1) {
+      return new SHA1Hasher();
+   }
+
+   return nullptr;
+}
+
+//******************************************************************************
+
+string ContentHasher::toHexString(const unsigned char* digest, size_t length) {
+   static const char HEX_DIGITS[] = "0123456789abcdef";
+
+   string hex;
+   hex.resize(2 * length);
+
+   for (size_t i = 0; i < length; ++i) {
+      hex[2 * i]       = HEX_DIGITS[digest[i] >> 4];
+      hex[(2 * i) + 1] = HEX_DIGITS[digest[i] & 0x0f];
+   }
+
+   return hex;
+}
+
+//******************************************************************************
+
+ContentHasher::~ContentHasher() {
+}
+
+//******************************************************************************
+
+string ContentHasher::hashBuffer(const void* data, size_t length) {
+   reset();
+   update(data, length);
+   return finalHex();
+}
+
+//******************************************************************************
+
+void ContentHasher::hashBuffers(const char* const* buffers,
+                                const size_t* lengths,
+                                size_t numBuffers,
+                                vector<string>& digests) {
+   digests.resize(numBuffers);
+
+   for (size_t i = 0; i < numBuffers; ++i) {
+      digests[i] = hashBuffer(buffers[i], lengths[i]);
+   }
+}
+
+//******************************************************************************
+
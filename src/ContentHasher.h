@@ -0,0 +1,102 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_CONTENTHASHER_H
+#define LACHEPAS_CONTENTHASHER_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Computes the unique identifiers of stored blocks. Each algorithm is a
+ * subclass created by name with create(); the algorithm used for a vault is
+ * recorded with the vault so its identifiers can always be re-verified.
+ * A hasher may be fed incrementally (reset, update..., finalHex) or hash a
+ * whole batch of buffers in one call with hashBuffers.
+ */
+class ContentHasher {
+
+public:
+   static const std::string ALGORITHM_SHA1;
+   static const std::string ALGORITHM_BLAKE3;
+   static const std::string DEFAULT_ALGORITHM;
+
+   /**
+    *
+    * @param algorithm
+    * @return boolean indicating whether the algorithm is supported
+    */
+   static bool isValidAlgorithm(const std::string& algorithm);
+
+   /**
+    * Creates a hasher for the specified algorithm
+    * @param algorithm
+    * @return new hasher (owned by the caller), or nullptr if unsupported
+    */
+   static ContentHasher* create(const std::string& algorithm);
+
+   /**
+    *
+    * @param digest
+    * @param length
+    * @return lowercase hex encoding of digest
+    */
+   static std::string toHexString(const unsigned char* digest, size_t length);
+
+   /**
+    * Destructor
+    */
+   virtual ~ContentHasher();
+
+   /**
+    *
+    * @return name of the algorithm
+    */
+   virtual const std::string& getAlgorithm() const = 0;
+
+   /**
+    * Discards any data passed to update and starts a new hash
+    */
+   virtual void reset() = 0;
+
+   /**
+    * Adds data to the hash being computed
+    * @param data
+    * @param length
+    */
+   virtual void update(const void* data, size_t length) = 0;
+
+   /**
+    * Completes the hash of all data passed to update since the last reset
+    * @return hex encoded digest
+    */
+   virtual std::string finalHex() = 0;
+
+   /**
+    * Hashes a single buffer
+    * @param data
+    * @param length
+    * @return hex encoded digest
+    */
+   std::string hashBuffer(const void* data, size_t length);
+
+   /**
+    * Hashes many independent buffers in one call
+    * @param buffers
+    * @param lengths
+    * @param numBuffers
+    * @param digests receives one hex encoded digest per buffer
+    */
+   virtual void hashBuffers(const char* const* buffers,
+                            const size_t* lengths,
+                            size_t numBuffers,
+                            std::vector<std::string>& digests);
+};
+
+}
+
+#endif
+
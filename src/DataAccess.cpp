@@ -3,12 +3,15 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+
 #include "AutoPointer.h"
 #include "DataAccess.h"
 #include "Logger.h"
 #include "DBBool.h"
 #include "DBDate.h"
 #include "DBInt.h"
+#include "DBLong.h"
 #include "DBNull.h"
 #include "DBStatementArgs.h"
 #include "DBString.h"
@@ -28,6 +31,44 @@ static const string SQL_QUERY_HAVE_TABLES =
    "WHERE type='table' "
    "AND name='local_directory'";
 
+static const string SQL_QUERY_HAVE_INDEX =
+   "SELECT name "
+   "FROM sqlite_master "
+   "WHERE type='index' "
+   "AND name=?";
+
+//******************************************************************************
+
+// With a write-ahead log a commit appends to the log instead of rewriting
+// the database through a rollback journal, and readers don't block the
+// writer. In WAL mode synchronous=NORMAL only syncs the log when it is
+// checkpointed into the database, so a crash can lose the last commits but
+// never leaves the database half written.
+//TODO: this is SQLite specific!!
+static const string SQL_PRAGMA_JOURNAL_MODE_WAL =
+   "PRAGMA journal_mode=WAL";
+
+static const string SQL_PRAGMA_SYNCHRONOUS_NORMAL =
+   "PRAGMA synchronous=NORMAL";
+
+// a FULL checkpoint syncs the log, copies all of it into the database and
+// syncs that, waiting for other connections if needed. its first column
+// is 1 if it was kept from finishing. without a write-ahead log there is
+// nothing to do (and commits are already synced).
+static const string SQL_PRAGMA_WAL_CHECKPOINT =
+   "PRAGMA wal_checkpoint(FULL)";
+
+// IMMEDIATE takes the write lock up front, so a transaction can't fail
+// part way through because another connection started writing first
+static const string SQL_BEGIN_TRANSACTION =
+   "BEGIN IMMEDIATE";
+
+static const string SQL_COMMIT_TRANSACTION =
+   "COMMIT";
+
+static const string SQL_ROLLBACK_TRANSACTION =
+   "ROLLBACK";
+
 //******************************************************************************
 
 // A “local directory” means a directory on your PC that will be replicated to
@@ -39,10 +80,21 @@ static const string SQL_QUERY_HAVE_TABLES =
 // dir_path - string value for the directory path
 // active - 0/1 (boolean) to indicate whether the directory should be used (or not). normally this is true (1)
 // recurse - 0/1 (boolean) to indicate whether subdirectories should be traversed (or not)
-// compress - 0/1 (boolean) to indicate whether to use compression (currently ignored)
+// compress - 0/1 (boolean) to indicate whether to compress the file blocks
 // encrypt - 0/1 (boolean) to indicate whether to encrypt the data (or not)
 // copy_count - integer value to specify how many copies (replicas) you want
-//              stored. normally, this is 1.
+//              stored. normally, this is 1. each block is placed on that many
+//              storage nodes (by capacity); 0 stores every block on every node
+// scan_threads - number of walker threads used when scanning the directory
+//                (1 means the directory is walked serially)
+// chunk_mode - how files are split into blocks: 'fixed' (fixed size blocks) or
+//              'cdc' (content-defined chunking)
+// chunk_min_size - smallest chunk (bytes) produced by content-defined chunking
+// chunk_avg_size - target chunk size (bytes); the block size in 'fixed' mode
+// chunk_max_size - largest chunk (bytes) produced by content-defined chunking
+// data_fragments - number of data fragments each block is erasure coded into, each stored on its own
+//                  node in place of copy_count copies. 0 (normally) stores whole blocks
+// parity_fragments - number of parity fragments added to the data fragments (how many nodes can be lost)
 static const string SQL_CREATE_LOCAL_DIRECTORY =
    "CREATE TABLE local_directory ("
       "local_directory_id INTEGER PRIMARY KEY, "
@@ -51,7 +103,14 @@ static const string SQL_CREATE_LOCAL_DIRECTORY =
       "recurse INTEGER NOT NULL, "
       "compress INTEGER NOT NULL, "
       "encrypt INTEGER NOT NULL, "
-      "copy_count INTEGER NOT NULL"
+      "copy_count INTEGER NOT NULL, "
+      "scan_threads INTEGER NOT NULL DEFAULT 1, "
+      "chunk_mode TEXT NOT NULL DEFAULT 'fixed', "
+      "chunk_min_size INTEGER NOT NULL DEFAULT 4096, "
+      "chunk_avg_size INTEGER NOT NULL DEFAULT 16384, "
+      "chunk_max_size INTEGER NOT NULL DEFAULT 65536, "
+      "data_fragments INTEGER NOT NULL DEFAULT 0, "
+      "parity_fragments INTEGER NOT NULL DEFAULT 0"
    ")";
 
 // Every file that is found under a “local directory” will result in a record in this table
@@ -82,28 +141,39 @@ static const string SQL_CREATE_LOCAL_FILE =
 // active - 0/1 (boolean) to indicate whether the storage node should be used (or not). normally this is true (1)
 // ping_time - unix timestamp to indicate the last time we communicated with the storage node (not currently populated)
 // copy_time - unix timestamp to indicate the last time we copied a file block to the storage node (not currently populated)
+// capacity - relative amount of storage on the node (e.g., in GB). nodes receive blocks in proportion to it
 static const string SQL_CREATE_STORAGE_NODE =
    "CREATE TABLE storage_node ("
       "storage_node_id INTEGER PRIMARY KEY, "
       "node_name TEXT NOT NULL, "
       "active INTEGER NOT NULL, "
       "ping_time REAL, "
-      "copy_time REAL"
+      "copy_time REAL, "
+      "capacity INTEGER NOT NULL DEFAULT 1"
    ")";
 
 // A “vault” is an association/grouping of a local_directory to a storage_node
 // vault-id - auto increment integer identifier for the row in the database (populated automatically by SQLite on insert)
 // storage_node_id - the row identifier for the storage node in the storage_node table (use for joins with storage_node table)
 // local_directory_id - the row identifier for the local directory in the local_directory table (use for joins with local_directory table)
-// compress - 0/1 (boolean) to indicate whether the vault files are compressed (currently not used)
+// compress - 0/1 (boolean) to indicate whether the vault files are compressed
 // encrypt - 0/1 (boolean) to indicate whether the vault files are encrypted
+// hash_algorithm - algorithm used for the unique identifiers of the vault's blocks ('sha1' or 'blake3')
+// payload_encoding - how the vault's blocks are sent and stored ('raw' bytes or 'base64' text)
+// cipher - cipher and mode of the vault's blocks when encrypted ('aes-256-gcm', 'aes-256-ctr' or legacy 'aes-256-ecb')
+// compression - codec of the vault's blocks when compressed ('lz4' or 'zstd'). empty for vaults
+//               created before blocks were compressed, whose blocks are stored as is
 static const string SQL_CREATE_VAULT =
    "CREATE TABLE vault ("
       "vault_id INTEGER PRIMARY KEY, "
       "storage_node_id INTEGER REFERENCES storage_node(storage_node_id), "
       "local_directory_id INTEGER REFERENCES local_directory(local_directory_id), "
       "compress INTEGER NOT NULL, "
-      "encrypt INTEGER NOT NULL"
+      "encrypt INTEGER NOT NULL, "
+      "hash_algorithm TEXT NOT NULL DEFAULT 'sha1', "
+      "payload_encoding TEXT NOT NULL DEFAULT 'base64', "
+      "cipher TEXT NOT NULL DEFAULT 'aes-256-ecb', "
+      "compression TEXT NOT NULL DEFAULT ''"
    ")";
 
 // A “vault file” is the occurrence of a local file stored on a storage node
@@ -117,6 +187,7 @@ static const string SQL_CREATE_VAULT =
 // user_permissions - unix permissions for user (rwx)
 // group_permissions - unix permissions for group (rwx)
 // other_permissions - unix permissions for others (rwx)
+// needs_resend - whether the next sync sends the file to the vault's node again (e.g., after block placement changed)
 static const string SQL_CREATE_VAULT_FILE =
    "CREATE TABLE vault_file ("
       "vault_file_id INTEGER PRIMARY KEY, "
@@ -128,7 +199,8 @@ static const string SQL_CREATE_VAULT_FILE =
       "block_count INTEGER NOT NULL, "
       "user_permissions TEXT NOT NULL, "
       "group_permissions TEXT NOT NULL, "
-      "other_permissions TEXT NOT NULL"
+      "other_permissions TEXT NOT NULL, "
+      "needs_resend INTEGER NOT NULL DEFAULT 0"
    ")";
 
 // A “file block” is a portion of a larger sized file, or the whole file if the file size <= block size
@@ -138,12 +210,25 @@ static const string SQL_CREATE_VAULT_FILE =
 // modify_time - unix timestamp of when the block was last updated
 // stored_time - unix timestamp for when the block was sent to the storage node
 // origin_filesize - block size used
-// stored_filesize - how many bytes did we send over to  the storage node (due to encryption and base-64 encoding it is often a little larger)
+// stored_filesize - how many bytes did we send over to  the storage node (smaller when compressed; encryption and
+//                   base-64 encoding make it a little larger)
 // block_sequence_number - integer to indicate the position of this block within the local file
 // padchar_count - the number of padding characters that were added as part of encryption (0 otherwise)
 // unique_identifier - the unique identifier of the file block (*** REALLY IMPORTANT ***)
 // node_directory - the name of the directory where the block is stored on the storage node
 // node_file - the name of the file where the block is stored on the storage node
+// block_offset - position (in bytes) of the block within the local file. with
+//                content-defined chunking blocks vary in size, so the offset
+//                (together with origin_filesize as the length) places the block
+// compression - codec the block was compressed with ('lz4' or 'zstd'), or empty if it is stored as is
+// placement_key - hash of the block's contents that decides which storage nodes hold it (empty for blocks
+//                 stored before blocks were placed, which were stored on every node)
+// fragment_index - which fragment of an erasure coded block is stored (data fragments first, then parity
+//                  fragments), or -1 when the whole block is stored
+// data_fragments - number of data fragments the block was split into (0 for a whole block)
+// parity_fragments - number of parity fragments computed for the block
+// payload_size - size of the compressed and encrypted block that was split into fragments (the fragments
+//                are padded to the same size)
 static const string SQL_CREATE_FILE_BLOCK =
    "CREATE TABLE vault_file_block ("
       "vault_file_block_id INTEGER PRIMARY KEY, "
@@ -157,15 +242,58 @@ static const string SQL_CREATE_FILE_BLOCK =
       "padchar_count INTEGER NOT NULL, "
       "unique_identifier TEXT NOT NULL, "
       "node_directory TEXT NOT NULL, "
-      "node_file TEXT NOT NULL"
+      "node_file TEXT NOT NULL, "
+      "block_offset INTEGER NOT NULL DEFAULT 0, "
+      "compression TEXT NOT NULL DEFAULT '', "
+      "placement_key TEXT NOT NULL DEFAULT '', "
+      "fragment_index INTEGER NOT NULL DEFAULT -1, "
+      "data_fragments INTEGER NOT NULL DEFAULT 0, "
+      "parity_fragments INTEGER NOT NULL DEFAULT 0, "
+      "payload_size INTEGER NOT NULL DEFAULT 0"
    ")";
 
+// How well the blocks of each kind of file have compressed, so files of a kind
+// that does not compress (such as .jpg or .zip) stop being compressed early
+// extension - lower case file name extension (without the dot), empty for none
+// blocks_probed - number of blocks checked for compressibility (aged over time)
+// blocks_compressed - number of those blocks that were stored compressed
+static const string SQL_CREATE_EXTENSION_COMPRESSION =
+   "CREATE TABLE IF NOT EXISTS extension_compression ("
+      "extension TEXT PRIMARY KEY, "
+      "blocks_probed INTEGER NOT NULL, "
+      "blocks_compressed INTEGER NOT NULL"
+   ")";
+
+//******************************************************************************
+
+// Indexes for the lookups that sync makes for every file on every node.
+// Without them each lookup scans its whole table, so a sync gets slower with
+// the square of the number of files.
+// local_file_directory_path - a file by its directory and path (SQL_SELECT_LOCAL_FILE),
+//                             and the files of a directory (SQL_SELECT_LOCAL_FILE_LIST)
+// vault_file_local_file_vault - the vault file of a local file in a vault (SQL_SELECT_VAULT_FILE)
+// vault_file_block_vault_file - the blocks of a vault file, already in sequence order
+//                               (SQL_SELECT_FILE_BLOCK needs no sort)
+static const string SQL_CREATE_INDEX_LOCAL_FILE_DIRECTORY_PATH =
+   "CREATE INDEX IF NOT EXISTS local_file_directory_path "
+   "ON local_file (local_directory_id, file_path)";
+
+static const string SQL_CREATE_INDEX_VAULT_FILE_LOCAL_FILE_VAULT =
+   "CREATE INDEX IF NOT EXISTS vault_file_local_file_vault "
+   "ON vault_file (local_file_id, vault_id)";
+
+static const string SQL_CREATE_INDEX_FILE_BLOCK_VAULT_FILE =
+   "CREATE INDEX IF NOT EXISTS vault_file_block_vault_file "
+   "ON vault_file_block (vault_file_id, block_sequence_number)";
+
 //******************************************************************************
 
 static const string SQL_INSERT_LOCAL_DIRECTORY =
    "INSERT INTO local_directory "
-   "(dir_path,active,recurse,compress,encrypt,copy_count) "
-   "VALUES (?,?,?,?,?,?)";
+   "(dir_path,active,recurse,compress,encrypt,copy_count,scan_threads,"
+      "chunk_mode,chunk_min_size,chunk_avg_size,chunk_max_size,data_fragments,"
+      "parity_fragments) "
+   "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?)";
 
 static const string SQL_INSERT_LOCAL_FILE =
    "INSERT INTO local_file "
@@ -174,37 +302,76 @@ static const string SQL_INSERT_LOCAL_FILE =
 
 static const string SQL_INSERT_STORAGE_NODE =
    "INSERT INTO storage_node "
-   "(node_name,active) "
-   "VALUES (?,?);";
+   "(node_name,active,capacity) "
+   "VALUES (?,?,?);";
 
 static const string SQL_INSERT_VAULT =
    "INSERT INTO vault "
-   "(storage_node_id,local_directory_id,compress,encrypt) "
-   "VALUES (?,?,?,?)";
+   "(storage_node_id,local_directory_id,compress,encrypt,hash_algorithm,"
+      "payload_encoding,cipher,compression) "
+   "VALUES (?,?,?,?,?,?,?,?)";
 
 static const string SQL_INSERT_VAULT_FILE =
    "INSERT INTO vault_file "
    "(local_file_id,vault_id,create_time,modify_time,origin_filesize,block_count,"
-      "user_permissions, group_permissions, other_permissions) "
-   "VALUES (?,?,?,?,?,?,?,?,?)";
+      "user_permissions, group_permissions, other_permissions, needs_resend) "
+   "VALUES (?,?,?,?,?,?,?,?,?,?)";
 
 static const string SQL_INSERT_FILE_BLOCK =
+   "INSERT INTO vault_file_block "
+   "(vault_file_id,create_time,modify_time,stored_time,origin_filesize,stored_filesize,"
+      "block_sequence_number,padchar_count,unique_identifier,node_directory,node_file,"
+      "block_offset,compression,placement_key,fragment_index,data_fragments,"
+      "parity_fragments,payload_size) "
+   "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
+
+// Rows for benchmarking the catalog: files 'benchmark/<n>' for n in a range,
+// each with a vault file holding one block
+static const string SQL_INSERT_BENCHMARK_LOCAL_FILES =
+   "WITH RECURSIVE seq(n) AS "
+      "(SELECT ? UNION ALL SELECT n + 1 FROM seq WHERE n < ?) "
+   "INSERT INTO local_file "
+   "(local_directory_id,file_path,create_time,modify_time,scan_time) "
+   "SELECT ?, 'benchmark/' || n, ?, ?, ? "
+   "FROM seq";
+
+static const string SQL_INSERT_BENCHMARK_VAULT_FILES =
+   "INSERT INTO vault_file "
+   "(local_file_id,vault_id,create_time,modify_time,origin_filesize,block_count,"
+      "user_permissions, group_permissions, other_permissions) "
+   "SELECT local_file_id, ?, create_time, modify_time, 16384, 1, 'rw-', 'r--', 'r--' "
+   "FROM local_file "
+   "WHERE local_file_id > (SELECT COALESCE(MAX(local_file_id), 0) FROM vault_file)";
+
+static const string SQL_INSERT_BENCHMARK_FILE_BLOCKS =
    "INSERT INTO vault_file_block "
    "(vault_file_id,create_time,modify_time,stored_time,origin_filesize,stored_filesize,"
       "block_sequence_number,padchar_count,unique_identifier,node_directory,node_file) "
-   "VALUES (?,?,?,?,?,?,?,?,?,?,?)";
+   "SELECT vault_file_id, create_time, modify_time, modify_time, 16384, 16384, "
+      "1, 0, 'benchmark' || vault_file_id, 'benchmark', 'benchmark' || vault_file_id "
+   "FROM vault_file "
+   "WHERE vault_file_id > (SELECT COALESCE(MAX(vault_file_id), 0) FROM vault_file_block)";
+
+static const string SQL_SAVE_EXTENSION_COMPRESSION =
+   "INSERT OR REPLACE INTO extension_compression "
+   "(extension,blocks_probed,blocks_compressed) "
+   "VALUES (?,?,?)";
 
 //******************************************************************************
 
 static const string SQL_SELECT_ACTIVE_LOCAL_DIRECTORY =
    "SELECT "
-      "local_directory_id, dir_path, active, recurse, compress, encrypt, copy_count "
+      "local_directory_id, dir_path, active, recurse, compress, encrypt, copy_count, "
+      "scan_threads, chunk_mode, chunk_min_size, chunk_avg_size, chunk_max_size, "
+      "data_fragments, parity_fragments "
    "FROM local_directory "
    "WHERE active = 1";
 
 static const string SQL_SELECT_INACTIVE_LOCAL_DIRECTORY =
    "SELECT "
-      "local_directory_id, dir_path, active, recurse, compress, encrypt, copy_count "
+      "local_directory_id, dir_path, active, recurse, compress, encrypt, copy_count, "
+      "scan_threads, chunk_mode, chunk_min_size, chunk_avg_size, chunk_max_size, "
+      "data_fragments, parity_fragments "
    "FROM local_directory "
    "WHERE active = 0";
 
@@ -223,19 +390,20 @@ static const string SQL_SELECT_LOCAL_FILE_LIST =
 
 static const string SQL_SELECT_ACTIVE_STORAGE_NODE =
    "SELECT "
-      "storage_node_id, node_name, ping_time, copy_time "
+      "storage_node_id, node_name, ping_time, copy_time, capacity "
    "FROM storage_node "
    "WHERE active = 1";
 
 static const string SQL_SELECT_INACTIVE_STORAGE_NODE =
    "SELECT "
-      "storage_node_id, node_name, ping_time, copy_time "
+      "storage_node_id, node_name, ping_time, copy_time, capacity "
    "FROM storage_node "
    "WHERE active = 0";
 
 static const string SQL_SELECT_NODE_VAULT =
    "SELECT "
-      "vault_id, compress, encrypt "
+      "vault_id, compress, encrypt, hash_algorithm, payload_encoding, cipher, "
+      "compression "
    "FROM vault "
    "WHERE storage_node_id = ? "
    "AND local_directory_id = ?";
@@ -244,7 +412,8 @@ static const string SQL_SELECT_VAULT_FILE =
    "SELECT "
       "vault_file_id, create_time, "
       "modify_time, origin_filesize, block_count, "
-      "user_permissions, group_permissions, other_permissions "
+      "user_permissions, group_permissions, other_permissions, "
+      "needs_resend "
    "FROM vault_file "
    "WHERE local_file_id = ? "
    "AND vault_id = ?";
@@ -253,11 +422,74 @@ static const string SQL_SELECT_FILE_BLOCK =
    "SELECT "
       "vault_file_block_id, create_time, modify_time, stored_time, "
       "origin_filesize, stored_filesize, block_sequence_number, "
-      "padchar_count, unique_identifier, node_directory, node_file "
+      "padchar_count, unique_identifier, node_directory, node_file, "
+      "block_offset, compression, placement_key, fragment_index, "
+      "data_fragments, parity_fragments, payload_size "
    "FROM vault_file_block "
    "WHERE vault_file_id = ? "
    "ORDER BY block_sequence_number";
 
+// every file of a local directory with its vault files (in any vault) and
+// their blocks, in one pass over the indexes instead of a lookup per file.
+// the columns are those of SQL_SELECT_LOCAL_FILE_LIST, then vault_id and
+// those of SQL_SELECT_VAULT_FILE, then those of SQL_SELECT_FILE_BLOCK. the
+// outer joins keep files with no vault file and vault files with no blocks
+// (NULL ids). ordering by path alone walks local_file_directory_path, so
+// the rows of each file arrive together without sorting the result.
+static const string SQL_SELECT_RESTORE_PLAN_COLUMNS =
+   "SELECT "
+      "lf.local_file_id, lf.file_path, lf.create_time, lf.modify_time, "
+      "lf.scan_time, "
+      "vf.vault_id, "
+      "vf.vault_file_id, vf.create_time, "
+      "vf.modify_time, vf.origin_filesize, vf.block_count, "
+      "vf.user_permissions, vf.group_permissions, vf.other_permissions, "
+      "vf.needs_resend, "
+      "vfb.vault_file_block_id, vfb.create_time, vfb.modify_time, "
+      "vfb.stored_time, vfb.origin_filesize, vfb.stored_filesize, "
+      "vfb.block_sequence_number, vfb.padchar_count, "
+      "vfb.unique_identifier, vfb.node_directory, vfb.node_file, "
+      "vfb.block_offset, vfb.compression, vfb.placement_key, "
+      "vfb.fragment_index, vfb.data_fragments, vfb.parity_fragments, "
+      "vfb.payload_size "
+   "FROM local_file lf "
+   "LEFT JOIN vault_file vf "
+      "ON vf.local_file_id = lf.local_file_id "
+   "LEFT JOIN vault_file_block vfb "
+      "ON vfb.vault_file_id = vf.vault_file_id "
+   "WHERE lf.local_directory_id = ? ";
+
+static const string SQL_SELECT_RESTORE_PLAN =
+   SQL_SELECT_RESTORE_PLAN_COLUMNS +
+   "ORDER BY lf.file_path";
+
+// the restore plan of one file, found with local_file_directory_path
+static const string SQL_SELECT_RESTORE_PLAN_FILE =
+   SQL_SELECT_RESTORE_PLAN_COLUMNS +
+   "AND lf.file_path = ? "
+   "ORDER BY lf.file_path";
+
+// the restore plan of the files under a path. the prefix is given as a
+// range (from the path with a '/' appended up to the path with a '0', the
+// character after '/', appended) so that it is a range scan of
+// local_file_directory_path, which LIKE would not be.
+static const string SQL_SELECT_RESTORE_PLAN_PATH_RANGE =
+   SQL_SELECT_RESTORE_PLAN_COLUMNS +
+   "AND lf.file_path >= ? "
+   "AND lf.file_path < ? "
+   "ORDER BY lf.file_path";
+
+// first column of each table's part of a SQL_SELECT_RESTORE_PLAN row
+#define RESTORE_PLAN_LOCAL_FILE_COLUMN 0
+#define RESTORE_PLAN_VAULT_ID_COLUMN 5
+#define RESTORE_PLAN_VAULT_FILE_COLUMN 6
+#define RESTORE_PLAN_FILE_BLOCK_COLUMN 15
+
+static const string SQL_SELECT_EXTENSION_COMPRESSION =
+   "SELECT "
+      "extension, blocks_probed, blocks_compressed "
+   "FROM extension_compression";
+
 //******************************************************************************
 
 static const string SQL_DELETE_LOCAL_DIRECTORY =
@@ -293,13 +525,20 @@ static const string SQL_DELETE_FILE_BLOCK =
 //******************************************************************************
 
 static const string SQL_UPDATE_LOCAL_DIRECTORY =
-   "UDPATE local_directory "
+   "UPDATE local_directory "
    "SET dir_path = ?, "
       "active = ?, "
       "recurse = ?, "
       "compress = ?, "
       "encrypt = ?, "
-      "copy_count = ? "
+      "copy_count = ?, "
+      "scan_threads = ?, "
+      "chunk_mode = ?, "
+      "chunk_min_size = ?, "
+      "chunk_avg_size = ?, "
+      "chunk_max_size = ?, "
+      "data_fragments = ?, "
+      "parity_fragments = ? "
    "WHERE local_directory_id = ?";
 
 static const string SQL_UPDATE_LOCAL_FILE =
@@ -316,7 +555,8 @@ static const string SQL_UPDATE_ACTIVE_STORAGE_NODE =
    "SET node_name = ?, "
       "active = ?, "
       "ping_time = ?, "
-      "copy_time = ? "
+      "copy_time = ?, "
+      "capacity = ? "
    "WHERE storage_node_id = ?";
 
 static const string SQL_UPDATE_NODE_VAULT =
@@ -324,7 +564,11 @@ static const string SQL_UPDATE_NODE_VAULT =
    "SET storage_node_id = ?, "
       "local_directory_id = ?, "
       "compress = ?, "
-      "encrypt = ? "
+      "encrypt = ?, "
+      "hash_algorithm = ?, "
+      "payload_encoding = ?, "
+      "cipher = ?, "
+      "compression = ? "
    "WHERE vault_id = ?";
 
 static const string SQL_UPDATE_VAULT_FILE =
@@ -337,7 +581,8 @@ static const string SQL_UPDATE_VAULT_FILE =
       "block_count = ?, "
       "user_permissions = ?, "
       "group_permissions = ?, "
-      "other_permissions = ? "
+      "other_permissions = ?, "
+      "needs_resend = ? "
    "WHERE vault_file_id = ?";
 
 static const string SQL_UPDATE_FILE_BLOCK =
@@ -352,27 +597,308 @@ static const string SQL_UPDATE_FILE_BLOCK =
       "padchar_count = ?, "
       "unique_identifier = ?, "
       "node_directory = ?, "
-      "node_file = ? "
+      "node_file = ?, "
+      "block_offset = ?, "
+      "compression = ?, "
+      "placement_key = ?, "
+      "fragment_index = ?, "
+      "data_fragments = ?, "
+      "parity_fragments = ?, "
+      "payload_size = ? "
    "WHERE vault_file_block_id = ?";
 
 //******************************************************************************
 
+// Columns added after the initial schema. Databases created by an older
+// version are upgraded in place when they are opened.
+static const string SQL_ALTER_LOCAL_DIRECTORY_SCAN_THREADS =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN scan_threads INTEGER NOT NULL DEFAULT 1";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MODE =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN chunk_mode TEXT NOT NULL DEFAULT 'fixed'";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MIN_SIZE =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN chunk_min_size INTEGER NOT NULL DEFAULT 4096";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_CHUNK_AVG_SIZE =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN chunk_avg_size INTEGER NOT NULL DEFAULT 16384";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MAX_SIZE =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN chunk_max_size INTEGER NOT NULL DEFAULT 65536";
+
+// vaults created before hash_algorithm existed used SHA-1
+static const string SQL_ALTER_VAULT_HASH_ALGORITHM =
+   "ALTER TABLE vault "
+   "ADD COLUMN hash_algorithm TEXT NOT NULL DEFAULT 'sha1'";
+
+// vaults created before payload_encoding existed sent base64 text
+static const string SQL_ALTER_VAULT_PAYLOAD_ENCODING =
+   "ALTER TABLE vault "
+   "ADD COLUMN payload_encoding TEXT NOT NULL DEFAULT 'base64'";
+
+// vaults created before cipher existed encrypted 16 bytes at a time (ECB)
+static const string SQL_ALTER_VAULT_CIPHER =
+   "ALTER TABLE vault "
+   "ADD COLUMN cipher TEXT NOT NULL DEFAULT 'aes-256-ecb'";
+
+// vaults created before compression existed stored their blocks uncompressed
+// (even with compress set)
+static const string SQL_ALTER_VAULT_COMPRESSION =
+   "ALTER TABLE vault "
+   "ADD COLUMN compression TEXT NOT NULL DEFAULT ''";
+
+static const string SQL_ALTER_FILE_BLOCK_OFFSET =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN block_offset INTEGER NOT NULL DEFAULT 0";
+
+// blocks stored before block_offset existed were all fixed 16 KB blocks
+static const string SQL_UPDATE_FILE_BLOCK_OFFSETS =
+   "UPDATE vault_file_block "
+   "SET block_offset = (block_sequence_number - 1) * 16384";
+
+static const string SQL_ALTER_FILE_BLOCK_COMPRESSION =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN compression TEXT NOT NULL DEFAULT ''";
+
+// blocks stored before each block recorded its codec were compressed with
+// their vault's codec if the vault was compressed
+static const string SQL_UPDATE_FILE_BLOCK_COMPRESSION =
+   "UPDATE vault_file_block "
+   "SET compression = COALESCE(("
+      "SELECT vault.compression "
+      "FROM vault_file, vault "
+      "WHERE vault_file.vault_file_id = vault_file_block.vault_file_id "
+      "AND vault.vault_id = vault_file.vault_id "
+      "AND vault.compress = 1), '')";
+
+static const string SQL_ALTER_STORAGE_NODE_CAPACITY =
+   "ALTER TABLE storage_node "
+   "ADD COLUMN capacity INTEGER NOT NULL DEFAULT 1";
+
+static const string SQL_ALTER_FILE_BLOCK_PLACEMENT_KEY =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN placement_key TEXT NOT NULL DEFAULT ''";
+
+// directories created before blocks were placed kept a copy on every node
+// whatever their copy_count, and keep doing so
+static const string SQL_UPDATE_COPY_COUNT_ALL_NODES =
+   "UPDATE local_directory "
+   "SET copy_count = 0";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_DATA_FRAGMENTS =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN data_fragments INTEGER NOT NULL DEFAULT 0";
+
+static const string SQL_ALTER_LOCAL_DIRECTORY_PARITY_FRAGMENTS =
+   "ALTER TABLE local_directory "
+   "ADD COLUMN parity_fragments INTEGER NOT NULL DEFAULT 0";
+
+static const string SQL_ALTER_FILE_BLOCK_FRAGMENT_INDEX =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN fragment_index INTEGER NOT NULL DEFAULT -1";
+
+static const string SQL_ALTER_FILE_BLOCK_DATA_FRAGMENTS =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN data_fragments INTEGER NOT NULL DEFAULT 0";
+
+static const string SQL_ALTER_FILE_BLOCK_PARITY_FRAGMENTS =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN parity_fragments INTEGER NOT NULL DEFAULT 0";
+
+static const string SQL_ALTER_FILE_BLOCK_PAYLOAD_SIZE =
+   "ALTER TABLE vault_file_block "
+   "ADD COLUMN payload_size INTEGER NOT NULL DEFAULT 0";
+
+static const string SQL_ALTER_VAULT_FILE_NEEDS_RESEND =
+   "ALTER TABLE vault_file "
+   "ADD COLUMN needs_resend INTEGER NOT NULL DEFAULT 0";
+
+//******************************************************************************
+
 using namespace lachepas;
 //using namespace chapeau;
 using namespace chaudiere;
 
 //******************************************************************************
 
+// reads the columns of SQL_SELECT_LOCAL_FILE_LIST (local_file_id through
+// scan_time), the first of them at the given column
+static bool ReadLocalFile(DBResultSet* rs, int column, LocalFile& localFile) {
+   const int localFileId = rs->intForColumnIndex(column);
+   AutoPointer<string*> filePath(rs->stringForColumnIndex(column + 1));
+
+   if ((localFileId < 1) || !filePath.haveObject()) {
+      return false;
+   }
+
+   AutoPointer<string*> createTime(rs->stringForColumnIndex(column + 2));
+   AutoPointer<string*> modifyTime(rs->stringForColumnIndex(column + 3));
+   AutoPointer<string*> scanTime(rs->stringForColumnIndex(column + 4));
+
+   localFile.setLocalFileId(localFileId);
+   localFile.setFilePath(*(filePath()));
+
+   if (createTime.haveObject()) {
+      localFile.setCreateTime(chaudiere::DateTime(*(createTime())));
+   }
+
+   if (modifyTime.haveObject()) {
+      localFile.setModifyTime(chaudiere::DateTime(*(modifyTime())));
+   }
+
+   if (scanTime.haveObject()) {
+      localFile.setScanTime(chaudiere::DateTime(*(scanTime())));
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+// reads the columns of SQL_SELECT_VAULT_FILE (vault_file_id through
+// needs_resend), the first of them at the given column
+static bool ReadVaultFile(DBResultSet* rs, int column, VaultFile& vaultFile) {
+   const int vaultFileId = rs->intForColumnIndex(column);
+
+   if (vaultFileId < 1) {
+      return false;
+   }
+
+   AutoPointer<DBDate*> createTime(rs->dateForColumnIndex(column + 1));
+   AutoPointer<DBDate*> modifyTime(rs->dateForColumnIndex(column + 2));
+   const int64_t originFileSize = rs->longForColumnIndex(column + 3);
+   const int blockCount = rs->intForColumnIndex(column + 4);
+   AutoPointer<string*> userPermissions(rs->stringForColumnIndex(column + 5));
+   AutoPointer<string*> groupPermissions(rs->stringForColumnIndex(column + 6));
+   AutoPointer<string*> otherPermissions(rs->stringForColumnIndex(column + 7));
+   const bool needsResend = rs->boolForColumnIndex(column + 8);
+
+   vaultFile.setVaultFileId(vaultFileId);
+   vaultFile.setOriginFileSize(originFileSize);
+   vaultFile.setBlockCount(blockCount);
+   vaultFile.setNeedsResend(needsResend);
+
+   if (userPermissions.haveObject()) {
+      vaultFile.setUserPermissions(*(userPermissions()));
+   }
+
+   if (groupPermissions.haveObject()) {
+      vaultFile.setGroupPermissions(*(groupPermissions()));
+   }
+
+   if (otherPermissions.haveObject()) {
+      vaultFile.setOtherPermissions(*(otherPermissions()));
+   }
+
+   if (createTime.haveObject()) {
+      vaultFile.setCreateTime(createTime->getDateTime());
+   }
+
+   if (modifyTime.haveObject()) {
+      vaultFile.setModifyTime(modifyTime->getDateTime());
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+// reads the columns of SQL_SELECT_FILE_BLOCK (vault_file_block_id through
+// payload_size), the first of them at the given column
+static bool ReadVaultFileBlock(DBResultSet* rs,
+                               int column,
+                               VaultFileBlock& vaultFileBlock) {
+   const int vaultFileBlockId = rs->intForColumnIndex(column);
+
+   if (vaultFileBlockId < 1) {
+      return false;
+   }
+
+   AutoPointer<string*> createTime(rs->stringForColumnIndex(column + 1));
+   AutoPointer<string*> modifyTime(rs->stringForColumnIndex(column + 2));
+   AutoPointer<string*> storedTime(rs->stringForColumnIndex(column + 3));
+   const int originFileSize = rs->intForColumnIndex(column + 4);
+   const int storedFileSize = rs->intForColumnIndex(column + 5);
+   const int blockSequenceNumber = rs->intForColumnIndex(column + 6);
+   const int padCharCount = rs->intForColumnIndex(column + 7);
+   AutoPointer<string*> uniqueIdentifier(rs->stringForColumnIndex(column + 8));
+   AutoPointer<string*> nodeDirectory(rs->stringForColumnIndex(column + 9));
+   AutoPointer<string*> nodeFile(rs->stringForColumnIndex(column + 10));
+   const int64_t blockOffset = rs->longForColumnIndex(column + 11);
+   AutoPointer<string*> compression(rs->stringForColumnIndex(column + 12));
+   AutoPointer<string*> placementKey(rs->stringForColumnIndex(column + 13));
+   const int fragmentIndex = rs->intForColumnIndex(column + 14);
+   const int dataFragments = rs->intForColumnIndex(column + 15);
+   const int parityFragments = rs->intForColumnIndex(column + 16);
+   const int payloadSize = rs->intForColumnIndex(column + 17);
+
+   vaultFileBlock.setVaultFileBlockId(vaultFileBlockId);
+   vaultFileBlock.setOriginFileSize(originFileSize);
+   vaultFileBlock.setStoredFileSize(storedFileSize);
+   vaultFileBlock.setBlockSequenceNumber(blockSequenceNumber);
+   vaultFileBlock.setBlockOffset(blockOffset);
+   vaultFileBlock.setPadCharCount(padCharCount);
+   vaultFileBlock.setFragmentIndex(fragmentIndex);
+   vaultFileBlock.setErasureCoding(dataFragments, parityFragments);
+   vaultFileBlock.setPayloadSize(payloadSize);
+
+   if (uniqueIdentifier.haveObject()) {
+      vaultFileBlock.setUniqueIdentifier(*(uniqueIdentifier()));
+   }
+
+   if (nodeDirectory.haveObject()) {
+      vaultFileBlock.setNodeDirectory(*(nodeDirectory()));
+   }
+
+   if (nodeFile.haveObject()) {
+      vaultFileBlock.setNodeFile(*(nodeFile()));
+   }
+
+   if (compression.haveObject()) {
+      vaultFileBlock.setCompression(*(compression()));
+   }
+
+   if (placementKey.haveObject()) {
+      vaultFileBlock.setPlacementKey(*(placementKey()));
+   }
+
+   if (createTime.haveObject()) {
+      vaultFileBlock.setCreateTime(chaudiere::DateTime(*(createTime())));
+   }
+
+   if (modifyTime.haveObject()) {
+      vaultFileBlock.setModifyTime(chaudiere::DateTime(*(modifyTime())));
+   }
+
+   if (storedTime.haveObject()) {
+      vaultFileBlock.setStoredTime(chaudiere::DateTime(*(storedTime())));
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
 DataAccess::DataAccess(const string& filePath) :
                        m_dbConnection(nullptr),
                        m_dbFilePath(filePath),
-                       m_debugPrint(true) {
+                       m_debugPrint(true),
+                       m_inTransaction(false) {
 }
 
 //******************************************************************************
 
 DataAccess::~DataAccess() {
    if (m_dbConnection != nullptr) {
+      // anything not committed by now is treated as if it never happened
+      if (m_inTransaction) {
+         rollback();
+      }
       m_dbConnection->close();
    }
 }
@@ -386,6 +912,10 @@ bool DataAccess::open() {
    if (m_dbConnection->open()) {
       //Logger::info("successfully opened database");
 
+      if (!enableWriteAheadLog()) {
+         Logger::warning("unable to enable write-ahead log, using rollback journal");
+      }
+
       if (!haveTables()) {
          if (createTables()) {
             Logger::info("db tables created");
@@ -395,7 +925,11 @@ bool DataAccess::open() {
          }
       } else {
          //Logger::info("already have db tables");
-         dbInitialized = true;
+         if (upgradeTables()) {
+            dbInitialized = true;
+         } else {
+            Logger::error("unable to upgrade db tables");
+         }
       }
    } else {
       Logger::error("unable to open database");
@@ -450,7 +984,15 @@ bool DataAccess::createTables() {
          ++numTables;
       }
 
-      if (numTables == 6) {
+      if (createTable(SQL_CREATE_EXTENSION_COMPRESSION)) {
+         ++numTables;
+      }
+
+      if (!createIndexes()) {
+         return false;
+      }
+
+      if (numTables == 7) {
          return true;
       } else {
          return false;
@@ -480,8 +1022,342 @@ bool DataAccess::haveTables() {
 
 //******************************************************************************
 
+bool DataAccess::createIndexes() {
+   int numFailures = 0;
+
+   if (!createIndexIfMissing("local_file_directory_path",
+                             SQL_CREATE_INDEX_LOCAL_FILE_DIRECTORY_PATH)) {
+      ++numFailures;
+   }
+
+   if (!createIndexIfMissing("vault_file_local_file_vault",
+                             SQL_CREATE_INDEX_VAULT_FILE_LOCAL_FILE_VAULT)) {
+      ++numFailures;
+   }
+
+   if (!createIndexIfMissing("vault_file_block_vault_file",
+                             SQL_CREATE_INDEX_FILE_BLOCK_VAULT_FILE)) {
+      ++numFailures;
+   }
+
+   return (numFailures == 0);
+}
+
+//******************************************************************************
+
+bool DataAccess::haveColumn(const string& tableName,
+                            const string& columnName) {
+   bool haveColumnInTable = false;
+   if (m_dbConnection != nullptr) {
+      //TODO: this is SQLite specific!!
+      const string sql = string("PRAGMA table_info(") + tableName + string(")");
+      AutoPointer<DBResultSet*> rs(m_dbConnection->executeQuery(sql));
+      if (rs.haveObject()) {
+         while (rs->next()) {
+            AutoPointer<string*> name(rs->stringForColumnIndex(1));
+            if (name.haveObject() && (*(name()) == columnName)) {
+               haveColumnInTable = true;
+               break;
+            }
+         }
+      }
+   }
+
+   return haveColumnInTable;
+}
+
+//******************************************************************************
+
+bool DataAccess::addColumnIfMissing(const string& tableName,
+                                    const string& columnName,
+                                    const string& sql) {
+   if (haveColumn(tableName, columnName)) {
+      return true;
+   }
+
+   Logger::info(string("upgrading table ") +
+                tableName +
+                string(": adding column ") +
+                columnName);
+
+   unsigned long rowsAffected = 0;
+   return m_dbConnection->executeUpdate(sql, rowsAffected);
+}
+
+//******************************************************************************
+
+bool DataAccess::haveIndex(const string& indexName) {
+   bool haveIndexInDB = false;
+   if (m_dbConnection != nullptr) {
+      DBStatementArgs args;
+      args.add(new DBString(indexName));
+
+      AutoPointer<DBResultSet*> rs(
+         m_dbConnection->executeQuery(SQL_QUERY_HAVE_INDEX, args));
+      if (rs.haveObject()) {
+         if (rs->next()) {
+            haveIndexInDB = true;
+         }
+      }
+   }
+
+   return haveIndexInDB;
+}
+
+//******************************************************************************
+
+bool DataAccess::createIndexIfMissing(const string& indexName,
+                                      const string& sql) {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (haveIndex(indexName)) {
+      return true;
+   }
+
+   // building an index over a large catalog takes a while, but only once
+   Logger::info(string("creating index ") + indexName);
+
+   unsigned long rowsAffected = 0;
+   return m_dbConnection->executeUpdate(sql, rowsAffected);
+}
+
+//******************************************************************************
+
+bool DataAccess::upgradeTables() {
+   if (m_dbConnection == nullptr) {
+      Logger::error("unable to upgrade tables: no database connection");
+      return false;
+   }
+
+   int numFailures = 0;
+
+   if (!addColumnIfMissing("local_directory",
+                           "scan_threads",
+                           SQL_ALTER_LOCAL_DIRECTORY_SCAN_THREADS)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "chunk_mode",
+                           SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MODE)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "chunk_min_size",
+                           SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MIN_SIZE)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "chunk_avg_size",
+                           SQL_ALTER_LOCAL_DIRECTORY_CHUNK_AVG_SIZE)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "chunk_max_size",
+                           SQL_ALTER_LOCAL_DIRECTORY_CHUNK_MAX_SIZE)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault",
+                           "hash_algorithm",
+                           SQL_ALTER_VAULT_HASH_ALGORITHM)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault",
+                           "payload_encoding",
+                           SQL_ALTER_VAULT_PAYLOAD_ENCODING)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault",
+                           "cipher",
+                           SQL_ALTER_VAULT_CIPHER)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault",
+                           "compression",
+                           SQL_ALTER_VAULT_COMPRESSION)) {
+      ++numFailures;
+   }
+
+   if (!haveColumn("vault_file_block", "block_offset")) {
+      unsigned long rowsAffected = 0;
+
+      if (!addColumnIfMissing("vault_file_block",
+                              "block_offset",
+                              SQL_ALTER_FILE_BLOCK_OFFSET) ||
+          !m_dbConnection->executeUpdate(SQL_UPDATE_FILE_BLOCK_OFFSETS,
+                                         rowsAffected)) {
+         ++numFailures;
+      }
+   }
+
+   if (!haveColumn("vault_file_block", "compression")) {
+      unsigned long rowsAffected = 0;
+
+      if (!addColumnIfMissing("vault_file_block",
+                              "compression",
+                              SQL_ALTER_FILE_BLOCK_COMPRESSION) ||
+          !m_dbConnection->executeUpdate(SQL_UPDATE_FILE_BLOCK_COMPRESSION,
+                                         rowsAffected)) {
+         ++numFailures;
+      }
+   }
+
+   if (!createTable(SQL_CREATE_EXTENSION_COMPRESSION)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("storage_node",
+                           "capacity",
+                           SQL_ALTER_STORAGE_NODE_CAPACITY)) {
+      ++numFailures;
+   }
+
+   if (!haveColumn("vault_file_block", "placement_key")) {
+      unsigned long rowsAffected = 0;
+
+      if (!addColumnIfMissing("vault_file_block",
+                              "placement_key",
+                              SQL_ALTER_FILE_BLOCK_PLACEMENT_KEY) ||
+          !m_dbConnection->executeUpdate(SQL_UPDATE_COPY_COUNT_ALL_NODES,
+                                         rowsAffected)) {
+         ++numFailures;
+      }
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "data_fragments",
+                           SQL_ALTER_LOCAL_DIRECTORY_DATA_FRAGMENTS)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("local_directory",
+                           "parity_fragments",
+                           SQL_ALTER_LOCAL_DIRECTORY_PARITY_FRAGMENTS)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault_file_block",
+                           "fragment_index",
+                           SQL_ALTER_FILE_BLOCK_FRAGMENT_INDEX)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault_file_block",
+                           "data_fragments",
+                           SQL_ALTER_FILE_BLOCK_DATA_FRAGMENTS)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault_file_block",
+                           "parity_fragments",
+                           SQL_ALTER_FILE_BLOCK_PARITY_FRAGMENTS)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault_file_block",
+                           "payload_size",
+                           SQL_ALTER_FILE_BLOCK_PAYLOAD_SIZE)) {
+      ++numFailures;
+   }
+
+   if (!addColumnIfMissing("vault_file",
+                           "needs_resend",
+                           SQL_ALTER_VAULT_FILE_NEEDS_RESEND)) {
+      ++numFailures;
+   }
+
+   if (!createIndexes()) {
+      ++numFailures;
+   }
+
+   return (numFailures == 0);
+}
+
+//******************************************************************************
+
+bool DataAccess::enableWriteAheadLog() {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   // the pragma answers with the journal mode now in effect, which stays
+   // the old one if WAL isn't possible (e.g., an in-memory database)
+   bool walEnabled = false;
+   AutoPointer<DBResultSet*> rs(
+      m_dbConnection->executeQuery(SQL_PRAGMA_JOURNAL_MODE_WAL));
+   if (rs.haveObject()) {
+      if (rs->next()) {
+         AutoPointer<string*> journalMode(rs->stringForColumnIndex(0));
+         if (journalMode.haveObject() && (*(journalMode()) == "wal")) {
+            walEnabled = true;
+         }
+      }
+   }
+
+   if (walEnabled) {
+      unsigned long rowsAffected = 0;
+      if (!m_dbConnection->executeUpdate(SQL_PRAGMA_SYNCHRONOUS_NORMAL,
+                                         rowsAffected)) {
+         Logger::warning("unable to set synchronous mode of database");
+      }
+   }
+
+   return walEnabled;
+}
+
+//******************************************************************************
+
+bool DataAccess::beginTransaction() {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (m_inTransaction) {
+      Logger::error("unable to begin transaction: transaction already active");
+      return false;
+   }
+
+   unsigned long rowsAffected = 0;
+   if (m_dbConnection->executeUpdate(SQL_BEGIN_TRANSACTION, rowsAffected)) {
+      m_inTransaction = true;
+   }
+
+   return m_inTransaction;
+}
+
+//******************************************************************************
+
+bool DataAccess::inTransaction() const {
+   return m_inTransaction;
+}
+
+//******************************************************************************
+
 bool DataAccess::commit() {
    if (m_dbConnection != nullptr) {
+      if (m_inTransaction) {
+         unsigned long rowsAffected = 0;
+         if (m_dbConnection->executeUpdate(SQL_COMMIT_TRANSACTION,
+                                           rowsAffected)) {
+            m_inTransaction = false;
+            return true;
+         }
+
+         return false;
+      }
+
       return m_dbConnection->commit();
    }
 
@@ -492,6 +1368,15 @@ bool DataAccess::commit() {
 
 bool DataAccess::rollback() {
    if (m_dbConnection != nullptr) {
+      if (m_inTransaction) {
+         // the transaction is over even if the rollback reports an error
+         // (SQLite may already have rolled it back itself)
+         m_inTransaction = false;
+         unsigned long rowsAffected = 0;
+         return m_dbConnection->executeUpdate(SQL_ROLLBACK_TRANSACTION,
+                                              rowsAffected);
+      }
+
       return m_dbConnection->rollback();
    }
 
@@ -500,6 +1385,28 @@ bool DataAccess::rollback() {
 
 //******************************************************************************
 
+bool DataAccess::syncCommitted() {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (m_inTransaction) {
+      Logger::error("unable to sync catalog: transaction active");
+      return false;
+   }
+
+   AutoPointer<DBResultSet*> rs(
+      m_dbConnection->executeQuery(SQL_PRAGMA_WAL_CHECKPOINT));
+   if (rs.haveObject() && rs->next()) {
+      return (rs->intForColumnIndex(0) == 0);
+   }
+
+   return false;
+}
+
+//******************************************************************************
+
 bool DataAccess::insertStorageNode(StorageNode& storageNode) {
    bool dbUpdateSuccess = false;
    if (m_dbConnection != nullptr) {
@@ -508,6 +1415,7 @@ bool DataAccess::insertStorageNode(StorageNode& storageNode) {
          DBStatementArgs args;
          args.add(new DBString(nodeName));
          args.add(new DBBool(storageNode.getActive()));
+         args.add(new DBInt(storageNode.getCapacity()));
 
          unsigned long rowsAffected = 0;
 
@@ -540,6 +1448,13 @@ bool DataAccess::insertLocalDirectory(LocalDirectory& localDirectory) {
          args.add(new DBBool(localDirectory.getCompress()));
          args.add(new DBBool(localDirectory.getEncrypt()));
          args.add(new DBInt(localDirectory.getCopyCount()));
+         args.add(new DBInt(localDirectory.getScanThreads()));
+         args.add(new DBString(localDirectory.getChunkMode()));
+         args.add(new DBInt(localDirectory.getChunkMinSize()));
+         args.add(new DBInt(localDirectory.getChunkAvgSize()));
+         args.add(new DBInt(localDirectory.getChunkMaxSize()));
+         args.add(new DBInt(localDirectory.getDataFragments()));
+         args.add(new DBInt(localDirectory.getParityFragments()));
 
          unsigned long rowsAffected = 0;
 
@@ -608,6 +1523,10 @@ bool DataAccess::insertVault(Vault& vault) {
             args.add(new DBInt(localDirectoryId));
             args.add(new DBBool(vault.getCompress()));
             args.add(new DBBool(vault.getEncrypt()));
+            args.add(new DBString(vault.getHashAlgorithm()));
+            args.add(new DBString(vault.getPayloadEncoding()));
+            args.add(new DBString(vault.getCipher()));
+            args.add(new DBString(vault.getCompression()));
 
             unsigned long rowsAffected = 0;
 
@@ -644,11 +1563,12 @@ bool DataAccess::insertVaultFile(VaultFile& vaultFile) {
             args.add(new DBDate(vaultFile.getCreateTime()));
             args.add(new DBDate(vaultFile.getModifyTime()));
 
-            args.add(new DBInt(vaultFile.getOriginFileSize()));
+            args.add(new DBLong(vaultFile.getOriginFileSize()));
             args.add(new DBInt(vaultFile.getBlockCount()));
             args.add(new DBString(vaultFile.getUserPermissions().getPermissionsString()));
             args.add(new DBString(vaultFile.getGroupPermissions().getPermissionsString()));
             args.add(new DBString(vaultFile.getOtherPermissions().getPermissionsString()));
+            args.add(new DBBool(vaultFile.getNeedsResend()));
 
             unsigned long rowsAffected = 0;
 
@@ -693,6 +1613,13 @@ bool DataAccess::insertVaultFileBlock(VaultFileBlock& vaultFileBlock) {
                args.add(new DBString(uniqueIdentifier));
                args.add(new DBString(nodeDirectory));
                args.add(new DBString(nodeFile));
+               args.add(new DBLong(vaultFileBlock.getBlockOffset()));
+               args.add(new DBString(vaultFileBlock.getCompression()));
+               args.add(new DBString(vaultFileBlock.getPlacementKey()));
+               args.add(new DBInt(vaultFileBlock.getFragmentIndex()));
+               args.add(new DBInt(vaultFileBlock.getDataFragments()));
+               args.add(new DBInt(vaultFileBlock.getParityFragments()));
+               args.add(new DBInt(vaultFileBlock.getPayloadSize()));
 
                unsigned long rowsAffected = 0;
 
@@ -708,7 +1635,11 @@ bool DataAccess::insertVaultFileBlock(VaultFileBlock& vaultFileBlock) {
                   ::printf("originFileSize=%d\n", vaultFileBlock.getOriginFileSize());
                   ::printf("storedFileSize=%d\n", vaultFileBlock.getStoredFileSize());
                   ::printf("sequenceNumber=%d\n", vaultFileBlock.getBlockSequenceNumber());
+                  ::printf("blockOffset=%lld\n", (long long) vaultFileBlock.getBlockOffset());
                   ::printf("padCharCount=%d\n", vaultFileBlock.getPadCharCount());
+                  ::printf("compression='%s'\n", vaultFileBlock.getCompression().c_str());
+                  ::printf("placementKey='%s'\n", vaultFileBlock.getPlacementKey().c_str());
+                  ::printf("fragmentIndex=%d\n", vaultFileBlock.getFragmentIndex());
                   ::printf("uniqueIdentifier='%s'\n", uniqueIdentifier.c_str());
                   ::printf("nodeDirectory='%s'\n", nodeDirectory.c_str());
                   ::printf("nodeFile='%s'\n", nodeFile.c_str());
@@ -743,6 +1674,7 @@ bool DataAccess::updateStorageNode(StorageNode& storageNode) {
             args.add(new DBBool(storageNode.getActive()));
             args.add(new DBDate(storageNode.getPingTime()));
             args.add(new DBDate(storageNode.getCopyTime()));
+            args.add(new DBInt(storageNode.getCapacity()));
             args.add(new DBInt(storageNode.getStorageNodeId()));
 
             unsigned long rowsAffected = 0;
@@ -772,6 +1704,7 @@ bool DataAccess::updateLocalDirectory(LocalDirectory& localDirectory) {
          const int localDirectoryId = localDirectory.getLocalDirectoryId();
          if (localDirectoryId > -1) {
             const int copyCount = localDirectory.getCopyCount();
+            const int scanThreads = localDirectory.getScanThreads();
             const bool active = localDirectory.getActive();
             const bool recurse = localDirectory.getRecurse();
             const bool compress = localDirectory.getCompress();
@@ -784,6 +1717,13 @@ bool DataAccess::updateLocalDirectory(LocalDirectory& localDirectory) {
             args.add(new DBBool(compress));
             args.add(new DBBool(encrypt));
             args.add(new DBInt(copyCount));
+            args.add(new DBInt(scanThreads));
+            args.add(new DBString(localDirectory.getChunkMode()));
+            args.add(new DBInt(localDirectory.getChunkMinSize()));
+            args.add(new DBInt(localDirectory.getChunkAvgSize()));
+            args.add(new DBInt(localDirectory.getChunkMaxSize()));
+            args.add(new DBInt(localDirectory.getDataFragments()));
+            args.add(new DBInt(localDirectory.getParityFragments()));
             args.add(new DBInt(localDirectoryId));
 
             unsigned long rowsAffected = 0;
@@ -862,6 +1802,10 @@ bool DataAccess::updateVault(Vault& vault) {
                args.add(new DBInt(localDirectoryId));
                args.add(new DBBool(compress));
                args.add(new DBBool(encrypt));
+               args.add(new DBString(vault.getHashAlgorithm()));
+               args.add(new DBString(vault.getPayloadEncoding()));
+               args.add(new DBString(vault.getCipher()));
+               args.add(new DBString(vault.getCompression()));
                args.add(new DBInt(vaultId));
 
                unsigned long rowsAffected = 0;
@@ -895,7 +1839,7 @@ bool DataAccess::updateVaultFile(VaultFile& vaultFile) {
       if (vaultFileId > -1) {
          if (localFileId > -1) {
             if (vaultId > -1) {
-               const int originFileSize = vaultFile.getOriginFileSize();
+               const int64_t originFileSize = vaultFile.getOriginFileSize();
                const int blockCount = vaultFile.getBlockCount();
                const string& userPermissions =
                   vaultFile.getUserPermissions().getPermissionsString();
@@ -907,13 +1851,14 @@ bool DataAccess::updateVaultFile(VaultFile& vaultFile) {
                DBStatementArgs args;
                args.add(new DBInt(localFileId));
                args.add(new DBInt(vaultId));
-               args.add(new DBNull("DBString"));
-               args.add(new DBNull("DBString"));
-               args.add(new DBInt(originFileSize));
+               args.add(new DBDate(vaultFile.getCreateTime()));
+               args.add(new DBDate(vaultFile.getModifyTime()));
+               args.add(new DBLong(originFileSize));
                args.add(new DBInt(blockCount));
                args.add(new DBString(userPermissions));
                args.add(new DBString(groupPermissions));
                args.add(new DBString(otherPermissions));
+               args.add(new DBBool(vaultFile.getNeedsResend()));
                args.add(new DBInt(vaultFileId));
 
                unsigned long rowsAffected = 0;
@@ -969,6 +1914,13 @@ bool DataAccess::updateVaultFileBlock(VaultFileBlock& vaultFileBlock) {
                      args.add(new DBString(uniqueIdentifier));
                      args.add(new DBString(nodeDirectory));
                      args.add(new DBString(nodeFile));
+                     args.add(new DBLong(vaultFileBlock.getBlockOffset()));
+                     args.add(new DBString(vaultFileBlock.getCompression()));
+                     args.add(new DBString(vaultFileBlock.getPlacementKey()));
+                     args.add(new DBInt(vaultFileBlock.getFragmentIndex()));
+                     args.add(new DBInt(vaultFileBlock.getDataFragments()));
+                     args.add(new DBInt(vaultFileBlock.getParityFragments()));
+                     args.add(new DBInt(vaultFileBlock.getPayloadSize()));
                      args.add(new DBInt(vaultFileBlockId));
 
                      unsigned long rowsAffected = 0;
@@ -1181,10 +2133,12 @@ bool DataAccess::getStorageNodes(const string& query,
                   rs->stringForColumnIndex(2));
                AutoPointer<string*> copyTime(
                   rs->stringForColumnIndex(3));
+               const int capacity = rs->intForColumnIndex(4);
 
                StorageNode storageNode;
                storageNode.setStorageNodeId(storageNodeId);
                storageNode.setNodeName(*(nodeName()));
+               storageNode.setCapacity(capacity);
 
                if (pingTime.haveObject()) {
                   storageNode.setPingTime(chaudiere::DateTime(*(pingTime())));
@@ -1245,6 +2199,14 @@ bool DataAccess::getLocalDirectories(const string& query,
                const bool compress = rs->boolForColumnIndex(4);
                const bool encrypt = rs->boolForColumnIndex(5);
                const int copyCount = rs->intForColumnIndex(6);
+               const int scanThreads = rs->intForColumnIndex(7);
+               AutoPointer<string*> chunkMode(
+                  rs->stringForColumnIndex(8));
+               const int chunkMinSize = rs->intForColumnIndex(9);
+               const int chunkAvgSize = rs->intForColumnIndex(10);
+               const int chunkMaxSize = rs->intForColumnIndex(11);
+               const int dataFragments = rs->intForColumnIndex(12);
+               const int parityFragments = rs->intForColumnIndex(13);
 
                LocalDirectory localDirectory;
                localDirectory.setLocalDirectoryId(localDirectoryId);
@@ -1254,6 +2216,15 @@ bool DataAccess::getLocalDirectories(const string& query,
                localDirectory.setCompress(compress);
                localDirectory.setEncrypt(encrypt);
                localDirectory.setCopyCount(copyCount);
+               localDirectory.setScanThreads(scanThreads);
+               localDirectory.setChunkSizes(chunkMinSize,
+                                            chunkAvgSize,
+                                            chunkMaxSize);
+               localDirectory.setErasureCoding(dataFragments, parityFragments);
+
+               if (chunkMode.haveObject()) {
+                  localDirectory.setChunkMode(*(chunkMode()));
+               }
 
                listDirectories.push_back(localDirectory);
             }
@@ -1370,35 +2341,9 @@ bool DataAccess::getLocalFilesForDirectory(int localDirectoryId,
       if (rs.haveObject()) {
          //Logger::debug("have non-null resultSet");
          while (rs->next()) {
-            const int localFileId = rs->intForColumnIndex(0);
-            AutoPointer<string*> filePath(
-               rs->stringForColumnIndex(1));
-
-            if ((localFileId > 0) && (filePath.haveObject())) {
-               AutoPointer<string*> createTime(
-                  rs->stringForColumnIndex(2));
-               AutoPointer<string*> modifyTime(
-                  rs->stringForColumnIndex(3));
-               AutoPointer<string*> scanTime(
-                  rs->stringForColumnIndex(4));
-
-               LocalFile localFile;
+            LocalFile localFile;
+            if (ReadLocalFile(rs(), 0, localFile)) {
                localFile.setLocalDirectoryId(localDirectoryId);
-               localFile.setLocalFileId(localFileId);
-               localFile.setFilePath(*(filePath()));
-
-               if (createTime.haveObject()) {
-                  localFile.setCreateTime(chaudiere::DateTime(*(createTime())));
-               }
-
-               if (modifyTime.haveObject()) {
-                  localFile.setModifyTime(chaudiere::DateTime(*(modifyTime())));
-               }
-
-               if (scanTime.haveObject()) {
-                  localFile.setScanTime(chaudiere::DateTime(*(scanTime())));
-               }
-
                listFiles.push_back(localFile);
             }
          }
@@ -1441,12 +2386,32 @@ bool DataAccess::getVault(int storageNodeId,
                   if (vaultId > -1) {
                      const bool compress = rs->boolForColumnIndex(1);
                      const bool encrypt = rs->boolForColumnIndex(2);
+                     AutoPointer<string*> hashAlgorithm(
+                        rs->stringForColumnIndex(3));
+                     AutoPointer<string*> payloadEncoding(
+                        rs->stringForColumnIndex(4));
+                     AutoPointer<string*> cipher(
+                        rs->stringForColumnIndex(5));
+                     AutoPointer<string*> compression(
+                        rs->stringForColumnIndex(6));
 
                      vault.setVaultId(vaultId);
                      vault.setStorageNodeId(storageNodeId);
                      vault.setLocalDirectoryId(localDirectoryId);
                      vault.setCompress(compress);
                      vault.setEncrypt(encrypt);
+                     if (hashAlgorithm.haveObject()) {
+                        vault.setHashAlgorithm(*(hashAlgorithm()));
+                     }
+                     if (payloadEncoding.haveObject()) {
+                        vault.setPayloadEncoding(*(payloadEncoding()));
+                     }
+                     if (cipher.haveObject()) {
+                        vault.setCipher(*(cipher()));
+                     }
+                     if (compression.haveObject()) {
+                        vault.setCompression(*(compression()));
+                     }
 
                      dbAccessSuccess = true;
                   }
@@ -1489,48 +2454,9 @@ bool DataAccess::getVaultFile(int vaultId, int localFileId, VaultFile& vaultFile
             if (rs.haveObject()) {
                //Logger::debug("have non-null resultSet");
                if (rs->next()) {
-                  const int vaultFileId = rs->intForColumnIndex(0);
-
-                  if (vaultFileId > 0) {
-                     AutoPointer<DBDate*> createTime(
-                        rs->dateForColumnIndex(1));
-                     AutoPointer<DBDate*> modifyTime(
-                        rs->dateForColumnIndex(2));
-                     const int originFileSize = rs->intForColumnIndex(3);
-                     const int blockCount = rs->intForColumnIndex(4);
-                     AutoPointer<string*> userPermissions(
-                        rs->stringForColumnIndex(5));
-                     AutoPointer<string*> groupPermissions(
-                        rs->stringForColumnIndex(6));
-                     AutoPointer<string*> otherPermissions(
-                        rs->stringForColumnIndex(7));
-
-                     vaultFile.setVaultFileId(vaultFileId);
+                  if (ReadVaultFile(rs(), 0, vaultFile)) {
                      vaultFile.setLocalFileId(localFileId);
                      vaultFile.setVaultId(vaultId);
-                     vaultFile.setOriginFileSize(originFileSize);
-                     vaultFile.setBlockCount(blockCount);
-
-                     if (userPermissions.haveObject()) {
-                        vaultFile.setUserPermissions(*(userPermissions()));
-                     }
-
-                     if (groupPermissions.haveObject()) {
-                        vaultFile.setGroupPermissions(*(groupPermissions()));
-                     }
-
-                     if (otherPermissions.haveObject()) {
-                        vaultFile.setOtherPermissions(*(otherPermissions()));
-                     }
-
-                     if (createTime.haveObject()) {
-                        vaultFile.setCreateTime(createTime->getDateTime());
-                     }
-
-                     if (modifyTime.haveObject()) {
-                        vaultFile.setModifyTime(modifyTime->getDateTime());
-                     }
-
                      dbAccessSuccess = true;
                   }
                }
@@ -1568,58 +2494,9 @@ bool DataAccess::getBlocksForVaultFile(int vaultFileId,
          if (rs.haveObject()) {
             //Logger::debug("have non-null resultSet");
             while (rs->next()) {
-               const int vaultFileBlockId = rs->intForColumnIndex(0);
-
-               if (vaultFileBlockId > 0) {
-                  AutoPointer<string*> createTime(
-                     rs->stringForColumnIndex(1));
-                  AutoPointer<string*> modifyTime(
-                     rs->stringForColumnIndex(2));
-                  AutoPointer<string*> storedTime(
-                     rs->stringForColumnIndex(3));
-                  const int originFileSize = rs->intForColumnIndex(4);
-                  const int storedFileSize = rs->intForColumnIndex(5);
-                  const int blockSequenceNumber = rs->intForColumnIndex(6);
-                  const int padCharCount = rs->intForColumnIndex(7);
-                  AutoPointer<string*> uniqueIdentifier(
-                     rs->stringForColumnIndex(8));
-                  AutoPointer<string*> nodeDirectory(
-                     rs->stringForColumnIndex(9));
-                  AutoPointer<string*> nodeFile(
-                     rs->stringForColumnIndex(10));
-
-                  VaultFileBlock vaultFileBlock;
-                  vaultFileBlock.setVaultFileBlockId(vaultFileBlockId);
+               VaultFileBlock vaultFileBlock;
+               if (ReadVaultFileBlock(rs(), 0, vaultFileBlock)) {
                   vaultFileBlock.setVaultFileId(vaultFileId);
-                  vaultFileBlock.setOriginFileSize(originFileSize);
-                  vaultFileBlock.setStoredFileSize(storedFileSize);
-                  vaultFileBlock.setBlockSequenceNumber(blockSequenceNumber);
-                  vaultFileBlock.setPadCharCount(padCharCount);
-
-                  if (uniqueIdentifier.haveObject()) {
-                     vaultFileBlock.setUniqueIdentifier(*(uniqueIdentifier()));
-                  }
-
-                  if (nodeDirectory.haveObject()) {
-                     vaultFileBlock.setNodeDirectory(*(nodeDirectory()));
-                  }
-
-                  if (nodeFile.haveObject()) {
-                     vaultFileBlock.setNodeFile(*(nodeFile()));
-                  }
-
-                  if (createTime.haveObject()) {
-                     vaultFileBlock.setCreateTime(chaudiere::DateTime(*(createTime())));
-                  }
-
-                  if (modifyTime.haveObject()) {
-                     vaultFileBlock.setModifyTime(chaudiere::DateTime(*(modifyTime())));
-                  }
-
-                  if (storedTime.haveObject()) {
-                     vaultFileBlock.setStoredTime(chaudiere::DateTime(*(storedTime())));
-                  }
-
                   listFileBlocks.push_back(vaultFileBlock);
                }
             }
@@ -1639,4 +2516,260 @@ bool DataAccess::getBlocksForVaultFile(int vaultFileId,
 
 //******************************************************************************
 
+// hands a finished file to the callback with each vault file's blocks in
+// sequence order
+static bool FinishRestorePlanFile(RestorePlanFile& planFile,
+                                  const DataAccess::RestorePlanCallback& callback) {
+   for (auto& listFileBlocks : planFile.vaultFileBlocks) {
+      sort(listFileBlocks.begin(),
+           listFileBlocks.end(),
+           [](const VaultFileBlock& a, const VaultFileBlock& b) {
+              return a.getBlockSequenceNumber() < b.getBlockSequenceNumber();
+           });
+   }
+
+   return callback(planFile);
+}
+
+//******************************************************************************
+
+// reads the rows of a restore plan query, handing each file to the callback
+// once all of its rows have been read
+static bool ReadRestorePlan(DBResultSet* rs,
+                            int localDirectoryId,
+                            const DataAccess::RestorePlanCallback& callback) {
+   // only the file whose rows are being read is held in memory
+   RestorePlanFile planFile;
+   bool haveFile = false;
+
+   while (rs->next()) {
+      const int localFileId =
+         rs->intForColumnIndex(RESTORE_PLAN_LOCAL_FILE_COLUMN);
+
+      if (!haveFile || (localFileId != planFile.localFile.getLocalFileId())) {
+         if (haveFile && !FinishRestorePlanFile(planFile, callback)) {
+            return true;
+         }
+
+         planFile.localFile = LocalFile();
+         planFile.vaultFiles.clear();
+         planFile.vaultFileBlocks.clear();
+
+         haveFile = ReadLocalFile(rs,
+                                  RESTORE_PLAN_LOCAL_FILE_COLUMN,
+                                  planFile.localFile);
+         if (!haveFile) {
+            continue;
+         }
+
+         planFile.localFile.setLocalDirectoryId(localDirectoryId);
+      }
+
+      VaultFile vaultFile;
+      if (!ReadVaultFile(rs, RESTORE_PLAN_VAULT_FILE_COLUMN, vaultFile)) {
+         continue;
+      }
+
+      // one row per block, so the vault file is usually the last one seen
+      int vaultFileIndex = planFile.vaultFiles.size() - 1;
+      while ((vaultFileIndex > -1) &&
+             (planFile.vaultFiles[vaultFileIndex].getVaultFileId() !=
+              vaultFile.getVaultFileId())) {
+         --vaultFileIndex;
+      }
+
+      if (vaultFileIndex < 0) {
+         vaultFile.setLocalFileId(localFileId);
+         vaultFile.setVaultId(rs->intForColumnIndex(RESTORE_PLAN_VAULT_ID_COLUMN));
+         vaultFileIndex = planFile.vaultFiles.size();
+         planFile.vaultFiles.push_back(vaultFile);
+         planFile.vaultFileBlocks.push_back(vector<VaultFileBlock>());
+      }
+
+      VaultFileBlock vaultFileBlock;
+      if (ReadVaultFileBlock(rs,
+                             RESTORE_PLAN_FILE_BLOCK_COLUMN,
+                             vaultFileBlock)) {
+         vaultFileBlock.setVaultFileId(vaultFile.getVaultFileId());
+         planFile.vaultFileBlocks[vaultFileIndex].push_back(vaultFileBlock);
+      }
+   }
+
+   if (haveFile) {
+      FinishRestorePlanFile(planFile, callback);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool DataAccess::getRestorePlan(int localDirectoryId,
+                                const RestorePlanCallback& callback) {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (localDirectoryId < 0) {
+      Logger::error("unable to retrieve restore plan, invalid directory id");
+      return false;
+   }
+
+   DBStatementArgs args;
+   args.add(new DBInt(localDirectoryId));
+
+   AutoPointer<DBResultSet*> rs(
+      m_dbConnection->executeQuery(SQL_SELECT_RESTORE_PLAN, args));
+   if (!rs.haveObject()) {
+      return false;
+   }
+
+   return ReadRestorePlan(rs(), localDirectoryId, callback);
+}
+
+//******************************************************************************
+
+bool DataAccess::getRestorePlanForFile(int localDirectoryId,
+                                       const string& filePath,
+                                       const RestorePlanCallback& callback) {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (localDirectoryId < 0) {
+      Logger::error("unable to retrieve restore plan, invalid directory id");
+      return false;
+   }
+
+   DBStatementArgs args;
+   args.add(new DBInt(localDirectoryId));
+   args.add(new DBString(filePath));
+
+   AutoPointer<DBResultSet*> rs(
+      m_dbConnection->executeQuery(SQL_SELECT_RESTORE_PLAN_FILE, args));
+   if (!rs.haveObject()) {
+      return false;
+   }
+
+   return ReadRestorePlan(rs(), localDirectoryId, callback);
+}
+
+//******************************************************************************
+
+bool DataAccess::getRestorePlanForPath(int localDirectoryId,
+                                       const string& dirPath,
+                                       const RestorePlanCallback& callback) {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   if (localDirectoryId < 0) {
+      Logger::error("unable to retrieve restore plan, invalid directory id");
+      return false;
+   }
+
+   DBStatementArgs args;
+   args.add(new DBInt(localDirectoryId));
+   args.add(new DBString(dirPath + "/"));
+   args.add(new DBString(dirPath + "0"));
+
+   AutoPointer<DBResultSet*> rs(
+      m_dbConnection->executeQuery(SQL_SELECT_RESTORE_PLAN_PATH_RANGE, args));
+   if (!rs.haveObject()) {
+      return false;
+   }
+
+   return ReadRestorePlan(rs(), localDirectoryId, callback);
+}
+
+//******************************************************************************
+
+bool DataAccess::insertBenchmarkFiles(int localDirectoryId,
+                                      int vaultId,
+                                      int firstFile,
+                                      int lastFile) {
+   if (m_dbConnection == nullptr) {
+      Logger::error(MSG_NO_DB_CONNECTION);
+      return false;
+   }
+
+   chaudiere::DateTime now;
+   unsigned long rowsAffected = 0;
+
+   DBStatementArgs fileArgs;
+   fileArgs.add(new DBInt(firstFile));
+   fileArgs.add(new DBInt(lastFile));
+   fileArgs.add(new DBInt(localDirectoryId));
+   fileArgs.add(new DBDate(now));
+   fileArgs.add(new DBDate(now));
+   fileArgs.add(new DBDate(now));
+
+   DBStatementArgs vaultFileArgs;
+   vaultFileArgs.add(new DBInt(vaultId));
+
+   return m_dbConnection->executeUpdate(SQL_INSERT_BENCHMARK_LOCAL_FILES,
+                                        fileArgs,
+                                        rowsAffected) &&
+          m_dbConnection->executeUpdate(SQL_INSERT_BENCHMARK_VAULT_FILES,
+                                        vaultFileArgs,
+                                        rowsAffected) &&
+          m_dbConnection->executeUpdate(SQL_INSERT_BENCHMARK_FILE_BLOCKS,
+                                        rowsAffected);
+}
+
+//******************************************************************************
+
+
+bool DataAccess::getCompressionHistory(map<string, CompressionHistory>& mapExtensionHistory) {
+   bool dbAccessSuccess = false;
+   if (m_dbConnection != nullptr) {
+      AutoPointer<DBResultSet*> rs(
+         m_dbConnection->executeQuery(SQL_SELECT_EXTENSION_COMPRESSION));
+
+      if (rs.haveObject()) {
+         while (rs->next()) {
+            AutoPointer<string*> extension(rs->stringForColumnIndex(0));
+
+            if (extension.haveObject()) {
+               CompressionHistory& history =
+                  mapExtensionHistory[*(extension())];
+               history.blocksProbed = rs->intForColumnIndex(1);
+               history.blocksCompressed = rs->intForColumnIndex(2);
+            }
+         }
+         dbAccessSuccess = true;
+      }
+   } else {
+      Logger::error(MSG_NO_DB_CONNECTION);
+   }
+
+   return dbAccessSuccess;
+}
+
+//******************************************************************************
+
+bool DataAccess::saveCompressionHistory(const string& extension,
+                                        const CompressionHistory& history) {
+   bool dbUpdateSuccess = false;
+   if (m_dbConnection != nullptr) {
+      DBStatementArgs args;
+      args.add(new DBString(extension));
+      args.add(new DBInt(history.blocksProbed));
+      args.add(new DBInt(history.blocksCompressed));
+
+      unsigned long rowsAffected = 0;
+
+      dbUpdateSuccess =
+         m_dbConnection->executeUpdate(SQL_SAVE_EXTENSION_COMPRESSION, args, rowsAffected);
+   } else {
+      Logger::error(MSG_NO_DB_CONNECTION);
+   }
+
+   return dbUpdateSuccess;
+}
+
+//******************************************************************************
 
@@ -4,7 +4,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
+#include <functional>
 
 #include "LocalDirectory.h"
 #include "LocalFile.h"
@@ -12,6 +14,7 @@
 #include "Vault.h"
 #include "VaultFile.h"
 #include "VaultFileBlock.h"
+#include "CompressionPolicy.h"
 #include "Database.h"
 
 /**
@@ -19,9 +22,25 @@
 
 namespace lachepas {
 
+/**
+ * A file of a local directory with its vault files and their blocks, as
+ * handed out by DataAccess::getRestorePlan
+ */
+struct RestorePlanFile {
+   LocalFile localFile;
+   std::vector<VaultFile> vaultFiles;  // one per vault that has the file
+   std::vector<std::vector<VaultFileBlock>> vaultFileBlocks;  // of each vault file, by sequence
+};
+
 class DataAccess {
 
 public:
+   /**
+    * Receives the files of a restore plan one at a time
+    * @return false to stop reading the plan
+    */
+   typedef std::function<bool(const RestorePlanFile&)> RestorePlanCallback;
+
    /**
     *
     * @param filePath
@@ -58,18 +77,58 @@ public:
     */
    bool haveTables();
 
+   /**
+    * Creates the indexes used by the per-file lookups (those not already
+    * in the database)
+    * @return boolean indicating whether all of the indexes exist
+    */
+   bool createIndexes();
+
+   /**
+    * Brings the tables of an existing database up to the current schema
+    * @return boolean indicating whether the upgrade succeeded
+    */
+   bool upgradeTables();
+
+   /**
+    * Switches the database to write-ahead logging (done by open)
+    * @return boolean indicating whether the database uses a write-ahead log
+    */
+   bool enableWriteAheadLog();
+
+   /**
+    * Starts a transaction that holds every change until commit (or
+    * rollback), so that many rows cost a single sync of the log
+    * @return
+    */
+   bool beginTransaction();
+
    /**
     *
+    * @return whether a transaction started by beginTransaction is open
+    */
+   bool inTransaction() const;
+
+   /**
+    * Commits the transaction started by beginTransaction
     * @return
     */
    bool commit();
 
    /**
-    *
+    * Discards the changes made since beginTransaction
     * @return
     */
    bool rollback();
 
+   /**
+    * Makes the changes committed so far survive a crash or power loss (a
+    * commit alone only reaches the write-ahead log). Must be called outside
+    * of a transaction.
+    * @return false if the log could not be checkpointed
+    */
+   bool syncCommitted();
+
    /**
     *
     * @param storageNode
@@ -298,8 +357,87 @@ public:
    bool getBlocksForVaultFile(int vaultFileId,
                               std::vector<VaultFileBlock>& listFileBlocks);
 
+   /**
+    * Reads the files of a local directory together with their vault files
+    * and blocks with a single query, handing each file to the callback as
+    * soon as its rows have been read. Only one file is held in memory at a
+    * time, however large the directory.
+    * @param localDirectoryId
+    * @param callback called for each file, in path order
+    * @return false if the plan could not be read
+    * @see RestorePlanFile()
+    */
+   bool getRestorePlan(int localDirectoryId,
+                       const RestorePlanCallback& callback);
+
+   /**
+    * Reads the restore plan of a single file of a local directory
+    * @param localDirectoryId
+    * @param filePath path of the file within the directory (as stored)
+    * @param callback called for the file if it is found
+    * @return false if the plan could not be read
+    * @see getRestorePlan()
+    */
+   bool getRestorePlanForFile(int localDirectoryId,
+                              const std::string& filePath,
+                              const RestorePlanCallback& callback);
+
+   /**
+    * Reads the restore plan of the files below a path of a local directory,
+    * using the directory/path index to visit only those files
+    * @param localDirectoryId
+    * @param dirPath path of the subdirectory within the directory (as
+    * stored, without a trailing '/')
+    * @param callback called for each file, in path order
+    * @return false if the plan could not be read
+    * @see getRestorePlan()
+    */
+   bool getRestorePlanForPath(int localDirectoryId,
+                              const std::string& dirPath,
+                              const RestorePlanCallback& callback);
+
+   /**
+    * Retrieves how well the blocks of each file name extension have compressed
+    * @param mapExtensionHistory receives the history by extension
+    * @return
+    * @see CompressionHistory()
+    */
+   bool getCompressionHistory(std::map<std::string, CompressionHistory>& mapExtensionHistory);
+
+   /**
+    * Saves how well the blocks of a file name extension have compressed
+    * @param extension
+    * @param history
+    * @return
+    * @see CompressionHistory()
+    */
+   bool saveCompressionHistory(const std::string& extension,
+                               const CompressionHistory& history);
+
+   /**
+    * Fills the catalog with files for benchmarking lookups. Each file is
+    * named 'benchmark/<n>' and has a vault file with a single block.
+    * @param localDirectoryId directory of the files
+    * @param vaultId vault of the vault files
+    * @param firstFile number of the first file to add
+    * @param lastFile number of the last file to add
+    * @return
+    */
+   bool insertBenchmarkFiles(int localDirectoryId,
+                             int vaultId,
+                             int firstFile,
+                             int lastFile);
+
 
 protected:
+   bool haveColumn(const std::string& tableName,
+                   const std::string& columnName);
+   bool addColumnIfMissing(const std::string& tableName,
+                           const std::string& columnName,
+                           const std::string& sql);
+   bool haveIndex(const std::string& indexName);
+   bool createIndexIfMissing(const std::string& indexName,
+                             const std::string& sql);
    bool getStorageNodes(const std::string& query,
                         std::vector<StorageNode>& listNodes);
    bool getLocalDirectories(const std::string& query,
@@ -310,6 +448,7 @@ private:
    chapeau::Database* m_dbConnection;
    std::string m_dbFilePath;
    bool m_debugPrint;
+   bool m_inTransaction;
 
    // not available
    DataAccess(const DataAccess&);
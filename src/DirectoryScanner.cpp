@@ -0,0 +1,247 @@
+// Copyright Paul Dardeau, 2016
+// DirectoryScanner.cpp
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "DirectoryScanner.h"
+#include "GFSExclusions.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+// how long an idle walker sleeps before looking for work to steal again
+static const int IDLE_WAIT_MILLIS = 5;
+
+//******************************************************************************
+
+DirectoryScanner::DirectoryScanner(const GFSExclusions& exclusions,
+                                   bool recurse,
+                                   int numThreads,
+                                   int queueCapacity) :
+   m_exclusions(exclusions),
+   m_entries(queueCapacity),
+   m_pendingDirectories(0),
+   m_stopped(false),
+   m_numThreads(numThreads > 0 ? numThreads : 1),
+   m_recurse(recurse) {
+
+   for (int i = 0; i < m_numThreads; ++i) {
+      m_walkerDeques.push_back(unique_ptr<WalkerDeque>(new WalkerDeque));
+   }
+}
+
+//******************************************************************************
+
+DirectoryScanner::~DirectoryScanner() {
+   stop();
+}
+
+//******************************************************************************
+
+bool DirectoryScanner::start(const string& rootDirectory) {
+   if (!m_walkers.empty()) {
+      return false;
+   }
+
+   addDirectory(0, rootDirectory);
+
+   for (int i = 0; i < m_numThreads; ++i) {
+      m_walkers.push_back(thread(&DirectoryScanner::runWalker, this, i));
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool DirectoryScanner::nextEntry(ScanEntry& entry) {
+   return m_entries.pop(entry);
+}
+
+//******************************************************************************
+
+void DirectoryScanner::stop() {
+   m_stopped = true;
+   m_entries.close();
+   m_idleCondition.notify_all();
+   joinWalkers();
+}
+
+//******************************************************************************
+
+void DirectoryScanner::joinWalkers() {
+   for (auto& walker : m_walkers) {
+      if (walker.joinable()) {
+         walker.join();
+      }
+   }
+
+   m_walkers.clear();
+}
+
+//******************************************************************************
+
+void DirectoryScanner::addDirectory(int walkerIndex, const string& dirPath) {
+   ++m_pendingDirectories;
+
+   WalkerDeque& walkerDeque = *m_walkerDeques[walkerIndex];
+   {
+      lock_guard<mutex> lock(walkerDeque.mutex);
+      walkerDeque.directories.push_back(dirPath);
+   }
+
+   m_idleCondition.notify_one();
+}
+
+//******************************************************************************
+
+bool DirectoryScanner::takeDirectory(int walkerIndex, string& dirPath) {
+   // newest work from our own deque first (depth-first keeps it small)
+   {
+      WalkerDeque& ownDeque = *m_walkerDeques[walkerIndex];
+      lock_guard<mutex> lock(ownDeque.mutex);
+      if (!ownDeque.directories.empty()) {
+         dirPath = ownDeque.directories.back();
+         ownDeque.directories.pop_back();
+         return true;
+      }
+   }
+
+   // steal the oldest work (likely the largest subtree) from someone else
+   for (int i = 1; i < m_numThreads; ++i) {
+      WalkerDeque& victim = *m_walkerDeques[(walkerIndex + i) % m_numThreads];
+      lock_guard<mutex> lock(victim.mutex);
+      if (!victim.directories.empty()) {
+         dirPath = victim.directories.front();
+         victim.directories.pop_front();
+         return true;
+      }
+   }
+
+   return false;
+}
+
+//******************************************************************************
+
+void DirectoryScanner::directoryFinished() {
+   if (--m_pendingDirectories == 0) {
+      // nothing queued and nothing being read -- the walk is complete
+      m_entries.close();
+      m_idleCondition.notify_all();
+   }
+}
+
+//******************************************************************************
+
+void DirectoryScanner::runWalker(int walkerIndex) {
+   string dirPath;
+
+   while (!m_stopped) {
+      if (takeDirectory(walkerIndex, dirPath)) {
+         scanDirectory(dirPath, walkerIndex);
+         directoryFinished();
+      } else {
+         if (m_pendingDirectories == 0) {
+            break;
+         }
+
+         unique_lock<mutex> lock(m_idleMutex);
+         m_idleCondition.wait_for(lock, chrono::milliseconds(IDLE_WAIT_MILLIS));
+      }
+   }
+}
+
+//******************************************************************************
+
+void DirectoryScanner::scanDirectory(const string& dirPath, int walkerIndex) {
+   const char* pszDirPath = dirPath.c_str();
+   DIR* dir;
+
+   if ((dir = ::opendir(pszDirPath)) != nullptr) {
+      int pathLength;
+      char path[PATH_MAX];
+      struct dirent* entry;
+
+      while (!m_stopped && ((entry = ::readdir(dir)) != nullptr)) {
+         if (entry->d_type & DT_DIR) {
+            if ((::strcmp(entry->d_name, "..") != 0) &&
+                (::strcmp(entry->d_name, ".") != 0)) {
+
+               pathLength = ::snprintf(path,
+                                       PATH_MAX,
+                                       "%s/%s",
+                                       pszDirPath,
+                                       entry->d_name);
+
+               if (pathLength >= PATH_MAX) {
+                  ::fprintf(stderr, "Path length too long: %s\n", path);
+               } else {
+                  ScanEntry dirEntry;
+                  dirEntry.dirPath = path;
+                  dirEntry.statErrno = 0;
+                  dirEntry.isDirectory = true;
+                  m_entries.push(std::move(dirEntry));
+
+                  if (m_recurse) {
+                     const string dirName(entry->d_name);
+
+                     if (!m_exclusions.excludeDirectory(dirName)) {
+                        addDirectory(walkerIndex, string(path));
+                     } else {
+                        ::printf("excluding directory: '%s'\n", dirName.c_str());
+                     }
+                  }
+               }
+            }
+         } else {
+            // regular file?
+            if (entry->d_type & DT_REG) {
+               const string fileName(entry->d_name);
+               if (!m_exclusions.excludeFile(fileName)) {
+                  pathLength = ::snprintf(path,
+                                          PATH_MAX,
+                                          "%s/%s",
+                                          pszDirPath,
+                                          entry->d_name);
+
+                  if (pathLength >= PATH_MAX) {
+                     ::fprintf(stderr, "Path length too long: %s\n", path);
+                  } else {
+                     ScanEntry fileEntry;
+                     fileEntry.dirPath = dirPath;
+                     fileEntry.fileName = fileName;
+                     fileEntry.isDirectory = false;
+                     fileEntry.statErrno = 0;
+
+                     if (::stat(path, &fileEntry.fileStat) != 0) {
+                        fileEntry.statErrno = errno;
+                     }
+
+                     m_entries.push(std::move(fileEntry));
+                  }
+               }
+            } else {
+               ::printf("ignoring file: %s\n", entry->d_name);
+            }
+         }
+      }
+
+      ::closedir(dir);
+   } else {
+      Logger::error(string("unable to open directory '") +
+                    pszDirPath +
+                    "': " +
+                    ::strerror(errno));
+   }
+}
+
+//******************************************************************************
+
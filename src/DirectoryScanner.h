@@ -0,0 +1,116 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_DIRECTORYSCANNER_H
+#define LACHEPAS_DIRECTORYSCANNER_H
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+
+
+namespace lachepas {
+
+class GFSExclusions;
+
+/**
+ * An entry discovered by DirectoryScanner. Directory entries are reported so
+ * that the consumer sees the same directory callbacks as the serial walk;
+ * file entries carry the result of the stat call made by the walker thread.
+ */
+struct ScanEntry {
+   std::string dirPath;
+   std::string fileName;
+   struct stat fileStat;
+   int statErrno;
+   bool isDirectory;
+};
+
+/**
+ * Walks a directory tree with a pool of walker threads. Each walker owns a
+ * deque of directories still to be read; it works from the back of its own
+ * deque and, when that runs dry, steals from the front of another walker's.
+ * Regular files are stat'ed by the walkers (so stat latency overlaps) and
+ * handed to the consumer through a bounded queue. Exclusion and recurse
+ * handling follows GFSClient::scanDir exactly.
+ */
+class DirectoryScanner {
+
+public:
+   /**
+    *
+    * @param exclusions directory and file exclusions to honor
+    * @param recurse whether subdirectories are traversed
+    * @param numThreads number of walker threads
+    * @param queueCapacity maximum number of entries waiting for the consumer
+    */
+   DirectoryScanner(const GFSExclusions& exclusions,
+                    bool recurse,
+                    int numThreads,
+                    int queueCapacity);
+
+   /**
+    * Destructor
+    */
+   ~DirectoryScanner();
+
+   /**
+    * Starts the walker threads at the specified directory
+    * @param rootDirectory the top of the tree to walk
+    * @return boolean indicating whether the scan was started
+    */
+   bool start(const std::string& rootDirectory);
+
+   /**
+    * Retrieves the next discovered entry, waiting for one if necessary
+    * @param entry receives the entry
+    * @return false once the walk is complete and all entries consumed
+    */
+   bool nextEntry(ScanEntry& entry);
+
+   /**
+    * Stops the walk early and waits for the walker threads to finish
+    */
+   void stop();
+
+
+private:
+   struct WalkerDeque {
+      std::mutex mutex;
+      std::deque<std::string> directories;
+   };
+
+   void runWalker(int walkerIndex);
+   void addDirectory(int walkerIndex, const std::string& dirPath);
+   bool takeDirectory(int walkerIndex, std::string& dirPath);
+   void scanDirectory(const std::string& dirPath, int walkerIndex);
+   void directoryFinished();
+   void joinWalkers();
+
+   const GFSExclusions& m_exclusions;
+   BoundedQueue<ScanEntry> m_entries;
+   std::vector<std::unique_ptr<WalkerDeque>> m_walkerDeques;
+   std::vector<std::thread> m_walkers;
+   std::mutex m_idleMutex;
+   std::condition_variable m_idleCondition;
+   std::atomic<long> m_pendingDirectories;
+   std::atomic<bool> m_stopped;
+   int m_numThreads;
+   bool m_recurse;
+
+   // not available
+   DirectoryScanner(const DirectoryScanner&);
+   DirectoryScanner& operator=(const DirectoryScanner&);
+};
+
+}
+
+#endif
+
@@ -13,17 +13,13 @@
 #include <openssl/evp.h>
 
 #include "Encryption.h"
-#include "base64.h"
+#include "Base64Codec.h"
 
 
 #define STACK_BUFFER_BYTES 512
 #define HALF_BUFFER_SIZE STACK_BUFFER_BYTES / 2
 
 using namespace std;
-
-static const string EMPTY_STRING = "";
-
-
 using namespace lachepas;
 
 //******************************************************************************
@@ -122,41 +118,31 @@ string Encryption::computeHMAC(const char* str,
 
 string Encryption::base64Encode(unsigned char const* buffer,
                                 unsigned int len) {
-   const int encodedLength = ::Base64encode_len(len);
-   if (encodedLength > 0) {
-      char* encodedStr = new char[encodedLength];
-      const int bytesEncoded = ::Base64encode(encodedStr, (const char*) buffer, len);
-      string encodedString;
-
-      if (bytesEncoded > 0) {
-         encodedString = encodedStr;
-      }
-
-      delete [] encodedStr;
-      return encodedString;
-   } else {
-      return EMPTY_STRING;
-   }
+   string encodedString;
+   base64Encode(buffer, len, encodedString);
+   return encodedString;
 }
 
 //******************************************************************************
 
 string Encryption::base64Decode(string const& s) {
-   const int decodedLength = ::Base64decode_len(s.data());
-   if (decodedLength > 0) {
-      char* decodedStr = new char[decodedLength];
-      const int bytesDecoded = ::Base64decode(decodedStr, s.data());
-      if (bytesDecoded > 0) {
-         string decodedString(decodedStr, bytesDecoded);
-         delete [] decodedStr;
-         return decodedString;
-      } else {
-         delete [] decodedStr;
-         return EMPTY_STRING;
-      }
-   } else {
-      return EMPTY_STRING;
-   }
+   string decodedString;
+   base64Decode(s, decodedString);
+   return decodedString;
+}
+
+//******************************************************************************
+
+void Encryption::base64Encode(unsigned char const* buffer,
+                              unsigned int len,
+                              string& encoded) {
+   Base64Codec::encode(buffer, len, encoded);
+}
+
+//******************************************************************************
+
+void Encryption::base64Decode(string const& s, string& decoded) {
+   Base64Codec::decode(s.data(), s.length(), decoded);
 }
 
 //******************************************************************************
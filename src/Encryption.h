@@ -16,6 +16,8 @@ public:
    static std::string digestToHexString(const unsigned char* digest, int len);
    static std::string base64Encode(unsigned char const* , unsigned int len);
    static std::string base64Decode(std::string const& s);
+   static void base64Encode(unsigned char const* buffer, unsigned int len, std::string& encoded);
+   static void base64Decode(std::string const& s, std::string& decoded);
 };
 
 }
@@ -0,0 +1,573 @@
+// Copyright Paul Dardeau, 2016
+// FileBlockStore.cpp
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "FileBlockStore.h"
+#include "BinaryFile.h"
+#include "FileReferenceCount.h"
+#include "ReferenceCountIndex.h"
+#include "GroupCommit.h"
+#include "ContentHasher.h"
+#include "GFS.h"
+#include "OSUtils.h"
+#include "StrUtils.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+static const string SLASH                  = "/";
+
+static const string TEMP_FILE_MARKER       = ".tmp.";
+static const string TEMP_FILE_TEMPLATE     = TEMP_FILE_MARKER + "XXXXXX";
+
+static const size_t WRITE_PIECE_SIZE       = 65536;
+
+//******************************************************************************
+
+FileBlockStore::FileBlockStore() :
+   m_referenceCounts(new ReferenceCountIndex),
+   m_groupCommit(nullptr),
+   m_baseDirFd(-1) {
+}
+
+//******************************************************************************
+
+FileBlockStore::~FileBlockStore() {
+   close();
+   delete m_referenceCounts;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::open(const string& baseDir) {
+   if (!OSUtils::directoryExists(baseDir)) {
+      Logger::error(string("directory to serve does not exist: ") + baseDir);
+      return false;
+   }
+
+   m_baseDir = baseDir;
+
+   const bool importNeeded = !ReferenceCountIndex::exists(m_baseDir);
+
+   if (!m_referenceCounts->open(m_baseDir)) {
+      Logger::error("unable to open reference count index");
+      return false;
+   }
+
+   if (importNeeded && !importReferenceCounts()) {
+      Logger::error("unable to import reference counts");
+      return false;
+   }
+
+   if (getGroupCommit()) {
+      // blocks live in many files, so a shared sync has to cover the
+      // whole file system
+      if (!GroupCommit::isFileSystemSyncAvailable()) {
+         Logger::error("group commit is not available on this platform, "
+                       "syncing each block instead");
+         return true;
+      }
+
+      m_baseDirFd = ::open(m_baseDir.c_str(), O_RDONLY);
+      if (m_baseDirFd == -1) {
+         Logger::error(string("unable to open directory '") +
+                       m_baseDir +
+                       string("'"));
+         return false;
+      }
+
+      const int baseDirFd = m_baseDirFd;
+      m_groupCommit = new GroupCommit([baseDirFd]() {
+         return GroupCommit::syncFileSystem(baseDirFd);
+      });
+      m_groupCommit->setBatchSize(getGroupCommitBatchSize());
+      m_groupCommit->setMaxDelay(getGroupCommitMaxDelay());
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void FileBlockStore::close() {
+   // every block is synced before fileAdd returns
+   m_referenceCounts->close();
+
+   if (m_groupCommit != nullptr) {
+      delete m_groupCommit;
+      m_groupCommit = nullptr;
+   }
+
+   if (m_baseDirFd != -1) {
+      ::close(m_baseDirFd);
+      m_baseDirFd = -1;
+   }
+}
+
+//******************************************************************************
+
+bool FileBlockStore::syncWrites() {
+   if (m_groupCommit == nullptr) {
+      return true;
+   }
+
+   return m_groupCommit->waitForSync(m_groupCommit->registerWrite());
+}
+
+//******************************************************************************
+
+bool FileBlockStore::dirList(vector<string>& listDirectories) {
+   const char* pszDirPath = m_baseDir.c_str();
+   DIR* dir;
+   struct dirent* entry;
+   bool success = false;
+
+   if ((dir = ::opendir(pszDirPath)) != nullptr) {
+      while ((entry = ::readdir(dir)) != nullptr) {
+         if (entry->d_type & DT_DIR) {
+            listDirectories.push_back(string(entry->d_name));
+         }
+      }
+
+      ::closedir(dir);
+      success = true;
+   } else {
+      Logger::error(string("unable to open directory '") +
+                    string(pszDirPath) +
+                    string("'"));
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::getPathForFile(const string& directory,
+                                    const string& file,
+                                    string& filePath) {
+   string dirPath = m_baseDir;
+
+   if (!directory.empty()) {
+      if (!StrUtils::endsWith(dirPath, SLASH) &&
+          !StrUtils::startsWith(directory, SLASH)) {
+         dirPath += SLASH;
+      }
+
+      dirPath += directory;
+   }
+
+   filePath = OSUtils::pathJoin(dirPath, file);
+
+   return true;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileUniqueIdentifier(const string& directory,
+                                          const string& file,
+                                          string& uniqueIdentifier,
+                                          const string& hashAlgorithm) {
+   string filePath;
+   if (getPathForFile(directory, file, filePath)) {
+      return GFS::uniqueIdentifierForFile(filePath,
+                                          uniqueIdentifier,
+                                          hashAlgorithm);
+   } else {
+      return false;
+   }
+}
+
+//******************************************************************************
+
+bool FileBlockStore::writeFile(const string& filePath,
+                               const string& fileContents,
+                               const string& expectedIdentifier,
+                               string& uniqueIdentifier,
+                               const string& hashAlgorithm) {
+   ContentHasher* hasher = ContentHasher::create(hashAlgorithm);
+   if (hasher == nullptr) {
+      ::printf("error: unsupported hash algorithm '%s'\n", hashAlgorithm.c_str());
+      return false;
+   }
+
+   // The block is written under a temporary name and only renamed into place
+   // once its identifier has been verified, so a partial or corrupt block is
+   // never visible under its final name.
+   string tempFilePath = filePath;
+   tempFilePath += TEMP_FILE_TEMPLATE;
+   vector<char> tempPathBuffer(tempFilePath.begin(), tempFilePath.end());
+   tempPathBuffer.push_back('\0');
+
+   const int fd = ::mkstemp(&tempPathBuffer[0]);
+   if (fd == -1) {
+      ::printf("error: unable to create temporary file for '%s'\n",
+               filePath.c_str());
+      delete hasher;
+      return false;
+   }
+
+   tempFilePath = &tempPathBuffer[0];
+
+   // hash each piece just before writing it, while it's still in cache,
+   // rather than reading the whole file back afterwards
+   const char* data = fileContents.data();
+   size_t bytesRemaining = fileContents.length();
+   bool writeSuccess = true;
+
+   while (writeSuccess && (bytesRemaining > 0)) {
+      const size_t pieceLength =
+         (bytesRemaining < WRITE_PIECE_SIZE) ? bytesRemaining : WRITE_PIECE_SIZE;
+      hasher->update(data, pieceLength);
+      writeSuccess = BinaryFile::writeFully(fd, data, pieceLength);
+      data += pieceLength;
+      bytesRemaining -= pieceLength;
+   }
+
+   // with group commit the data is synced along with other blocks below
+   if (writeSuccess && (m_groupCommit == nullptr) && (::fsync(fd) != 0)) {
+      writeSuccess = false;
+   }
+
+   ::close(fd);
+
+   if (!writeSuccess) {
+      ::printf("error: unable to write to file '%s'\n", filePath.c_str());
+      ::unlink(tempFilePath.c_str());
+      delete hasher;
+      return false;
+   }
+
+   string storedFileId = hasher->finalHex();
+   delete hasher;
+
+   if (storedFileId.empty() ||
+       (!expectedIdentifier.empty() && (storedFileId != expectedIdentifier))) {
+      // delete the file that we just wrote, since its contents don't match
+      // what the client sent
+      ::unlink(tempFilePath.c_str());
+      ::printf("error: unique identifier mismatch for file '%s'\n",
+               filePath.c_str());
+      return false;
+   }
+
+   // the data has to be on disk before the block gets its final name
+   if (!syncWrites()) {
+      ::unlink(tempFilePath.c_str());
+      ::printf("error: unable to sync file '%s'\n", filePath.c_str());
+      return false;
+   }
+
+   if (getVerifyReadBack()) {
+      // paranoid mode: also check what actually landed on disk
+      string readBackFileId;
+      if (!GFS::uniqueIdentifierForFile(tempFilePath,
+                                        readBackFileId,
+                                        hashAlgorithm) ||
+          (readBackFileId != storedFileId)) {
+         ::unlink(tempFilePath.c_str());
+         ::printf("error: read back verification failed for file '%s'\n",
+                  filePath.c_str());
+         return false;
+      }
+   }
+
+   if (::rename(tempFilePath.c_str(), filePath.c_str()) != 0) {
+      ::unlink(tempFilePath.c_str());
+      ::printf("error: unable to rename temporary file to '%s'\n",
+               filePath.c_str());
+      return false;
+   }
+
+   uniqueIdentifier = storedFileId;
+   return true;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::importReferenceCounts() {
+   // one-time migration from the counts kept in each block's extended
+   // attributes; the attributes are left alone
+   FileReferenceCount fileReferenceCount;
+   map<string, uint32_t> counts;
+   vector<string> listDirectories;
+
+   if (!dirList(listDirectories)) {
+      return false;
+   }
+
+   for (const string& directory : listDirectories) {
+      // only the two digit block directories
+      if ((directory.length() != 2) ||
+          !::isdigit(directory[0]) ||
+          !::isdigit(directory[1])) {
+         continue;
+      }
+
+      vector<string> listFiles;
+      if (!fileList(directory, listFiles)) {
+         return false;
+      }
+
+      for (const string& fileName : listFiles) {
+         string filePath;
+         getPathForFile(directory, fileName, filePath);
+
+         long refCountValue =
+            fileReferenceCount.referenceCountForFile(filePath);
+         if (refCountValue < 1L) {
+            // the block is there, so something refers to it
+            Logger::warning(string("no reference count for '") +
+                            filePath +
+                            string("', using 1"));
+            refCountValue = 1L;
+         }
+
+         counts[fileName] = static_cast<uint32_t>(refCountValue);
+      }
+   }
+
+   if (!m_referenceCounts->importCounts(counts)) {
+      return false;
+   }
+
+   Logger::info(string("imported reference counts for ") +
+                to_string(counts.size()) +
+                string(" blocks"));
+   return true;
+}
+
+//******************************************************************************
+
+mutex& FileBlockStore::lockForName(const string& fileName) {
+   return m_nameLocks[hash<string>()(fileName) % NAME_LOCK_COUNT];
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileAdd(const string& fileName,
+                             const string& fileContents,
+                             string& directory,
+                             string& uniqueIdentifier,
+                             const string& hashAlgorithm) {
+   if (uniqueIdentifier.empty()) {
+      ::printf("fileAdd: uniqueIdentifier empty, returning\n");
+      return false;
+   }
+
+   directory = directoryForIdentifier(uniqueIdentifier);
+
+   string filePath;
+   getPathForFile(directory, fileName, filePath);
+
+   if (filePath.empty()) {
+      ::printf("error: filePath is empty for directory='%s', fileName='%s'\n",
+               directory.c_str(),
+               fileName.c_str());
+      return false;
+   }
+
+   // adds and deletes of the same block must not interleave
+   lock_guard<mutex> lock(lockForName(fileName));
+   uint32_t refCount;
+
+   if (OSUtils::pathExists(filePath)) {
+      return m_referenceCounts->adjust(fileName, 1, refCount);
+   } else {
+      // count the reference before the block appears, so a crash in
+      // between can only leave a count that is too high (leaking the
+      // block) rather than too low (losing it)
+      if (!m_referenceCounts->adjust(fileName, 1, refCount)) {
+         ::printf("error: unable to store reference count\n");
+         return false;
+      }
+
+      string nodeUniqueIdentifier;
+      // with group commit, also wait for the rename
+      if (writeFile(filePath,
+                    fileContents,
+                    uniqueIdentifier,
+                    nodeUniqueIdentifier,
+                    hashAlgorithm) &&
+          syncWrites()) {
+         uniqueIdentifier = nodeUniqueIdentifier;
+         return true;
+      } else {
+         ::printf("writeFile failed\n");
+         m_referenceCounts->adjust(fileName, -1, refCount);
+         return false;
+      }
+   }
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileAddReference(const string& fileName,
+                                     string& directory,
+                                     const string& uniqueIdentifier) {
+   if (uniqueIdentifier.empty()) {
+      return false;
+   }
+
+   directory = directoryForIdentifier(uniqueIdentifier);
+
+   string filePath;
+   getPathForFile(directory, fileName, filePath);
+
+   lock_guard<mutex> lock(lockForName(fileName));
+
+   // the client won't send the block, so it has to really be here (a crash
+   // can leave a count for a block that was never written)
+   if (filePath.empty() || !OSUtils::pathExists(filePath)) {
+      return false;
+   }
+
+   uint32_t refCount;
+   return m_referenceCounts->adjust(fileName, 1, refCount);
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileDelete(const string& directory,
+                                const string& fileName) {
+   string filePath;
+   getPathForFile(directory, fileName, filePath);
+
+   lock_guard<mutex> lock(lockForName(fileName));
+
+   if (OSUtils::pathExists(filePath)) {
+      if (m_referenceCounts->referenceCount(fileName) < 1) {
+         return false;
+      }
+
+      uint32_t refCount;
+      if (!m_referenceCounts->adjust(fileName, -1, refCount)) {
+         return false;
+      }
+
+      // a crash before the unlink leaves a block with no references,
+      // which a later add of the same block simply reuses
+      if (refCount > 0) {
+         return true;
+      } else {
+         const int rc = ::unlink(filePath.c_str());
+         if (rc == 0) {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileExists(const string& directory,
+                                const string& fileName) {
+   string filePath;
+   getPathForFile(directory, fileName, filePath);
+   return OSUtils::pathExists(filePath);
+}
+
+//******************************************************************************
+
+void FileBlockStore::filesExist(const vector<string>& fileNames,
+                                vector<bool>& stored) {
+   // every stored block has a reference count, so the count index can
+   // answer without probing the block files
+   m_referenceCounts->hasReferences(fileNames, stored);
+}
+
+//******************************************************************************
+
+bool FileBlockStore::fileList(const string& directory,
+                              vector<string>& listFiles) {
+   string dirPath = m_baseDir;
+
+   if (!directory.empty()) {
+      if (!StrUtils::endsWith(dirPath, SLASH) &&
+          !StrUtils::startsWith(directory, SLASH)) {
+         dirPath += SLASH;
+      }
+
+      dirPath += directory;
+   } else {
+      printf("no directory specified\n");
+      return false;
+   }
+
+   const char* pszDirPath = dirPath.c_str();
+   DIR* dir;
+   struct dirent* entry;
+   bool success = false;
+
+   if ((dir = ::opendir(pszDirPath)) != nullptr) {
+      while ((entry = ::readdir(dir)) != nullptr) {
+         if (!(entry->d_type & DT_DIR)) {
+            const string fileName(entry->d_name);
+
+            // skip blocks that are still being written
+            if (fileName.find(TEMP_FILE_MARKER) == string::npos) {
+               listFiles.push_back(fileName);
+            }
+         }
+      }
+
+      ::closedir(dir);
+      success = true;
+   } else {
+      Logger::error(string("unable to open directory '") +
+                    string(pszDirPath) +
+                    string("'"));
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool FileBlockStore::retrieveFileContents(const string& directory,
+                                          const string& fileName,
+                                          string& fileContents) {
+   bool retrievalSuccess = false;
+
+   if (directory.empty()) {
+      ::printf("retrieveFileContents: missing directory\n");
+      return false;
+   }
+
+   if (fileName.empty()) {
+      ::printf("retrieveFileContents: missing file name\n");
+      return false;
+   }
+
+   string filePath;
+   getPathForFile(directory, fileName, filePath);
+
+   if (filePath.empty()) {
+      ::printf("error: filePath is empty for directory='%s', fileName='%s'\n",
+               directory.c_str(),
+               fileName.c_str());
+      return false;
+   }
+
+   if (OSUtils::pathExists(filePath)) {
+      retrievalSuccess = GFS::readFile(filePath, fileContents);
+   } else {
+      ::printf("error: file does not exist\n");
+   }
+
+   return retrievalSuccess;
+}
+
+//******************************************************************************
+
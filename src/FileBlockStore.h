@@ -0,0 +1,199 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_FILEBLOCKSTORE_H
+#define LACHEPAS_FILEBLOCKSTORE_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockStore.h"
+
+
+namespace lachepas {
+
+class GroupCommit;
+class ReferenceCountIndex;
+
+/**
+ * The original storage engine: each block is its own file in one of 100
+ * two digit directories. Reference counts are kept in a ReferenceCountIndex
+ * in the base directory.
+ */
+class FileBlockStore : public BlockStore {
+
+public:
+   /**
+    * Default constructor
+    */
+   FileBlockStore();
+
+   /**
+    * Destructor
+    */
+   ~FileBlockStore();
+
+   /**
+    *
+    * @param baseDir
+    * @return
+    */
+   bool open(const std::string& baseDir);
+
+   /**
+    *
+    */
+   void close();
+
+   /**
+    *
+    * @param listDirectories
+    * @return
+    */
+   bool dirList(std::vector<std::string>& listDirectories);
+
+   /**
+    *
+    * @param fileName
+    * @param fileContents
+    * @param directory
+    * @param uniqueIdentifier
+    * @param hashAlgorithm
+    * @return
+    */
+   bool fileAdd(const std::string& fileName,
+                const std::string& fileContents,
+                std::string& directory,
+                std::string& uniqueIdentifier,
+                const std::string& hashAlgorithm);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   bool fileDelete(const std::string& directory,
+                   const std::string& fileName);
+
+   /**
+    *
+    * @param fileName
+    * @param directory
+    * @param uniqueIdentifier
+    * @return
+    */
+   bool fileAddReference(const std::string& fileName,
+                         std::string& directory,
+                         const std::string& uniqueIdentifier);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   bool fileExists(const std::string& directory,
+                   const std::string& fileName);
+
+   /**
+    *
+    * @param fileNames
+    * @param stored
+    */
+   void filesExist(const std::vector<std::string>& fileNames,
+                   std::vector<bool>& stored);
+
+   /**
+    *
+    * @param directory
+    * @param listFiles
+    * @return
+    */
+   bool fileList(const std::string& directory,
+                 std::vector<std::string>& listFiles);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @param fileContents
+    * @return
+    */
+   bool retrieveFileContents(const std::string& directory,
+                             const std::string& fileName,
+                             std::string& fileContents);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @param uniqueIdentifier
+    * @param hashAlgorithm
+    * @return
+    */
+   bool fileUniqueIdentifier(const std::string& directory,
+                             const std::string& fileName,
+                             std::string& uniqueIdentifier,
+                             const std::string& hashAlgorithm);
+
+
+private:
+   /**
+    * Writes a block, computing its unique identifier as it is written, and
+    * moves it into place only if the identifier matches the expected one
+    * @param filePath
+    * @param fileContents
+    * @param expectedIdentifier identifier supplied by the client
+    * @param uniqueIdentifier
+    * @param hashAlgorithm
+    * @return
+    */
+   bool writeFile(const std::string& filePath,
+                  const std::string& fileContents,
+                  const std::string& expectedIdentifier,
+                  std::string& uniqueIdentifier,
+                  const std::string& hashAlgorithm);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @param filePath
+    * @return
+    */
+   bool getPathForFile(const std::string& directory,
+                       const std::string& fileName,
+                       std::string& filePath);
+
+   /**
+    * Waits for a group commit covering everything written so far
+    * @return
+    */
+   bool syncWrites();
+
+   /**
+    * Imports the reference counts kept in extended attributes by earlier
+    * versions into the reference count index
+    * @return
+    */
+   bool importReferenceCounts();
+
+   std::mutex& lockForName(const std::string& fileName);
+
+   static const size_t NAME_LOCK_COUNT = 64;
+
+   ReferenceCountIndex* m_referenceCounts;
+   std::mutex m_nameLocks[NAME_LOCK_COUNT];
+   GroupCommit* m_groupCommit;
+   std::string m_baseDir;
+   int m_baseDirFd;
+
+   // not available
+   FileBlockStore(const FileBlockStore&);
+   FileBlockStore& operator=(const FileBlockStore&);
+};
+
+}
+
+#endif
+
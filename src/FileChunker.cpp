@@ -0,0 +1,241 @@
+// Copyright Paul Dardeau, 2016
+// FileChunker.cpp
+
+#include <string.h>
+
+#include "FileChunker.h"
+
+using namespace std;
+using namespace lachepas;
+
+const string FileChunker::CHUNK_MODE_FIXED = "fixed";
+const string FileChunker::CHUNK_MODE_CDC   = "cdc";
+
+const int FileChunker::DEFAULT_MIN_CHUNK_SIZE =  4096;
+const int FileChunker::DEFAULT_AVG_CHUNK_SIZE = 16384;
+const int FileChunker::DEFAULT_MAX_CHUNK_SIZE = 65536;
+
+// smallest chunk size accepted in either mode
+static const int MIN_CHUNK_SIZE_LIMIT = 64;
+
+// seed for the gear table. the table determines every chunk boundary ever
+// recorded in a vault, so neither the seed nor the generator may change.
+static const uint64_t GEAR_SEED = 0x6c616368657061ULL;
+
+//******************************************************************************
+
+static const uint64_t* GearTable() {
+   static uint64_t gear[256];
+   static const bool initialized = [] {
+      // splitmix64
+      uint64_t state = GEAR_SEED;
+      for (int i = 0; i < 256; ++i) {
+         state += 0x9e3779b97f4a7c15ULL;
+         uint64_t z = state;
+         z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+         gear[i] = z ^ (z >> 31);
+      }
+      return true;
+   }();
+
+   (void) initialized;
+   return gear;
+}
+
+//******************************************************************************
+
+static uint64_t HighBitsMask(int numBits) {
+   // the gear hash shifts left, so the high bits depend on the most bytes
+   return ((1ULL << numBits) - 1) << (64 - numBits);
+}
+
+//******************************************************************************
+
+bool FileChunker::isValidChunkMode(const string& chunkMode) {
+   return (chunkMode == CHUNK_MODE_FIXED) || (chunkMode == CHUNK_MODE_CDC);
+}
+
+//******************************************************************************
+
+FileChunker::FileChunker(const string& chunkMode,
+                         int minChunkSize,
+                         int avgChunkSize,
+                         int maxChunkSize) :
+   m_file(nullptr),
+   m_maskSmall(0),
+   m_maskLarge(0),
+   m_minChunkSize(minChunkSize),
+   m_avgChunkSize(avgChunkSize),
+   m_maxChunkSize(maxChunkSize),
+   m_bufferStart(0),
+   m_bufferEnd(0),
+   m_fileOffset(0),
+   m_contentDefined(chunkMode == CHUNK_MODE_CDC),
+   m_endOfFile(false),
+   m_error(false) {
+
+   if (m_minChunkSize < MIN_CHUNK_SIZE_LIMIT) {
+      m_minChunkSize = MIN_CHUNK_SIZE_LIMIT;
+   }
+
+   if (m_avgChunkSize < m_minChunkSize) {
+      m_avgChunkSize = m_minChunkSize;
+   }
+
+   if (m_maxChunkSize < m_avgChunkSize) {
+      m_maxChunkSize = m_avgChunkSize;
+   }
+
+   if (!m_contentDefined) {
+      // fixed blocks are all the same size
+      m_maxChunkSize = m_avgChunkSize;
+   }
+
+   // normalized chunking: a stricter mask before the average size and a
+   // looser one after it pulls chunk sizes in toward the average
+   int avgBits = 0;
+   while ((1 << (avgBits + 1)) <= m_avgChunkSize) {
+      ++avgBits;
+   }
+
+   m_maskSmall = HighBitsMask(avgBits + 1);
+   m_maskLarge = HighBitsMask(avgBits - 1);
+
+   m_buffer.resize(2 * m_maxChunkSize);
+}
+
+//******************************************************************************
+
+FileChunker::~FileChunker() {
+   close();
+}
+
+//******************************************************************************
+
+bool FileChunker::open(const string& filePath) {
+   close();
+
+   m_file = ::fopen(filePath.c_str(), "rb");
+   m_bufferStart = 0;
+   m_bufferEnd = 0;
+   m_fileOffset = 0;
+   m_endOfFile = false;
+   m_error = (m_file == nullptr);
+
+   return !m_error;
+}
+
+//******************************************************************************
+
+void FileChunker::close() {
+   if (m_file != nullptr) {
+      ::fclose(m_file);
+      m_file = nullptr;
+   }
+}
+
+//******************************************************************************
+
+bool FileChunker::hasError() const {
+   return m_error;
+}
+
+//******************************************************************************
+
+bool FileChunker::fillBuffer() {
+   if (m_bufferStart > 0) {
+      const int remaining = m_bufferEnd - m_bufferStart;
+      ::memmove(&m_buffer[0], &m_buffer[m_bufferStart], remaining);
+      m_bufferStart = 0;
+      m_bufferEnd = remaining;
+   }
+
+   const size_t room = m_buffer.size() - m_bufferEnd;
+   const size_t bytesRead = ::fread(&m_buffer[m_bufferEnd], 1, room, m_file);
+   m_bufferEnd += bytesRead;
+
+   if (bytesRead < room) {
+      if (::ferror(m_file)) {
+         m_error = true;
+         return false;
+      }
+
+      m_endOfFile = true;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool FileChunker::nextChunk(string& chunk, int64_t& offset) {
+   if ((m_file == nullptr) || m_error) {
+      return false;
+   }
+
+   if (((m_bufferEnd - m_bufferStart) < m_maxChunkSize) && !m_endOfFile) {
+      if (!fillBuffer()) {
+         return false;
+      }
+   }
+
+   const int available = m_bufferEnd - m_bufferStart;
+   if (available == 0) {
+      return false;
+   }
+
+   int chunkLength;
+
+   if (m_contentDefined) {
+      chunkLength =
+         findCutPoint((const unsigned char*) &m_buffer[m_bufferStart],
+                      available);
+   } else {
+      chunkLength = (available < m_avgChunkSize) ? available : m_avgChunkSize;
+   }
+
+   chunk.assign(m_buffer, m_bufferStart, chunkLength);
+   offset = m_fileOffset;
+
+   m_bufferStart += chunkLength;
+   m_fileOffset += chunkLength;
+
+   return true;
+}
+
+//******************************************************************************
+
+int FileChunker::findCutPoint(const unsigned char* data, int length) const {
+   if (length <= m_minChunkSize) {
+      return length;
+   }
+
+   if (length > m_maxChunkSize) {
+      length = m_maxChunkSize;
+   }
+
+   const int normalSize = (length < m_avgChunkSize) ? length : m_avgChunkSize;
+   const uint64_t* gear = GearTable();
+   uint64_t hash = 0;
+   int i = m_minChunkSize;
+
+   for (; i < normalSize; ++i) {
+      hash = (hash << 1) + gear[data[i]];
+      if ((hash & m_maskSmall) == 0) {
+         return i + 1;
+      }
+   }
+
+   for (; i < length; ++i) {
+      hash = (hash << 1) + gear[data[i]];
+      if ((hash & m_maskLarge) == 0) {
+         return i + 1;
+      }
+   }
+
+   return length;
+}
+
+//******************************************************************************
+
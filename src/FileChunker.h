@@ -0,0 +1,114 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_FILECHUNKER_H
+#define LACHEPAS_FILECHUNKER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+
+namespace lachepas {
+
+/**
+ * Splits a file into the blocks that are stored on the storage nodes. In
+ * fixed mode every block is the average chunk size (except the last one). In
+ * content-defined mode (FastCDC) block boundaries are picked by a rolling
+ * gear hash over the data itself, so an insert or delete only changes the
+ * blocks around the edit instead of shifting every block after it.
+ */
+class FileChunker {
+
+public:
+   static const std::string CHUNK_MODE_FIXED;
+   static const std::string CHUNK_MODE_CDC;
+
+   static const int DEFAULT_MIN_CHUNK_SIZE;
+   static const int DEFAULT_AVG_CHUNK_SIZE;
+   static const int DEFAULT_MAX_CHUNK_SIZE;
+
+   /**
+    *
+    * @param chunkMode CHUNK_MODE_FIXED or CHUNK_MODE_CDC
+    * @return boolean indicating whether chunkMode is a known mode
+    */
+   static bool isValidChunkMode(const std::string& chunkMode);
+
+   /**
+    *
+    * @param chunkMode CHUNK_MODE_FIXED or CHUNK_MODE_CDC
+    * @param minChunkSize smallest chunk produced (except at end of file)
+    * @param avgChunkSize target chunk size (the block size in fixed mode)
+    * @param maxChunkSize largest chunk produced
+    */
+   FileChunker(const std::string& chunkMode,
+               int minChunkSize,
+               int avgChunkSize,
+               int maxChunkSize);
+
+   /**
+    * Destructor
+    */
+   ~FileChunker();
+
+   /**
+    * Opens the file to be chunked
+    * @param filePath
+    * @return
+    */
+   bool open(const std::string& filePath);
+
+   /**
+    * Closes the file
+    */
+   void close();
+
+   /**
+    * Retrieves the next chunk of the file
+    * @param chunk receives the chunk data
+    * @param offset receives the position of the chunk within the file
+    * @return false at end of file or on a read error (see hasError)
+    */
+   bool nextChunk(std::string& chunk, int64_t& offset);
+
+   /**
+    *
+    * @return boolean indicating whether a read error occurred
+    */
+   bool hasError() const;
+
+   /**
+    * Determines where the first chunk of a buffer ends
+    * @param data
+    * @param length
+    * @return length of the chunk starting at data
+    */
+   int findCutPoint(const unsigned char* data, int length) const;
+
+
+private:
+   bool fillBuffer();
+
+   std::string m_buffer;
+   FILE* m_file;
+   uint64_t m_maskSmall;
+   uint64_t m_maskLarge;
+   int m_minChunkSize;
+   int m_avgChunkSize;
+   int m_maxChunkSize;
+   int m_bufferStart;
+   int m_bufferEnd;
+   int64_t m_fileOffset;
+   bool m_contentDefined;
+   bool m_endOfFile;
+   bool m_error;
+
+   // not available
+   FileChunker(const FileChunker&);
+   FileChunker& operator=(const FileChunker&);
+};
+
+}
+
+#endif
+
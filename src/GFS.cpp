@@ -3,10 +3,8 @@
 
 #include <stdio.h>
 
-//#include <openssl/evp.h>
-
 #include "GFS.h"
-//#include "Encryption.h"
+#include "ContentHasher.h"
 #include "OSUtils.h"
 #include "Logger.h"
 #include "StrUtils.h"
@@ -20,6 +18,17 @@ static const string EMPTY_STRING = "";
 using namespace lachepas;
 using namespace chaudiere;
 
+const string GFS::PAYLOAD_ENCODING_BASE64 = "base64";
+const string GFS::PAYLOAD_ENCODING_RAW    = "raw";
+const string GFS::DEFAULT_PAYLOAD_ENCODING = GFS::PAYLOAD_ENCODING_RAW;
+
+//******************************************************************************
+
+bool GFS::isValidPayloadEncoding(const string& payloadEncoding) {
+   return (payloadEncoding == PAYLOAD_ENCODING_BASE64) ||
+          (payloadEncoding == PAYLOAD_ENCODING_RAW);
+}
+
 //******************************************************************************
 
 string GFS::uniqueIdentifierForString(const string& s) {
@@ -28,84 +37,92 @@ string GFS::uniqueIdentifierForString(const string& s) {
 
 //******************************************************************************
 
+string GFS::uniqueIdentifierForString(const string& s,
+                                      const string& algorithm) {
+   return GFS::uniqueIdentifierForBuffer(s.data(), s.size(), algorithm);
+}
+
+//******************************************************************************
+
 string GFS::uniqueIdentifierForBuffer(const char* s, int length) {
+   return GFS::uniqueIdentifierForBuffer(s,
+                                         length,
+                                         ContentHasher::DEFAULT_ALGORITHM);
+}
+
+//******************************************************************************
+
+string GFS::uniqueIdentifierForBuffer(const char* s,
+                                      int length,
+                                      const string& algorithm) {
    if ((nullptr == s) || (length == 0)) {
       return EMPTY_STRING;
    }
 
-   return "";
-   //return Encryption::SHA1ForString(s, length);
+   ContentHasher* hasher = ContentHasher::create(algorithm);
+   if (hasher == nullptr) {
+      Logger::error("unsupported hash algorithm '" + algorithm + "'");
+      return EMPTY_STRING;
+   }
+
+   const string uniqueIdentifier = hasher->hashBuffer(s, length);
+   delete hasher;
+   return uniqueIdentifier;
 }
 
 //******************************************************************************
 
 bool GFS::uniqueIdentifierForFile(const string& filePath,
                                   string& uniqueIdentifier) {
-/*
-   FILE* f = ::fopen(filePath.c_str(), "r");
-   if (f != nullptr) {
-      const EVP_MD* sha1 = ::EVP_sha1();
-      if (nullptr == sha1) {
-         ::printf("error: EVP_sha1 returned null\n");
-         return false;
-      }
-
-      EVP_MD_CTX* mdctx = ::EVP_MD_CTX_create();
-
-      if (nullptr == mdctx) {
-         ::printf("error: EVP_MD_CTX_create returned null\n");
-         return false;
-      }
+   return GFS::uniqueIdentifierForFile(filePath,
+                                       uniqueIdentifier,
+                                       ContentHasher::DEFAULT_ALGORITHM);
+}
 
-      //::EVP_DigestInit(&mdctx, sha1);
-      if (1 != ::EVP_DigestInit_ex(mdctx, sha1, nullptr)) {
-         ::printf("error: EVP_DigestInit_ex failed\n");
-         ::EVP_MD_CTX_destroy(mdctx);
-         return false;
-      }
+//******************************************************************************
 
-      unsigned char buf[8192];
-      size_t bufLen;
-
-      while (1) {
-         bufLen = ::fread(buf, 1, 8192, f);
-         if (bufLen == 0) {
-            if (::ferror(f)) {
-               // error reading file
-               ::fclose(f);
-               return false;
-            }
-            break;
-         } else {
-            if (1 != ::EVP_DigestUpdate(mdctx, buf, bufLen)) {
-               ::printf("error: EVP_DigestUpdate failed\n");
-               ::fclose(f);
-               ::EVP_MD_CTX_destroy(mdctx);
-            }
-         }
-      }
+bool GFS::uniqueIdentifierForFile(const string& filePath,
+                                  string& uniqueIdentifier,
+                                  const string& algorithm) {
+   FILE* f = ::fopen(filePath.c_str(), "rb");
+   if (f == nullptr) {
+      // unable to open file
+      return false;
+   }
 
+   ContentHasher* hasher = ContentHasher::create(algorithm);
+   if (hasher == nullptr) {
+      Logger::error("unsupported hash algorithm '" + algorithm + "'");
       ::fclose(f);
+      return false;
+   }
 
-      unsigned char md_value[EVP_MAX_MD_SIZE];
-      unsigned int md_len;
+   unsigned char buf[8192];
+   size_t bufLen;
+   bool success = true;
 
-      if (1 == ::EVP_DigestFinal_ex(mdctx, md_value, &md_len)) {
-         ::EVP_MD_CTX_destroy(mdctx);
-         uniqueIdentifier = Encryption::digestToHexString(md_value, md_len);
-         return true;
+   while (1) {
+      bufLen = ::fread(buf, 1, sizeof(buf), f);
+      if (bufLen == 0) {
+         if (::ferror(f)) {
+            // error reading file
+            success = false;
+         }
+         break;
       } else {
-         ::EVP_MD_CTX_destroy(mdctx);
-         ::printf("error: EVP_DigestFinal_ex failed\n");
-         return false;
+         hasher->update(buf, bufLen);
       }
-   } else {
-      // unable to open file
-      return false;
    }
-   */
 
-   return false;
+   ::fclose(f);
+
+   if (success) {
+      uniqueIdentifier = hasher->finalHex();
+      success = !uniqueIdentifier.empty();
+   }
+
+   delete hasher;
+   return success;
 }
 
 //******************************************************************************
@@ -122,17 +139,21 @@ bool GFS::readFile(const string& filePath,
    const long fileBytes = ::ftell(f);
    ::fseek(f, 0, SEEK_SET);
 
-   char* buffer = new char[fileBytes + 1];
-   const size_t numObjectsRead = ::fread(buffer, fileBytes, 1, f);
+   if (fileBytes < 0) {
+      ::fclose(f);
+      return false;
+   }
+
+   // blocks may hold raw bytes, so don't treat them as C strings
+   fileContents.resize(fileBytes);
+   const size_t numObjectsRead = ::fread(&fileContents[0], fileBytes, 1, f);
    ::fclose(f);
 
    if (numObjectsRead < 1) {
-      delete [] buffer;
+      fileContents.clear();
       return false;
    }
 
-   buffer[fileBytes] = '\0';
-   fileContents = buffer;
    return true;
 }
 
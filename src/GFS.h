@@ -10,10 +10,24 @@ namespace lachepas {
 class GFS {
 
 public:
+   // how block contents are carried in messages and kept on the nodes
+   static const std::string PAYLOAD_ENCODING_BASE64;  // legacy text mode
+   static const std::string PAYLOAD_ENCODING_RAW;
+   static const std::string DEFAULT_PAYLOAD_ENCODING;
+
+   static bool isValidPayloadEncoding(const std::string& payloadEncoding);
    static std::string uniqueIdentifierForString(const std::string& s);
+   static std::string uniqueIdentifierForString(const std::string& s,
+                                                const std::string& algorithm);
    static std::string uniqueIdentifierForBuffer(const char* s, int length);
+   static std::string uniqueIdentifierForBuffer(const char* s,
+                                                int length,
+                                                const std::string& algorithm);
    static bool uniqueIdentifierForFile(const std::string& filePath,
                                        std::string& uniqueIdentifier);
+   static bool uniqueIdentifierForFile(const std::string& filePath,
+                                       std::string& uniqueIdentifier,
+                                       const std::string& algorithm);
    static bool readFile(const std::string& filePath,
                         std::string& fileContents);
 };
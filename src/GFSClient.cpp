@@ -13,6 +13,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
+#include <mutex>
 #include <string>
 
 
@@ -25,12 +27,21 @@
 #include "GFSMessage.h"
 #include "GFSMessageCommands.h"
 #include "BasicException.h"
-#include "aes256.h"
 #include "IniReader.h"
 #include "GFS.h"
 #include "Encryption.h"
+#include "BlockCipher.h"
+#include "BlockCompressor.h"
+#include "CompressionPolicy.h"
 #include "StringTokenizer.h"
 #include "FilePermissions.h"
+#include "DirectoryScanner.h"
+#include "SendPipeline.h"
+#include "FileChunker.h"
+#include "ReedSolomon.h"
+#include "ReplicaSelector.h"
+#include "RestoreEngine.h"
+#include "SyncTransaction.h"
 
 #define PAGE_SIZE_2X   8192
 #define PAGE_SIZE_3X  12288
@@ -40,11 +51,47 @@
 #define PAGE_SIZE_7X  28672
 #define PAGE_SIZE_8X  32768
 
-#define FILE_BLOCK_SIZE PAGE_SIZE_4X
+// maximum number of scanned entries waiting to be processed
+#define SCAN_QUEUE_CAPACITY 4096
+
+// threads that encrypt/encode/identify blocks while they are being sent
+#define SEND_TRANSFORM_WORKERS 2
+
+// blocks allowed to wait between each stage of the send pipeline
+#define SEND_QUEUE_DEPTH 8
+
+// blocks allowed to wait for each node, i.e., how far a slow node may fall
+// behind the others before it holds them back
+#define SEND_NODE_QUEUE_DEPTH 64
+
+// blocks whose existence on a node is checked with a single request
+#define SEND_BATCH_SIZE 256
+
+// files whose catalog changes are committed together during a sync, and
+// the longest (in milliseconds) a batch may stay uncommitted
+#define SYNC_COMMIT_FILES 1000
+#define SYNC_COMMIT_MILLIS 5000
+
+// blocks queued for each restore fetch worker, so that the workers never
+// wait on the catalog query between files
+#define RESTORE_QUEUE_BLOCKS_PER_WORKER 4
+
+// percentile of recent block fetch latencies after which a restore asks a
+// second node for the block
+#define RESTORE_HEDGE_PERCENTILE 95
+
+// blocks encrypted and decrypted per cipher by benchmarkCiphers
+#define CIPHER_BENCHMARK_BLOCKS 4096
+
+// largest catalog (in files) built by benchmarkCatalog, growing tenfold from
+// 10 thousand, and the files looked up at each size
+#define CATALOG_BENCHMARK_MAX_FILES 10000000
+#define CATALOG_BENCHMARK_LOOKUPS 10000
 
 using namespace std;
 
 static const string DB_FILE                = "gfs_db.sqlite3";
+static const string BENCHMARK_DB_FILE      = "gfs_db_benchmark.sqlite3";
 
 static const string EMPTY_STRING           = "";
 static const string SINGLE_QUOTE           = "'";
@@ -62,77 +109,6 @@ using namespace tonnerre;
 
 //******************************************************************************
 
-string Decrypt(const string& cipherText,
-               const string& encryptionKey) {
-   //TODO: implement Decrypt
-   return EMPTY_STRING;
-}
-
-//******************************************************************************
-
-string Encrypt(const string& fileContents,
-               const string& encryptionKey,
-               int& padChars) {
-   aes256_context ctx;
-   bool encrypting = true;
-   int offset = 0;
-   uint8_t key[32];
-   uint8_t buffer[16];
-   char cipherChars[17];
-   string cipherText;
-
-   if (encryptionKey.length() < 32) {
-      ::printf("error: encryption key must be 32 bytes\n");
-      return EMPTY_STRING;
-   }
-
-   int remainingBytes = fileContents.length();
-
-   ::memset(key, 0, sizeof(key));
-   ::memset(buffer, 0, sizeof(buffer));
-   ::memset(cipherChars, 0, sizeof(cipherChars));
-
-   padChars = 0;
-
-   ::strncpy((char*)key, encryptionKey.c_str(), 32);
-
-   while (encrypting) {
-      ::aes256_init(&ctx, key);
-
-      if (remainingBytes > 15) {
-         ::memcpy(buffer, fileContents.c_str() + offset, 16);
-      } else {
-         ::memcpy(buffer, fileContents.c_str() + offset, remainingBytes);
-         if (remainingBytes < 16) {
-            // add padding
-            const int numPadChars = 16 - remainingBytes;
-            ::memset(buffer+remainingBytes, 0, numPadChars);
-            padChars = numPadChars;
-         }
-      }
-
-      ::aes256_encrypt_ecb(&ctx, buffer);
-
-      ::memcpy(cipherChars, buffer, 16);
-      cipherChars[16] = '\0';
-
-      cipherText += string(cipherChars);
-
-      ::aes256_done(&ctx);
-
-      remainingBytes -= 16;
-      offset += 16;
-
-      if (remainingBytes <= 0) {
-         encrypting = false;
-      }
-   }
-
-   return cipherText;
-}
-
-//******************************************************************************
-
 bool TimeTToDateTime(time_t t, DateTime& dateTime) {
    time_t timeValue = t;
    struct tm* tm = ::localtime(&timeValue);
@@ -160,10 +136,54 @@ bool TimeSpecToDateTime(struct timespec& ts, DateTime& dateTime) {
 
 //******************************************************************************
 
+// index of the vault file a restore plan file has in a vault (-1 if none)
+static int IndexForVault(const RestorePlanFile& planFile, int vaultId) {
+   const int numVaultFiles = planFile.vaultFiles.size();
+   for (int i = 0; i < numVaultFiles; ++i) {
+      if (planFile.vaultFiles[i].getVaultId() == vaultId) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+//******************************************************************************
+
+// a path within a local directory as the catalog stores it, i.e., with a
+// leading '/' and no trailing '/' (empty for the directory itself). the
+// local directory's own path is removed if it was given.
+static string CatalogPath(const string& path, const string& directoryPath) {
+   string catalogPath = path;
+   const size_t prefixLength = directoryPath.find_last_not_of('/') + 1;
+
+   if ((prefixLength > 0) &&
+       (catalogPath.size() > prefixLength) &&
+       (catalogPath.compare(0, prefixLength, directoryPath, 0, prefixLength) == 0) &&
+       (catalogPath[prefixLength] == '/')) {
+      catalogPath.erase(0, prefixLength);
+   }
+
+   if (catalogPath.compare(0, 2, "./") == 0) {
+      catalogPath.erase(0, 1);
+   }
+
+   const size_t first = catalogPath.find_first_not_of('/');
+   if (first == string::npos) {
+      return string();
+   }
+
+   const size_t last = catalogPath.find_last_not_of('/');
+   return "/" + catalogPath.substr(first, last - first + 1);
+}
+
+//******************************************************************************
+
 GFSClient::GFSClient(const GFSOptions& gfsOptions) :
                      m_currentDir(OSUtils::getCurrentDirectory()),
                      m_metaDataDBFile(DB_FILE),
                      m_dataAccess(nullptr),
+                     m_syncTransaction(nullptr),
                      m_gfsOptions(gfsOptions),
                      m_localDirectoryId(-1),
                      m_localDirectoryPathLength(0),
@@ -204,6 +224,8 @@ GFSClient::GFSClient(const GFSOptions& gfsOptions) :
             Logger::info("successfully opened database");
 
             if (m_dataAccess->getActiveStorageNodes(m_activeNodes)) {
+               loadBlockPlacement();
+
                if (m_activeNodes.empty()) {
                   Logger::warning("no storage nodes defined");
                } else {
@@ -270,6 +292,13 @@ void GFSClient::initializeDirectory() {
             localDirectory.setCompress(m_gfsOptions.getUseCompression());
             localDirectory.setEncrypt(m_gfsOptions.getUseEncryption());
             localDirectory.setCopyCount(m_gfsOptions.getCopyCount());
+            localDirectory.setScanThreads(m_gfsOptions.getScanThreads());
+            localDirectory.setChunkMode(m_gfsOptions.getChunkMode());
+            localDirectory.setChunkSizes(m_gfsOptions.getChunkMinSize(),
+                                         m_gfsOptions.getChunkAvgSize(),
+                                         m_gfsOptions.getChunkMaxSize());
+            localDirectory.setErasureCoding(m_gfsOptions.getDataFragments(),
+                                            m_gfsOptions.getParityFragments());
 
             if (m_dataAccess->insertLocalDirectory(localDirectory)) {
                if (localDirectory.getLocalDirectoryId() > -1) {
@@ -291,269 +320,931 @@ void GFSClient::initializeDirectory() {
 
 //******************************************************************************
 
-int GFSClient::sendFile(int numBlockFiles,
+int GFSClient::sendFile(const LocalDirectory& localDirectory,
                         const string& filePath,
-                        bool encrypt,
                         string& nodeBlockFlags,
                         map<int, VaultFile>& mapVaultIdToVaultFile,
                         chaudiere::DateTime& createTime,
                         chaudiere::DateTime& modifyTime) {
-   FILE* f = nullptr;
-   char fileBuffer[FILE_BLOCK_SIZE];
-   string fileContents;
-
-   if (numBlockFiles > 1) {
-      f = ::fopen(filePath.c_str(), "rb");
-      if (f == nullptr) {
-         Logger::error(string("unable to open file '") +
-                       filePath +
-                       SINGLE_QUOTE);
-         return 0;
+   int numNodeBlocksCopied = 0;
+
+   // determine which nodes receive this file's blocks
+   vector<int> nodeIndexes;
+   vector<NodeBlockList> nodeBlockLists(m_activeNodes.size());
+   set<FileBlock::Format> blockFormats;
+   auto itNodeList = m_activeNodes.cbegin();
+   const auto itNodeListEnd = m_activeNodes.cend();
+
+   for (int j = 0; itNodeList != itNodeListEnd; ++itNodeList, ++j) {
+      if (nodeBlockFlags[j] == FLAG_BLOCK_NONE) {
+         continue;
+      }
+
+      auto itVault = m_mapNodeToVault.find((*itNodeList).getNodeName());
+      if (itVault == m_mapNodeToVault.end()) {
+         nodeBlockFlags[j] = FLAG_BLOCK_NONE;
+         continue;
       }
-   }
 
-   // are we using encryption, if so, we need an encryption key
-   string encryptionKey;
-   if (encrypt) {
-      encryptionKey = m_gfsOptions.getEncryptionKey();
+      const Vault& vault = (*itVault).second;
+      nodeBlockLists[j].nodeIndex = j;
+      nodeBlockLists[j].format =
+         FileBlock::Format(vault.getCompress() ? vault.getCompression() : EMPTY_STRING,
+                           vault.getEncrypt() ? vault.getCipher() : EMPTY_STRING,
+                           vault.getPayloadEncoding(),
+                           vault.getHashAlgorithm());
+      blockFormats.insert(nodeBlockLists[j].format);
+
+      auto itVaultFile = mapVaultIdToVaultFile.find(vault.getVaultId());
+
+      if ((nodeBlockFlags[j] == FLAG_BLOCK_SELECTIVE) &&
+          (itVaultFile != mapVaultIdToVaultFile.end())) {
+         // blocks already stored for this file on the node only need to be
+         // sent again if their unique identifier changed
+         if (!loadNodeBlockList((*itVaultFile).second, nodeBlockLists[j])) {
+            Logger::error("unable to retrieve blocks for vault file");
+            nodeBlockFlags[j] = FLAG_BLOCK_ALL;
+         }
+      }
+
+      nodeIndexes.push_back(j);
    }
 
-   string b64FileContents;
-   string localUniqueIdentifier;
-   int numNodeBlocksCopied = 0;
-   const int blockSize = FILE_BLOCK_SIZE;
+   if (nodeIndexes.empty()) {
+      return numNodeBlocksCopied;
+   }
 
-   for (int i = 0; i < numBlockFiles; ++i) {
+   FileChunker chunker(localDirectory.getChunkMode(),
+                       localDirectory.getChunkMinSize(),
+                       localDirectory.getChunkAvgSize(),
+                       localDirectory.getChunkMaxSize());
 
-      int originBlockSize = 0;
-      int padCharCount = 0;
+   if (!chunker.open(filePath)) {
+      Logger::error(string("unable to open file '") +
+                    filePath +
+                    SINGLE_QUOTE);
+      return numNodeBlocksCopied;
+   }
 
-      if (numBlockFiles == 1) {
-         fileContents = EMPTY_STRING;
+   // one compressor for each codec the vaults use
+   BlockCompressorMap blockCompressors;
+   for (const auto& blockFormat : blockFormats) {
+      const string& compression = blockFormat.compression;
+      if (!compression.empty() &&
+          (blockCompressors.find(compression) == blockCompressors.end())) {
+         unique_ptr<BlockCompressor> blockCompressor(new BlockCompressor);
+         if (!blockCompressor->init(compression,
+                                    m_gfsOptions.getCompressionLevel())) {
+            Logger::error(string("unable to initialize compression '") +
+                          compression +
+                          SINGLE_QUOTE);
+            return numNodeBlocksCopied;
+         }
+         blockCompressors[compression] = std::move(blockCompressor);
+      }
+   }
 
-         if (!readFile(filePath, fileContents)) {
-            Logger::error(string("unable to read file '") +
-                          filePath +
+   // blocks are only compressed while they keep compressing, starting from
+   // how earlier files with the same extension went
+   const string extension = CompressionPolicy::extensionForPath(filePath);
+   auto itHistory = m_compressionHistory.find(extension);
+   CompressionPolicy compressionPolicy((itHistory != m_compressionHistory.end()) ?
+                                       (*itHistory).second : CompressionHistory());
+
+   // if we're using encryption, the key is expanded once for the whole
+   // file for each cipher the vaults use
+   BlockCipherMap blockCiphers;
+   for (const auto& blockFormat : blockFormats) {
+      const string& cipher = blockFormat.cipher;
+      if (!cipher.empty() && (blockCiphers.find(cipher) == blockCiphers.end())) {
+         unique_ptr<BlockCipher> blockCipher(new BlockCipher);
+         if (!blockCipher->init(cipher, m_gfsOptions.getEncryptionKey())) {
+            Logger::error(string("unable to initialize cipher '") +
+                          cipher +
                           SINGLE_QUOTE);
             return numNodeBlocksCopied;
          }
+         blockCiphers[cipher] = std::move(blockCipher);
+      }
+   }
 
-         originBlockSize = fileContents.size();
+   SendPipeline pipeline(SEND_TRANSFORM_WORKERS, SEND_QUEUE_DEPTH);
+   pipeline.setNodeQueueDepth(SEND_NODE_QUEUE_DEPTH);
+
+   // each block only goes to the copy_count nodes it is placed on. a node
+   // that no longer holds some of the file's blocks drops their rows (and
+   // its references to them) when the file is finished.
+   const int copyCount = localDirectory.getCopyCount();
+
+   // an erasure coded directory instead sends each of the nodes a block is
+   // placed on one of its fragments
+   unique_ptr<ReedSolomon> reedSolomon;
+   if (isErasureCoded(localDirectory)) {
+      reedSolomon.reset(new ReedSolomon(localDirectory.getDataFragments(),
+                                        localDirectory.getParityFragments()));
+   } else if (localDirectory.getDataFragments() > 0) {
+      Logger::warning("not enough storage nodes for erasure coding, sending whole blocks");
+   }
 
-         if (originBlockSize > 0) {
-            if (encrypt) {
-               padCharCount = 0;
+   int64_t fileSize = 0;
+
+   pipeline.setReader([&](FileBlock& block, bool& endOfFile) {
+      const bool readSuccess =
+         readFileBlock(chunker, filePath, block, endOfFile);
+      fileSize += block.originBlockSize;
+      return readSuccess;
+   });
+
+   // placement keys of the blocks read, to tell a block that moved to
+   // another node from one that left the file
+   mutex placementKeyMutex;
+   set<string> placementKeys;
+
+   pipeline.setTransform([&](FileBlock& block) {
+      const bool transformed = transformFileBlock(block,
+                                                  blockCompressors,
+                                                  compressionPolicy,
+                                                  blockCiphers,
+                                                  blockFormats,
+                                                  reedSolomon.get());
+
+      lock_guard<mutex> lock(placementKeyMutex);
+      placementKeys.insert(block.placementKey);
+      return transformed;
+   });
+
+   pipeline.setPlacementCheck([&](int nodeIndex, const FileBlock& block) {
+      if (block.dataFragments > 0) {
+         return block.fragmentIndexFor(nodeIndex) > -1;
+      }
 
-               const string encryptedFileContents =
-                  Encrypt(fileContents,
-                          encryptionKey,
-                          padCharCount);
+      return m_blockPlacement.isPlacedOn(block.placementKey,
+                                         copyCount,
+                                         nodeIndex);
+   });
+
+   // the block lists are only read by the sender threads while the
+   // pipeline runs; the result handler (this thread) updates them
+   pipeline.setExistenceCheck([&](int nodeIndex,
+                                  const vector<const FileBlock*>& blocks,
+                                  vector<bool>& stored) {
+      checkFileBlocks(m_activeNodes[nodeIndex].getNodeName(),
+                      nodeBlockLists[nodeIndex],
+                      blocks,
+                      stored);
+   }, SEND_BATCH_SIZE);
+
+   pipeline.setSender([&](int nodeIndex,
+                          const FileBlock& block,
+                          bool storedOnNode,
+                          BlockSendResult& result) {
+      sendFileBlock(m_activeNodes[nodeIndex].getNodeName(),
+                    nodeBlockLists[nodeIndex],
+                    block,
+                    storedOnNode,
+                    result);
+   });
+
+   pipeline.setResultHandler([&](const BlockSendResult& result) {
+      if (result.success && !result.carriedForward) {
+         ++numNodeBlocksCopied;
+      }
 
-               b64FileContents =
-                  Encryption::base64Encode((const unsigned char*) encryptedFileContents.data(),
-                                           encryptedFileContents.size());
+      return recordFileBlock(result,
+                             nodeBlockLists[result.nodeIndex],
+                             mapVaultIdToVaultFile,
+                             createTime,
+                             modifyTime);
+   });
+
+   const bool fileRead = pipeline.run(nodeIndexes);
+
+   const CompressionHistory fileHistory = compressionPolicy.getFileHistory();
+   if (fileHistory.blocksProbed > 0) {
+      CompressionHistory& history = m_compressionHistory[extension];
+      CompressionPolicy::mergeHistory(history, fileHistory);
+      if (!m_dataAccess->saveCompressionHistory(extension, history)) {
+         Logger::error("unable to save compression history");
+      }
+   }
 
-               localUniqueIdentifier =
-                  GFS::uniqueIdentifierForString(b64FileContents);
+   // the number of blocks (and the size, if the file changed while it
+   // was being read) is only known once the whole file has been chunked
+   const int numBlocks = pipeline.getBlocksRead();
 
-            } else {
-               b64FileContents =
-                  Encryption::base64Encode((const unsigned char*) fileContents.data(),
-                                           fileContents.size());
+   vector<bool> nodeSent(m_activeNodes.size(), true);
+   for (auto nodeIndex : nodeIndexes) {
+      nodeSent[nodeIndex] = fileRead && !pipeline.hasNodeFailed(nodeIndex);
+   }
 
-               localUniqueIdentifier =
-                  GFS::uniqueIdentifierForString(b64FileContents);
+   // each node keeps the new version only if all of it reached that node,
+   // and only gives up a block that moved once the block's new nodes have it
+   for (auto nodeIndex : nodeIndexes) {
+      NodeBlockList& nodeBlockList = nodeBlockLists[nodeIndex];
+      bool fileSent = nodeSent[nodeIndex];
+
+      if (fileSent &&
+          !haveMovedBlocksPlaced(nodeBlockList,
+                                 copyCount,
+                                 placementKeys,
+                                 nodeSent)) {
+         Logger::info(string("file '") +
+                      filePath +
+                      "' keeps its previous version on node '" +
+                      m_activeNodes[nodeIndex].getNodeName() +
+                      "' until its moved blocks reach their new nodes");
+         fileSent = false;
+      }
+
+      if (fileSent) {
+         // drop the rows for blocks that are no longer part of the file
+         for (auto& it : nodeBlockList.previousBlocks) {
+            VaultFileBlock& previousBlock = it.second;
+            if (nodeBlockList.retainedBlockIds.count(previousBlock.getVaultFileBlockId()) == 0) {
+               if (!m_dataAccess->deleteVaultFileBlock(previousBlock)) {
+                  Logger::error("unable to delete replaced vault file block");
+               }
             }
          }
       } else {
-         ::memset(fileBuffer, 0, sizeof(fileBuffer));
-         const size_t bytesRead = ::fread(fileBuffer, 1, blockSize, f);
-         originBlockSize = bytesRead;
-
-         if (bytesRead < blockSize) {
-            if (i < (numBlockFiles-1)) {
-               Logger::error(string("error reading file '") +
-                             filePath +
-                             SINGLE_QUOTE);
-               ::fclose(f);
-               return numNodeBlocksCopied;
+         // leave the catalog describing the previous (complete) version
+         for (auto& insertedBlock : nodeBlockList.insertedBlocks) {
+            if (!m_dataAccess->deleteVaultFileBlock(insertedBlock)) {
+               Logger::error("unable to delete incomplete vault file block");
             }
          }
+      }
 
-         if (encrypt) {
-            padCharCount = 0;
+      // references are added now, and released once the batch holding
+      // these row changes is committed
+      const string& nodeName = m_activeNodes[nodeIndex].getNodeName();
+      settleNodeReferences(nodeName, nodeBlockList, fileSent);
+
+      auto itVaultFile =
+         mapVaultIdToVaultFile.find(m_mapNodeToVault[nodeName].getVaultId());
+      if (itVaultFile == mapVaultIdToVaultFile.end()) {
+         continue;
+      }
+
+      VaultFile& vaultFile = (*itVaultFile).second;
+
+      if (fileSent) {
+         if ((vaultFile.getBlockCount() != numBlocks) ||
+             (vaultFile.getOriginFileSize() != fileSize) ||
+             !(vaultFile.getModifyTime() == modifyTime) ||
+             vaultFile.getNeedsResend()) {
+            vaultFile.setBlockCount(numBlocks);
+            vaultFile.setOriginFileSize(fileSize);
+            vaultFile.setCreateTime(createTime);
+            vaultFile.setModifyTime(modifyTime);
+            vaultFile.setNeedsResend(false);
+
+            if (!m_dataAccess->updateVaultFile(vaultFile)) {
+               Logger::error("unable to update vault file");
+            }
+         }
+      } else {
+         // the next sync sends the file to this node again
+         if (!nodeSent[nodeIndex]) {
+            Logger::error(string("file '") +
+                          filePath +
+                          "' not fully sent to node '" +
+                          nodeName +
+                          SINGLE_QUOTE);
+         }
 
-            const string encryptedFileContents =
-               Encrypt(fileContents,
-                       encryptionKey,
-                       padCharCount);
+         if (!markVaultFileStale(vaultFile)) {
+            Logger::error("unable to update vault file");
+         }
+      }
+   }
 
-            b64FileContents =
-               Encryption::base64Encode((const unsigned char*) encryptedFileContents.data(),
-                                        encryptedFileContents.size());
+   chunker.close();
 
-            localUniqueIdentifier =
-               GFS::uniqueIdentifierForString(b64FileContents);
+   return numNodeBlocksCopied;
+}
 
-         } else {
-            b64FileContents =
-               Encryption::base64Encode((const unsigned char*) fileBuffer,
-                                        bytesRead);
+//******************************************************************************
+
+bool GFSClient::readFileBlock(FileChunker& chunker,
+                              const string& filePath,
+                              FileBlock& block,
+                              bool& endOfFile) {
+   if (!chunker.nextChunk(block.data, block.blockOffset)) {
+      if (chunker.hasError()) {
+         Logger::error(string("error reading file '") +
+                       filePath +
+                       SINGLE_QUOTE);
+         return false;
+      }
+
+      endOfFile = true;
+      return true;
+   }
+
+   block.originBlockSize = block.data.size();
 
-            localUniqueIdentifier =
-               GFS::uniqueIdentifierForString(b64FileContents);
+   return true;
+}
+
+//******************************************************************************
+
+bool GFSClient::transformFileBlock(FileBlock& block,
+                                   const BlockCompressorMap& blockCompressors,
+                                   CompressionPolicy& compressionPolicy,
+                                   const BlockCipherMap& blockCiphers,
+                                   const set<FileBlock::Format>& blockFormats,
+                                   const ReedSolomon* reedSolomon) {
+   // placement goes by the contents, which are the same for every vault
+   block.placementKey = BlockPlacement::placementKeyForBlock(block.data);
+
+   // one payload for each compression and cipher pair the vaults use (each
+   // empty when not used)
+   typedef pair<string, string> PayloadKey;
+   set<PayloadKey> payloadKeys;
+   set<PayloadKey> textPayloadKeys;
+   set<string> compressions;
+   for (const auto& blockFormat : blockFormats) {
+      payloadKeys.insert(blockFormat.payloadKey());
+      if (!blockFormat.compression.empty()) {
+         compressions.insert(blockFormat.compression);
+      }
+      // only vaults still in text mode need the (33% larger) base64 form
+      if (blockFormat.payloadEncoding == GFS::PAYLOAD_ENCODING_BASE64) {
+         textPayloadKeys.insert(blockFormat.payloadKey());
+      }
+   }
+
+   // compress once for each codec, before encryption (ciphertext does not
+   // compress), unless the probe finds the block is already compressed.
+   // a codec that does not save enough has its payloads made from the
+   // block data itself.
+   map<string, string> compressedData;
+   if (!compressions.empty() && compressionPolicy.shouldCompress(block.data)) {
+      for (const auto& compression : compressions) {
+         string& compressed = compressedData[compression];
+         auto itCompressor = blockCompressors.find(compression);
+         if ((itCompressor == blockCompressors.end()) ||
+             !(*itCompressor).second->compress(block.data, compressed)) {
+            return false;
+         }
+
+         if (!CompressionPolicy::isWorthwhile(block.data.size(),
+                                              compressed.size())) {
+            compressedData.erase(compression);
          }
       }
 
-      if ((originBlockSize == 0) || (b64FileContents.empty())) {
-         // nothing to send
-         return numNodeBlocksCopied;
+      compressionPolicy.recordOutcome(!compressedData.empty());
+   }
+
+   // payloads made from each (compressed) form, so the last one can take
+   // the bytes instead of copying them
+   map<string, int> sourceUses;
+   for (const auto& payloadKey : payloadKeys) {
+      const string& compression = payloadKey.first;
+      if (compressedData.find(compression) != compressedData.end()) {
+         ++sourceUses[compression];
+      } else {
+         ++sourceUses[EMPTY_STRING];
       }
+   }
 
-      // for each node
-      auto itNodeList = m_activeNodes.cbegin();
-      const auto itNodeListEnd = m_activeNodes.cend();
+   for (const auto& payloadKey : payloadKeys) {
+      const string& cipher = payloadKey.second;
+      FileBlock::Payload& payload = block.payloads[payloadKey];
+      auto itCompressed = compressedData.find(payloadKey.first);
+      if (itCompressed != compressedData.end()) {
+         payload.compression = payloadKey.first;
+      }
+      string& source = (itCompressed != compressedData.end()) ?
+         (*itCompressed).second : block.data;
+      const bool lastUse = (--sourceUses[payload.compression] == 0);
+
+      if (cipher.empty()) {
+         // the source bytes are only copied if a cipher still needs them
+         if (lastUse) {
+            payload.bytes.swap(source);
+         } else {
+            payload.bytes = source;
+         }
+      } else {
+         auto itCipher = blockCiphers.find(cipher);
+         if ((itCipher == blockCiphers.end()) ||
+             !(*itCipher).second->encrypt(source,
+                                          payload.bytes,
+                                          payload.padCharCount)) {
+            return false;
+         }
+      }
 
-      for (int j = 0; itNodeList != itNodeListEnd; ++itNodeList, ++j) {
-         const char nodeFlag = nodeBlockFlags[j];
-         bool addBlockToNode = false;
+      if (payload.bytes.empty()) {
+         return false;
+      }
 
-         if (nodeFlag == FLAG_BLOCK_NONE) {
-            continue;
-         } else if (nodeFlag == FLAG_BLOCK_ALL) {
-            // all blocks are being added for this node, no
-            // comparisons/checks are needed
-            addBlockToNode = true;
+      // fragments are encoded one by one once they are split
+      if ((reedSolomon == nullptr) &&
+          (textPayloadKeys.find(payloadKey) != textPayloadKeys.end())) {
+         Encryption::base64Encode((const unsigned char*) payload.bytes.data(),
+                                  payload.bytes.size(),
+                                  payload.text);
+      }
+   }
+
+   if (reedSolomon != nullptr) {
+      // fragment i goes to the i-th node the block is placed on. the
+      // payloads are only kept as fragments.
+      block.dataFragments = reedSolomon->getDataFragments();
+      block.parityFragments = reedSolomon->getParityFragments();
+      m_blockPlacement.nodesForBlock(block.placementKey,
+                                     block.dataFragments + block.parityFragments,
+                                     block.fragmentNodes);
+
+      for (const auto& payloadKey : payloadKeys) {
+         FileBlock::Payload& payload = block.payloads[payloadKey];
+         payload.payloadSize = payload.bytes.size();
+         reedSolomon->encode(payload.bytes, payload.fragments);
+
+         if (textPayloadKeys.find(payloadKey) != textPayloadKeys.end()) {
+            payload.fragmentTexts.resize(payload.fragments.size());
+            for (size_t i = 0; i < payload.fragments.size(); ++i) {
+               const string& fragment = payload.fragments[i];
+               Encryption::base64Encode((const unsigned char*) fragment.data(),
+                                        fragment.size(),
+                                        payload.fragmentTexts[i]);
+            }
          }
 
-         const StorageNode& node = *itNodeList;
-         const string& nodeName = node.getNodeName();
+         string().swap(payload.bytes);
+      }
+   }
 
-         auto itVault = m_mapNodeToVault.find(nodeName);
-         if (itVault == m_mapNodeToVault.end()) {
-            nodeBlockFlags[j] = FLAG_BLOCK_NONE;
-            continue;
+   // vaults created before the defaults changed keep their cipher, encoding
+   // and algorithm, so a block may need an identifier for each combination
+   for (const auto& blockFormat : blockFormats) {
+      if (block.dataFragments > 0) {
+         vector<string>& identifiers = block.fragmentIdentifiers[blockFormat];
+         const int numFragments = block.fragmentNodes.size();
+         for (int i = 0; i < numFragments; ++i) {
+            identifiers.push_back(
+               GFS::uniqueIdentifierForString(block.payloadFor(blockFormat, i),
+                                              blockFormat.hashAlgorithm));
          }
+      } else {
+         block.uniqueIdentifiers[blockFormat] =
+            GFS::uniqueIdentifierForString(block.payloadFor(blockFormat, -1),
+                                           blockFormat.hashAlgorithm);
+      }
+   }
 
-         Vault& vault = (*itVault).second;
+   // the source bytes are no longer needed once the payloads exist
+   string().swap(block.data);
 
-         // determine if this block exists on storage node
+   return true;
+}
 
-         if (nodeFlag == FLAG_BLOCK_SELECTIVE) {
-            // if the unique identifier on this block matches what's last
-            // stored on this node, then we don't need to send it
-            // (i.e., it's still current)
-            //TODO: check if unique identifier of file block matches what may
-            // be stored on the node vault
-            bool uniqueIdentifierMatches = false;
+//******************************************************************************
 
-            if (uniqueIdentifierMatches) {
-               addBlockToNode = false;
-            } else {
-               addBlockToNode = true;
-            }
+bool GFSClient::loadNodeBlockList(const VaultFile& vaultFile,
+                                  NodeBlockList& nodeBlockList) {
+   vector<VaultFileBlock> listFileBlocks;
+
+   if (!m_dataAccess->getBlocksForVaultFile(vaultFile.getVaultFileId(),
+                                            listFileBlocks)) {
+      return false;
+   }
+
+   for (const auto& vaultFileBlock : listFileBlocks) {
+      const string& uniqueIdentifier = vaultFileBlock.getUniqueIdentifier();
+      nodeBlockList.previousBlocks[vaultFileBlock.getBlockSequenceNumber()] =
+         vaultFileBlock;
+
+      if (nodeBlockList.storedBlocks.find(uniqueIdentifier) ==
+          nodeBlockList.storedBlocks.end()) {
+         nodeBlockList.storedBlocks[uniqueIdentifier] = vaultFileBlock;
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void GFSClient::checkFileBlocks(const string& nodeName,
+                                const NodeBlockList& nodeBlockList,
+                                const vector<const FileBlock*>& blocks,
+                                vector<bool>& stored) {
+   stored.assign(blocks.size(), false);
+
+   // blocks the file already has on the node are carried forward without
+   // asking, so leave them out
+   vector<string> identifiers;
+   vector<size_t> positions;
+   const size_t numBlocks = blocks.size();
+
+   for (size_t i = 0; i < numBlocks; ++i) {
+      const int fragmentIndex =
+         blocks[i]->fragmentIndexFor(nodeBlockList.nodeIndex);
+      const string& uniqueIdentifier =
+         blocks[i]->uniqueIdentifierFor(nodeBlockList.format, fragmentIndex);
+      if (!uniqueIdentifier.empty() &&
+          (nodeBlockList.storedBlocks.find(uniqueIdentifier) ==
+           nodeBlockList.storedBlocks.end())) {
+         identifiers.push_back(uniqueIdentifier);
+         positions.push_back(i);
+      }
+   }
+
+   const size_t maxBatchSize = GFSMessageCommands::MAX_FILE_BATCH_SIZE;
+
+   for (size_t start = 0; start < identifiers.size(); start += maxBatchSize) {
+      const size_t end = min(start + maxBatchSize, identifiers.size());
+      const vector<string> batchIdentifiers(identifiers.begin() + start,
+                                            identifiers.begin() + end);
+
+      Message message(GFSMessageCommands::MSG_FILE_HAS_BATCH,
+                      MessageType::MessageTypeText);
+      GFSMessage::setFileList(message, batchIdentifiers);
+
+      Message response;
+      bool msgSent;
+
+      try {
+         msgSent = message.send(nodeName, response);
+      } catch (const BasicException& be) {
+         msgSent = false;
+      }
+
+      // if the node can't answer (e.g., it predates the request), the
+      // blocks are just sent in full
+      vector<bool> batchStored;
+      if (!msgSent ||
+          !GFSMessage::getRC(response) ||
+          !GFSMessage::getFileBitmap(response,
+                                     batchIdentifiers.size(),
+                                     batchStored)) {
+         return;
+      }
+
+      for (size_t i = start; i < end; ++i) {
+         stored[positions[i]] = batchStored[i - start];
+      }
+   }
+}
+
+//******************************************************************************
+
+void GFSClient::sendFileBlock(const string& nodeName,
+                              const NodeBlockList& nodeBlockList,
+                              const FileBlock& block,
+                              bool storedOnNode,
+                              BlockSendResult& result) {
+   const int fragmentIndex = block.fragmentIndexFor(nodeBlockList.nodeIndex);
+   const string& uniqueIdentifier =
+      block.uniqueIdentifierFor(nodeBlockList.format, fragmentIndex);
+
+   // if the unique identifier of this block matches a block already stored
+   // for the file on this node, then we don't need to send it
+   // (i.e., it's still current)
+   auto itStored = nodeBlockList.storedBlocks.find(uniqueIdentifier);
+   if (itStored != nodeBlockList.storedBlocks.end()) {
+      const VaultFileBlock& storedBlock = (*itStored).second;
+      result.success = true;
+      result.carriedForward = true;
+      result.nodeUniqueIdentifier = storedBlock.getUniqueIdentifier();
+      result.nodeDirectory = storedBlock.getNodeDirectory();
+      result.nodeFile = storedBlock.getNodeFile();
+      return;
+   }
+
+   if (storedOnNode) {
+      // the node has it for some other file; only add a reference
+      Message refMessage(GFSMessageCommands::MSG_FILE_ADD_REF,
+                         MessageType::MessageTypeText);
+      GFSMessage::setFile(refMessage, uniqueIdentifier);
+      GFSMessage::setUniqueIdentifier(refMessage, uniqueIdentifier);
+
+      sendBlockMessage(nodeName, refMessage, result);
+      if (result.success) {
+         return;
+      }
+
+      // deleted since the check, so send it after all
+      result.error.clear();
+   }
+
+   Message message(GFSMessageCommands::MSG_FILE_ADD, MessageType::MessageTypeText);
+   // raw payloads are checked against the stored file size by the node
+   const string& payload = block.payloadFor(nodeBlockList.format, fragmentIndex);
+   message.setTextPayload(payload);
+   GFSMessage::setStoredFileSize(message, payload.size());
+   GFSMessage::setPayloadEncoding(message, nodeBlockList.format.payloadEncoding);
+
+   GFSMessage::setFile(message, uniqueIdentifier);
+   GFSMessage::setUniqueIdentifier(message, uniqueIdentifier);
+   GFSMessage::setHashAlgorithm(message, nodeBlockList.format.hashAlgorithm);
+
+   sendBlockMessage(nodeName, message, result);
+}
+
+//******************************************************************************
+
+void GFSClient::sendBlockMessage(const string& nodeName,
+                                 Message& message,
+                                 BlockSendResult& result) {
+   Message response;
+   bool msgSent;
+
+   try {
+      msgSent = message.send(nodeName, response);
+   } catch (const BasicException& be) {
+      msgSent = false;
+   }
+
+   if (!msgSent) {
+      result.error = string("unable to send message to service '") +
+                     nodeName +
+                     SINGLE_QUOTE;
+      return;
+   }
+
+   if (!GFSMessage::getRC(response)) {
+      if (GFSMessage::hasError(response)) {
+         result.error = string("error from node: '") +
+                        GFSMessage::getError(response) +
+                        SINGLE_QUOTE;
+      }
+      return;
+   }
+
+   result.success = true;
+
+   if (GFSMessage::hasUniqueIdentifier(response)) {
+      result.nodeUniqueIdentifier = GFSMessage::getUniqueIdentifier(response);
+   }
+
+   if (GFSMessage::hasDirectory(response) && GFSMessage::hasFile(response)) {
+      result.nodeDirectory = GFSMessage::getDirectory(response);
+      result.nodeFile = GFSMessage::getFile(response);
+   }
+}
+
+//******************************************************************************
+
+bool GFSClient::recordFileBlock(const BlockSendResult& result,
+                                NodeBlockList& nodeBlockList,
+                                map<int, VaultFile>& mapVaultIdToVaultFile,
+                                chaudiere::DateTime& createTime,
+                                chaudiere::DateTime& modifyTime) {
+   if (!result.success) {
+      if (result.error.empty()) {
+         Logger::error("request failed, no error provided by node");
+         return true;
+      }
+
+      Logger::error(result.error);
+      return false;
+   }
+
+   if (result.nodeUniqueIdentifier.empty()) {
+      return true;
+   }
+
+   const FileBlock& block = *result.block;
+   const int fragmentIndex = block.fragmentIndexFor(result.nodeIndex);
+   const string& uniqueIdentifier =
+      block.uniqueIdentifierFor(nodeBlockList.format, fragmentIndex);
+
+   if (result.carriedForward) {
+      // an unchanged block in the same position keeps its existing row
+      auto itPrevious =
+         nodeBlockList.previousBlocks.find(block.blockSequenceNumber);
+      if (itPrevious != nodeBlockList.previousBlocks.end()) {
+         const VaultFileBlock& previousBlock = (*itPrevious).second;
+         if ((previousBlock.getUniqueIdentifier() == uniqueIdentifier) &&
+             (previousBlock.getFragmentIndex() == fragmentIndex) &&
+             (previousBlock.getBlockOffset() == block.blockOffset) &&
+             (previousBlock.getPadCharCount() ==
+              block.padCharCountFor(nodeBlockList.format))) {
+            nodeBlockList.retainedBlockIds.insert(previousBlock.getVaultFileBlockId());
+            return true;
          }
+      }
+   } else {
+      // the node counted a reference for the block
+      ++nodeBlockList.addedReferences[uniqueIdentifier];
+   }
 
-         if (addBlockToNode) {
-            Message message(GFSMessageCommands::MSG_FILE_ADD, MessageType::MessageTypeText);
-            message.setTextPayload(b64FileContents);
-            const int storedBlockSize = b64FileContents.size();
-            GFSMessage::setStoredFileSize(message, storedBlockSize);
+   if (result.nodeUniqueIdentifier != uniqueIdentifier) {
+      Logger::error("local unique identifier mismatch with node unique identifier");
+      ::printf("local identifier='%s'\n", uniqueIdentifier.c_str());
+      ::printf("node identifier='%s'\n", result.nodeUniqueIdentifier.c_str());
+      return false;
+   }
 
-            GFSMessage::setFile(message, localUniqueIdentifier);
-            GFSMessage::setUniqueIdentifier(message, localUniqueIdentifier);
+   if (result.nodeDirectory.empty() || result.nodeFile.empty()) {
+      Logger::error("addFile - response missing file or directory");
+      return true;
+   }
 
-            Message response;
-            bool msgSent;
+   const string& nodeName = m_activeNodes[result.nodeIndex].getNodeName();
+   const Vault& vault = m_mapNodeToVault[nodeName];
 
-            try {
-               msgSent = message.send(nodeName, response);
-            } catch (const BasicException& be) {
-               msgSent = false;
-            }
+   auto it = mapVaultIdToVaultFile.find(vault.getVaultId());
+   if (it == mapVaultIdToVaultFile.cend()) {
+      Logger::error("unable to find vault file using vault id");
+      return true;
+   }
 
-            if (msgSent) {
-               if (GFSMessage::getRC(response)) {
-                  ++numNodeBlocksCopied;
-
-                  if (GFSMessage::hasUniqueIdentifier(response)) {
-                     const string& nodeUniqueIdentifier =
-                        GFSMessage::getUniqueIdentifier(response);
-
-                     if (nodeUniqueIdentifier == localUniqueIdentifier) {
-                        if (GFSMessage::hasDirectory(response) &&
-                            GFSMessage::hasFile(response)) {
-                           const string& directory =
-                              GFSMessage::getDirectory(response);
-                           const string& file =
-                              GFSMessage::getFile(response);
-
-                           const int vaultId = vault.getVaultId();
-                           auto it = mapVaultIdToVaultFile.find(vaultId);
-                           if (it != mapVaultIdToVaultFile.cend()) {
-                              const VaultFile& vaultFile = (*it).second;
-                              const int vaultFileId = vaultFile.getVaultFileId();
-
-                              chaudiere::DateTime storedTime;
-
-                              VaultFileBlock vaultFileBlock;
-                              vaultFileBlock.setCreateTime(createTime);
-                              vaultFileBlock.setModifyTime(modifyTime);
-                              vaultFileBlock.setStoredTime(storedTime);
-                              vaultFileBlock.setUniqueIdentifier(nodeUniqueIdentifier);
-                              vaultFileBlock.setNodeDirectory(directory);
-                              vaultFileBlock.setNodeFile(file);
-                              vaultFileBlock.setVaultFileId(vaultFileId);
-                              vaultFileBlock.setOriginFileSize(originBlockSize);
-                              vaultFileBlock.setStoredFileSize(storedBlockSize);
-                              vaultFileBlock.setBlockSequenceNumber(i+1);
-                              vaultFileBlock.setPadCharCount(padCharCount);
-
-                              if (m_dataAccess->insertVaultFileBlock(vaultFileBlock)) {
-                                 //Logger::debug("inserted vault file block");
-                              } else {
-                                 Logger::error("unable to insert vault file block");
-                                 return numNodeBlocksCopied;
-                              }
-                           } else {
-                              Logger::error("unable to find vault file using vault id");
-                           }
-                        } else {
-                           Logger::error("addFile - response missing file or directory");
-                        }
-                     } else {
-                        Logger::error("local unique identifier mismatch with node unique identifier");
-                        ::printf("local identifier='%s'\n", localUniqueIdentifier.c_str());
-                        ::printf("node identifier='%s'\n", nodeUniqueIdentifier.c_str());
-                        return numNodeBlocksCopied;
-                     }
-                  }
-               } else {
-                  if (GFSMessage::hasError(response)) {
-                     const string& error = GFSMessage::getError(response);
-                     Logger::error(string("error from node: '") +
-                                   error +
-                                   SINGLE_QUOTE);
-                     return numNodeBlocksCopied;
-                  } else {
-                     Logger::error("request failed, no error provided by node");
-                  }
-               }
-            } else {
-               Logger::error(string("unable to send message to service '") +
-                             nodeName +
-                             SINGLE_QUOTE);
-               return numNodeBlocksCopied;
-            }
-         } // if addBlockToNode
-      } // for each node
-   } // for each block in file
+   const VaultFile& vaultFile = (*it).second;
+   chaudiere::DateTime storedTime;
+
+   // blocks finish out of order; the sequence number comes from the reader
+   VaultFileBlock vaultFileBlock;
+   vaultFileBlock.setCreateTime(createTime);
+   vaultFileBlock.setModifyTime(modifyTime);
+   vaultFileBlock.setStoredTime(storedTime);
+   vaultFileBlock.setUniqueIdentifier(result.nodeUniqueIdentifier);
+   vaultFileBlock.setNodeDirectory(result.nodeDirectory);
+   vaultFileBlock.setNodeFile(result.nodeFile);
+   vaultFileBlock.setVaultFileId(vaultFile.getVaultFileId());
+   vaultFileBlock.setOriginFileSize(block.originBlockSize);
+   vaultFileBlock.setStoredFileSize(
+      block.payloadFor(nodeBlockList.format, fragmentIndex).size());
+   vaultFileBlock.setBlockSequenceNumber(block.blockSequenceNumber);
+   vaultFileBlock.setBlockOffset(block.blockOffset);
+   vaultFileBlock.setPadCharCount(
+      block.padCharCountFor(nodeBlockList.format));
+   vaultFileBlock.setCompression(
+      block.compressionFor(nodeBlockList.format));
+   vaultFileBlock.setPlacementKey(block.placementKey);
+
+   if (fragmentIndex > -1) {
+      vaultFileBlock.setFragmentIndex(fragmentIndex);
+      vaultFileBlock.setErasureCoding(block.dataFragments,
+                                      block.parityFragments);
+      vaultFileBlock.setPayloadSize(block.payloadSizeFor(nodeBlockList.format));
+   }
 
-   if (f != nullptr) {
-      ::fclose(f);
+   if (!m_dataAccess->insertVaultFileBlock(vaultFileBlock)) {
+      Logger::error("unable to insert vault file block");
+      return false;
    }
 
-   return numNodeBlocksCopied;
+   nodeBlockList.insertedBlocks.push_back(vaultFileBlock);
+
+   return true;
+}
+
+//******************************************************************************
+
+bool GFSClient::haveMovedBlocksPlaced(const NodeBlockList& nodeBlockList,
+                                      int copyCount,
+                                      const set<string>& placementKeys,
+                                      const vector<bool>& nodeSent) {
+   const int numNodes = nodeSent.size();
+   vector<int> placedNodes;
+
+   for (const auto& it : nodeBlockList.previousBlocks) {
+      const VaultFileBlock& previousBlock = it.second;
+      const string& placementKey = previousBlock.getPlacementKey();
+
+      // blocks that stay, and blocks no longer in the file, have nowhere
+      // else to be
+      if ((nodeBlockList.retainedBlockIds.count(previousBlock.getVaultFileBlockId()) > 0) ||
+          (placementKeys.find(placementKey) == placementKeys.end())) {
+         continue;
+      }
+
+      const int numPlacedNodes = (previousBlock.getFragmentIndex() > -1) ?
+         (previousBlock.getDataFragments() + previousBlock.getParityFragments()) :
+         copyCount;
+      m_blockPlacement.nodesForBlock(placementKey, numPlacedNodes, placedNodes);
+
+      for (auto placedNode : placedNodes) {
+         if ((placedNode > -1) && (placedNode < numNodes) && !nodeSent[placedNode]) {
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void GFSClient::settleNodeReferences(const string& nodeName,
+                                     const NodeBlockList& nodeBlockList,
+                                     bool keepNewVersion) {
+   // references held less references needed, by identifier
+   map<string, int> surplus;
+   map<string, const VaultFileBlock*> nodeBlocks;
+
+   for (const auto& it : nodeBlockList.previousBlocks) {
+      const VaultFileBlock& previousBlock = it.second;
+      const string& uniqueIdentifier = previousBlock.getUniqueIdentifier();
+      nodeBlocks[uniqueIdentifier] = &previousBlock;
+
+      if (keepNewVersion &&
+          (nodeBlockList.retainedBlockIds.count(previousBlock.getVaultFileBlockId()) == 0)) {
+         ++surplus[uniqueIdentifier];
+      }
+   }
+
+   for (const auto& insertedBlock : nodeBlockList.insertedBlocks) {
+      const string& uniqueIdentifier = insertedBlock.getUniqueIdentifier();
+      nodeBlocks[uniqueIdentifier] = &insertedBlock;
+
+      if (keepNewVersion) {
+         --surplus[uniqueIdentifier];
+      }
+   }
+
+   for (const auto& it : nodeBlockList.addedReferences) {
+      surplus[it.first] += it.second;
+   }
+
+   for (const auto& it : surplus) {
+      auto itBlock = nodeBlocks.find(it.first);
+      if ((it.second == 0) || (itBlock == nodeBlocks.end())) {
+         continue;
+      }
+
+      const VaultFileBlock& nodeBlock = *((*itBlock).second);
+
+      // a block that is now in the file more often than before was carried
+      // forward without references for the extra copies
+      for (int i = it.second; i < 0; ++i) {
+         Message message(GFSMessageCommands::MSG_FILE_ADD_REF,
+                         MessageType::MessageTypeText);
+         GFSMessage::setFile(message, nodeBlock.getNodeFile());
+         GFSMessage::setUniqueIdentifier(message, it.first);
+
+         BlockSendResult result;
+         sendBlockMessage(nodeName, message, result);
+         if (!result.success) {
+            Logger::error(string("unable to add reference to block '") +
+                          it.first +
+                          "' on node '" +
+                          nodeName +
+                          SINGLE_QUOTE);
+         }
+      }
+
+      if (it.second < 1) {
+         continue;
+      }
+
+      // a release can't be undone, so it waits until the dropped rows are
+      // committed (and synced); if they come back, the release is skipped
+      const string uniqueIdentifier = it.first;
+      const string nodeDirectory = nodeBlock.getNodeDirectory();
+      const string nodeFile = nodeBlock.getNodeFile();
+      const int numReferences = it.second;
+      const SyncTransaction::CommitAction release =
+         [this, nodeName, uniqueIdentifier, nodeDirectory, nodeFile, numReferences]() {
+            releaseNodeBlock(nodeName,
+                             uniqueIdentifier,
+                             nodeDirectory,
+                             nodeFile,
+                             numReferences);
+         };
+
+      if (m_syncTransaction != nullptr) {
+         m_syncTransaction->afterCommit(release);
+      } else if (m_dataAccess->syncCommitted()) {
+         release();
+      } else {
+         Logger::error("unable to sync catalog changes, block left on node");
+      }
+   }
+}
+
+//******************************************************************************
+
+void GFSClient::releaseNodeBlock(const string& nodeName,
+                                 const string& uniqueIdentifier,
+                                 const string& nodeDirectory,
+                                 const string& nodeFile,
+                                 int numReferences) {
+   // the node removes the block once no file refers to it
+   for (int i = 0; i < numReferences; ++i) {
+      Message message(GFSMessageCommands::MSG_FILE_DELETE,
+                      MessageType::MessageTypeText);
+      GFSMessage::setDirectory(message, nodeDirectory);
+      GFSMessage::setFile(message, nodeFile);
+
+      BlockSendResult result;
+      sendBlockMessage(nodeName, message, result);
+      if (!result.success) {
+         Logger::error(string("unable to release block '") +
+                       uniqueIdentifier +
+                       "' on node '" +
+                       nodeName +
+                       SINGLE_QUOTE);
+         break;
+      }
+   }
 }
 
 //******************************************************************************
@@ -582,262 +1273,281 @@ void GFSClient::scanProcessFile(const string& dirPath,
                                      fileName.c_str());
    const string fullFilePath(path);
 
-   if (!m_previewOnly) {
-      Logger::debug(fullFilePath);
-   }
-
    if (pathLength >= PATH_MAX) {
       ::fprintf(stderr, "Path length too long: %s\n", path);
    } else {
       struct stat st;
       const int rc = ::stat(path, &st);
       if (rc == 0) {
-         const string relativeFilePath =
-            fullFilePath.substr(m_localDirectoryPathLength);
+         scanProcessFile(fullFilePath, fileName, st, localDirectory);
+      } else {
+         Logger::error(string("unable to stat file '") +
+                       path +
+                       SINGLE_QUOTE);
+      }
+   }
+}
+
+//******************************************************************************
+
+void GFSClient::scanProcessFile(const string& fullFilePath,
+                                const string& fileName,
+                                const struct stat& st,
+                                const LocalDirectory& localDirectory) {
+   if (!m_previewOnly) {
+      Logger::debug(fullFilePath);
+   }
 
-         const off_t fileSize = st.st_size;
-         chaudiere::DateTime createTime;
-         chaudiere::DateTime modifyTime;
-         FilePermissions userPermissions;
-         FilePermissions groupPermissions;
-         FilePermissions otherPermissions;
+   const string relativeFilePath =
+      fullFilePath.substr(m_localDirectoryPathLength);
 
-         const mode_t fileMode = st.st_mode;
+   const off_t fileSize = st.st_size;
+   chaudiere::DateTime createTime;
+   chaudiere::DateTime modifyTime;
+   FilePermissions userPermissions;
+   FilePermissions groupPermissions;
+   FilePermissions otherPermissions;
 
-         // --------  user --------
-         // user read
-         if ((fileMode & S_IRUSR) == S_IRUSR) {
-            userPermissions.setReadPermission();
-         }
+   const mode_t fileMode = st.st_mode;
 
-         // user write
-         if ((fileMode & S_IWUSR) == S_IWUSR) {
-            userPermissions.setWritePermission();
-         }
+   // --------  user --------
+   // user read
+   if ((fileMode & S_IRUSR) == S_IRUSR) {
+      userPermissions.setReadPermission();
+   }
 
-         // user execute
-         if ((fileMode & S_IXUSR) == S_IXUSR) {
-            userPermissions.setExecutePermission();
-         }
+   // user write
+   if ((fileMode & S_IWUSR) == S_IWUSR) {
+      userPermissions.setWritePermission();
+   }
 
-         // --------  group --------
-         // group read
-         if ((fileMode & S_IRGRP) == S_IRGRP) {
-            groupPermissions.setReadPermission();
-         }
+   // user execute
+   if ((fileMode & S_IXUSR) == S_IXUSR) {
+      userPermissions.setExecutePermission();
+   }
 
-         // group write
-         if ((fileMode & S_IWGRP) == S_IWGRP) {
-            groupPermissions.setWritePermission();
-         }
+   // --------  group --------
+   // group read
+   if ((fileMode & S_IRGRP) == S_IRGRP) {
+      groupPermissions.setReadPermission();
+   }
 
-         // group execute
-         if ((fileMode & S_IXGRP) == S_IXGRP) {
-            groupPermissions.setExecutePermission();
-         }
+   // group write
+   if ((fileMode & S_IWGRP) == S_IWGRP) {
+      groupPermissions.setWritePermission();
+   }
 
-         // --------  other --------
-         // other read
-         if ((fileMode & S_IROTH) == S_IROTH) {
-            otherPermissions.setReadPermission();
-         }
+   // group execute
+   if ((fileMode & S_IXGRP) == S_IXGRP) {
+      groupPermissions.setExecutePermission();
+   }
 
-         // other write
-         if ((fileMode & S_IWOTH) == S_IWOTH) {
-            otherPermissions.setWritePermission();
-         }
+   // --------  other --------
+   // other read
+   if ((fileMode & S_IROTH) == S_IROTH) {
+      otherPermissions.setReadPermission();
+   }
 
-         // other execute
-         if ((fileMode & S_IXOTH) == S_IXOTH) {
-            otherPermissions.setExecutePermission();
-         }
+   // other write
+   if ((fileMode & S_IWOTH) == S_IWOTH) {
+      otherPermissions.setWritePermission();
+   }
+
+   // other execute
+   if ((fileMode & S_IXOTH) == S_IXOTH) {
+      otherPermissions.setExecutePermission();
+   }
 
 
 #ifdef __linux__
-         time_t ctimeValue = st.st_ctime;
-         time_t mtimeValue = st.st_mtime;
-         TimeTToDateTime(ctimeValue, createTime);
-         TimeTToDateTime(mtimeValue, modifyTime);
+   time_t ctimeValue = st.st_ctime;
+   time_t mtimeValue = st.st_mtime;
+   TimeTToDateTime(ctimeValue, createTime);
+   TimeTToDateTime(mtimeValue, modifyTime);
 #else
-         struct timespec ctimespec = st.st_ctimespec;
-         struct timespec mtimespec = st.st_mtimespec;
-         TimeSpecToDateTime(ctimespec, createTime);
-         TimeSpecToDateTime(mtimespec, modifyTime);
+   struct timespec ctimespec = st.st_ctimespec;
+   struct timespec mtimespec = st.st_mtimespec;
+   TimeSpecToDateTime(ctimespec, createTime);
+   TimeSpecToDateTime(mtimespec, modifyTime);
 #endif
 
-         chaudiere::DateTime scanTime;
-
-         const int blockSize = FILE_BLOCK_SIZE;
-         int numBlockFiles;
+   chaudiere::DateTime scanTime;
 
-         bool existingLocalFile = false;
+   // estimated here; sendFile records the actual count once the file has
+   // been chunked (content-defined chunks vary in size)
+   const int blockSize = localDirectory.getChunkAvgSize();
+   int numBlockFiles;
 
-         // have we seen this file before?
-         LocalFile localFile;
-         if (!m_dataAccess->getLocalFile(m_localDirectoryId,
-                                         relativeFilePath,
-                                         localFile)) {
+   bool existingLocalFile = false;
 
-            if (m_previewOnly) {
-               Logger::debug("new file");
-            } else {
-               // we have NOT seen this file before (it's new)
-               localFile.setLocalDirectoryId(m_localDirectoryId);
-               localFile.setFilePath(relativeFilePath);
-               localFile.setCreateTime(createTime);
-               localFile.setModifyTime(modifyTime);
-               localFile.setScanTime(scanTime);
-
-               if (!m_dataAccess->insertLocalFile(localFile)) {
-                  Logger::error("unable to insert local file");
-                  return;
-               }
-            }
-         } else {
-            // we have seen this file before
-            existingLocalFile = true;
+   // have we seen this file before?
+   LocalFile localFile;
+   if (!m_dataAccess->getLocalFile(m_localDirectoryId,
+                                   relativeFilePath,
+                                   localFile)) {
 
-            if (!m_previewOnly) {
-               Logger::debug("existing file");
-
-               // update the scan time
-               localFile.setScanTime(scanTime);
-               m_dataAccess->updateLocalFile(localFile);
-            }
+      if (m_previewOnly) {
+         Logger::debug("new file");
+      } else {
+         // we have NOT seen this file before (it's new)
+         localFile.setLocalDirectoryId(m_localDirectoryId);
+         localFile.setFilePath(relativeFilePath);
+         localFile.setCreateTime(createTime);
+         localFile.setModifyTime(modifyTime);
+         localFile.setScanTime(scanTime);
+
+         if (!m_dataAccess->insertLocalFile(localFile)) {
+            Logger::error("unable to insert local file");
+            return;
          }
+      }
+   } else {
+      // we have seen this file before
+      existingLocalFile = true;
 
-         const int localFileId = localFile.getLocalFileId();
+      if (!m_previewOnly) {
+         Logger::debug("existing file");
 
-         if (fileSize <= blockSize) {
-            numBlockFiles = 1;
-         } else {
-            numBlockFiles = fileSize / blockSize;
-            if ((fileSize % blockSize) > 0) {
-               ++numBlockFiles;
-            }
-         }
+         // update the scan time
+         localFile.setScanTime(scanTime);
+         m_dataAccess->updateLocalFile(localFile);
+      }
+   }
 
-         map<int, VaultFile> mapVaultIdToVaultFile;
-         string nodeBlockFlags(m_activeNodes.size(), FLAG_BLOCK_SELECTIVE);
+   const int localFileId = localFile.getLocalFileId();
 
-         // for each node
-         auto itNodeList = m_activeNodes.cbegin();
-         const auto itNodeListEnd = m_activeNodes.cend();
+   if (fileSize <= blockSize) {
+      numBlockFiles = 1;
+   } else {
+      numBlockFiles = fileSize / blockSize;
+      if ((fileSize % blockSize) > 0) {
+         ++numBlockFiles;
+      }
+   }
 
-         for (int j = 0; itNodeList != itNodeListEnd; ++itNodeList, ++j) {
-            const StorageNode& node = *itNodeList;
-            const string& nodeName = node.getNodeName();
+   map<int, VaultFile> mapVaultIdToVaultFile;
+   string nodeBlockFlags(m_activeNodes.size(), FLAG_BLOCK_SELECTIVE);
 
-            auto itVault = m_mapNodeToVault.find(nodeName);
-            if (itVault == m_mapNodeToVault.end()) {
-               nodeBlockFlags[j] = FLAG_BLOCK_NONE;
-               continue;
-            }
+   // for each node
+   auto itNodeList = m_activeNodes.cbegin();
+   const auto itNodeListEnd = m_activeNodes.cend();
 
-            Vault& vault = (*itVault).second;
-            const int vaultId = vault.getVaultId();
+   for (int j = 0; itNodeList != itNodeListEnd; ++itNodeList, ++j) {
+      const StorageNode& node = *itNodeList;
+      const string& nodeName = node.getNodeName();
 
-            VaultFile vaultFile;
-            bool addVaultFileToMap = true;
-
-            if (!m_dataAccess->getVaultFile(vaultId,
-                                            localFileId,
-                                            vaultFile)) {
-
-               vaultFile.setLocalFileId(localFileId);
-               vaultFile.setVaultId(vaultId);
-               vaultFile.setCreateTime(createTime);
-               vaultFile.setModifyTime(modifyTime);
-               vaultFile.setOriginFileSize(fileSize);
-               vaultFile.setBlockCount(numBlockFiles);
-               vaultFile.setUserPermissions(userPermissions);
-               vaultFile.setGroupPermissions(groupPermissions);
-               vaultFile.setOtherPermissions(otherPermissions);
-
-               if (m_previewOnly) {
-                  Logger::debug("file needs to be added to vault");
-               } else {
-                  if (m_dataAccess->insertVaultFile(vaultFile)) {
-                     nodeBlockFlags[j] = FLAG_BLOCK_ALL;
-                  } else {
-                     addVaultFileToMap = false;
-                     nodeBlockFlags[j] = FLAG_BLOCK_NONE;
-                     Logger::error("unable to create vault file");
-                  }
-               }
-            } else {
-               // existing vault file
+      auto itVault = m_mapNodeToVault.find(nodeName);
+      if (itVault == m_mapNodeToVault.end()) {
+         nodeBlockFlags[j] = FLAG_BLOCK_NONE;
+         continue;
+      }
 
-               // same file size as before?
-               if (fileSize == vaultFile.getOriginFileSize()) {
-                  // same size as before, check file modify time
-                  const bool fileModifyTimesMatch =
-                     (vaultFile.getModifyTime() == modifyTime);
+      Vault& vault = (*itVault).second;
+      const int vaultId = vault.getVaultId();
 
-                  if (!fileModifyTimesMatch) {
-                     if (modifyTime < vaultFile.getModifyTime()) {
-                        Logger::error("filesystem time earlier than vault file time");
-                     }
-                  }
+      VaultFile vaultFile;
+      bool addVaultFileToMap = true;
+
+      if (!m_dataAccess->getVaultFile(vaultId,
+                                      localFileId,
+                                      vaultFile)) {
+
+         vaultFile.setLocalFileId(localFileId);
+         vaultFile.setVaultId(vaultId);
+         vaultFile.setCreateTime(createTime);
+         vaultFile.setModifyTime(modifyTime);
+         vaultFile.setOriginFileSize(fileSize);
+         vaultFile.setBlockCount(numBlockFiles);
+         vaultFile.setUserPermissions(userPermissions);
+         vaultFile.setGroupPermissions(groupPermissions);
+         vaultFile.setOtherPermissions(otherPermissions);
+
+         if (m_previewOnly) {
+            Logger::debug("file needs to be added to vault");
+         } else {
+            if (m_dataAccess->insertVaultFile(vaultFile)) {
+               nodeBlockFlags[j] = FLAG_BLOCK_ALL;
+            } else {
+               addVaultFileToMap = false;
+               nodeBlockFlags[j] = FLAG_BLOCK_NONE;
+               Logger::error("unable to create vault file");
+            }
+         }
+      } else {
+         // existing vault file
 
-                  if (fileModifyTimesMatch) {
-                     addVaultFileToMap = false;
-                     nodeBlockFlags[j] = FLAG_BLOCK_NONE;
-                  } else {
-                     ::printf("%s\n", fileName.c_str());
-                     ::printf("+++ newer modify time on disk\n");
-                     ::printf("*** db modify time: '%s'\n", vaultFile.getModifyTime().formattedString().c_str());
-                     ::printf("*** fs modify time: '%s'\n", modifyTime.formattedString().c_str());
+         // same file size as before?
+         if (fileSize == vaultFile.getOriginFileSize()) {
+            // same size as before, check file modify time
+            const bool fileModifyTimesMatch =
+               (vaultFile.getModifyTime() == modifyTime);
 
-                     addVaultFileToMap = true;
-                     nodeBlockFlags[j] = FLAG_BLOCK_SELECTIVE;
-                  }
-               } else {
-                  // different file size, we need to update (at least 1 block)
-                  ::printf("%s\n", fileName.c_str());
-                  ::printf("different file size\n");
-                  nodeBlockFlags[j] = FLAG_BLOCK_SELECTIVE;
+            if (!fileModifyTimesMatch) {
+               if (modifyTime < vaultFile.getModifyTime()) {
+                  Logger::error("filesystem time earlier than vault file time");
                }
             }
 
-            if (addVaultFileToMap) {
-               mapVaultIdToVaultFile[vaultId] = vaultFile;
+            if (fileModifyTimesMatch && !vaultFile.getNeedsResend()) {
+               addVaultFileToMap = false;
+               nodeBlockFlags[j] = FLAG_BLOCK_NONE;
+            } else if (fileModifyTimesMatch) {
+               // unchanged, but blocks have to move to or from the node
+               addVaultFileToMap = true;
+               nodeBlockFlags[j] = FLAG_BLOCK_SELECTIVE;
             } else {
-               if (!m_previewOnly) {
-                  Logger::debug("not adding vault file to map");
-               }
+               ::printf("%s\n", fileName.c_str());
+               ::printf("+++ newer modify time on disk\n");
+               ::printf("*** db modify time: '%s'\n", vaultFile.getModifyTime().formattedString().c_str());
+               ::printf("*** fs modify time: '%s'\n", modifyTime.formattedString().c_str());
+
+               addVaultFileToMap = true;
+               nodeBlockFlags[j] = FLAG_BLOCK_SELECTIVE;
             }
+         } else {
+            // different file size, we need to update (at least 1 block)
+            ::printf("%s\n", fileName.c_str());
+            ::printf("different file size\n");
+            nodeBlockFlags[j] = FLAG_BLOCK_SELECTIVE;
          }
+      }
 
+      if (addVaultFileToMap) {
+         mapVaultIdToVaultFile[vaultId] = vaultFile;
+      } else {
          if (!m_previewOnly) {
+            Logger::debug("not adding vault file to map");
+         }
+      }
+   }
 
+   if (!m_previewOnly) {
 
-         } else {
-            const int numNodeBlocksCopied =
-               sendFile(numBlockFiles,
-                        fullFilePath,
-                        localDirectory.getEncrypt(),
-                        nodeBlockFlags,
-                        mapVaultIdToVaultFile,
-                        createTime,
-                        modifyTime);
-
-            // did we copy any data for this file to a storage node?
-            if (numNodeBlocksCopied > 0) {
-               // update the copy time
-               chaudiere::DateTime copyTime;
-               localFile.setCopyTime(copyTime);
-               m_dataAccess->updateLocalFile(localFile);
-            }
-         }
 
-         //m_dataAccess->commit();
-      } else {
-         Logger::error(string("unable to stat file '") +
-                       path +
-                       SINGLE_QUOTE);
+   } else {
+      const int numNodeBlocksCopied =
+         sendFile(localDirectory,
+                  fullFilePath,
+                  nodeBlockFlags,
+                  mapVaultIdToVaultFile,
+                  createTime,
+                  modifyTime);
+
+      // did we copy any data for this file to a storage node?
+      if (numNodeBlocksCopied > 0) {
+         // update the copy time
+         chaudiere::DateTime copyTime;
+         localFile.setCopyTime(copyTime);
+         m_dataAccess->updateLocalFile(localFile);
       }
    }
+
+   // every block row recorded for the file was acknowledged by its node
+   // (and the rows of a node that failed have been undone), so the file
+   // can be committed
+   if (m_syncTransaction != nullptr) {
+      m_syncTransaction->fileFinished();
+   }
 }
 
 //******************************************************************************
@@ -849,6 +1559,11 @@ void GFSClient::scanDir(const string& dirPath,
    DIR* dir;
    m_previewOnly = true;
 
+   if (localDirectory.getScanThreads() > 1) {
+      scanDirParallel(dirPath, localDirectory);
+      return;
+   }
+
    if ((dir = ::opendir(pszDirPath)) != nullptr) {
       int pathLength;
       char path[PATH_MAX];
@@ -909,6 +1624,45 @@ void GFSClient::scanDir(const string& dirPath,
 
 //******************************************************************************
 
+void GFSClient::scanDirParallel(const string& dirPath,
+                                const LocalDirectory& localDirectory) {
+   DirectoryScanner scanner(m_exclusions,
+                            localDirectory.getRecurse(),
+                            localDirectory.getScanThreads(),
+                            SCAN_QUEUE_CAPACITY);
+
+   if (!scanner.start(dirPath)) {
+      Logger::error(string("unable to start scan of directory '") +
+                    dirPath +
+                    SINGLE_QUOTE);
+      return;
+   }
+
+   // the walker threads only read the filesystem; all catalog and node
+   // work stays on this thread, exactly as in the serial walk
+   ScanEntry entry;
+   while (scanner.nextEntry(entry)) {
+      if (entry.isDirectory) {
+         scanProcessDirectory(entry.dirPath);
+      } else {
+         const string fullFilePath = entry.dirPath + "/" + entry.fileName;
+
+         if (entry.statErrno == 0) {
+            scanProcessFile(fullFilePath,
+                            entry.fileName,
+                            entry.fileStat,
+                            localDirectory);
+         } else {
+            Logger::error(string("unable to stat file '") +
+                          fullFilePath +
+                          SINGLE_QUOTE);
+         }
+      }
+   }
+}
+
+//******************************************************************************
+
 void GFSClient::sync() {
    const string& directory = m_gfsOptions.getDirectory();
 
@@ -967,6 +1721,10 @@ void GFSClient::sync() {
                vault.setLocalDirectoryId(m_localDirectoryId);
                vault.setCompress(compress);
                vault.setEncrypt(encrypt);
+               vault.setHashAlgorithm(m_gfsOptions.getHashAlgorithm());
+               vault.setPayloadEncoding(m_gfsOptions.getPayloadEncoding());
+               vault.setCipher(m_gfsOptions.getCipher());
+               vault.setCompression(m_gfsOptions.getCompression());
 
                if (m_dataAccess->insertVault(vault)) {
                   m_mapNodeToVault[nodeName] = vault;
@@ -981,10 +1739,29 @@ void GFSClient::sync() {
          if (!m_mapNodeToVault.empty()) {
             m_localDirectoryPathLength = directory.size();
 
+            if (compress &&
+                !m_dataAccess->getCompressionHistory(m_compressionHistory)) {
+               Logger::warning("unable to retrieve compression history");
+            }
+
             Logger::info(string("scanning directory '") +
                          directory +
                          SINGLE_QUOTE);
+
+            SyncTransaction syncTransaction(*m_dataAccess);
+            syncTransaction.setBatchSize(SYNC_COMMIT_FILES);
+            syncTransaction.setMaxDelay(SYNC_COMMIT_MILLIS);
+            if (!syncTransaction.begin()) {
+               Logger::warning("unable to begin transaction, committing each change");
+            }
+
+            m_syncTransaction = &syncTransaction;
             scanDir(directory, localDirectory);
+            m_syncTransaction = nullptr;
+
+            if (!syncTransaction.commit()) {
+               Logger::error("unable to commit catalog changes");
+            }
          } else {
             Logger::error("unable to sync -- no vaults available");
          }
@@ -1102,6 +1879,167 @@ void GFSClient::listNodes() {
 
 //******************************************************************************
 
+void GFSClient::benchmarkCiphers() {
+   const size_t blockSize = FileChunker::DEFAULT_AVG_CHUNK_SIZE;
+   vector<string> plainBlocks(CIPHER_BENCHMARK_BLOCKS);
+
+   // random contents (xorshift), so no two blocks are alike
+   uint64_t state = 0x9e3779b97f4a7c15ULL;
+   for (auto& plainBlock : plainBlocks) {
+      plainBlock.resize(blockSize);
+      for (size_t i = 0; i < blockSize; ++i) {
+         state ^= state << 13;
+         state ^= state >> 7;
+         state ^= state << 17;
+         plainBlock[i] = static_cast<char>(state);
+      }
+   }
+
+   // use the configured key when there is one; any key will do otherwise
+   string encryptionKey = m_gfsOptions.getEncryptionKey();
+   if (encryptionKey.length() < BlockCipher::KEY_LEN) {
+      encryptionKey.assign(BlockCipher::KEY_LEN, 'k');
+   }
+
+   const double megabytes =
+      static_cast<double>(blockSize * plainBlocks.size()) / (1024.0 * 1024.0);
+   const vector<string> ciphers = { BlockCipher::CIPHER_AES256_ECB,
+                                    BlockCipher::CIPHER_AES256_CTR,
+                                    BlockCipher::CIPHER_AES256_GCM };
+
+   ::printf("%-12s %14s %14s\n", "cipher", "encrypt MB/s", "decrypt MB/s");
+
+   for (const auto& cipher : ciphers) {
+      BlockCipher blockCipher;
+      if (!blockCipher.init(cipher, encryptionKey)) {
+         Logger::error("unable to initialize cipher " + cipher);
+         continue;
+      }
+
+      vector<string> blocks(plainBlocks.size());
+      vector<int> padCharCounts(plainBlocks.size());
+      bool success = true;
+
+      const auto encryptStart = chrono::steady_clock::now();
+      for (size_t i = 0; i < plainBlocks.size(); ++i) {
+         success = blockCipher.encrypt(plainBlocks[i],
+                                       blocks[i],
+                                       padCharCounts[i]) && success;
+      }
+      const auto encryptEnd = chrono::steady_clock::now();
+      for (size_t i = 0; i < blocks.size(); ++i) {
+         success = blockCipher.decrypt(blocks[i], padCharCounts[i]) && success;
+      }
+      const auto decryptEnd = chrono::steady_clock::now();
+
+      if (!success || blocks != plainBlocks) {
+         Logger::error("cipher " + cipher + " failed round trip");
+         continue;
+      }
+
+      const chrono::duration<double> encryptSeconds = encryptEnd - encryptStart;
+      const chrono::duration<double> decryptSeconds = decryptEnd - encryptEnd;
+      ::printf("%-12s %14.1f %14.1f\n",
+               cipher.c_str(),
+               megabytes / encryptSeconds.count(),
+               megabytes / decryptSeconds.count());
+   }
+}
+
+//******************************************************************************
+
+void GFSClient::benchmarkCatalog() {
+   // a scratch catalog, so the real one is left alone
+   ::unlink(BENCHMARK_DB_FILE.c_str());
+
+   {
+      DataAccess dataAccess(BENCHMARK_DB_FILE);
+      if (!dataAccess.open()) {
+         Logger::error("unable to create benchmark database");
+         return;
+      }
+
+      LocalDirectory localDirectory;
+      localDirectory.setDirectoryPath("/benchmark");
+      StorageNode storageNode;
+      storageNode.setNodeName("benchmark");
+      Vault vault;
+
+      if (!dataAccess.insertLocalDirectory(localDirectory) ||
+          !dataAccess.insertStorageNode(storageNode)) {
+         Logger::error("unable to populate benchmark database");
+         return;
+      }
+
+      vault.setStorageNodeId(storageNode.getStorageNodeId());
+      vault.setLocalDirectoryId(localDirectory.getLocalDirectoryId());
+      if (!dataAccess.insertVault(vault)) {
+         Logger::error("unable to populate benchmark database");
+         return;
+      }
+
+      ::printf("%12s %16s\n", "files", "lookup us/file");
+
+      // random files (xorshift), so the lookups don't share cached pages
+      uint64_t state = 0x9e3779b97f4a7c15ULL;
+      int numFiles = 0;
+
+      for (int targetFiles = 10000;
+           targetFiles <= CATALOG_BENCHMARK_MAX_FILES;
+           targetFiles *= 10) {
+         if (!dataAccess.insertBenchmarkFiles(localDirectory.getLocalDirectoryId(),
+                                              vault.getVaultId(),
+                                              numFiles + 1,
+                                              targetFiles)) {
+            Logger::error("unable to populate benchmark database");
+            break;
+         }
+         numFiles = targetFiles;
+
+         bool success = true;
+         const auto lookupStart = chrono::steady_clock::now();
+
+         for (int i = 0; i < CATALOG_BENCHMARK_LOOKUPS; ++i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            const int fileNumber = 1 + (state % numFiles);
+
+            LocalFile localFile;
+            VaultFile vaultFile;
+            vector<VaultFileBlock> listFileBlocks;
+
+            success = dataAccess.getLocalFile(localDirectory.getLocalDirectoryId(),
+                                              "benchmark/" + to_string(fileNumber),
+                                              localFile) &&
+                      dataAccess.getVaultFile(vault.getVaultId(),
+                                              localFile.getLocalFileId(),
+                                              vaultFile) &&
+                      dataAccess.getBlocksForVaultFile(vaultFile.getVaultFileId(),
+                                                       listFileBlocks) &&
+                      (listFileBlocks.size() == 1) &&
+                      success;
+         }
+
+         const chrono::duration<double> lookupSeconds =
+            chrono::steady_clock::now() - lookupStart;
+
+         if (!success) {
+            Logger::error("benchmark lookup failed");
+            break;
+         }
+
+         ::printf("%12d %16.1f\n",
+                  numFiles,
+                  lookupSeconds.count() * 1000000.0 / CATALOG_BENCHMARK_LOOKUPS);
+      }
+   }
+
+   ::unlink(BENCHMARK_DB_FILE.c_str());
+}
+
+//******************************************************************************
+
 int GFSClient::getNumberActiveLocalDirectories() const {
    return m_activeDirectories.size();
 }
@@ -1127,84 +2065,255 @@ bool GFSClient::getActiveLocalDirectories(vector<LocalDirectory>& vecLocalDirect
                Logger::warning("no active local directories defined");
             }
 
-            success = true;
-         } else {
-            Logger::error("unable to retrieve active local directories");
-            return false;
+            success = true;
+         } else {
+            Logger::error("unable to retrieve active local directories");
+            return false;
+         }
+      } else {
+         success = true;
+      }
+
+      auto it = m_activeDirectories.cbegin();
+      const auto itEnd = m_activeDirectories.cend();
+      for (; it != itEnd; ++it) {
+         const LocalDirectory& localDirectory = *it;
+         vecLocalDirectories.push_back(localDirectory);
+      }
+   } else {
+      Logger::error("no data access available");
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool GFSClient::getInactiveLocalDirectories(vector<LocalDirectory>& vecLocalDirectories) {
+   bool success = false;
+
+   if (m_dataAccess != nullptr) {
+      if (m_dataAccess->getInactiveLocalDirectories(vecLocalDirectories)) {
+         if (vecLocalDirectories.empty()) {
+            Logger::warning("no inactive local directories defined");
+         }
+
+         success = true;
+      } else {
+         Logger::error("unable to retrieve inactive local directories");
+      }
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool GFSClient::addStorageNode(StorageNode& storageNode) {
+   bool success = false;
+
+   if (m_dataAccess != nullptr) {
+      success = m_dataAccess->insertStorageNode(storageNode);
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool GFSClient::updateStorageNode(StorageNode& storageNode) {
+   bool success = false;
+
+   if (m_dataAccess != nullptr) {
+      success = m_dataAccess->updateStorageNode(storageNode);
+   }
+
+   return success;
+}
+
+//******************************************************************************
+
+bool GFSClient::activateStorageNode(StorageNode& storageNode) {
+   storageNode.setActive(true);
+   return updateStorageNode(storageNode) && rebalanceBlocks();
+}
+
+//******************************************************************************
+
+bool GFSClient::deactivateStorageNode(StorageNode& storageNode) {
+   storageNode.setActive(false);
+   return updateStorageNode(storageNode) && rebalanceBlocks();
+}
+
+//******************************************************************************
+
+bool GFSClient::rebalanceBlocks() {
+   if (m_dataAccess == nullptr) {
+      Logger::error("no database connection");
+      return false;
+   }
+
+   vector<StorageNode> activeNodes;
+   if (!m_dataAccess->getActiveStorageNodes(activeNodes)) {
+      Logger::error("unable to retrieve storage nodes");
+      return false;
+   }
+
+   m_activeNodes = activeNodes;
+   loadBlockPlacement();
+
+   const int numNodes = m_activeNodes.size();
+   bool success = true;
+   int numFilesMarked = 0;
+   vector<int> placedNodes;
+
+   for (const auto& localDirectory : m_activeDirectories) {
+      const int localDirectoryId = localDirectory.getLocalDirectoryId();
+      const int copyCount = localDirectory.getCopyCount();
+
+      // an erasure coded block is placed on one node per fragment, and
+      // the node holding fragment i must be the i-th of them
+      const bool erasureCoded = isErasureCoded(localDirectory);
+      const int numPlacedNodes = erasureCoded ?
+         (localDirectory.getDataFragments() + localDirectory.getParityFragments()) :
+         copyCount;
+
+      // a node without a vault (or vault file) is sent the whole file by
+      // the next sync anyway
+      vector<Vault> vaults(numNodes);
+      vector<bool> haveVault(numNodes, false);
+      for (int i = 0; i < numNodes; ++i) {
+         haveVault[i] =
+            m_dataAccess->getVault(m_activeNodes[i].getStorageNodeId(),
+                                   localDirectoryId,
+                                   vaults[i]);
+      }
+
+      vector<LocalFile> listLocalFiles;
+      if (!m_dataAccess->getLocalFilesForDirectory(localDirectoryId,
+                                                   listLocalFiles)) {
+         Logger::error("unable to retrieve file list for directory");
+         success = false;
+         continue;
+      }
+
+      for (const auto& localFile : listLocalFiles) {
+         vector<VaultFile> vaultFiles(numNodes);
+         vector<bool> haveVaultFile(numNodes, false);
+         // (node, fragment index) pairs by placement key
+         map<string, set<pair<int, int>>> nodesHoldingBlock;
+
+         for (int i = 0; i < numNodes; ++i) {
+            if (!haveVault[i] ||
+                !m_dataAccess->getVaultFile(vaults[i].getVaultId(),
+                                            localFile.getLocalFileId(),
+                                            vaultFiles[i])) {
+               continue;
+            }
+
+            haveVaultFile[i] = true;
+
+            vector<VaultFileBlock> listFileBlocks;
+            if (!m_dataAccess->getBlocksForVaultFile(vaultFiles[i].getVaultFileId(),
+                                                     listFileBlocks)) {
+               Logger::error("unable to retrieve blocks for vault file");
+               success = false;
+               continue;
+            }
+
+            // blocks stored before placement stay where they are until
+            // their file is sent again
+            for (const auto& vaultFileBlock : listFileBlocks) {
+               const string& placementKey = vaultFileBlock.getPlacementKey();
+               if (!placementKey.empty()) {
+                  nodesHoldingBlock[placementKey].insert(
+                     make_pair(i, vaultFileBlock.getFragmentIndex()));
+               }
+            }
          }
-      } else {
-         success = true;
-      }
 
-      auto it = m_activeDirectories.cbegin();
-      const auto itEnd = m_activeDirectories.cend();
-      for (; it != itEnd; ++it) {
-         const LocalDirectory& localDirectory = *it;
-         vecLocalDirectories.push_back(localDirectory);
-      }
-   } else {
-      Logger::error("no data access available");
-   }
+         // a node has to be sent the file again if it gains or loses a block
+         vector<bool> nodeChanged(numNodes, false);
+         for (const auto& it : nodesHoldingBlock) {
+            const set<pair<int, int>>& holders = it.second;
+            m_blockPlacement.nodesForBlock(it.first, numPlacedNodes, placedNodes);
 
-   return success;
-}
+            set<pair<int, int>> placed;
+            const int numPlaced = placedNodes.size();
+            for (int j = 0; j < numPlaced; ++j) {
+               placed.insert(make_pair(placedNodes[j], erasureCoded ? j : -1));
+            }
 
-//******************************************************************************
+            for (const auto& holder : placed) {
+               if (holders.count(holder) == 0) {
+                  nodeChanged[holder.first] = true;
+               }
+            }
 
-bool GFSClient::getInactiveLocalDirectories(vector<LocalDirectory>& vecLocalDirectories) {
-   bool success = false;
+            for (const auto& holder : holders) {
+               if (placed.count(holder) == 0) {
+                  nodeChanged[holder.first] = true;
+               }
+            }
+         }
 
-   if (m_dataAccess != nullptr) {
-      if (m_dataAccess->getInactiveLocalDirectories(vecLocalDirectories)) {
-         if (vecLocalDirectories.empty()) {
-            Logger::warning("no inactive local directories defined");
+         bool fileMarked = false;
+         for (int i = 0; i < numNodes; ++i) {
+            if (nodeChanged[i] && haveVaultFile[i]) {
+               if (markVaultFileStale(vaultFiles[i])) {
+                  fileMarked = true;
+               } else {
+                  Logger::error("unable to update vault file");
+                  success = false;
+               }
+            }
          }
 
-         success = true;
-      } else {
-         Logger::error("unable to retrieve inactive local directories");
+         if (fileMarked) {
+            ++numFilesMarked;
+         }
       }
    }
 
+   Logger::info(to_string(numFilesMarked) +
+                " file(s) have blocks to move on the next sync");
+
    return success;
 }
 
 //******************************************************************************
 
-bool GFSClient::addStorageNode(StorageNode& storageNode) {
-   bool success = false;
+void GFSClient::loadBlockPlacement() {
+   m_blockPlacement.clear();
 
-   if (m_dataAccess != nullptr) {
-      success = m_dataAccess->insertStorageNode(storageNode);
+   for (const auto& storageNode : m_activeNodes) {
+      m_blockPlacement.addNode(storageNode.getNodeName(),
+                               storageNode.getCapacity());
    }
-
-   return success;
 }
 
 //******************************************************************************
 
-bool GFSClient::updateStorageNode(StorageNode& storageNode) {
-   bool success = false;
-
-   if (m_dataAccess != nullptr) {
-      success = m_dataAccess->updateStorageNode(storageNode);
+bool GFSClient::markVaultFileStale(VaultFile& vaultFile) {
+   // the modify time is left alone, so that a restore still sees which
+   // version of the file the node holds
+   if (vaultFile.getNeedsResend()) {
+      return true;
    }
 
-   return success;
+   vaultFile.setNeedsResend(true);
+   return m_dataAccess->updateVaultFile(vaultFile);
 }
 
 //******************************************************************************
 
-bool GFSClient::activateStorageNode(StorageNode& storageNode) {
-   storageNode.setActive(true);
-   return updateStorageNode(storageNode);
-}
-
-//******************************************************************************
+bool GFSClient::isErasureCoded(const LocalDirectory& localDirectory) const {
+   const int dataFragments = localDirectory.getDataFragments();
+   const int numFragments = dataFragments + localDirectory.getParityFragments();
 
-bool GFSClient::deactivateStorageNode(StorageNode& storageNode) {
-   storageNode.setActive(false);
-   return updateStorageNode(storageNode);
+   return (dataFragments > 0) &&
+          (numFragments <= ReedSolomon::MAX_FRAGMENTS) &&
+          (numFragments <= m_blockPlacement.getNodeCount());
 }
 
 //******************************************************************************
@@ -1348,11 +2457,13 @@ void GFSClient::addStorageNode() {
             StorageNode storageNode;
             storageNode.setNodeName(nodeName);
             storageNode.setActive(true);
+            storageNode.setCapacity(m_gfsOptions.getNodeCapacity());
 
             if (m_dataAccess->insertStorageNode(storageNode)) {
                if (storageNode.getStorageNodeId() > -1) {
                   m_activeNodes.push_back(storageNode);
                   Logger::info("storage node added");
+                  rebalanceBlocks();
                } else {
                   Logger::error("storage node id missing from database insert");
                }
@@ -1389,6 +2500,7 @@ void GFSClient::removeStorageNode() {
             if (m_dataAccess->deleteActiveStorageNode(storageNode)) {
                m_activeNodes.erase(m_activeNodes.begin() + nodeIndex);
                Logger::info("storage node removed");
+               rebalanceBlocks();
             } else {
                Logger::error("unable to remove storage node from database");
             }
@@ -1444,23 +2556,33 @@ int GFSClient::indexForLocalDirectory(const string& dirPath) {
 //******************************************************************************
 
 bool GFSClient::restore() {
+   return restoreFromOptions(RESTORE_DIRECTORY, string());
+}
+
+//******************************************************************************
+
+bool GFSClient::restoreFromOptions(RestoreScope restoreScope,
+                                   const string& restorePath) {
    bool success = false;
 
    const string& nodeName = m_gfsOptions.getNode();
    const string& sourceDirectory = m_gfsOptions.getDirectory();
    const string& targetDirectory = m_gfsOptions.getTargetDirectory();
 
-   if (!nodeName.empty()) {
-      if (!sourceDirectory.empty()) {
-         if (!targetDirectory.empty()) {
+   if (!sourceDirectory.empty()) {
+      if (!targetDirectory.empty()) {
 
-            // source and target directory cannot be same
-            if (sourceDirectory == targetDirectory) {
-               Logger::error("source and target directory cannot be the same");
-               return false;
-            }
+         // source and target directory cannot be same
+         if (sourceDirectory == targetDirectory) {
+            Logger::error("source and target directory cannot be the same");
+            return false;
+         }
+
+         // valid node name? without one, every block is taken from
+         // whichever node holding it is fastest
+         const StorageNode* storageNode = nullptr;
 
-            // valid node name?
+         if (!nodeName.empty()) {
             const int nodeIndex = indexForStorageNode(nodeName);
 
             if (nodeIndex == -1) {
@@ -1468,31 +2590,35 @@ bool GFSClient::restore() {
                return false;
             }
 
-            // valid source directory?
-            const int sourceDirectoryIndex = indexForLocalDirectory(sourceDirectory);
+            storageNode = &m_activeNodes[nodeIndex];
+         }
 
-            if (sourceDirectoryIndex == -1) {
-               Logger::error("unrecognized local directory (source)");
-               return false;
-            }
+         // valid source directory?
+         const int sourceDirectoryIndex = indexForLocalDirectory(sourceDirectory);
 
-            // valid target directory?
-            //TODO: validate target directory
+         if (sourceDirectoryIndex == -1) {
+            Logger::error("unrecognized local directory (source)");
+            return false;
+         }
 
-            const string& encryptionKey = m_gfsOptions.getEncryptionKey();
-            const StorageNode& storageNode = m_activeNodes[nodeIndex];
-            const LocalDirectory& sourceDirectory = m_activeDirectories[sourceDirectoryIndex];
+         // valid target directory?
+         //TODO: validate target directory
 
-            return fullRestore(encryptionKey, storageNode, sourceDirectory, targetDirectory);
+         const string& encryptionKey = m_gfsOptions.getEncryptionKey();
+         const LocalDirectory& sourceDirectory = m_activeDirectories[sourceDirectoryIndex];
+
+         return restoreFiles(encryptionKey,
+                             storageNode,
+                             sourceDirectory,
+                             restoreScope,
+                             restorePath,
+                             targetDirectory);
 
-         } else {
-            Logger::error("missing target directory");
-         }
       } else {
-         Logger::error("missing source directory");
+         Logger::error("missing target directory");
       }
    } else {
-      Logger::error("missing node name");
+      Logger::error("missing source directory");
    }
 
    return success;
@@ -1503,21 +2629,16 @@ bool GFSClient::restore() {
 bool GFSClient::restoreSubdirectory(const string& dirPath) {
    bool success = false;
 
-   const string& nodeName = m_gfsOptions.getNode();
    const string& vaultDirectory = m_gfsOptions.getDirectory();
 
-   if (!nodeName.empty()) {
-      if (!vaultDirectory.empty()) {
-         if (!dirPath.empty()) {
-            //TODO: implement restoreSubdirectory
-         } else {
-            Logger::error("missing directory name/path to restore");
-         }
+   if (!vaultDirectory.empty()) {
+      if (!dirPath.empty()) {
+         success = restoreFromOptions(RESTORE_SUBDIRECTORY, dirPath);
       } else {
-         Logger::error("missing vault directory");
+         Logger::error("missing directory name/path to restore");
       }
    } else {
-      Logger::error("missing node name");
+      Logger::error("missing vault directory");
    }
 
    return success;
@@ -1528,22 +2649,17 @@ bool GFSClient::restoreSubdirectory(const string& dirPath) {
 bool GFSClient::restoreFile() {
    bool success = false;
 
-   const string& nodeName = m_gfsOptions.getNode();
    const string& directory = m_gfsOptions.getDirectory();
    const string& filePath = m_gfsOptions.getFile();
 
-   if (!nodeName.empty()) {
-      if (!directory.empty()) {
-         if (!filePath.empty()) {
-            //TODO: implement restoreFile
-         } else {
-            Logger::error("missing file name/path");
-         }
+   if (!directory.empty()) {
+      if (!filePath.empty()) {
+         success = restoreFromOptions(RESTORE_FILE, filePath);
       } else {
-         Logger::error("missing directory");
+         Logger::error("missing file name/path");
       }
    } else {
-      Logger::error("missing node name");
+      Logger::error("missing directory");
    }
 
    return success;
@@ -1568,7 +2684,13 @@ bool GFSClient::retrieveFile(const string& nodeName,
             if (message.send(nodeName, response)) {
                if (GFSMessage::getRC(response)) {
                   fileContents = response.getTextPayload();
-                  success = true;
+                  if (GFSMessage::hasStoredFileSize(response) &&
+                      (GFSMessage::getStoredFileSize(response) !=
+                       fileContents.length())) {
+                     Logger::error("file contents from storage node are incomplete");
+                  } else {
+                     success = true;
+                  }
                } else {
                   Logger::error("file retrieve failed on storage node");
                }
@@ -1590,218 +2712,152 @@ bool GFSClient::retrieveFile(const string& nodeName,
 
 //******************************************************************************
 
-bool GFSClient::fullRestore(const string& encryptionKey,
-                            const StorageNode& storageNode,
-                            const LocalDirectory& sourceDirectory,
-                            const string& targetDirectory) {
+bool GFSClient::restoreFiles(const string& encryptionKey,
+                             const StorageNode* storageNode,
+                             const LocalDirectory& sourceDirectory,
+                             RestoreScope restoreScope,
+                             const string& restorePath,
+                             const string& targetDirectory) {
    bool success = false;
 
-   const int nodeIndex = storageNode.getStorageNodeId();
    const int sourceDirectoryId = sourceDirectory.getLocalDirectoryId();
 
-   Vault vault;
-   if (m_dataAccess->getVault(nodeIndex, sourceDirectoryId, vault)) {
-      const bool encrypted = vault.getEncrypt();
-      const int vaultId = vault.getVaultId();
-      vector<LocalFile> listLocalFiles;
-      if (m_dataAccess->getLocalFilesForDirectory(sourceDirectoryId,
-                                                  listLocalFiles)) {
-         if (!listLocalFiles.empty()) {
-            const string& nodeName = storageNode.getNodeName();
-
-            auto itLocalFile = listLocalFiles.cbegin();
-            const auto itLocalFileEnd = listLocalFiles.cend();
-            const string FILE_DIR_DELIMITER = "/";
-
-            for (; itLocalFile != itLocalFileEnd; ++itLocalFile) {
-               const LocalFile& localFile = *itLocalFile;
-               const string& localFilePath = localFile.getFilePath();
-
-               StringTokenizer st(localFilePath, FILE_DIR_DELIMITER);
-               const int numTokens = st.countTokens();
-
-               if (numTokens > 1) {
-                  // walk the directory path and create any subdirectories
-                  // that are missing
-                  string dirPath = targetDirectory;
-                  const int numSubDirs = numTokens - 1;
-
-                  for (int i = 0; i < numSubDirs; ++i) {
-                     dirPath += FILE_DIR_DELIMITER;
-                     dirPath += st.nextToken();
-
-                     if (!OSUtils::directoryExists(dirPath)) {
-                        if (!OSUtils::createDirectory(dirPath)) {
-                           Logger::error(string("unable to create directory: ") + dirPath);
-                        }
-                     }
-                  }
-               } else {
-                  // if we only have a single token, that means we're not
-                  // dealing with subdirectories, so we don't need to
-                  // check for existence (or create any)
-               }
+   const string catalogPath =
+      CatalogPath(restorePath, sourceDirectory.getDirectoryPath());
 
-               VaultFile vaultFile;
-               if (m_dataAccess->getVaultFile(vaultId,
-                                              localFile.getLocalFileId(),
-                                              vaultFile)) {
-                  const int vaultFileId = vaultFile.getVaultFileId();
-                  const int numBlocks = vaultFile.getBlockCount();
-                  vector<VaultFileBlock> listFileBlocks;
-
-                  if (m_dataAccess->getBlocksForVaultFile(vaultFileId,
-                                                          listFileBlocks)) {
-                     if (listFileBlocks.size() == numBlocks) {
-                        const string vaultFilePath =
-                           OSUtils::pathJoin(targetDirectory, localFilePath);
-                        FILE* f = ::fopen(vaultFilePath.c_str(), "wb");
-                        if (f != nullptr) {
-                           // determine the permissions needed for the file
-                           const FilePermissions& userPermissions =
-                              vaultFile.getUserPermissions();
-                           const FilePermissions& groupPermissions =
-                              vaultFile.getGroupPermissions();
-                           const FilePermissions& otherPermissions =
-                              vaultFile.getOtherPermissions();
-
-                           mode_t fileMode = 0;
-
-                           // ------------  user ---------------
-                           if (userPermissions.hasReadPermission()) {
-                              fileMode |= S_IRUSR;
-                           }
-
-                           if (userPermissions.hasWritePermission()) {
-                              fileMode |= S_IWUSR;
-                           }
-
-                           if (userPermissions.hasExecutePermission()) {
-                              fileMode |= S_IXUSR;
-                           }
-
-                           // ------------  group ---------------
-                           if (groupPermissions.hasReadPermission()) {
-                              fileMode |= S_IRGRP;
-                           }
-
-                           if (groupPermissions.hasWritePermission()) {
-                              fileMode |= S_IWGRP;
-                           }
-
-                           if (groupPermissions.hasExecutePermission()) {
-                              fileMode |= S_IXGRP;
-                           }
-
-                           // ------------  other ---------------
-                           if (otherPermissions.hasReadPermission()) {
-                              fileMode |= S_IROTH;
-                           }
-
-                           if (otherPermissions.hasWritePermission()) {
-                              fileMode |= S_IWOTH;
-                           }
-
-                           if (otherPermissions.hasExecutePermission()) {
-                              fileMode |= S_IXOTH;
-                           }
-
-                           // set the file's permissions
-                           const int rc = ::fchmod(fileno(f), fileMode);
-                           if (rc != 0) {
-                              Logger::error("unable to set file permissions");
-                           }
-
-                           auto itListFileBlocks = listFileBlocks.cbegin();
-                           const auto itListFileBlocksEnd = listFileBlocks.cend();
-
-                           for (; itListFileBlocks != itListFileBlocksEnd; ++itListFileBlocks) {
-                              const VaultFileBlock& vaultFileBlock = *itListFileBlocks;
-                              string fileContents;
-
-                              if (retrieveFile(nodeName,
-                                               vaultFileBlock.getNodeDirectory(),
-                                               vaultFileBlock.getNodeFile(),
-                                               fileContents)) {
-
-                                 const string calcUniqueId =
-                                    GFS::uniqueIdentifierForString(fileContents);
-
-                                 // pass integrity check?
-                                 if (calcUniqueId == vaultFileBlock.getUniqueIdentifier()) {
-                                    // does it match the stored size?
-                                    if (fileContents.length() == vaultFileBlock.getStoredFileSize()) {
-                                       // remove base64 encoding
-                                       const string unencodedFileContents =
-                                          Encryption::base64Decode(fileContents);
-                                       string finalText;
-
-                                       if (encrypted) {
-                                          const int padCharCount =
-                                             vaultFileBlock.getPadCharCount();
-
-                                          // unencrypt
-                                          finalText = Decrypt(unencodedFileContents,
-                                                              encryptionKey);
-
-                                          // remove padding chars
-                                          if (padCharCount > 0) {
-                                             finalText = finalText.substr(0,
-                                                                          finalText.size() - padCharCount);
-                                          }
-                                       } else {
-                                          finalText = unencodedFileContents;
-                                       }
-
-                                       // does it match the original size?
-                                       if (finalText.size() == vaultFileBlock.getOriginFileSize()) {
-                                          // write the block out to file
-                                          const size_t objectsWritten =
-                                               ::fwrite(finalText.data(), finalText.size(), 1, f);
-
-                                          if (objectsWritten > 0) {
-                                             //Logger::debug("restored file block");
-                                          } else {
-                                             Logger::error("fwrite failed");
-                                          }
-                                       } else {
-                                          Logger::error("block mismatch with original size");
-                                          ::printf("block size = %lu\n", finalText.size());
-                                          ::printf("origin file size = %d\n", vaultFileBlock.getOriginFileSize());
-                                       }
-                                    } else {
-                                       Logger::error("block mismatch with stored size");
-                                    }
-                                 } else {
-                                    Logger::error("block failed unique id (integrity) check");
-                                    ::printf("calcUniqueId='%s'\n", calcUniqueId.c_str());
-                                    ::printf("block unique='%s'\n", vaultFileBlock.getUniqueIdentifier().c_str());
-                                 }
-                              } else {
-                                 Logger::error("retrieveFile failed");
-                              }
-                           }
-
-                           ::fclose(f);
-                        }
-                     } else {
-                        Logger::error("number of blocks returned mismatch with number blocks stored");
-                        ::printf("number blocks returned = %lu\n", listFileBlocks.size());
-                        ::printf("number blocks stored = %d\n", numBlocks);
-                        ::printf("file path=%s\n", localFilePath.c_str());
-                     }
-                  } else {
-                     Logger::error("unable to retrieve blocks for vault file");
-                  }
-               } else {
-                  Logger::error("unable to retrieve vault file from DB");
-               }
-            }
-         } else {
-            Logger::warning("no files found for directory");
+   if (catalogPath.empty()) {
+      if (restoreScope == RESTORE_FILE) {
+         Logger::error("missing file name/path");
+         return false;
+      }
+
+      // the subdirectory is the whole directory
+      restoreScope = RESTORE_DIRECTORY;
+   }
+
+   // every active node holding a copy of a block is a candidate for it
+   // (with copy_count below the number of nodes a node only holds some of
+   // each file's blocks). a chosen node is listed first, so it is tried
+   // first until the restore has measured the nodes.
+   vector<const StorageNode*> restoreNodes;
+   if (storageNode != nullptr) {
+      restoreNodes.push_back(storageNode);
+   }
+   for (const auto& activeNode : m_activeNodes) {
+      if ((storageNode == nullptr) ||
+          (activeNode.getStorageNodeId() != storageNode->getStorageNodeId())) {
+         restoreNodes.push_back(&activeNode);
+      }
+   }
+
+   vector<RestoreVault> restoreVaults;
+   for (const auto restoreNode : restoreNodes) {
+      RestoreVault restoreVault;
+      if (!m_dataAccess->getVault(restoreNode->getStorageNodeId(),
+                                  sourceDirectoryId,
+                                  restoreVault.vault)) {
+         continue;
+      }
+
+      restoreVault.nodeName = restoreNode->getNodeName();
+
+      // the key is expanded once for the whole restore; the cipher can be
+      // shared by threads restoring blocks in parallel
+      const Vault& vault = restoreVault.vault;
+      if (vault.getEncrypt()) {
+         restoreVault.blockCipher.reset(new BlockCipher);
+         if (!restoreVault.blockCipher->init(vault.getCipher(), encryptionKey)) {
+            Logger::error("unable to initialize cipher for vault");
+            return false;
+         }
+      }
+
+      restoreVaults.push_back(std::move(restoreVault));
+   }
+
+   if (!restoreVaults.empty()) {
+
+      // each block records its own codec (blocks that did not compress
+      // are stored as is). the decompressors are all set up before the
+      // fetch workers start so that the workers only read the map.
+      BlockCompressorMap blockCompressors;
+      const vector<string> codecs = { BlockCompressor::COMPRESSION_LZ4,
+                                      BlockCompressor::COMPRESSION_ZSTD };
+      for (const auto& codec : codecs) {
+         unique_ptr<BlockCompressor> blockCompressor(new BlockCompressor);
+         if (blockCompressor->init(codec, 0)) {
+            blockCompressors[codec] = std::move(blockCompressor);
          }
+      }
+
+      // each block is fetched from the fastest healthy node holding it,
+      // hedged to a second node when slow and retried on another on error.
+      // declared before the engine so that requests still running after
+      // a hedge are waited for once the workers have stopped.
+      ReplicaSelector replicaSelector(restoreVaults.size());
+      replicaSelector.setHedgePercentile(RESTORE_HEDGE_PERCENTILE);
+
+      // blocks of many files are fetched at once and written wherever
+      // they belong as they arrive
+      const int restoreThreads = m_gfsOptions.getRestoreThreads();
+      RestoreEngine restoreEngine(restoreThreads,
+                                  restoreThreads * RESTORE_QUEUE_BLOCKS_PER_WORKER);
+      restoreEngine.start();
+
+      bool haveFiles = false;
+
+      const auto restoreFile = [&](const RestorePlanFile& planFile) {
+         haveFiles = true;
+         restorePlanFile(restoreVaults,
+                         planFile,
+                         targetDirectory,
+                         blockCompressors,
+                         replicaSelector,
+                         restoreEngine);
+         return true;
+      };
+
+      // the files come with their vault files and blocks (from every
+      // vault) from a single query, read as the restore goes. a file or
+      // subdirectory is looked up by path in the directory/path index, so
+      // only its own files are read, however large the directory.
+      bool planRead = false;
+
+      if (restoreScope == RESTORE_FILE) {
+         planRead = m_dataAccess->getRestorePlanForFile(sourceDirectoryId,
+                                                        catalogPath,
+                                                        restoreFile);
+      } else if (restoreScope == RESTORE_SUBDIRECTORY) {
+         planRead = m_dataAccess->getRestorePlanForPath(sourceDirectoryId,
+                                                        catalogPath,
+                                                        restoreFile);
       } else {
+         planRead = m_dataAccess->getRestorePlan(sourceDirectoryId,
+                                                 restoreFile);
+      }
+
+      const bool filesRestored = restoreEngine.finish();
+
+      if (!planRead) {
          Logger::error("unable to retrieve file list for directory");
+      } else if (!haveFiles) {
+         if (restoreScope == RESTORE_DIRECTORY) {
+            Logger::warning("no files found for directory");
+         } else {
+            Logger::error("no files found for '" + catalogPath + "'");
+         }
+      } else {
+         Logger::info(to_string(restoreEngine.getFilesRestored()) +
+                      " files restored (" +
+                      to_string(restoreEngine.getBytesRestored()) +
+                      " bytes), " +
+                      to_string(restoreEngine.getFilesFailed()) +
+                      " failed, " +
+                      to_string(replicaSelector.getHedgedFetches()) +
+                      " block fetches hedged, " +
+                      to_string(replicaSelector.getFailovers()) +
+                      " failed over");
+         success = filesRestored;
       }
    } else {
       Logger::error("unable to find vault for node/directory");
@@ -1812,4 +2868,478 @@ bool GFSClient::fullRestore(const string& encryptionKey,
 
 //******************************************************************************
 
+void GFSClient::restorePlanFile(const vector<RestoreVault>& restoreVaults,
+                                const RestorePlanFile& planFile,
+                                const string& targetDirectory,
+                                const BlockCompressorMap& blockCompressors,
+                                ReplicaSelector& replicaSelector,
+                                RestoreEngine& restoreEngine) {
+   const LocalFile& localFile = planFile.localFile;
+   const string& localFilePath = localFile.getFilePath();
+   const string FILE_DIR_DELIMITER = "/";
+
+   StringTokenizer st(localFilePath, FILE_DIR_DELIMITER);
+   const int numTokens = st.countTokens();
+
+   if (numTokens > 1) {
+      // walk the directory path and create any subdirectories
+      // that are missing
+      string dirPath = targetDirectory;
+      const int numSubDirs = numTokens - 1;
+
+      for (int i = 0; i < numSubDirs; ++i) {
+         dirPath += FILE_DIR_DELIMITER;
+         dirPath += st.nextToken();
+
+         if (!OSUtils::directoryExists(dirPath)) {
+            if (!OSUtils::createDirectory(dirPath)) {
+               Logger::error(string("unable to create directory: ") + dirPath);
+            }
+         }
+      }
+   } else {
+      // if we only have a single token, that means we're not
+      // dealing with subdirectories, so we don't need to
+      // check for existence (or create any)
+   }
+
+   VaultFile vaultFile;
+   if (findRestoreVaultFile(restoreVaults,
+                            planFile,
+                            vaultFile)) {
+      const size_t numBlocks = vaultFile.getBlockCount();
+      map<int, RestoreBlock> fileBlocks;  // by sequence number
+
+      collectRestoreBlocks(restoreVaults,
+                           planFile,
+                           vaultFile,
+                           fileBlocks);
+
+      if (fileBlocks.size() == numBlocks) {
+         const string vaultFilePath =
+            OSUtils::pathJoin(targetDirectory, localFilePath);
+
+         // determine the permissions needed for the file
+         const FilePermissions& userPermissions =
+            vaultFile.getUserPermissions();
+         const FilePermissions& groupPermissions =
+            vaultFile.getGroupPermissions();
+         const FilePermissions& otherPermissions =
+            vaultFile.getOtherPermissions();
+
+         mode_t fileMode = 0;
+
+         // ------------  user ---------------
+         if (userPermissions.hasReadPermission()) {
+            fileMode |= S_IRUSR;
+         }
+
+         if (userPermissions.hasWritePermission()) {
+            fileMode |= S_IWUSR;
+         }
+
+         if (userPermissions.hasExecutePermission()) {
+            fileMode |= S_IXUSR;
+         }
+
+         // ------------  group ---------------
+         if (groupPermissions.hasReadPermission()) {
+            fileMode |= S_IRGRP;
+         }
+
+         if (groupPermissions.hasWritePermission()) {
+            fileMode |= S_IWGRP;
+         }
+
+         if (groupPermissions.hasExecutePermission()) {
+            fileMode |= S_IXGRP;
+         }
+
+         // ------------  other ---------------
+         if (otherPermissions.hasReadPermission()) {
+            fileMode |= S_IROTH;
+         }
+
+         if (otherPermissions.hasWritePermission()) {
+            fileMode |= S_IWOTH;
+         }
+
+         if (otherPermissions.hasExecutePermission()) {
+            fileMode |= S_IXOTH;
+         }
+
+         // the file is created at its full size and each block is written at
+         // its offset by whichever fetch worker retrieves it
+         if (restoreEngine.beginFile(vaultFilePath,
+                                     fileMode,
+                                     vaultFile.getOriginFileSize())) {
+            bool queued = true;
+
+            for (const auto& it : fileBlocks) {
+               const RestoreBlock& restoreBlock = it.second;
+               const VaultFileBlock& vaultFileBlock =
+                  restoreBlock.vaultFileBlock;
+
+               // the block is fetched after the plan file is gone, so the
+               // fetch keeps its own copy of it
+               const bool added =
+                  restoreEngine.addBlock(vaultFileBlock.getBlockOffset(),
+                                         vaultFileBlock.getOriginFileSize(),
+                                         [this, &restoreVaults, &blockCompressors, &replicaSelector, restoreBlock]
+                                         (int workerIndex, string& contents) {
+                  return restoreBlockContents(restoreVaults,
+                                              restoreBlock,
+                                              blockCompressors,
+                                              replicaSelector,
+                                              contents);
+               });
+
+               if (!added) {
+                  queued = false;
+                  break;
+               }
+            }
+
+            restoreEngine.endFile(queued);
+         }
+      } else {
+         Logger::error("number of blocks returned mismatch with number blocks stored");
+         ::printf("number blocks returned = %zu\n", fileBlocks.size());
+         ::printf("number blocks stored = %zu\n", numBlocks);
+         ::printf("file path=%s\n", localFilePath.c_str());
+         restoreEngine.fileSkipped();
+      }
+   } else {
+      Logger::error("unable to retrieve vault file from DB");
+      restoreEngine.fileSkipped();
+   }
+}
+
+//******************************************************************************
+
+bool GFSClient::restoreBlockContents(const vector<RestoreVault>& restoreVaults,
+                                     const RestoreBlock& restoreBlock,
+                                     const BlockCompressorMap& blockCompressors,
+                                     ReplicaSelector& replicaSelector,
+                                     string& contents) {
+   const RestoreFragment* replica = nullptr;
+
+   if (restoreBlock.fragments.empty()) {
+      const vector<RestoreFragment>& replicas = restoreBlock.replicas;
+      vector<int> replicaNodes;
+      for (const auto& candidate : replicas) {
+         replicaNodes.push_back(candidate.restoreVaultIndex);
+      }
+
+      // a hedged request may outlive this call, so the fetch has its own
+      // copy of the replicas
+      const ReplicaSelector::ReplicaFetch fetchReplica =
+         [this, &restoreVaults, replicas](int replica, string& replicaContents) {
+         const RestoreFragment& candidate = replicas[replica];
+         return retrieveStoredBlock(restoreVaults[candidate.restoreVaultIndex],
+                                    candidate.vaultFileBlock,
+                                    replicaContents);
+      };
+
+      const int replicaIndex =
+         replicaSelector.fetch(replicaNodes,
+                               restoreBlock.vaultFileBlock.getStoredFileSize(),
+                               fetchReplica,
+                               contents);
+      if (replicaIndex < 0) {
+         Logger::error("unable to retrieve block from any replica");
+         return false;
+      }
+
+      replica = &replicas[replicaIndex];
+   } else {
+      // an erasure coded block is rebuilt from its fragments before it is
+      // decrypted (its fragments all come from vaults with the same cipher)
+      if (!reconstructBlock(restoreVaults,
+                            restoreBlock,
+                            replicaSelector,
+                            contents)) {
+         return false;
+      }
+   }
+
+   // the replicas of a block may be stored differently in each vault, so
+   // the block is decoded as the vault it came from stored it
+   const VaultFileBlock& vaultFileBlock = (replica != nullptr) ?
+      replica->vaultFileBlock : restoreBlock.vaultFileBlock;
+   const RestoreVault& restoreVault = (replica != nullptr) ?
+      restoreVaults[replica->restoreVaultIndex] :
+      restoreVaults[restoreBlock.restoreVaultIndex];
+
+   // decrypt in place (also removes the IV, tag and padding)
+   if (restoreVault.blockCipher &&
+       !restoreVault.blockCipher->decrypt(contents,
+                                          vaultFileBlock.getPadCharCount())) {
+      Logger::error("unable to decrypt block");
+      return false;
+   }
+
+   const string& compression = vaultFileBlock.getCompression();
+   if (!compression.empty()) {
+      const auto it = blockCompressors.find(compression);
+      string decodedContents;
+
+      if ((it == blockCompressors.end()) ||
+          !(*it).second->decompress(contents,
+                                    vaultFileBlock.getOriginFileSize(),
+                                    decodedContents)) {
+         Logger::error("unable to decompress block");
+         return false;
+      }
+      contents.swap(decodedContents);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool GFSClient::findRestoreVaultFile(const vector<RestoreVault>& restoreVaults,
+                                     const RestorePlanFile& planFile,
+                                     VaultFile& vaultFile) {
+   bool found = false;
+
+   // the newest version of the file; a vault file left at an older version
+   // (its node failed while the file was being sent) is older
+   for (const auto& restoreVault : restoreVaults) {
+      const int index = IndexForVault(planFile, restoreVault.vault.getVaultId());
+      if (index > -1) {
+         const VaultFile& candidate = planFile.vaultFiles[index];
+         if (!found || (vaultFile.getModifyTime() < candidate.getModifyTime())) {
+            vaultFile = candidate;
+            found = true;
+         }
+      }
+   }
+
+   return found;
+}
+
+//******************************************************************************
+
+void GFSClient::collectRestoreBlocks(const vector<RestoreVault>& restoreVaults,
+                                     const RestorePlanFile& planFile,
+                                     const VaultFile& vaultFile,
+                                     map<int, RestoreBlock>& fileBlocks) {
+   const int numVaults = restoreVaults.size();
+
+   // each block comes from one of the vaults holding it whole at the same
+   // version (every such copy is kept so that the restore can choose), or
+   // else from the fragments of it held by any of the vaults
+   for (int i = 0; i < numVaults; ++i) {
+      const int index = IndexForVault(planFile, restoreVaults[i].vault.getVaultId());
+      if (index < 0) {
+         continue;
+      }
+
+      const VaultFile& candidate = planFile.vaultFiles[index];
+      if (!(candidate.getModifyTime() == vaultFile.getModifyTime()) ||
+          (candidate.getOriginFileSize() != vaultFile.getOriginFileSize())) {
+         continue;
+      }
+
+      const vector<VaultFileBlock>& listFileBlocks =
+         planFile.vaultFileBlocks[index];
+
+      for (const auto& vaultFileBlock : listFileBlocks) {
+         RestoreBlock& restoreBlock =
+            fileBlocks[vaultFileBlock.getBlockSequenceNumber()];
+         const bool haveWhole = (restoreBlock.restoreVaultIndex > -1) &&
+                                restoreBlock.fragments.empty();
+
+         RestoreFragment fragment;
+         fragment.vaultFileBlock = vaultFileBlock;
+         fragment.restoreVaultIndex = i;
+
+         if (haveWhole) {
+            if (vaultFileBlock.getFragmentIndex() < 0) {
+               restoreBlock.replicas.push_back(fragment);
+            }
+         } else if (vaultFileBlock.getFragmentIndex() < 0) {
+            restoreBlock.vaultFileBlock = vaultFileBlock;
+            restoreBlock.restoreVaultIndex = i;
+            restoreBlock.fragments.clear();
+            restoreBlock.replicas.assign(1, fragment);
+         } else if (restoreBlock.fragments.empty()) {
+            restoreBlock.vaultFileBlock = vaultFileBlock;
+            restoreBlock.restoreVaultIndex = i;
+            restoreBlock.fragments.push_back(fragment);
+         } else {
+            // fragments only fit together if they were split from the
+            // same payload
+            const VaultFileBlock& first = restoreBlock.vaultFileBlock;
+            const Vault& firstVault =
+               restoreVaults[restoreBlock.restoreVaultIndex].vault;
+            const Vault& vault = restoreVaults[i].vault;
+
+            bool haveFragment = false;
+            for (const auto& existing : restoreBlock.fragments) {
+               if (existing.vaultFileBlock.getFragmentIndex() ==
+                   vaultFileBlock.getFragmentIndex()) {
+                  haveFragment = true;
+               }
+            }
+
+            if (!haveFragment &&
+                (vaultFileBlock.getDataFragments() == first.getDataFragments()) &&
+                (vaultFileBlock.getParityFragments() == first.getParityFragments()) &&
+                (vaultFileBlock.getPayloadSize() == first.getPayloadSize()) &&
+                (vaultFileBlock.getPadCharCount() == first.getPadCharCount()) &&
+                (vaultFileBlock.getCompression() == first.getCompression()) &&
+                (vault.getEncrypt() == firstVault.getEncrypt()) &&
+                (!vault.getEncrypt() || (vault.getCipher() == firstVault.getCipher()))) {
+               restoreBlock.fragments.push_back(fragment);
+            }
+         }
+      }
+   }
+
+   // a block with too few fragments can not be restored
+   for (auto it = fileBlocks.begin(); it != fileBlocks.end(); ) {
+      RestoreBlock& restoreBlock = (*it).second;
+      if (!restoreBlock.fragments.empty() &&
+          ((int) restoreBlock.fragments.size() <
+           restoreBlock.vaultFileBlock.getDataFragments())) {
+         Logger::error("not enough fragments to rebuild block");
+         it = fileBlocks.erase(it);
+      } else {
+         // data fragments first, which rebuild the block without decoding
+         sort(restoreBlock.fragments.begin(),
+              restoreBlock.fragments.end(),
+              [](const RestoreFragment& a, const RestoreFragment& b) {
+                 return a.vaultFileBlock.getFragmentIndex() <
+                        b.vaultFileBlock.getFragmentIndex();
+              });
+         ++it;
+      }
+   }
+}
+
+//******************************************************************************
+
+bool GFSClient::retrieveStoredBlock(const RestoreVault& restoreVault,
+                                    const VaultFileBlock& vaultFileBlock,
+                                    string& contents) {
+   const Vault& vault = restoreVault.vault;
+
+   if (!retrieveFile(restoreVault.nodeName,
+                     vaultFileBlock.getNodeDirectory(),
+                     vaultFileBlock.getNodeFile(),
+                     contents)) {
+      Logger::error("retrieveFile failed");
+      return false;
+   }
+
+   const string calcUniqueId =
+      GFS::uniqueIdentifierForString(contents, vault.getHashAlgorithm());
+
+   // pass integrity check?
+   if (calcUniqueId != vaultFileBlock.getUniqueIdentifier()) {
+      Logger::error("block failed unique id (integrity) check");
+      ::printf("calcUniqueId='%s'\n", calcUniqueId.c_str());
+      ::printf("block unique='%s'\n", vaultFileBlock.getUniqueIdentifier().c_str());
+      return false;
+   }
+
+   // does it match the stored size?
+   const int storedFileSize = vaultFileBlock.getStoredFileSize();
+   if ((storedFileSize < 0) ||
+       (contents.length() != static_cast<size_t>(storedFileSize))) {
+      Logger::error("block mismatch with stored size");
+      return false;
+   }
+
+   // remove base64 encoding (only vaults in text mode have it)
+   if (vault.getPayloadEncoding() == GFS::PAYLOAD_ENCODING_BASE64) {
+      string decodedContents;
+      Encryption::base64Decode(contents, decodedContents);
+      contents.swap(decodedContents);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool GFSClient::reconstructBlock(const vector<RestoreVault>& restoreVaults,
+                                 const RestoreBlock& restoreBlock,
+                                 ReplicaSelector& replicaSelector,
+                                 string& contents) {
+   const VaultFileBlock& first = restoreBlock.vaultFileBlock;
+   ReedSolomon reedSolomon(first.getDataFragments(),
+                           first.getParityFragments());
+   if (!reedSolomon.isValid()) {
+      Logger::error("invalid erasure coding for block");
+      return false;
+   }
+
+   const int dataFragments = reedSolomon.getDataFragments();
+   const int numFragments = dataFragments + reedSolomon.getParityFragments();
+   vector<string> fragmentContents(numFragments);
+   vector<const string*> fragments(numFragments, nullptr);
+   int numRetrieved = 0;
+
+   // the fragments on the fastest healthy nodes are fetched first (data
+   // fragments first among equals)
+   vector<int> fragmentNodes;
+   for (const auto& fragment : restoreBlock.fragments) {
+      fragmentNodes.push_back(fragment.restoreVaultIndex);
+   }
+
+   vector<int> order;
+   replicaSelector.orderReplicas(fragmentNodes,
+                                 first.getStoredFileSize(),
+                                 order);
+
+   // only as many fragments as are needed are fetched; a fragment that
+   // can not be retrieved is replaced by the next one
+   for (const int position : order) {
+      if (numRetrieved == dataFragments) {
+         break;
+      }
+
+      const RestoreFragment& fragment = restoreBlock.fragments[position];
+      const int fragmentIndex = fragment.vaultFileBlock.getFragmentIndex();
+      if ((fragmentIndex < 0) || (fragmentIndex >= numFragments)) {
+         continue;
+      }
+
+      // fetched through the selector to keep the node statistics current
+      // (a single fragment is never hedged)
+      const ReplicaSelector::ReplicaFetch fetchFragment =
+         [this, &restoreVaults, fragment](int replica, string& replicaContents) {
+         return retrieveStoredBlock(restoreVaults[fragment.restoreVaultIndex],
+                                    fragment.vaultFileBlock,
+                                    replicaContents);
+      };
+
+      const vector<int> fragmentNode(1, fragment.restoreVaultIndex);
+      const int fetched =
+         replicaSelector.fetch(fragmentNode,
+                               fragment.vaultFileBlock.getStoredFileSize(),
+                               fetchFragment,
+                               fragmentContents[fragmentIndex]);
+
+      if (fetched > -1) {
+         fragments[fragmentIndex] = &fragmentContents[fragmentIndex];
+         ++numRetrieved;
+      }
+   }
+
+   if (!reedSolomon.decode(fragments, first.getPayloadSize(), contents)) {
+      Logger::error("unable to rebuild block from its fragments");
+      ::printf("fragments retrieved = %d\n", numRetrieved);
+      ::printf("data fragments = %d\n", dataFragments);
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
 
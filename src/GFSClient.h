@@ -2,22 +2,38 @@
 #ifndef LACHEPAS_GFSCLIENT_H
 #define LACHEPAS_GFSCLIENT_H
 
+#include <sys/stat.h>
+
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <set>
 
+#include "BlockPlacement.h"
+#include "CompressionPolicy.h"
 #include "DateTime.h"
 #include "GFSOptions.h"
 #include "GFSExclusions.h"
 #include "Vault.h"
+#include "VaultFileBlock.h"
+#include "Message.h"
+#include "SendPipeline.h"
 
 
 namespace lachepas {
 
+class BlockCipher;
+class BlockCompressor;
 class DataAccess;
+class FileChunker;
 class LocalDirectory;
+class ReedSolomon;
+class ReplicaSelector;
+class RestoreEngine;
+struct RestorePlanFile;
 class StorageNode;
+class SyncTransaction;
 class VaultFile;
 
 /**
@@ -26,6 +42,75 @@ class VaultFile;
 class GFSClient {
 
 private:
+   typedef std::map<std::string, std::unique_ptr<BlockCipher>> BlockCipherMap;
+   typedef std::map<std::string, std::unique_ptr<BlockCompressor>> BlockCompressorMap;
+
+   /**
+    * Blocks already stored for a file on one node, used to avoid resending
+    * blocks whose unique identifier hasn't changed
+    */
+   struct NodeBlockList {
+      FileBlock::Format format;                            // of the vault
+      std::map<std::string, VaultFileBlock> storedBlocks;  // by identifier
+      std::map<int, VaultFileBlock> previousBlocks;        // by sequence
+      std::set<int> retainedBlockIds;
+      std::vector<VaultFileBlock> insertedBlocks;
+      std::map<std::string, int> addedReferences;         // by identifier
+      int nodeIndex;
+
+      NodeBlockList() :
+         nodeIndex(-1) {
+      }
+   };
+
+   /**
+    * What part of a local directory a restore covers
+    */
+   enum RestoreScope {
+      RESTORE_DIRECTORY,     // every file
+      RESTORE_SUBDIRECTORY,  // the files below a path
+      RESTORE_FILE           // a single file
+   };
+
+   /**
+    * A vault that a restore takes blocks from
+    */
+   struct RestoreVault {
+      Vault vault;
+      std::string nodeName;
+      std::unique_ptr<BlockCipher> blockCipher;  // only if encrypted
+   };
+
+   /**
+    * A stored block (or fragment) and the vault it is taken from
+    */
+   struct RestoreFragment {
+      VaultFileBlock vaultFileBlock;
+      int restoreVaultIndex;
+
+      RestoreFragment() :
+         restoreVaultIndex(-1) {
+      }
+   };
+
+   /**
+    * A block of a file being restored and the vault it is taken from. A
+    * block stored whole lists every whole copy found (vaultFileBlock is
+    * the first of them). An erasure coded block stored nowhere whole lists
+    * the fragments found (by fragment index), and vaultFileBlock is the
+    * first of them.
+    */
+   struct RestoreBlock {
+      VaultFileBlock vaultFileBlock;
+      int restoreVaultIndex;
+      std::vector<RestoreFragment> replicas;
+      std::vector<RestoreFragment> fragments;
+
+      RestoreBlock() :
+         restoreVaultIndex(-1) {
+      }
+   };
+
    /**
     *
     * @param nodeName
@@ -40,6 +125,27 @@ private:
     */
    int indexForLocalDirectory(const std::string& dirPath);
 
+   /**
+    * Rebuilds the block placement from the active storage nodes
+    */
+   void loadBlockPlacement();
+
+   /**
+    * Flags a vault file so that the next sync sends the file to the vault's
+    * node again
+    * @param vaultFile
+    * @return
+    */
+   bool markVaultFileStale(VaultFile& vaultFile);
+
+   /**
+    *
+    * @param localDirectory
+    * @return whether the directory's blocks are split into fragments, which
+    * needs a node for each fragment
+    */
+   bool isErasureCoded(const LocalDirectory& localDirectory) const;
+
 protected:
 
    /**
@@ -50,6 +156,15 @@ protected:
    void scanDir(const std::string& dirPath,
                 const LocalDirectory& localDirectory);
 
+   /**
+    * Walks the directory tree with the local directory's configured number
+    * of walker threads, feeding discovered files to scanProcessFile
+    * @param dirPath
+    * @param localDirectory
+    */
+   void scanDirParallel(const std::string& dirPath,
+                        const LocalDirectory& localDirectory);
+
    /**
     *
     * @param dirPath
@@ -66,6 +181,18 @@ protected:
                         const std::string& fileName,
                         const LocalDirectory& localDirectory);
 
+   /**
+    *
+    * @param fullFilePath
+    * @param fileName
+    * @param st file status already obtained for fullFilePath
+    * @param localDirectory
+    */
+   void scanProcessFile(const std::string& fullFilePath,
+                        const std::string& fileName,
+                        const struct stat& st,
+                        const LocalDirectory& localDirectory);
+
    /**
     *
     * @param filePath
@@ -76,35 +203,273 @@ protected:
 
    /**
     *
-    * @param numBlockFiles
+    * @param localDirectory directory settings (encryption, chunking)
     * @param filePath
-    * @param encrypt
     * @param nodeBlockFlags
     * @param mapVaultIdToVaultFile
     * @param createTime
     * @param modifyTime
     * @return
     */
-   int sendFile(int numBlockFiles,
+   int sendFile(const LocalDirectory& localDirectory,
                 const std::string& filePath,
-                bool encrypt,
                 std::string& nodeBlockFlags,
                 std::map<int, VaultFile>& mapVaultIdToVaultFile,
                 chaudiere::DateTime& createTime,
                 chaudiere::DateTime& modifyTime);
 
    /**
-    *
+    * Reads the next block of a file being sent (pipeline reader stage)
+    * @param chunker
+    * @param filePath
+    * @param block
+    * @param endOfFile
+    * @return
+    */
+   bool readFileBlock(FileChunker& chunker,
+                      const std::string& filePath,
+                      FileBlock& block,
+                      bool& endOfFile);
+
+   /**
+    * Compresses and encrypts (optionally) and encodes a block and computes
+    * its unique identifiers (pipeline transform stage, runs on worker threads)
+    * @param block
+    * @param blockCompressors compressors by codec name
+    * @param compressionPolicy decides whether the block is worth compressing
+    * @param blockCiphers ciphers (keys already expanded) by name
+    * @param blockFormats formats of the vaults receiving the block
+    * @param reedSolomon splits the payloads into fragments (nullptr to send
+    * them whole)
+    * @return
+    */
+   bool transformFileBlock(FileBlock& block,
+                           const BlockCompressorMap& blockCompressors,
+                           CompressionPolicy& compressionPolicy,
+                           const BlockCipherMap& blockCiphers,
+                           const std::set<FileBlock::Format>& blockFormats,
+                           const ReedSolomon* reedSolomon);
+
+   /**
+    * Loads the blocks currently recorded for a vault file
+    * @param vaultFile
+    * @param nodeBlockList
+    * @return
+    */
+   bool loadNodeBlockList(const VaultFile& vaultFile,
+                          NodeBlockList& nodeBlockList);
+
+   /**
+    * Asks a storage node which of a batch of blocks it already stores
+    * (pipeline existence check, runs on the node's sender thread)
+    * @param nodeName
+    * @param nodeBlockList
+    * @param blocks
+    * @param stored
+    */
+   void checkFileBlocks(const std::string& nodeName,
+                        const NodeBlockList& nodeBlockList,
+                        const std::vector<const FileBlock*>& blocks,
+                        std::vector<bool>& stored);
+
+   /**
+    * Sends a block to a storage node unless the node already has it
+    * (pipeline sender stage, runs on the node's sender thread)
+    * @param nodeName
+    * @param nodeBlockList
+    * @param block
+    * @param storedOnNode whether the node has the block for some other file
+    * @param result
+    */
+   void sendFileBlock(const std::string& nodeName,
+                      const NodeBlockList& nodeBlockList,
+                      const FileBlock& block,
+                      bool storedOnNode,
+                      BlockSendResult& result);
+
+   /**
+    * Sends a request that stores a block (or a reference to it) on a node
+    * and fills in the result from the response
+    * @param nodeName
+    * @param message
+    * @param result
+    */
+   void sendBlockMessage(const std::string& nodeName,
+                         tonnerre::Message& message,
+                         BlockSendResult& result);
+
+   /**
+    * Determines whether every block that moved off a node (a block still in
+    * the file that the node no longer holds) reached the nodes it is now
+    * placed on
+    * @param nodeBlockList
+    * @param copyCount
+    * @param placementKeys placement keys of the blocks in the file
+    * @param nodeSent whether the file reached each node
+    * @return
+    */
+   bool haveMovedBlocksPlaced(const NodeBlockList& nodeBlockList,
+                              int copyCount,
+                              const std::set<std::string>& placementKeys,
+                              const std::vector<bool>& nodeSent);
+
+   /**
+    * Settles the references a node holds for a file's blocks once the file
+    * has been sent to it. Every row of a vault file holds one reference to
+    * its block, but a block carried forward to a new position took none of
+    * its own, so references are released (or added) per block. References
+    * are added at once; releases wait for the sync transaction to commit.
+    * @param nodeName
+    * @param nodeBlockList
+    * @param keepNewVersion whether the node keeps the version just sent
+    * (otherwise the previous one)
+    */
+   void settleNodeReferences(const std::string& nodeName,
+                             const NodeBlockList& nodeBlockList,
+                             bool keepNewVersion);
+
+   /**
+    * Drops references a file held to a block on a storage node
+    * @param nodeName
+    * @param uniqueIdentifier
+    * @param nodeDirectory
+    * @param nodeFile
+    * @param numReferences
+    */
+   void releaseNodeBlock(const std::string& nodeName,
+                         const std::string& uniqueIdentifier,
+                         const std::string& nodeDirectory,
+                         const std::string& nodeFile,
+                         int numReferences);
+
+   /**
+    * Records a block stored on a node in the catalog
+    * @param result
+    * @param nodeBlockList
+    * @param mapVaultIdToVaultFile
+    * @param createTime
+    * @param modifyTime
+    * @return false if the rest of the file should not be sent
+    */
+   bool recordFileBlock(const BlockSendResult& result,
+                        NodeBlockList& nodeBlockList,
+                        std::map<int, VaultFile>& mapVaultIdToVaultFile,
+                        chaudiere::DateTime& createTime,
+                        chaudiere::DateTime& modifyTime);
+
+   /**
+    * Checks the restore options and restores from the chosen node
+    * @param restoreScope
+    * @param restorePath subdirectory or file to restore (ignored for the
+    * whole directory)
+    * @return
+    */
+   bool restoreFromOptions(RestoreScope restoreScope,
+                           const std::string& restorePath);
+
+   /**
+    * Restores the files of a local directory, of one of its subdirectories
+    * or a single file
     * @param encryptionKey
-    * @param storageNode
+    * @param storageNode node to try first (nullptr to let the restore
+    * choose the fastest node for each block)
     * @param sourceDirectory
+    * @param restoreScope
+    * @param restorePath subdirectory or file within the source directory
     * @param targetDirectory
     * @return
     */
-   bool fullRestore(const std::string& encryptionKey,
-                    const StorageNode& storageNode,
-                    const LocalDirectory& sourceDirectory,
-                    const std::string& targetDirectory);
+   bool restoreFiles(const std::string& encryptionKey,
+                     const StorageNode* storageNode,
+                     const LocalDirectory& sourceDirectory,
+                     RestoreScope restoreScope,
+                     const std::string& restorePath,
+                     const std::string& targetDirectory);
+
+   /**
+    * Restores one file of a restore plan into the target directory
+    * @param restoreVaults
+    * @param planFile the file with its vault files and blocks
+    * @param targetDirectory
+    * @param blockCompressors decompressors by codec
+    * @param replicaSelector chooses the node each block is fetched from
+    * @param restoreEngine writes the file's blocks as they are fetched
+    */
+   void restorePlanFile(const std::vector<RestoreVault>& restoreVaults,
+                        const RestorePlanFile& planFile,
+                        const std::string& targetDirectory,
+                        const BlockCompressorMap& blockCompressors,
+                        ReplicaSelector& replicaSelector,
+                        RestoreEngine& restoreEngine);
+
+   /**
+    * Retrieves a block from the best of its replicas (or rebuilds it from
+    * its fragments), decrypts and decompresses it. Called by the restore
+    * fetch workers.
+    * @param restoreVaults
+    * @param restoreBlock
+    * @param blockCompressors decompressors by codec
+    * @param replicaSelector
+    * @param contents receives the block as it was read from the file
+    * @return
+    */
+   bool restoreBlockContents(const std::vector<RestoreVault>& restoreVaults,
+                             const RestoreBlock& restoreBlock,
+                             const BlockCompressorMap& blockCompressors,
+                             ReplicaSelector& replicaSelector,
+                             std::string& contents);
+
+   /**
+    * Finds the newest version of a file in any of the vaults
+    * @param restoreVaults
+    * @param planFile the file with its vault files
+    * @param vaultFile
+    * @return false if no vault has the file
+    */
+   bool findRestoreVaultFile(const std::vector<RestoreVault>& restoreVaults,
+                             const RestorePlanFile& planFile,
+                             VaultFile& vaultFile);
+
+   /**
+    * Gathers the blocks of one version of a file from the vaults: every
+    * whole copy of each block, or else the fragments of it that the vaults
+    * hold
+    * @param restoreVaults
+    * @param planFile the file with its vault files and blocks
+    * @param vaultFile the version to restore
+    * @param fileBlocks receives the blocks by sequence number
+    */
+   void collectRestoreBlocks(const std::vector<RestoreVault>& restoreVaults,
+                             const RestorePlanFile& planFile,
+                             const VaultFile& vaultFile,
+                             std::map<int, RestoreBlock>& fileBlocks);
+
+   /**
+    * Retrieves a stored block (or fragment) from its node and checks it
+    * against the catalog
+    * @param restoreVault vault holding the block
+    * @param vaultFileBlock
+    * @param contents receives the block as stored (base64 removed)
+    * @return
+    */
+   bool retrieveStoredBlock(const RestoreVault& restoreVault,
+                            const VaultFileBlock& vaultFileBlock,
+                            std::string& contents);
+
+   /**
+    * Rebuilds an erasure coded block from the first of its fragments that
+    * can be retrieved, trying the fastest healthy nodes first
+    * @param restoreVaults
+    * @param restoreBlock
+    * @param replicaSelector
+    * @param contents receives the block as stored before it was split
+    * @return false if fewer fragments than the block's data fragments
+    * could be retrieved
+    */
+   bool reconstructBlock(const std::vector<RestoreVault>& restoreVaults,
+                         const RestoreBlock& restoreBlock,
+                         ReplicaSelector& replicaSelector,
+                         std::string& contents);
 
 public:
 
@@ -168,6 +533,20 @@ public:
     */
    void listNodes();
 
+   /**
+    * Measures single-threaded encryption and decryption throughput of each
+    * supported cipher on random blocks of the average chunk size and
+    * prints one line per cipher
+    */
+   void benchmarkCiphers();
+
+   /**
+    * Measures the catalog lookups sync makes for each file (local file,
+    * vault file and its blocks) as a scratch catalog grows from 10 thousand
+    * to 10 million files, and prints one line per size
+    */
+   void benchmarkCatalog();
+
    /**
     *
     * @return
@@ -266,6 +645,16 @@ public:
     */
    bool activateStorageNode(StorageNode& storageNode);
 
+   /**
+    * Works out which stored blocks have to move after the active storage
+    * nodes (or their capacities) changed, and marks the files that hold
+    * them so that the next sync sends each moved block to its new node.
+    * Once the new node has it, the block is dropped from (and released on)
+    * the node it left. Blocks that stay where they are are not sent again.
+    * @return
+    */
+   bool rebalanceBlocks();
+
    /**
     *
     */
@@ -283,14 +672,14 @@ public:
    bool restore();
 
    /**
-    *
-    * @param dirPath
+    * Restores the files below a subdirectory of the directory
+    * @param dirPath path of the subdirectory within the directory
     * @return
     */
    bool restoreSubdirectory(const std::string& dirPath);
 
    /**
-    *
+    * Restores the file given in the options (a path within the directory)
     * @return
     */
    bool restoreFile();
@@ -311,7 +700,9 @@ public:
 
 private:
    std::map<std::string, Vault> m_mapNodeToVault;
+   std::map<std::string, CompressionHistory> m_compressionHistory;  // by extension
    std::vector<StorageNode> m_activeNodes;
+   BlockPlacement m_blockPlacement;  // over m_activeNodes
    std::vector<LocalDirectory> m_activeDirectories;
    GFSExclusions m_exclusions;
    std::string m_currentDir;
@@ -319,6 +710,7 @@ private:
    std::string m_metaDataDBFile;
    std::string m_messagingService;
    DataAccess* m_dataAccess;
+   SyncTransaction* m_syncTransaction;  // only while syncing
    GFSOptions m_gfsOptions;
    int m_localDirectoryId;
    int m_localDirectoryPathLength;
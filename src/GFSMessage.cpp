@@ -25,6 +25,9 @@ static const string KEY_DIR                = KEY_PREFIX + "dir";
 static const string KEY_DIR_LIST           = KEY_PREFIX + "dirList";
 static const string KEY_FILE               = KEY_PREFIX + "file";
 static const string KEY_FILE_LIST          = KEY_PREFIX + "fileList";
+static const string KEY_FILE_BITMAP        = KEY_PREFIX + "fileBitmap";
+static const string KEY_HASH_ALGORITHM     = KEY_PREFIX + "hash_alg";
+static const string KEY_PAYLOAD_ENCODING   = KEY_PREFIX + "payload_enc";
 static const string KEY_ORIGIN_FS          = KEY_PREFIX + "origin_fs";
 static const string KEY_STORED_FS          = KEY_PREFIX + "stored_fs";
 static const string KEY_UNIQUE_IDENTIFIER  = KEY_PREFIX + "unique_id";
@@ -156,6 +159,44 @@ const string& GFSMessage::getUniqueIdentifier(const tonnerre::Message& message)
 
 //******************************************************************************
 
+void GFSMessage::setHashAlgorithm(tonnerre::Message& message,
+                                  const string& hashAlgorithm) {
+   GFSMessage::setKeyValue(message, KEY_HASH_ALGORITHM, hashAlgorithm);
+}
+
+//******************************************************************************
+
+bool GFSMessage::hasHashAlgorithm(const tonnerre::Message& message) {
+   return GFSMessage::hasKey(message, KEY_HASH_ALGORITHM);
+}
+
+//******************************************************************************
+
+const string& GFSMessage::getHashAlgorithm(const tonnerre::Message& message) {
+   return GFSMessage::getKeyValue(message, KEY_HASH_ALGORITHM);
+}
+
+//******************************************************************************
+
+void GFSMessage::setPayloadEncoding(tonnerre::Message& message,
+                                    const string& payloadEncoding) {
+   GFSMessage::setKeyValue(message, KEY_PAYLOAD_ENCODING, payloadEncoding);
+}
+
+//******************************************************************************
+
+bool GFSMessage::hasPayloadEncoding(const tonnerre::Message& message) {
+   return GFSMessage::hasKey(message, KEY_PAYLOAD_ENCODING);
+}
+
+//******************************************************************************
+
+const string& GFSMessage::getPayloadEncoding(const tonnerre::Message& message) {
+   return GFSMessage::getKeyValue(message, KEY_PAYLOAD_ENCODING);
+}
+
+//******************************************************************************
+
 void GFSMessage::setOriginFileSize(tonnerre::Message& message,
                                    unsigned long fileSize) {
    GFSMessage::setKeyValue(message, KEY_ORIGIN_FS, StrUtils::toString(fileSize));
@@ -188,13 +229,13 @@ void GFSMessage::setStoredFileSize(tonnerre::Message& message,
 
 //******************************************************************************
 
-bool GFSMessage::hasStoredFileSize(tonnerre::Message& message) {
+bool GFSMessage::hasStoredFileSize(const tonnerre::Message& message) {
    return GFSMessage::hasKey(message, KEY_STORED_FS);
 }
 
 //******************************************************************************
 
-unsigned long GFSMessage::getStoredFileSize(tonnerre::Message& message) {
+unsigned long GFSMessage::getStoredFileSize(const tonnerre::Message& message) {
    unsigned long fileSize = 0L;
    const string& fileSizeString = GFSMessage::getKeyValue(message, KEY_STORED_FS);
    if (!fileSizeString.empty()) {
@@ -226,13 +267,13 @@ void GFSMessage::setFileList(tonnerre::Message& message,
 
 //******************************************************************************
 
-bool GFSMessage::hasFileList(tonnerre::Message& message) {
+bool GFSMessage::hasFileList(const tonnerre::Message& message) {
    return GFSMessage::hasKey(message, KEY_FILE_LIST);
 }
 
 //******************************************************************************
 
-bool GFSMessage::getFileList(tonnerre::Message& message,
+bool GFSMessage::getFileList(const tonnerre::Message& message,
                              vector<string>& listFiles) {
    bool success = false;
    if (hasFileList(message)) {
@@ -253,6 +294,67 @@ bool GFSMessage::getFileList(tonnerre::Message& message,
 
 //******************************************************************************
 
+void GFSMessage::setFileBitmap(tonnerre::Message& message,
+                               const vector<bool>& flags) {
+   static const char HEX_DIGITS[] = "0123456789abcdef";
+
+   const size_t numFlags = flags.size();
+   string encodedBitmap((numFlags + 3) / 4, '0');
+
+   for (size_t i = 0; i < numFlags; ++i) {
+      if (flags[i]) {
+         const size_t digit = i / 4;
+         const int value = (encodedBitmap[digit] <= '9') ?
+            encodedBitmap[digit] - '0' :
+            encodedBitmap[digit] - 'a' + 10;
+         encodedBitmap[digit] = HEX_DIGITS[value | (8 >> (i % 4))];
+      }
+   }
+
+   GFSMessage::setKeyValue(message, KEY_FILE_BITMAP, encodedBitmap);
+}
+
+//******************************************************************************
+
+bool GFSMessage::hasFileBitmap(const tonnerre::Message& message) {
+   return GFSMessage::hasKey(message, KEY_FILE_BITMAP);
+}
+
+//******************************************************************************
+
+bool GFSMessage::getFileBitmap(const tonnerre::Message& message,
+                               size_t numFiles,
+                               vector<bool>& flags) {
+   if (!hasFileBitmap(message)) {
+      return false;
+   }
+
+   const string& encodedBitmap = GFSMessage::getKeyValue(message, KEY_FILE_BITMAP);
+   if (encodedBitmap.length() != (numFiles + 3) / 4) {
+      return false;
+   }
+
+   flags.assign(numFiles, false);
+
+   for (size_t i = 0; i < numFiles; ++i) {
+      const char c = encodedBitmap[i / 4];
+      int value;
+      if ((c >= '0') && (c <= '9')) {
+         value = c - '0';
+      } else if ((c >= 'a') && (c <= 'f')) {
+         value = c - 'a' + 10;
+      } else {
+         return false;
+      }
+
+      flags[i] = ((value & (8 >> (i % 4))) != 0);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
 void GFSMessage::setDirList(tonnerre::Message& message,
                             const vector<string>& listDirectories) {
    if (!listDirectories.empty()) {
@@ -146,6 +146,51 @@ public:
     */
    static const std::string& getUniqueIdentifier(const tonnerre::Message& message);
 
+   /**
+    *
+    * @param message
+    * @param hashAlgorithm algorithm used to compute the unique identifier
+    */
+   static void setHashAlgorithm(tonnerre::Message& message,
+                                const std::string& hashAlgorithm);
+
+   /**
+    *
+    * @param message
+    * @return
+    */
+   static bool hasHashAlgorithm(const tonnerre::Message& message);
+
+   /**
+    *
+    * @param message
+    * @return
+    */
+   static const std::string& getHashAlgorithm(const tonnerre::Message& message);
+
+   /**
+    *
+    * @param message
+    * @param payloadEncoding how the block in the payload is encoded (raw
+    * bytes or base64 text)
+    */
+   static void setPayloadEncoding(tonnerre::Message& message,
+                                  const std::string& payloadEncoding);
+
+   /**
+    *
+    * @param message
+    * @return
+    */
+   static bool hasPayloadEncoding(const tonnerre::Message& message);
+
+   /**
+    *
+    * @param message
+    * @return
+    */
+   static const std::string& getPayloadEncoding(const tonnerre::Message& message);
+
    /**
     *
     * @param message
@@ -181,14 +226,14 @@ public:
     * @param message
     * @return
     */
-   static bool hasStoredFileSize(tonnerre::Message& message);
+   static bool hasStoredFileSize(const tonnerre::Message& message);
 
    /**
     *
     * @param message
     * @return
     */
-   static unsigned long getStoredFileSize(tonnerre::Message& message);
+   static unsigned long getStoredFileSize(const tonnerre::Message& message);
 
    /**
     *
@@ -203,7 +248,7 @@ public:
     * @param message
     * @return
     */
-   static bool hasFileList(tonnerre::Message& message);
+   static bool hasFileList(const tonnerre::Message& message);
 
    /**
     *
@@ -211,9 +256,36 @@ public:
     * @param listFiles
     * @return
     */
-   static bool getFileList(tonnerre::Message& message,
+   static bool getFileList(const tonnerre::Message& message,
                            std::vector<std::string>& listFiles);
 
+   /**
+    * Sets a bitmap with one flag per entry of a file list (encoded as hex
+    * digits, 4 flags per digit)
+    * @param message
+    * @param flags
+    */
+   static void setFileBitmap(tonnerre::Message& message,
+                             const std::vector<bool>& flags);
+
+   /**
+    *
+    * @param message
+    * @return
+    */
+   static bool hasFileBitmap(const tonnerre::Message& message);
+
+   /**
+    *
+    * @param message
+    * @param numFiles number of entries in the file list the bitmap is for
+    * @param flags
+    * @return false if the bitmap is missing or doesn't have numFiles flags
+    */
+   static bool getFileBitmap(const tonnerre::Message& message,
+                             size_t numFiles,
+                             std::vector<bool>& flags);
+
    /**
     *
     * @param message
@@ -13,4 +13,8 @@ const string GFSMessageCommands::MSG_FILE_RETRIEVE = "fileRetrieve";
 const string GFSMessageCommands::MSG_FILE_ID = "fileId";
 const string GFSMessageCommands::MSG_FILE_STAT = "fileStat";
 const string GFSMessageCommands::MSG_FILE_LIST = "fileList";
+const string GFSMessageCommands::MSG_FILE_HAS_BATCH = "fileHasBatch";
+const string GFSMessageCommands::MSG_FILE_ADD_REF = "fileAddRef";
+
+const int GFSMessageCommands::MAX_FILE_BATCH_SIZE = 4096;
 
@@ -23,6 +23,11 @@ public:
    static const std::string MSG_FILE_ID;
    static const std::string MSG_FILE_STAT;
    static const std::string MSG_FILE_LIST;
+   static const std::string MSG_FILE_HAS_BATCH;
+   static const std::string MSG_FILE_ADD_REF;
+
+   // most block identifiers a MSG_FILE_HAS_BATCH request may carry
+   static const int MAX_FILE_BATCH_SIZE;
 };
 
 }
@@ -2,6 +2,13 @@
 // GFSOptions.cpp
 
 #include "GFSOptions.h"
+#include "FileChunker.h"
+#include "ContentHasher.h"
+#include "GFS.h"
+#include "BlockCipher.h"
+#include "BlockCompressor.h"
+#include "ReedSolomon.h"
+#include "RestoreEngine.h"
 
 using namespace std;
 using namespace lachepas;
@@ -9,7 +16,21 @@ using namespace lachepas;
 //******************************************************************************
 
 GFSOptions::GFSOptions() :
+   m_chunkMode(FileChunker::CHUNK_MODE_FIXED),
+   m_hashAlgorithm(ContentHasher::DEFAULT_ALGORITHM),
+   m_payloadEncoding(GFS::DEFAULT_PAYLOAD_ENCODING),
+   m_cipher(BlockCipher::DEFAULT_CIPHER),
+   m_compression(BlockCompressor::DEFAULT_COMPRESSION),
    m_copyCount(1),
+   m_nodeCapacity(1),
+   m_scanThreads(1),
+   m_restoreThreads(RestoreEngine::DEFAULT_FETCH_WORKERS),
+   m_chunkMinSize(FileChunker::DEFAULT_MIN_CHUNK_SIZE),
+   m_chunkAvgSize(FileChunker::DEFAULT_AVG_CHUNK_SIZE),
+   m_chunkMaxSize(FileChunker::DEFAULT_MAX_CHUNK_SIZE),
+   m_dataFragments(0),
+   m_parityFragments(0),
+   m_compressionLevel(0),
    m_debugMode(false),
    m_useEncryption(false),
    m_useCompression(false),
@@ -27,7 +48,21 @@ GFSOptions::GFSOptions(const GFSOptions& copy) :
    m_encryptionIV(copy.m_encryptionIV),
    m_configFile(copy.m_configFile),
    m_node(copy.m_node),
+   m_chunkMode(copy.m_chunkMode),
+   m_hashAlgorithm(copy.m_hashAlgorithm),
+   m_payloadEncoding(copy.m_payloadEncoding),
+   m_cipher(copy.m_cipher),
+   m_compression(copy.m_compression),
    m_copyCount(copy.m_copyCount),
+   m_nodeCapacity(copy.m_nodeCapacity),
+   m_scanThreads(copy.m_scanThreads),
+   m_restoreThreads(copy.m_restoreThreads),
+   m_chunkMinSize(copy.m_chunkMinSize),
+   m_chunkAvgSize(copy.m_chunkAvgSize),
+   m_chunkMaxSize(copy.m_chunkMaxSize),
+   m_dataFragments(copy.m_dataFragments),
+   m_parityFragments(copy.m_parityFragments),
+   m_compressionLevel(copy.m_compressionLevel),
    m_debugMode(copy.m_debugMode),
    m_useEncryption(copy.m_useEncryption),
    m_useCompression(copy.m_useCompression),
@@ -49,7 +84,21 @@ GFSOptions& GFSOptions::operator=(const GFSOptions& copy) {
    m_encryptionIV = copy.m_encryptionIV;
    m_configFile = copy.m_configFile;
    m_node = copy.m_node;
+   m_chunkMode = copy.m_chunkMode;
+   m_hashAlgorithm = copy.m_hashAlgorithm;
+   m_payloadEncoding = copy.m_payloadEncoding;
+   m_cipher = copy.m_cipher;
+   m_compression = copy.m_compression;
    m_copyCount = copy.m_copyCount;
+   m_nodeCapacity = copy.m_nodeCapacity;
+   m_scanThreads = copy.m_scanThreads;
+   m_restoreThreads = copy.m_restoreThreads;
+   m_chunkMinSize = copy.m_chunkMinSize;
+   m_chunkAvgSize = copy.m_chunkAvgSize;
+   m_chunkMaxSize = copy.m_chunkMaxSize;
+   m_dataFragments = copy.m_dataFragments;
+   m_parityFragments = copy.m_parityFragments;
+   m_compressionLevel = copy.m_compressionLevel;
    m_debugMode = copy.m_debugMode;
    m_useEncryption = copy.m_useEncryption;
    m_useCompression = copy.m_useCompression;
@@ -61,6 +110,38 @@ GFSOptions& GFSOptions::operator=(const GFSOptions& copy) {
 //******************************************************************************
 
 bool GFSOptions::validateOptions() const {
+   if (!FileChunker::isValidChunkMode(m_chunkMode)) {
+      return false;
+   }
+
+   if (!ContentHasher::isValidAlgorithm(m_hashAlgorithm)) {
+      return false;
+   }
+
+   if (!GFS::isValidPayloadEncoding(m_payloadEncoding)) {
+      return false;
+   }
+
+   if (!BlockCipher::isValidCipher(m_cipher)) {
+      return false;
+   }
+
+   if (!BlockCompressor::isValidCompression(m_compression)) {
+      return false;
+   }
+
+   // a copy count of 0 keeps every block on every node
+   if ((m_copyCount < 0) || (m_nodeCapacity < 1)) {
+      return false;
+   }
+
+   // 0 data fragments stores whole blocks (and takes no parity fragments)
+   if ((m_dataFragments < 0) || (m_parityFragments < 0) ||
+       ((m_dataFragments == 0) && (m_parityFragments > 0)) ||
+       (m_dataFragments + m_parityFragments > ReedSolomon::MAX_FRAGMENTS)) {
+      return false;
+   }
+
    return true;
 }
 
@@ -174,6 +255,159 @@ int GFSOptions::getCopyCount() const {
 
 //******************************************************************************
 
+void GFSOptions::setNodeCapacity(int nodeCapacity) {
+   m_nodeCapacity = nodeCapacity;
+}
+
+//******************************************************************************
+
+int GFSOptions::getNodeCapacity() const {
+   return m_nodeCapacity;
+}
+
+//******************************************************************************
+
+void GFSOptions::setErasureCoding(int dataFragments, int parityFragments) {
+   m_dataFragments = dataFragments;
+   m_parityFragments = parityFragments;
+}
+
+//******************************************************************************
+
+int GFSOptions::getDataFragments() const {
+   return m_dataFragments;
+}
+
+//******************************************************************************
+
+int GFSOptions::getParityFragments() const {
+   return m_parityFragments;
+}
+
+//******************************************************************************
+
+void GFSOptions::setScanThreads(int scanThreads) {
+   m_scanThreads = scanThreads;
+}
+
+//******************************************************************************
+
+int GFSOptions::getScanThreads() const {
+   return m_scanThreads;
+}
+
+//******************************************************************************
+
+void GFSOptions::setRestoreThreads(int restoreThreads) {
+   m_restoreThreads = restoreThreads;
+}
+
+//******************************************************************************
+
+int GFSOptions::getRestoreThreads() const {
+   return m_restoreThreads;
+}
+
+//******************************************************************************
+
+void GFSOptions::setChunkMode(const string& chunkMode) {
+   m_chunkMode = chunkMode;
+}
+
+//******************************************************************************
+
+const string& GFSOptions::getChunkMode() const {
+   return m_chunkMode;
+}
+
+//******************************************************************************
+
+void GFSOptions::setChunkSizes(int minSize, int avgSize, int maxSize) {
+   m_chunkMinSize = minSize;
+   m_chunkAvgSize = avgSize;
+   m_chunkMaxSize = maxSize;
+}
+
+//******************************************************************************
+
+int GFSOptions::getChunkMinSize() const {
+   return m_chunkMinSize;
+}
+
+//******************************************************************************
+
+int GFSOptions::getChunkAvgSize() const {
+   return m_chunkAvgSize;
+}
+
+//******************************************************************************
+
+int GFSOptions::getChunkMaxSize() const {
+   return m_chunkMaxSize;
+}
+
+//******************************************************************************
+
+void GFSOptions::setHashAlgorithm(const string& hashAlgorithm) {
+   m_hashAlgorithm = hashAlgorithm;
+}
+
+//******************************************************************************
+
+const string& GFSOptions::getHashAlgorithm() const {
+   return m_hashAlgorithm;
+}
+
+//******************************************************************************
+
+void GFSOptions::setPayloadEncoding(const string& payloadEncoding) {
+   m_payloadEncoding = payloadEncoding;
+}
+
+//******************************************************************************
+
+const string& GFSOptions::getPayloadEncoding() const {
+   return m_payloadEncoding;
+}
+
+//******************************************************************************
+
+void GFSOptions::setCipher(const string& cipher) {
+   m_cipher = cipher;
+}
+
+//******************************************************************************
+
+const string& GFSOptions::getCipher() const {
+   return m_cipher;
+}
+
+//******************************************************************************
+
+void GFSOptions::setCompression(const string& compression) {
+   m_compression = compression;
+}
+
+//******************************************************************************
+
+const string& GFSOptions::getCompression() const {
+   return m_compression;
+}
+
+//******************************************************************************
+
+void GFSOptions::setCompressionLevel(int compressionLevel) {
+   m_compressionLevel = compressionLevel;
+}
+
+//******************************************************************************
+
+int GFSOptions::getCompressionLevel() const {
+   return m_compressionLevel;
+}
+
+//******************************************************************************
+
 void GFSOptions::setDebugMode(bool debugMode) {
    m_debugMode = debugMode;
 }
@@ -20,7 +20,21 @@ private:
    std::string m_encryptionIV;
    std::string m_configFile;
    std::string m_node;
+   std::string m_chunkMode;
+   std::string m_hashAlgorithm;
+   std::string m_payloadEncoding;
+   std::string m_cipher;
+   std::string m_compression;
    int m_copyCount;
+   int m_nodeCapacity;
+   int m_scanThreads;
+   int m_restoreThreads;
+   int m_chunkMinSize;
+   int m_chunkAvgSize;
+   int m_chunkMaxSize;
+   int m_dataFragments;
+   int m_parityFragments;
+   int m_compressionLevel;
    bool m_debugMode;
    bool m_useEncryption;
    bool m_useCompression;
@@ -159,6 +173,165 @@ public:
     */
    int getCopyCount() const;
 
+   /**
+    * Sets the capacity given to storage nodes when they are added
+    * @param nodeCapacity relative amount of storage on the node
+    * @see StorageNode::setCapacity()
+    */
+   void setNodeCapacity(int nodeCapacity);
+
+   /**
+    *
+    * @return
+    */
+   int getNodeCapacity() const;
+
+   /**
+    * Sets how the blocks of a directory being initialized are erasure coded
+    * @param dataFragments number of data fragments per block (0 to store
+    * whole blocks)
+    * @param parityFragments number of parity fragments per block
+    * @see LocalDirectory::setErasureCoding()
+    */
+   void setErasureCoding(int dataFragments, int parityFragments);
+
+   /**
+    *
+    * @return
+    */
+   int getDataFragments() const;
+
+   /**
+    *
+    * @return
+    */
+   int getParityFragments() const;
+
+   /**
+    *
+    * @param scanThreads
+    */
+   void setScanThreads(int scanThreads);
+
+   /**
+    *
+    * @return
+    */
+   int getScanThreads() const;
+
+   /**
+    * Sets how many blocks a restore fetches at once
+    * @param restoreThreads
+    */
+   void setRestoreThreads(int restoreThreads);
+
+   /**
+    *
+    * @return
+    */
+   int getRestoreThreads() const;
+
+   /**
+    *
+    * @param chunkMode
+    */
+   void setChunkMode(const std::string& chunkMode);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getChunkMode() const;
+
+   /**
+    *
+    * @param minSize
+    * @param avgSize
+    * @param maxSize
+    */
+   void setChunkSizes(int minSize, int avgSize, int maxSize);
+
+   /**
+    *
+    * @return
+    */
+   int getChunkMinSize() const;
+
+   /**
+    *
+    * @return
+    */
+   int getChunkAvgSize() const;
+
+   /**
+    *
+    * @return
+    */
+   int getChunkMaxSize() const;
+
+   /**
+    *
+    * @param hashAlgorithm
+    */
+   void setHashAlgorithm(const std::string& hashAlgorithm);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getHashAlgorithm() const;
+
+   /**
+    * Sets how blocks of new vaults are sent and stored (existing vaults
+    * keep their encoding)
+    * @param payloadEncoding
+    */
+   void setPayloadEncoding(const std::string& payloadEncoding);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getPayloadEncoding() const;
+
+   /**
+    * Sets the cipher and mode used to encrypt the blocks of new vaults
+    * (existing vaults keep theirs)
+    * @param cipher
+    */
+   void setCipher(const std::string& cipher);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getCipher() const;
+
+   /**
+    * Sets the codec used to compress the blocks of new vaults (existing
+    * vaults keep theirs)
+    * @param compression 'lz4' (fast) or 'zstd' (smaller)
+    */
+   void setCompression(const std::string& compression);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getCompression() const;
+
+   /**
+    * Sets the compression level (zstd only; 0 selects the codec's default)
+    * @param compressionLevel
+    */
+   void setCompressionLevel(int compressionLevel);
+
+   /**
+    *
+    * @return
+    */
+   int getCompressionLevel() const;
+
    /**
     *
     * @param debugMode
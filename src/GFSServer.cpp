@@ -15,9 +15,15 @@
 #include "StrUtils.h"
 #include "GFSMessage.h"
 #include "GFSMessageCommands.h"
-#include "FileReferenceCount.h"
+#include "BlockStore.h"
+#include "FileBlockStore.h"
+#include "PackBlockStore.h"
 #include "GFS.h"
+#include "ContentHasher.h"
 #include "Encryption.h"
+#include "IniReader.h"
+#include "KeyValuePairs.h"
+#include "BasicException.h"
 
 using namespace std;
 using namespace lachepas;
@@ -31,7 +37,64 @@ static const string ZERO                   = "0";
 static const string ERR_MISSING_DIRECTORY  = "missing directory name";
 static const string ERR_MISSING_FILE       = "missing file name";
 static const string ERR_NOT_IMPLEMENTED    = "not implemented";
+static const string ERR_UNSUPPORTED_HASH   = "unsupported hash algorithm";
+static const string ERR_UNKNOWN_ENCODING   = "unsupported payload encoding";
+static const string ERR_PAYLOAD_LENGTH     = "payload length mismatch";
+
+static const string SEC_STORAGE_NODE       = "storage_node";
+static const string KEY_STORAGE_ENGINE     = "storage_engine";
+static const string KEY_PACK_SIZE          = "pack_size";
+static const string KEY_VERIFY_READ_BACK   = "verify_read_back";
+static const string KEY_GROUP_COMMIT       = "group_commit";
+static const string KEY_GROUP_COMMIT_BATCH = "group_commit_batch_size";
+static const string KEY_GROUP_COMMIT_DELAY = "group_commit_max_delay_ms";
 
+//******************************************************************************
+
+// Requests from clients that predate the hash algorithm header are for
+// vaults whose identifiers are SHA-1.
+static const string& HashAlgorithmForRequest(const Message& requestMessage) {
+   if (GFSMessage::hasHashAlgorithm(requestMessage)) {
+      return GFSMessage::getHashAlgorithm(requestMessage);
+   }
+
+   return ContentHasher::ALGORITHM_SHA1;
+}
+
+//******************************************************************************
+
+// Likewise, blocks from clients that predate the payload encoding header
+// are base64 text.
+static const string& PayloadEncodingForRequest(const Message& requestMessage) {
+   if (GFSMessage::hasPayloadEncoding(requestMessage)) {
+      return GFSMessage::getPayloadEncoding(requestMessage);
+   }
+
+   return GFS::PAYLOAD_ENCODING_BASE64;
+}
+
+//******************************************************************************
+
+// Raw payloads carry their length in the stored file size header, so a
+// block that was cut short on the way is refused rather than stored.
+static bool IsPayloadComplete(const Message& requestMessage,
+                              const string& payload) {
+   if (PayloadEncodingForRequest(requestMessage) != GFS::PAYLOAD_ENCODING_RAW) {
+      return true;
+   }
+
+   return GFSMessage::hasStoredFileSize(requestMessage) &&
+          (GFSMessage::getStoredFileSize(requestMessage) == payload.length());
+}
+
+//******************************************************************************
+
+static bool IsTrueSetting(const string& settingValue) {
+   string value = settingValue;
+   StrUtils::trim(value);
+   StrUtils::toLowerCase(value);
+   return (value == "true") || (value == "yes") || (value == "1");
+}
 
 //******************************************************************************
 //******************************************************************************
@@ -71,18 +134,30 @@ public:
             encodeError(responseMessage, "unable to obtain directory list");
          }
       } else if (requestName == GFSMessageCommands::MSG_FILE_ADD) {
-         if (GFSMessage::hasFile(requestMessage)) {
+         const string& hashAlgorithm = HashAlgorithmForRequest(requestMessage);
+
+         if (!ContentHasher::isValidAlgorithm(hashAlgorithm)) {
+            encodeError(responseMessage, ERR_UNSUPPORTED_HASH);
+         } else if (!GFS::isValidPayloadEncoding(PayloadEncodingForRequest(requestMessage))) {
+            encodeError(responseMessage, ERR_UNKNOWN_ENCODING);
+         } else if (!IsPayloadComplete(requestMessage, requestMessage.getTextPayload())) {
+            encodeError(responseMessage, ERR_PAYLOAD_LENGTH);
+         } else if (GFSMessage::hasFile(requestMessage)) {
             if (GFSMessage::hasUniqueIdentifier(requestMessage)) {
                const string& file = GFSMessage::getFile(requestMessage);
-               const string& b64FileContents = requestMessage.getTextPayload();
+               // stored as received (raw bytes or legacy base64 text);
+               // the client knows which from its vault
+               const string& fileContents = requestMessage.getTextPayload();
                string directory;
                string uniqueIdentifier =
                   GFSMessage::getUniqueIdentifier(requestMessage);
 
-               const string& fileContents = b64FileContents;
-
                if (!fileContents.empty() &&
-                   m_server.fileAdd(file, fileContents, directory, uniqueIdentifier)) {
+                   m_server.fileAdd(file,
+                                    fileContents,
+                                    directory,
+                                    uniqueIdentifier,
+                                    hashAlgorithm)) {
                   encodeBool(responseMessage, true);
                   GFSMessage::setUniqueIdentifier(responseMessage, uniqueIdentifier);
                   GFSMessage::setFile(responseMessage, file);
@@ -104,15 +179,67 @@ public:
             ::printf("hasFile returned false\n");
             encodeError(responseMessage, ERR_MISSING_FILE);
          }
-      } else if (requestName == GFSMessageCommands::MSG_FILE_UPDATE) {
+      } else if (requestName == GFSMessageCommands::MSG_FILE_ADD_REF) {
          if (GFSMessage::hasFile(requestMessage)) {
+            if (GFSMessage::hasUniqueIdentifier(requestMessage)) {
+               const string& file = GFSMessage::getFile(requestMessage);
+               const string& uniqueIdentifier =
+                  GFSMessage::getUniqueIdentifier(requestMessage);
+               string directory;
+
+               if (m_server.fileAddReference(file, directory, uniqueIdentifier)) {
+                  encodeBool(responseMessage, true);
+                  GFSMessage::setUniqueIdentifier(responseMessage, uniqueIdentifier);
+                  GFSMessage::setFile(responseMessage, file);
+                  GFSMessage::setDirectory(responseMessage, directory);
+               } else {
+                  encodeError(responseMessage, "file not stored");
+               }
+            } else {
+               encodeError(responseMessage, "missing unique identifier");
+            }
+         } else {
+            encodeError(responseMessage, ERR_MISSING_FILE);
+         }
+      } else if (requestName == GFSMessageCommands::MSG_FILE_HAS_BATCH) {
+         vector<string> listFiles;
+
+         if (!GFSMessage::getFileList(requestMessage, listFiles)) {
+            encodeError(responseMessage, ERR_MISSING_FILE);
+         } else if (listFiles.size() >
+                    static_cast<size_t>(GFSMessageCommands::MAX_FILE_BATCH_SIZE)) {
+            encodeError(responseMessage, "too many files in batch");
+         } else {
+            vector<bool> stored;
+
+            if (m_server.filesExist(listFiles, stored)) {
+               encodeSuccess(responseMessage);
+               GFSMessage::setFileBitmap(responseMessage, stored);
+            } else {
+               encodeError(responseMessage, "unable to check files");
+            }
+         }
+      } else if (requestName == GFSMessageCommands::MSG_FILE_UPDATE) {
+         const string& hashAlgorithm = HashAlgorithmForRequest(requestMessage);
+
+         if (!ContentHasher::isValidAlgorithm(hashAlgorithm)) {
+            encodeError(responseMessage, ERR_UNSUPPORTED_HASH);
+         } else if (!GFS::isValidPayloadEncoding(PayloadEncodingForRequest(requestMessage))) {
+            encodeError(responseMessage, ERR_UNKNOWN_ENCODING);
+         } else if (!IsPayloadComplete(requestMessage, requestMessage.getTextPayload())) {
+            encodeError(responseMessage, ERR_PAYLOAD_LENGTH);
+         } else if (GFSMessage::hasFile(requestMessage)) {
             if (GFSMessage::hasDirectory(requestMessage)) {
                string directory = GFSMessage::getDirectory(requestMessage);
                string file = GFSMessage::getFile(requestMessage);
                const string& fileContents = requestMessage.getTextPayload();
                string uniqueIdentifier;
 
-               if (m_server.fileUpdate(fileContents, directory, file, uniqueIdentifier)) {
+               if (m_server.fileUpdate(fileContents,
+                                       directory,
+                                       file,
+                                       uniqueIdentifier,
+                                       hashAlgorithm)) {
                   encodeBool(responseMessage, true);
                   GFSMessage::setUniqueIdentifier(responseMessage, uniqueIdentifier);
                   GFSMessage::setDirectory(responseMessage, directory);
@@ -145,14 +272,21 @@ public:
             encodeError(responseMessage, ERR_MISSING_DIRECTORY);
          }
       } else if (requestName == GFSMessageCommands::MSG_FILE_ID) {
-         if (GFSMessage::hasDirectory(requestMessage)) {
+         const string& hashAlgorithm = HashAlgorithmForRequest(requestMessage);
+
+         if (!ContentHasher::isValidAlgorithm(hashAlgorithm)) {
+            encodeError(responseMessage, ERR_UNSUPPORTED_HASH);
+         } else if (GFSMessage::hasDirectory(requestMessage)) {
             if (GFSMessage::hasFile(requestMessage)) {
                const string& directory =
                   GFSMessage::getDirectory(requestMessage);
                const string& file = GFSMessage::getFile(requestMessage);
                string uniqueIdentifier;
 
-               if (m_server.fileUniqueIdentifier(directory, file, uniqueIdentifier)) {
+               if (m_server.fileUniqueIdentifier(directory,
+                                                 file,
+                                                 uniqueIdentifier,
+                                                 hashAlgorithm)) {
                   encodeSuccess(responseMessage);
                   GFSMessage::setUniqueIdentifier(responseMessage, uniqueIdentifier);
                } else {
@@ -202,7 +336,8 @@ public:
                string fileContents;
                if (m_server.retrieveFileContents(directory, fileName, fileContents)) {
                   encodeSuccess(responseMessage);
-                  responsePayload = fileContents;
+                  GFSMessage::setStoredFileSize(responseMessage, fileContents.length());
+                  responsePayload.swap(fileContents);
                } else {
                   encodeError(responseMessage, "unable to retrieve file contents");
                }
@@ -220,13 +355,23 @@ public:
 //******************************************************************************
 
 GFSServer::GFSServer() :
-   m_debugPrint(true) {
-   m_fileReferenceCount = new FileReferenceCount;
+   m_blockStore(nullptr),
+   m_storageEngine(BlockStore::ENGINE_FILES),
+   m_packSize(PackBlockStore::DEFAULT_MAX_PACK_SIZE),
+   m_groupCommitBatchSize(0),
+   m_groupCommitMaxDelay(0),
+   m_debugPrint(true),
+   m_verifyReadBack(false),
+   m_groupCommit(false) {
 }
 
 //******************************************************************************
 
 GFSServer::~GFSServer() {
+   if (m_blockStore != nullptr) {
+      m_blockStore->close();
+      delete m_blockStore;
+   }
 }
 
 //******************************************************************************
@@ -264,21 +409,26 @@ bool GFSServer::run(const string& directory,
       if (OSUtils::pathExists(iniFilePath)) {
          m_baseDir = directory;
 
-         const char* pszDirPath = m_baseDir.c_str();
-         DIR* dir;
-         struct dirent* entry;
-
-         if ((dir = ::opendir(pszDirPath)) != nullptr) {
-            while ((entry = ::readdir(dir)) != nullptr) {
-               if (entry->d_type & DT_DIR) {
-                  if ((::strcmp(entry->d_name, "..") != 0) &&
-                      (::strcmp(entry->d_name, ".") != 0)) {
-                     m_listSubdirs.push_back(string(entry->d_name));
-                  }
-               }
-            }
-         } else {
-            ::printf("error: opendir failed for '%s'\n", m_baseDir.c_str());
+         readStorageNodeSettings(iniFilePath);
+
+         m_blockStore = createBlockStore();
+         if (m_blockStore == nullptr) {
+            return false;
+         }
+
+         m_blockStore->setVerifyReadBack(m_verifyReadBack);
+         m_blockStore->setGroupCommit(m_groupCommit);
+         if (m_groupCommitBatchSize > 0) {
+            m_blockStore->setGroupCommitBatchSize(m_groupCommitBatchSize);
+         }
+         m_blockStore->setGroupCommitMaxDelay(m_groupCommitMaxDelay);
+
+         if (!m_blockStore->open(m_baseDir)) {
+            ::printf("error: unable to open '%s' block store in '%s'\n",
+                     m_storageEngine.c_str(),
+                     m_baseDir.c_str());
+            delete m_blockStore;
+            m_blockStore = nullptr;
             return false;
          }
 
@@ -286,6 +436,11 @@ bool GFSServer::run(const string& directory,
          GFSStorageMessageHandler handler(*this);
          server.setMessageHandler(&handler);
          const int rc = server.run();
+
+         m_blockStore->close();
+         delete m_blockStore;
+         m_blockStore = nullptr;
+
          return (rc == 0);
       } else {
          Logger::error(string("ini file path does not exist: '") +
@@ -302,165 +457,144 @@ bool GFSServer::run(const string& directory,
 
 //******************************************************************************
 
-bool GFSServer::dirStat(const string& directory) {
-   //TODO: implement dirStat
-   return false;
-}
+void GFSServer::readStorageNodeSettings(const string& iniFilePath) {
+   try {
+      IniReader reader(iniFilePath);
+
+      if (reader.hasSection(SEC_STORAGE_NODE)) {
+         KeyValuePairs kvpSettings;
+         if (reader.readSection(SEC_STORAGE_NODE, kvpSettings)) {
+            if (kvpSettings.hasKey(KEY_STORAGE_ENGINE)) {
+               string value = kvpSettings.getValue(KEY_STORAGE_ENGINE);
+               StrUtils::trim(value);
+               StrUtils::toLowerCase(value);
+               if (!setStorageEngine(value)) {
+                  Logger::error(string("unknown storage engine '") +
+                                value +
+                                string("', using '") +
+                                m_storageEngine +
+                                string("'"));
+               }
+            }
 
-//******************************************************************************
+            if (kvpSettings.hasKey(KEY_PACK_SIZE)) {
+               const string value = kvpSettings.getValue(KEY_PACK_SIZE);
+               const long long packSizeMB = ::atoll(value.c_str());
+               if (packSizeMB > 0) {
+                  m_packSize = static_cast<uint64_t>(packSizeMB) * 1024ULL * 1024ULL;
+               } else {
+                  Logger::error(string("invalid pack_size '") +
+                                value +
+                                string("'"));
+               }
+            }
 
-bool GFSServer::dirList(vector<string>& listDirectories) {
-   if (m_debugPrint) {
-      Logger::debug("dirList called");
-   }
+            if (kvpSettings.hasKey(KEY_VERIFY_READ_BACK)) {
+               setVerifyReadBack(
+                  IsTrueSetting(kvpSettings.getValue(KEY_VERIFY_READ_BACK)));
+            }
+
+            if (kvpSettings.hasKey(KEY_GROUP_COMMIT)) {
+               m_groupCommit =
+                  IsTrueSetting(kvpSettings.getValue(KEY_GROUP_COMMIT));
+            }
 
-   const char* pszDirPath = m_baseDir.c_str();
-   DIR* dir;
-   struct dirent* entry;
-   bool success = false;
+            if (kvpSettings.hasKey(KEY_GROUP_COMMIT_BATCH)) {
+               const int batchSize =
+                  ::atoi(kvpSettings.getValue(KEY_GROUP_COMMIT_BATCH).c_str());
+               if (batchSize > 0) {
+                  m_groupCommitBatchSize = batchSize;
+               }
+            }
 
-   if ((dir = ::opendir(pszDirPath)) != nullptr) {
-      while ((entry = ::readdir(dir)) != nullptr) {
-         if (entry->d_type & DT_DIR) {
-            listDirectories.push_back(string(entry->d_name));
+            if (kvpSettings.hasKey(KEY_GROUP_COMMIT_DELAY)) {
+               const int maxDelayMillis =
+                  ::atoi(kvpSettings.getValue(KEY_GROUP_COMMIT_DELAY).c_str());
+               if (maxDelayMillis >= 0) {
+                  m_groupCommitMaxDelay = maxDelayMillis;
+               }
+            }
          }
       }
-
-      ::closedir(dir);
-      success = true;
-   } else {
-      Logger::error(string("unable to open directory '") +
-                    string(pszDirPath) +
-                    string("'"));
+   } catch (const BasicException&) {
+      Logger::error("exception caught reading storage node settings");
    }
-
-   return success;
 }
 
 //******************************************************************************
 
-bool GFSServer::getPathForFile(const string& directory,
-                               const string& file,
-                               string& filePath) {
-   string dirPath = m_baseDir;
-
-   if (!directory.empty()) {
-      if (!StrUtils::endsWith(dirPath, SLASH) &&
-          !StrUtils::startsWith(directory, SLASH)) {
-         dirPath += SLASH;
-      }
-
-      dirPath += directory;
+BlockStore* GFSServer::createBlockStore() {
+   if (m_storageEngine == BlockStore::ENGINE_FILES) {
+      return new FileBlockStore();
+   } else if (m_storageEngine == BlockStore::ENGINE_PACK) {
+      PackBlockStore* packBlockStore = new PackBlockStore();
+      packBlockStore->setMaxPackSize(m_packSize);
+      return packBlockStore;
+   } else {
+      Logger::error(string("unknown storage engine: ") + m_storageEngine);
+      return nullptr;
    }
-
-   filePath = OSUtils::pathJoin(dirPath, file);
-
-   return true;
 }
 
 //******************************************************************************
 
-bool GFSServer::fileUniqueIdentifier(const string& directory,
-                                     const string& file,
-                                     string& uniqueIdentifier) {
-   string filePath;
-   if (getPathForFile(directory, file, filePath)) {
-      return GFS::uniqueIdentifierForFile(filePath, uniqueIdentifier);
-   } else {
+bool GFSServer::setStorageEngine(const string& storageEngine) {
+   if (!BlockStore::isValidEngine(storageEngine)) {
       return false;
    }
+
+   m_storageEngine = storageEngine;
+   return true;
 }
 
 //******************************************************************************
 
-bool GFSServer::writeFile(const string& filePath,
-                          const string& fileContents,
-                          string& uniqueIdentifier) {
-   FILE* f = ::fopen(filePath.c_str(), "wt");
-   if (f != nullptr) {
-      const size_t objectsWritten =
-           ::fwrite(fileContents.c_str(), fileContents.length(), 1, f);
-
-      if (objectsWritten > 0) {
-         ::fflush(f);
-         ::fsync(::fileno(f));
-         ::fclose(f);
-         f = nullptr;
-
-         string storedFileId;
-         if (GFS::uniqueIdentifierForFile(filePath, storedFileId)) {
-            uniqueIdentifier = storedFileId;
-            return true;
-         } else {
-            // delete the file that we just wrote, since we're unable to verify
-            // its integrity
-            ::unlink(filePath.c_str());
-            ::printf("error: unable to obtain unique identifier for file '%s'\n",
-                     filePath.c_str());
-            Logger::debug("file deleted");
-         }
-      } else {
-         ::printf("error: unable to write to file '%s'\n", filePath.c_str());
-      }
-
-      if (f != nullptr) {
-         ::fclose(f);
-      }
-   } else {
-      ::printf("error: unable to open file '%s'\n", filePath.c_str());
-   }
-
-   return false;
+const string& GFSServer::getStorageEngine() const {
+   return m_storageEngine;
 }
 
 //******************************************************************************
 
-long GFSServer::referenceCountForFile(const string& filePath) {
-   return m_fileReferenceCount->referenceCountForFile(filePath);
+void GFSServer::setVerifyReadBack(bool verifyReadBack) {
+   m_verifyReadBack = verifyReadBack;
+   if (m_blockStore != nullptr) {
+      m_blockStore->setVerifyReadBack(verifyReadBack);
+   }
 }
 
 //******************************************************************************
 
-bool GFSServer::storeInitialReferenceCount(const string& filePath) {
-   return m_fileReferenceCount->storeInitialReferenceCount(filePath);
+bool GFSServer::getVerifyReadBack() const {
+   return m_verifyReadBack;
 }
 
 //******************************************************************************
 
-bool GFSServer::storeUpdatedReferenceCount(const string& filePath,
-                                           long refCountValue) {
-   if (refCountValue < 1L) {
-      return false;
-   }
-
-   return m_fileReferenceCount->storeUpdatedReferenceCount(filePath,
-                                                           refCountValue);
+bool GFSServer::dirStat(const string& directory) {
+   //TODO: implement dirStat
+   return false;
 }
 
 //******************************************************************************
 
-bool GFSServer::incrementReferenceCount(const string& filePath) {
-   long refCountValue = referenceCountForFile(filePath);
-   if (refCountValue < 1L) {
-      return false;
+bool GFSServer::dirList(vector<string>& listDirectories) {
+   if (m_debugPrint) {
+      Logger::debug("dirList called");
    }
 
-   ++refCountValue;
-
-   return storeUpdatedReferenceCount(filePath, refCountValue);
+   return m_blockStore->dirList(listDirectories);
 }
 
 //******************************************************************************
 
-bool GFSServer::decrementReferenceCount(const string& filePath) {
-   long refCountValue = referenceCountForFile(filePath);
-   if (refCountValue < 1L) {
-      return false;
-   }
-
-   --refCountValue;
-
-   return storeUpdatedReferenceCount(filePath, refCountValue);
+bool GFSServer::fileUniqueIdentifier(const string& directory,
+                                     const string& file,
+                                     string& uniqueIdentifier,
+                                     const string& hashAlgorithm) {
+   return m_blockStore->fileUniqueIdentifier(directory,
+                                             file,
+                                             uniqueIdentifier,
+                                             hashAlgorithm);
 }
 
 //******************************************************************************
@@ -468,75 +602,31 @@ bool GFSServer::decrementReferenceCount(const string& filePath) {
 bool GFSServer::fileAdd(const string& fileName,
                         const string& fileContents,
                         string& directory,
-                        string& uniqueIdentifier) {
+                        string& uniqueIdentifier,
+                        const string& hashAlgorithm) {
    if (m_debugPrint) {
       Logger::debug("fileAdd called");
    }
 
-   if (uniqueIdentifier.empty()) {
-      ::printf("fileAdd: uniqueIdentifier empty, returning\n");
-      return false;
-   }
-
-   string dirName;
-   int digitsFound = 0;
-
-   for (const char ch : uniqueIdentifier) {
-      if (ch >= '0' && ch <= '9') {
-         ++digitsFound;
-
-         // is it a leading 0?
-         if ((ch == '0') && (0 == digitsFound)) {
-            // don't put it
-         } else {
-            dirName += ch;
-         }
-
-         if (digitsFound == 2) {
-            break;
-         }
-      }
-   }
-
-   if (dirName.empty()) {
-      dirName = "00";
-   } else {
-      if (dirName.length() == 1) {
-         // add a leading zero
-         dirName.insert(0, ZERO);
-      }
-   }
-
-   directory = dirName;
+   return m_blockStore->fileAdd(fileName,
+                                fileContents,
+                                directory,
+                                uniqueIdentifier,
+                                hashAlgorithm);
+}
 
-   string filePath;
-   getPathForFile(directory, fileName, filePath);
+//******************************************************************************
 
-   if (filePath.empty()) {
-      ::printf("error: filePath is empty for directory='%s', fileName='%s'\n",
-               directory.c_str(),
-               fileName.c_str());
-      return false;
+bool GFSServer::fileAddReference(const string& fileName,
+                                 string& directory,
+                                 const string& uniqueIdentifier) {
+   if (m_debugPrint) {
+      Logger::debug("fileAddReference called");
    }
 
-   if (OSUtils::pathExists(filePath)) {
-      bool rc = incrementReferenceCount(filePath);
-      return rc;
-   } else {
-      string nodeUniqueIdentifier;
-      if (writeFile(filePath, fileContents, nodeUniqueIdentifier)) {
-         const bool refCountStored = storeInitialReferenceCount(filePath);
-         if (refCountStored) {
-            uniqueIdentifier = nodeUniqueIdentifier;
-         } else {
-            ::printf("storeInitialRefCount failed\n");
-         }
-         return refCountStored;
-      } else {
-         ::printf("writeFile failed\n");
-         return false;
-      }
-   }
+   return m_blockStore->fileAddReference(fileName,
+                                         directory,
+                                         uniqueIdentifier);
 }
 
 //******************************************************************************
@@ -544,7 +634,8 @@ bool GFSServer::fileAdd(const string& fileName,
 bool GFSServer::fileUpdate(const string& fileContents,
                            string& directory,
                            string& fileName,
-                           string& uniqueIdentifier) {
+                           string& uniqueIdentifier,
+                           const string& hashAlgorithm) {
    if (m_debugPrint) {
       Logger::debug("fileUpdate called");
    }
@@ -555,12 +646,17 @@ bool GFSServer::fileUpdate(const string& fileContents,
    // that the data will be stored in a new directory and file.
 
    const string uniqueIDFileContents =
-      GFS::uniqueIdentifierForString(fileContents);
+      GFS::uniqueIdentifierForString(fileContents, hashAlgorithm);
 
    if (uniqueIDFileContents != fileName) {
       if (fileDelete(directory, fileName)) {
          fileName = uniqueIDFileContents;
-         return fileAdd(fileName, fileContents, directory, uniqueIdentifier);
+         uniqueIdentifier = uniqueIDFileContents;
+         return fileAdd(fileName,
+                        fileContents,
+                        directory,
+                        uniqueIdentifier,
+                        hashAlgorithm);
       } else {
          Logger::error("fileUpdate failed - unable to delete old file");
          return false;
@@ -579,26 +675,19 @@ bool GFSServer::fileDelete(const string& directory,
       Logger::debug("fileDelete called");
    }
 
-   string filePath;
-   getPathForFile(directory, fileName, filePath);
+   return m_blockStore->fileDelete(directory, fileName);
+}
 
-   if (OSUtils::pathExists(filePath)) {
-      const long refCountValue = referenceCountForFile(filePath);
-      if (refCountValue < 1L) {
-         return false;
-      } else {
-         if (refCountValue > 1L) {
-            return decrementReferenceCount(filePath);
-         } else {
-            const int rc = ::unlink(filePath.c_str());
-            if (rc == 0) {
-               return true;
-            }
-         }
-      }
+//******************************************************************************
+
+bool GFSServer::filesExist(const vector<string>& fileNames,
+                           vector<bool>& stored) {
+   if (m_debugPrint) {
+      Logger::debug("filesExist called");
    }
 
-   return false;
+   m_blockStore->filesExist(fileNames, stored);
+   return (stored.size() == fileNames.size());
 }
 
 //******************************************************************************
@@ -609,10 +698,7 @@ bool GFSServer::fileStat(const string& directory,
       Logger::debug("fileStat called");
    }
 
-   string filePath;
-   getPathForFile(directory, fileName, filePath);
-
-   if (OSUtils::pathExists(filePath)) {
+   if (m_blockStore->fileExists(directory, fileName)) {
 
    }
 
@@ -628,41 +714,7 @@ bool GFSServer::fileList(const string& directory,
       Logger::debug("fileList called");
    }
 
-   string dirPath = m_baseDir;
-
-   if (!directory.empty()) {
-      if (!StrUtils::endsWith(dirPath, SLASH) &&
-          !StrUtils::startsWith(directory, SLASH)) {
-         dirPath += SLASH;
-      }
-
-      dirPath += directory;
-   } else {
-      printf("no directory specified\n");
-      return false;
-   }
-
-   const char* pszDirPath = dirPath.c_str();
-   DIR* dir;
-   struct dirent* entry;
-   bool success = false;
-
-   if ((dir = ::opendir(pszDirPath)) != nullptr) {
-      while ((entry = ::readdir(dir)) != nullptr) {
-         if (!(entry->d_type & DT_DIR)) {
-            listFiles.push_back(string(entry->d_name));
-         }
-      }
-
-      ::closedir(dir);
-      success = true;
-   } else {
-      Logger::error(string("unable to open directory '") +
-                    string(pszDirPath) +
-                    string("'"));
-   }
-
-   return success;
+   return m_blockStore->fileList(directory, listFiles);
 }
 
 //******************************************************************************
@@ -670,37 +722,10 @@ bool GFSServer::fileList(const string& directory,
 bool GFSServer::retrieveFileContents(const string& directory,
                                      const string& fileName,
                                      string& fileContents) {
-   bool retrievalSuccess = false;
-
-   if (directory.empty()) {
-      ::printf("retrieveFileContents: missing directory\n");
-      return false;
-   }
-
-   if (fileName.empty()) {
-      ::printf("retrieveFileContents: missing file name\n");
-      return false;
-   }
-
-   string filePath;
-   getPathForFile(directory, fileName, filePath);
-
-   if (filePath.empty()) {
-      ::printf("error: filePath is empty for directory='%s', fileName='%s'\n",
-               directory.c_str(),
-               fileName.c_str());
-      return false;
-   }
-
-   if (OSUtils::pathExists(filePath)) {
-      retrievalSuccess = GFS::readFile(filePath, fileContents);
-   } else {
-      ::printf("error: file does not exist\n");
-   }
-
-   return retrievalSuccess;
+   return m_blockStore->retrieveFileContents(directory,
+                                             fileName,
+                                             fileContents);
 }
 
 //******************************************************************************
 //******************************************************************************
-
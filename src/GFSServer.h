@@ -2,6 +2,8 @@
 #ifndef LACHEPAS_GFSSERVER_H
 #define LACHEPAS_GFSSERVER_H
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
@@ -10,7 +12,7 @@
 
 namespace lachepas {
 
-class FileReferenceCount;
+class BlockStore;
 
 /**
  *
@@ -19,52 +21,16 @@ class GFSServer {
 
 protected:
    /**
-    *
-    * @param filePath
-    * @param fileContents
-    * @param uniqueIdentifier
-    * @return
-    */
-   bool writeFile(const std::string& filePath,
-                  const std::string& fileContents,
-                  std::string& uniqueIdentifier);
-
-   /**
-    *
-    * @param filePath
-    * @return
+    * Reads the storage node settings from the INI file
+    * @param iniFilePath
     */
-   long referenceCountForFile(const std::string& filePath);
+   void readStorageNodeSettings(const std::string& iniFilePath);
 
    /**
-    *
-    * @param filePath
-    * @return
+    * Creates the block store for the configured storage engine
+    * @return new block store, or nullptr if the engine isn't known
     */
-   bool storeInitialReferenceCount(const std::string& filePath);
-
-   /**
-    *
-    * @param filePath
-    * @param refCountValue
-    * @return
-    */
-   bool storeUpdatedReferenceCount(const std::string& filePath,
-                                   long refCountValue);
-
-   /**
-    *
-    * @param filePath
-    * @return
-    */
-   bool incrementReferenceCount(const std::string& filePath);
-
-   /**
-    *
-    * @param filePath
-    * @return
-    */
-   bool decrementReferenceCount(const std::string& filePath);
+   BlockStore* createBlockStore();
 
 public:
    /**
@@ -95,6 +61,35 @@ public:
             const std::string& iniFilePath,
             const std::string& serviceName);
 
+   /**
+    * Sets the storage engine used for blocks ("files", one file per block,
+    * or "pack", blocks appended to large pack files). Can also be set with
+    * storage_engine in the [storage_node] section of the INI file.
+    * @param storageEngine
+    * @return boolean indicating whether the storage engine is known
+    */
+   bool setStorageEngine(const std::string& storageEngine);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getStorageEngine() const;
+
+   /**
+    * Sets whether each block is read back from disk and verified after it
+    * is written (paranoid mode, off by default). Can also be turned on with
+    * verify_read_back in the [storage_node] section of the INI file.
+    * @param verifyReadBack
+    */
+   void setVerifyReadBack(bool verifyReadBack);
+
+   /**
+    *
+    * @return
+    */
+   bool getVerifyReadBack() const;
+
 
    // --------------------------------------
    // Operations once the server is running
@@ -120,12 +115,25 @@ public:
     * @param fileContents
     * @param directory
     * @param uniqueIdentifier
+    * @param hashAlgorithm
     * @return
     */
    bool fileAdd(const std::string& fileName,
                 const std::string& fileContents,
                 std::string& directory,
-                std::string& uniqueIdentifier);
+                std::string& uniqueIdentifier,
+                const std::string& hashAlgorithm);
+
+   /**
+    * Adds a reference to a block the node already has, without its contents
+    * @param fileName
+    * @param directory
+    * @param uniqueIdentifier
+    * @return
+    */
+   bool fileAddReference(const std::string& fileName,
+                         std::string& directory,
+                         const std::string& uniqueIdentifier);
 
    /**
     *
@@ -133,12 +141,14 @@ public:
     * @param directory
     * @param fileName
     * @param uniqueIdentifier
+    * @param hashAlgorithm
     * @return
     */
    bool fileUpdate(const std::string& fileContents,
                    std::string& directory,
                    std::string& fileName,
-                   std::string& uniqueIdentifier);
+                   std::string& uniqueIdentifier,
+                   const std::string& hashAlgorithm);
 
    /**
     *
@@ -149,16 +159,27 @@ public:
    bool fileDelete(const std::string& directory,
                    const std::string& fileName);
 
+   /**
+    * Checks which of a batch of blocks the node already has
+    * @param fileNames
+    * @param stored receives, for each name, whether the block is stored
+    * @return
+    */
+   bool filesExist(const std::vector<std::string>& fileNames,
+                   std::vector<bool>& stored);
+
    /**
     *
     * @param directory
     * @param fileName
     * @param uniqueIdentifier
+    * @param hashAlgorithm
     * @return
     */
    bool fileUniqueIdentifier(const std::string& directory,
                              const std::string& fileName,
-                             std::string& uniqueIdentifier);
+                             std::string& uniqueIdentifier,
+                             const std::string& hashAlgorithm);
 
    //TODO: how to return file stat info?
    /**
@@ -179,17 +200,6 @@ public:
    bool fileList(const std::string& directory,
                  std::vector<std::string>& listFiles);
 
-   /**
-    *
-    * @param directory
-    * @param fileName
-    * @param filePath
-    * @return
-    */
-   bool getPathForFile(const std::string& directory,
-                       const std::string& fileName,
-                       std::string& filePath);
-
    /**
     *
     * @param directory
@@ -202,11 +212,16 @@ public:
                              std::string& fileContents);
 
 private:
-   std::vector<std::string> m_listSubdirs;
-   FileReferenceCount* m_fileReferenceCount;
+   BlockStore* m_blockStore;
    std::string m_baseDir;
    std::string m_messagingService;
+   std::string m_storageEngine;
+   uint64_t m_packSize;
+   unsigned int m_groupCommitBatchSize;
+   unsigned int m_groupCommitMaxDelay;
    bool m_debugPrint;
+   bool m_verifyReadBack;
+   bool m_groupCommit;
 
 };
 
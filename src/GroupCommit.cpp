@@ -0,0 +1,160 @@
+// Copyright Paul Dardeau, 2016
+// GroupCommit.cpp
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "GroupCommit.h"
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+GroupCommit::GroupCommit(SyncFunction syncFunction) :
+   m_syncFunction(syncFunction),
+   m_writeSequence(0),
+   m_syncedSequence(0),
+   m_failedSequence(0),
+   m_batchSize(1),
+   m_maxDelayMillis(0),
+   m_syncInProgress(false),
+   m_leaderWaiting(false) {
+}
+
+//******************************************************************************
+
+GroupCommit::~GroupCommit() {
+}
+
+//******************************************************************************
+
+bool GroupCommit::syncFileData(int fd) {
+#ifdef __APPLE__
+   // fsync on macOS doesn't flush the drive's write cache
+   return ::fcntl(fd, F_FULLFSYNC) != -1;
+#else
+   return ::fdatasync(fd) == 0;
+#endif
+}
+
+//******************************************************************************
+
+bool GroupCommit::syncFileSystem(int fd) {
+#ifdef __linux__
+   return ::syncfs(fd) == 0;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+bool GroupCommit::isFileSystemSyncAvailable() {
+#ifdef __linux__
+   return true;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+void GroupCommit::setBatchSize(unsigned int batchSize) {
+   lock_guard<mutex> lock(m_mutex);
+   m_batchSize = (batchSize > 0) ? batchSize : 1;
+}
+
+//******************************************************************************
+
+void GroupCommit::setMaxDelay(unsigned int maxDelayMillis) {
+   lock_guard<mutex> lock(m_mutex);
+   m_maxDelayMillis = maxDelayMillis;
+}
+
+//******************************************************************************
+
+uint64_t GroupCommit::registerWrite() {
+   lock_guard<mutex> lock(m_mutex);
+   const uint64_t ticket = ++m_writeSequence;
+   if (m_leaderWaiting) {
+      m_writeRegistered.notify_one();
+   }
+   return ticket;
+}
+
+//******************************************************************************
+
+bool GroupCommit::waitForSync(uint64_t ticket) {
+   unique_lock<mutex> lock(m_mutex);
+
+   while (m_syncedSequence < ticket) {
+      if (m_failedSequence >= ticket) {
+         return false;
+      }
+
+      if (m_syncInProgress) {
+         // a sync is running, but it may have started before this write was
+         // registered; wait for it and check again
+         m_syncDone.wait(lock);
+         continue;
+      }
+
+      // become the leader
+      m_syncInProgress = true;
+
+      if ((m_batchSize > 1) && (m_maxDelayMillis > 0)) {
+         // give the batch a chance to fill before paying for a sync
+         const auto deadline = chrono::steady_clock::now() +
+                               chrono::milliseconds(m_maxDelayMillis);
+         m_leaderWaiting = true;
+         while (m_writeSequence - m_syncedSequence < m_batchSize) {
+            if (m_writeRegistered.wait_until(lock, deadline) ==
+                cv_status::timeout) {
+               break;
+            }
+         }
+         m_leaderWaiting = false;
+      }
+
+      // sync everything registered up to now
+      const uint64_t syncTarget = m_writeSequence;
+
+      lock.unlock();
+      const bool syncSuccess = m_syncFunction();
+      lock.lock();
+
+      m_syncInProgress = false;
+
+      if (syncSuccess) {
+         if (syncTarget > m_syncedSequence) {
+            m_syncedSequence = syncTarget;
+         }
+      } else {
+         // after a failed fsync the state of the data is unknown; fail
+         // every write the sync was meant to cover
+         if (syncTarget > m_failedSequence) {
+            m_failedSequence = syncTarget;
+         }
+      }
+
+      m_syncDone.notify_all();
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void GroupCommit::markSynced() {
+   lock_guard<mutex> lock(m_mutex);
+   if (m_writeSequence > m_syncedSequence) {
+      m_syncedSequence = m_writeSequence;
+   }
+   m_syncDone.notify_all();
+}
+
+//******************************************************************************
+
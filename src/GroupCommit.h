@@ -0,0 +1,120 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_GROUPCOMMIT_H
+#define LACHEPAS_GROUPCOMMIT_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+
+namespace lachepas {
+
+/**
+ * Shares one sync among concurrent writers. A writer calls registerWrite
+ * after its write() has returned and then waitForSync with the ticket it
+ * got back. The first waiter to find no sync running becomes the leader and
+ * runs the sync function on behalf of every write registered so far;
+ * the rest wait for it. No writer returns before a sync that started after
+ * its write has completed.
+ *
+ * By default the leader syncs right away, so only writes that arrive while
+ * a sync is running share the next one. With a batch size and a maximum
+ * delay, the leader holds off for up to the delay until that many writes
+ * are waiting, trading a little latency for fewer syncs.
+ */
+class GroupCommit {
+
+public:
+   /**
+    * Makes everything written so far durable (e.g., fdatasync)
+    * @return false if the sync failed
+    */
+   typedef std::function<bool()> SyncFunction;
+
+   /**
+    * Constructor
+    * @param syncFunction
+    */
+   explicit GroupCommit(SyncFunction syncFunction);
+
+   /**
+    * Destructor
+    */
+   ~GroupCommit();
+
+   /**
+    * Makes the data of a file durable (fdatasync, or F_FULLFSYNC on macOS)
+    * @param fd
+    * @return
+    */
+   static bool syncFileData(int fd);
+
+   /**
+    * Makes everything written to the file system holding the file durable
+    * (syncfs). Only available on Linux.
+    * @param fd any open file on the file system
+    * @return
+    */
+   static bool syncFileSystem(int fd);
+
+   /**
+    * @return boolean indicating whether syncFileSystem is available
+    */
+   static bool isFileSystemSyncAvailable();
+
+   /**
+    * Sets how many writes the leader waits for before syncing
+    * @param batchSize
+    */
+   void setBatchSize(unsigned int batchSize);
+
+   /**
+    * Sets how long the leader waits for a batch to fill (0 = don't wait)
+    * @param maxDelayMillis
+    */
+   void setMaxDelay(unsigned int maxDelayMillis);
+
+   /**
+    * Records a completed write that needs to be made durable
+    * @return ticket to pass to waitForSync
+    */
+   uint64_t registerWrite();
+
+   /**
+    * Waits until the write identified by the ticket is durable
+    * @param ticket
+    * @return false if the sync covering the write failed
+    */
+   bool waitForSync(uint64_t ticket);
+
+   /**
+    * Marks every write registered so far as durable, for use by a caller
+    * that has synced the data itself (e.g., before closing a file)
+    */
+   void markSynced();
+
+
+private:
+   SyncFunction m_syncFunction;
+   std::mutex m_mutex;
+   std::condition_variable m_syncDone;
+   std::condition_variable m_writeRegistered;
+   uint64_t m_writeSequence;
+   uint64_t m_syncedSequence;
+   uint64_t m_failedSequence;
+   unsigned int m_batchSize;
+   unsigned int m_maxDelayMillis;
+   bool m_syncInProgress;
+   bool m_leaderWaiting;
+
+   // not available
+   GroupCommit(const GroupCommit&);
+   GroupCommit& operator=(const GroupCommit&);
+};
+
+}
+
+#endif
+
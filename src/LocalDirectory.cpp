@@ -2,6 +2,7 @@
 // LocalDirectory.cpp
 
 #include "LocalDirectory.h"
+#include "FileChunker.h"
 
 using namespace std;
 using namespace lachepas;
@@ -9,8 +10,15 @@ using namespace lachepas;
 //******************************************************************************
 
 LocalDirectory::LocalDirectory() :
+   m_chunkMode(FileChunker::CHUNK_MODE_FIXED),
    m_localDirectoryId(-1),
    m_copyCount(1),
+   m_scanThreads(1),
+   m_chunkMinSize(FileChunker::DEFAULT_MIN_CHUNK_SIZE),
+   m_chunkAvgSize(FileChunker::DEFAULT_AVG_CHUNK_SIZE),
+   m_chunkMaxSize(FileChunker::DEFAULT_MAX_CHUNK_SIZE),
+   m_dataFragments(0),
+   m_parityFragments(0),
    m_active(true),
    m_recurse(false),
    m_compress(false),
@@ -21,8 +29,15 @@ LocalDirectory::LocalDirectory() :
 
 LocalDirectory::LocalDirectory(const LocalDirectory& copy) :
    m_directoryPath(copy.m_directoryPath),
+   m_chunkMode(copy.m_chunkMode),
    m_localDirectoryId(copy.m_localDirectoryId),
    m_copyCount(copy.m_copyCount),
+   m_scanThreads(copy.m_scanThreads),
+   m_chunkMinSize(copy.m_chunkMinSize),
+   m_chunkAvgSize(copy.m_chunkAvgSize),
+   m_chunkMaxSize(copy.m_chunkMaxSize),
+   m_dataFragments(copy.m_dataFragments),
+   m_parityFragments(copy.m_parityFragments),
    m_active(copy.m_active),
    m_recurse(copy.m_recurse),
    m_compress(copy.m_compress),
@@ -37,8 +52,15 @@ LocalDirectory& LocalDirectory::operator=(const LocalDirectory& copy) {
    }
 
    m_directoryPath = copy.m_directoryPath;
+   m_chunkMode = copy.m_chunkMode;
    m_localDirectoryId = copy.m_localDirectoryId;
    m_copyCount = copy.m_copyCount;
+   m_scanThreads = copy.m_scanThreads;
+   m_chunkMinSize = copy.m_chunkMinSize;
+   m_chunkAvgSize = copy.m_chunkAvgSize;
+   m_chunkMaxSize = copy.m_chunkMaxSize;
+   m_dataFragments = copy.m_dataFragments;
+   m_parityFragments = copy.m_parityFragments;
    m_active = copy.m_active;
    m_recurse = copy.m_recurse;
    m_compress = copy.m_compress;
@@ -73,6 +95,75 @@ int LocalDirectory::getCopyCount() const {
 
 //******************************************************************************
 
+void LocalDirectory::setScanThreads(int scanThreads) {
+   m_scanThreads = scanThreads;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getScanThreads() const {
+   return m_scanThreads;
+}
+
+//******************************************************************************
+
+void LocalDirectory::setChunkMode(const string& chunkMode) {
+   m_chunkMode = chunkMode;
+}
+
+//******************************************************************************
+
+const string& LocalDirectory::getChunkMode() const {
+   return m_chunkMode;
+}
+
+//******************************************************************************
+
+void LocalDirectory::setChunkSizes(int minSize, int avgSize, int maxSize) {
+   m_chunkMinSize = minSize;
+   m_chunkAvgSize = avgSize;
+   m_chunkMaxSize = maxSize;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getChunkMinSize() const {
+   return m_chunkMinSize;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getChunkAvgSize() const {
+   return m_chunkAvgSize;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getChunkMaxSize() const {
+   return m_chunkMaxSize;
+}
+
+//******************************************************************************
+
+void LocalDirectory::setErasureCoding(int dataFragments, int parityFragments) {
+   m_dataFragments = dataFragments;
+   m_parityFragments = parityFragments;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getDataFragments() const {
+   return m_dataFragments;
+}
+
+//******************************************************************************
+
+int LocalDirectory::getParityFragments() const {
+   return m_parityFragments;
+}
+
+//******************************************************************************
+
 void LocalDirectory::setLocalDirectoryId(int localDirectoryId) {
    m_localDirectoryId = localDirectoryId;
 }
@@ -14,8 +14,15 @@ class LocalDirectory {
 
 private:
    std::string m_directoryPath;
+   std::string m_chunkMode;
    int m_localDirectoryId;
    int m_copyCount;
+   int m_scanThreads;
+   int m_chunkMinSize;
+   int m_chunkAvgSize;
+   int m_chunkMaxSize;
+   int m_dataFragments;
+   int m_parityFragments;
    bool m_active;
    bool m_recurse;
    bool m_compress;
@@ -76,6 +83,80 @@ public:
     */
    int getCopyCount() const;
 
+   /**
+    * Sets the number of walker threads used to scan the directory
+    * @param scanThreads number of threads (1 means serial scan)
+    */
+   void setScanThreads(int scanThreads);
+
+   /**
+    * Retrieves the number of walker threads used to scan the directory
+    * @return number of scan threads
+    */
+   int getScanThreads() const;
+
+   /**
+    * Sets how files are split into blocks
+    * @param chunkMode FileChunker::CHUNK_MODE_FIXED or FileChunker::CHUNK_MODE_CDC
+    */
+   void setChunkMode(const std::string& chunkMode);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getChunkMode() const;
+
+   /**
+    * Sets the chunk sizes used for content-defined chunking. In fixed mode
+    * the average size is the block size.
+    * @param minSize smallest chunk (bytes)
+    * @param avgSize target chunk size (bytes)
+    * @param maxSize largest chunk (bytes)
+    */
+   void setChunkSizes(int minSize, int avgSize, int maxSize);
+
+   /**
+    *
+    * @return
+    */
+   int getChunkMinSize() const;
+
+   /**
+    *
+    * @return
+    */
+   int getChunkAvgSize() const;
+
+   /**
+    *
+    * @return
+    */
+   int getChunkMaxSize() const;
+
+   /**
+    * Sets how blocks are erasure coded. With dataFragments above 0 each
+    * block is split into dataFragments data fragments and parityFragments
+    * parity fragments, each stored on a different node, instead of being
+    * copied to copy_count nodes.
+    * @param dataFragments number of fragments needed to rebuild a block
+    * (0 to store whole blocks)
+    * @param parityFragments number of fragments that may be lost
+    */
+   void setErasureCoding(int dataFragments, int parityFragments);
+
+   /**
+    *
+    * @return
+    */
+   int getDataFragments() const;
+
+   /**
+    *
+    * @return
+    */
+   int getParityFragments() const;
+
    /**
     *
     * @param recurse
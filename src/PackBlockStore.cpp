@@ -0,0 +1,972 @@
+// Copyright Paul Dardeau, 2016
+// PackBlockStore.cpp
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <set>
+
+#include "PackBlockStore.h"
+#include "BinaryFile.h"
+#include "GroupCommit.h"
+#include "ContentHasher.h"
+#include "GFS.h"
+#include "OSUtils.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+const uint64_t PackBlockStore::DEFAULT_MAX_PACK_SIZE = 256ULL * 1024ULL * 1024ULL;
+
+static const string PACK_DIR_NAME          = "packs";
+static const string INDEX_FILE_NAME        = "index.dat";
+static const string INDEX_TEMP_FILE_NAME   = "index.dat.tmp";
+
+// Each record is a 16 byte header followed by the hash algorithm name, the
+// block identifier and the block data. All integers are little endian.
+//    0  magic            (4)
+//    4  record type      (1)
+//    5  algorithm length (1)
+//    6  id length        (2)
+//    8  data length      (4)
+//   12  checksum         (4)  FNV-1a of bytes 0-11, algorithm and id
+// The data of a block record isn't covered by the checksum since the block
+// identifier already is one.
+static const uint32_t RECORD_MAGIC         = 0x4b434150;  // "PACK"
+static const size_t RECORD_HEADER_SIZE     = 16;
+
+static const uint8_t RECORD_BLOCK          = 1;
+static const uint8_t RECORD_ADD_REF        = 2;
+static const uint8_t RECORD_REMOVE_REF     = 3;
+
+static const uint32_t INDEX_MAGIC          = 0x58444950;  // "PIDX"
+static const uint32_t INDEX_VERSION        = 1;
+static const size_t INDEX_HEADER_SIZE      = 28;
+static const size_t INDEX_FLUSH_SIZE       = 1048576;
+
+// The whole index is rewritten at each checkpoint, so checkpoints get
+// further apart as the index grows to keep the cost per record constant.
+static const uint64_t CHECKPOINT_MIN_RECORDS = 10000;
+
+//******************************************************************************
+
+static bool IdentifierMatches(const string& fileContents,
+                              const string& hashAlgorithm,
+                              const string& expectedIdentifier,
+                              string& uniqueIdentifier) {
+   if (!ContentHasher::isValidAlgorithm(hashAlgorithm)) {
+      return false;
+   }
+
+   uniqueIdentifier = GFS::uniqueIdentifierForString(fileContents,
+                                                     hashAlgorithm);
+   return !uniqueIdentifier.empty() && (uniqueIdentifier == expectedIdentifier);
+}
+
+//******************************************************************************
+
+PackBlockStore::PackBlockStore() :
+   m_activeFd(-1),
+   m_activeOffset(0),
+   m_maxPackSize(DEFAULT_MAX_PACK_SIZE),
+   m_recordsSinceCheckpoint(0),
+   m_groupCommit(nullptr),
+   m_writeFailed(false) {
+}
+
+//******************************************************************************
+
+PackBlockStore::~PackBlockStore() {
+   close();
+}
+
+//******************************************************************************
+
+void PackBlockStore::setMaxPackSize(uint64_t maxPackSize) {
+   m_maxPackSize = maxPackSize;
+}
+
+//******************************************************************************
+
+string PackBlockStore::pathForPack(uint32_t packNumber) const {
+   char fileName[32];
+   ::snprintf(fileName, sizeof(fileName), "pack-%06u.dat", packNumber);
+   return OSUtils::pathJoin(m_packDir, string(fileName));
+}
+
+//******************************************************************************
+
+bool PackBlockStore::openPack(uint32_t packNumber, bool create) {
+   const string packPath = pathForPack(packNumber);
+   int flags = O_RDWR;
+   if (create) {
+      flags |= O_CREAT | O_EXCL;
+   }
+
+   const int fd = ::open(packPath.c_str(), flags, 0600);
+   if (fd == -1) {
+      Logger::error(string("unable to open pack file '") +
+                    packPath +
+                    string("'"));
+      return false;
+   }
+
+   // make sure that a new pack survives a crash along with what's in it
+   if (create && !BinaryFile::syncDirectory(m_packDir)) {
+      Logger::error(string("unable to sync pack directory '") +
+                    m_packDir +
+                    string("'"));
+      ::close(fd);
+      return false;
+   }
+
+   m_packFds.push_back(fd);
+   m_activeFd = fd;
+   m_activeOffset = 0;
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::open(const string& baseDir) {
+   lock_guard<mutex> lock(m_mutex);
+
+   if (!OSUtils::directoryExists(baseDir)) {
+      Logger::error(string("directory to serve does not exist: ") + baseDir);
+      return false;
+   }
+
+   m_baseDir = baseDir;
+   m_packDir = OSUtils::pathJoin(baseDir, PACK_DIR_NAME);
+
+   if (!OSUtils::directoryExists(m_packDir) &&
+       !OSUtils::createPrivateDirectory(m_packDir)) {
+      Logger::error(string("unable to create pack directory '") +
+                    m_packDir +
+                    string("'"));
+      return false;
+   }
+
+   m_groupCommit = new GroupCommit([this]() {
+      return GroupCommit::syncFileData(m_activeFd.load());
+   });
+   m_groupCommit->setBatchSize(getGroupCommitBatchSize());
+   m_groupCommit->setMaxDelay(getGroupCommitMaxDelay());
+
+   // until recovery is done the index can't be trusted, so keep close()
+   // from checkpointing it if we bail out part way
+   m_writeFailed = true;
+
+   uint32_t packNumber = 0;
+   while (OSUtils::pathExists(pathForPack(packNumber))) {
+      if (!openPack(packNumber, false)) {
+         return false;
+      }
+      ++packNumber;
+   }
+
+   uint32_t checkpointPack = 0;
+   uint64_t checkpointOffset = 0;
+
+   if (!loadIndex(checkpointPack, checkpointOffset)) {
+      // rebuild the index from scratch by scanning every pack
+      m_index.clear();
+      checkpointPack = 0;
+      checkpointOffset = 0;
+   }
+
+   if (m_packFds.empty()) {
+      if (!m_index.empty() || (checkpointOffset > 0)) {
+         Logger::error("pack index refers to pack files that are missing");
+         return false;
+      }
+
+      if (!openPack(0, true)) {
+         return false;
+      }
+
+      m_writeFailed = false;
+      return true;
+   }
+
+   if (checkpointPack >= m_packFds.size()) {
+      Logger::error("pack index refers to pack files that are missing");
+      return false;
+   }
+
+   for (uint32_t i = checkpointPack; i < m_packFds.size(); ++i) {
+      if (!recoverPack(i, (i == checkpointPack) ? checkpointOffset : 0)) {
+         return false;
+      }
+   }
+
+   m_activeFd = m_packFds.back();
+   m_writeFailed = false;
+
+   if (m_recordsSinceCheckpoint > 0) {
+      Logger::info(string("recovered ") +
+                   to_string(m_recordsSinceCheckpoint) +
+                   string(" pack records written after the last checkpoint"));
+      writeCheckpoint();
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void PackBlockStore::close() {
+   lock_guard<mutex> lock(m_mutex);
+
+   if (!m_packFds.empty()) {
+      if (!m_writeFailed) {
+         writeCheckpoint();
+      }
+
+      for (const int fd : m_packFds) {
+         ::close(fd);
+      }
+
+      m_packFds.clear();
+      m_activeFd = -1;
+      m_activeOffset = 0;
+   }
+
+   m_index.clear();
+
+   if (m_groupCommit != nullptr) {
+      delete m_groupCommit;
+      m_groupCommit = nullptr;
+   }
+}
+
+//******************************************************************************
+
+bool PackBlockStore::loadIndex(uint32_t& checkpointPack,
+                               uint64_t& checkpointOffset) {
+   const string indexPath = OSUtils::pathJoin(m_packDir, INDEX_FILE_NAME);
+
+   if (!OSUtils::pathExists(indexPath)) {
+      checkpointPack = 0;
+      checkpointOffset = 0;
+      return true;
+   }
+
+   string indexContents;
+   if (!GFS::readFile(indexPath, indexContents) ||
+       (indexContents.length() < INDEX_HEADER_SIZE + 4)) {
+      Logger::error("unable to read pack index, rebuilding it");
+      return false;
+   }
+
+   const char* p = indexContents.data();
+   const size_t checksumOffset = indexContents.length() - 4;
+
+   if ((BinaryFile::getUint32(p) != INDEX_MAGIC) ||
+       (BinaryFile::getUint32(p + 4) != INDEX_VERSION) ||
+       (BinaryFile::getUint32(p + checksumOffset) !=
+        BinaryFile::checksum(p, checksumOffset))) {
+      Logger::error("pack index is corrupt, rebuilding it");
+      return false;
+   }
+
+   const uint64_t entryCount = BinaryFile::getUint64(p + 8);
+   checkpointPack = BinaryFile::getUint32(p + 16);
+   checkpointOffset = BinaryFile::getUint64(p + 20);
+
+   size_t pos = INDEX_HEADER_SIZE;
+   m_index.reserve(entryCount);
+
+   for (uint64_t i = 0; i < entryCount; ++i) {
+      if (pos + 2 > checksumOffset) {
+         Logger::error("pack index is truncated, rebuilding it");
+         return false;
+      }
+
+      const uint16_t idLength = BinaryFile::getUint16(p + pos);
+      pos += 2;
+
+      if (pos + idLength + 20 > checksumOffset) {
+         Logger::error("pack index is truncated, rebuilding it");
+         return false;
+      }
+
+      PackEntry entry;
+      const string identifier(p + pos, idLength);
+      pos += idLength;
+      entry.packNumber = BinaryFile::getUint32(p + pos);
+      entry.dataOffset = BinaryFile::getUint64(p + pos + 4);
+      entry.dataLength = BinaryFile::getUint32(p + pos + 12);
+      entry.refCount = BinaryFile::getUint32(p + pos + 16);
+      pos += 20;
+
+      m_index[identifier] = entry;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::writeIndex() {
+   const string indexPath = OSUtils::pathJoin(m_packDir, INDEX_FILE_NAME);
+   const string tempPath = OSUtils::pathJoin(m_packDir, INDEX_TEMP_FILE_NAME);
+
+   FILE* f = ::fopen(tempPath.c_str(), "wb");
+   if (f == nullptr) {
+      Logger::error(string("unable to create pack index '") +
+                    tempPath +
+                    string("'"));
+      return false;
+   }
+
+   string buffer;
+   buffer.reserve(INDEX_FLUSH_SIZE + 65536);
+   buffer.resize(INDEX_HEADER_SIZE);
+
+   char* header = &buffer[0];
+   BinaryFile::putUint32(header, INDEX_MAGIC);
+   BinaryFile::putUint32(header + 4, INDEX_VERSION);
+   BinaryFile::putUint64(header + 8, m_index.size());
+   BinaryFile::putUint32(header + 16,
+                         static_cast<uint32_t>(m_packFds.size() - 1));
+   BinaryFile::putUint64(header + 20, m_activeOffset);
+
+   uint32_t checksum = BinaryFile::CHECKSUM_INITIAL_VALUE;
+   bool writeSuccess = true;
+   char fields[20];
+
+   for (const auto& kv : m_index) {
+      const string& identifier = kv.first;
+      const PackEntry& entry = kv.second;
+
+      BinaryFile::putUint16(fields, static_cast<uint16_t>(identifier.length()));
+      buffer.append(fields, 2);
+      buffer.append(identifier);
+
+      BinaryFile::putUint32(fields, entry.packNumber);
+      BinaryFile::putUint64(fields + 4, entry.dataOffset);
+      BinaryFile::putUint32(fields + 12, entry.dataLength);
+      BinaryFile::putUint32(fields + 16, entry.refCount);
+      buffer.append(fields, 20);
+
+      if (buffer.length() >= INDEX_FLUSH_SIZE) {
+         checksum =
+            BinaryFile::checksum(buffer.data(), buffer.length(), checksum);
+         if (::fwrite(buffer.data(), 1, buffer.length(), f) !=
+             buffer.length()) {
+            writeSuccess = false;
+            break;
+         }
+         buffer.clear();
+      }
+   }
+
+   if (writeSuccess) {
+      checksum = BinaryFile::checksum(buffer.data(), buffer.length(), checksum);
+      BinaryFile::putUint32(fields, checksum);
+      buffer.append(fields, 4);
+
+      writeSuccess =
+         (::fwrite(buffer.data(), 1, buffer.length(), f) == buffer.length()) &&
+         (::fflush(f) == 0) &&
+         (::fsync(::fileno(f)) == 0);
+   }
+
+   if ((::fclose(f) != 0) || !writeSuccess) {
+      ::unlink(tempPath.c_str());
+      Logger::error("unable to write pack index");
+      return false;
+   }
+
+   if ((::rename(tempPath.c_str(), indexPath.c_str()) != 0) ||
+       !BinaryFile::syncDirectory(m_packDir)) {
+      Logger::error("unable to replace pack index");
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::writeCheckpoint() {
+   // everything in the index must be on disk before the index says so
+   if (!GroupCommit::syncFileData(m_activeFd.load())) {
+      Logger::error("unable to sync active pack file");
+      m_writeFailed = true;
+      return false;
+   }
+
+   m_groupCommit->markSynced();
+
+   if (!writeIndex()) {
+      return false;
+   }
+
+   m_recordsSinceCheckpoint = 0;
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::recoverPack(uint32_t packNumber, uint64_t startOffset) {
+   const int fd = m_packFds[packNumber];
+   const bool isLastPack = (packNumber + 1 == m_packFds.size());
+
+   struct stat st;
+   if (::fstat(fd, &st) != 0) {
+      Logger::error(string("unable to stat pack file '") +
+                    pathForPack(packNumber) +
+                    string("'"));
+      return false;
+   }
+
+   const uint64_t packSize = st.st_size;
+
+   if (startOffset > packSize) {
+      Logger::error(string("pack file '") +
+                    pathForPack(packNumber) +
+                    string("' is shorter than the pack index says"));
+      return false;
+   }
+
+   uint64_t offset = startOffset;
+   char header[RECORD_HEADER_SIZE];
+   string algorithmAndId;
+   string data;
+
+   while (offset + RECORD_HEADER_SIZE <= packSize) {
+      if (!BinaryFile::preadFully(fd, header, RECORD_HEADER_SIZE, offset)) {
+         break;
+      }
+
+      const uint8_t recordType = static_cast<uint8_t>(header[4]);
+      const uint8_t algorithmLength = static_cast<uint8_t>(header[5]);
+      const uint16_t idLength = BinaryFile::getUint16(header + 6);
+      const uint32_t dataLength = BinaryFile::getUint32(header + 8);
+      const uint64_t recordLength =
+         RECORD_HEADER_SIZE + algorithmLength + idLength + dataLength;
+
+      if ((BinaryFile::getUint32(header) != RECORD_MAGIC) ||
+          (recordType < RECORD_BLOCK) ||
+          (recordType > RECORD_REMOVE_REF) ||
+          (idLength == 0) ||
+          (offset + recordLength > packSize)) {
+         break;
+      }
+
+      algorithmAndId.resize(algorithmLength + idLength);
+      if (!BinaryFile::preadFully(fd,
+                                  &algorithmAndId[0],
+                                  algorithmAndId.length(),
+                                  offset + RECORD_HEADER_SIZE)) {
+         break;
+      }
+
+      const uint32_t checksum =
+         BinaryFile::checksum(algorithmAndId.data(),
+                              algorithmAndId.length(),
+                              BinaryFile::checksum(header, 12));
+      if (checksum != BinaryFile::getUint32(header + 12)) {
+         break;
+      }
+
+      const string hashAlgorithm = algorithmAndId.substr(0, algorithmLength);
+      const string identifier = algorithmAndId.substr(algorithmLength);
+      const uint64_t dataOffset =
+         offset + RECORD_HEADER_SIZE + algorithmLength + idLength;
+
+      if (recordType == RECORD_BLOCK) {
+         // a torn block shows up as an identifier mismatch
+         data.resize(dataLength);
+         string storedIdentifier;
+         if ((dataLength > 0) &&
+             !BinaryFile::preadFully(fd, &data[0], dataLength, dataOffset)) {
+            break;
+         }
+         if (!IdentifierMatches(data,
+                                hashAlgorithm,
+                                identifier,
+                                storedIdentifier)) {
+            break;
+         }
+      }
+
+      applyRecord(recordType, identifier, packNumber, dataOffset, dataLength);
+      offset += recordLength;
+      ++m_recordsSinceCheckpoint;
+   }
+
+   if (offset < packSize) {
+      if (isLastPack) {
+         // the last write before a crash; nobody was told it succeeded
+         Logger::warning(string("truncating incomplete record at offset ") +
+                         to_string(offset) +
+                         string(" of pack file '") +
+                         pathForPack(packNumber) +
+                         string("'"));
+         if ((::ftruncate(fd, offset) != 0) || (::fsync(fd) != 0)) {
+            Logger::error("unable to truncate pack file");
+            return false;
+         }
+      } else {
+         Logger::error(string("corrupt record at offset ") +
+                       to_string(offset) +
+                       string(" of pack file '") +
+                       pathForPack(packNumber) +
+                       string("', ignoring the rest of the pack"));
+      }
+   }
+
+   if (isLastPack) {
+      m_activeOffset = offset;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void PackBlockStore::applyRecord(uint8_t recordType,
+                                 const string& identifier,
+                                 uint32_t packNumber,
+                                 uint64_t dataOffset,
+                                 uint32_t dataLength) {
+   auto it = m_index.find(identifier);
+
+   if (recordType == RECORD_BLOCK) {
+      if (it != m_index.end()) {
+         ++it->second.refCount;
+      } else {
+         PackEntry entry;
+         entry.packNumber = packNumber;
+         entry.dataOffset = dataOffset;
+         entry.dataLength = dataLength;
+         entry.refCount = 1;
+         m_index[identifier] = entry;
+      }
+   } else if (recordType == RECORD_ADD_REF) {
+      if (it != m_index.end()) {
+         ++it->second.refCount;
+      }
+   } else if (recordType == RECORD_REMOVE_REF) {
+      if (it != m_index.end()) {
+         if (it->second.refCount > 1) {
+            --it->second.refCount;
+         } else {
+            // the data stays in its pack as dead space
+            m_index.erase(it);
+         }
+      }
+   }
+}
+
+//******************************************************************************
+
+bool PackBlockStore::appendRecord(uint8_t recordType,
+                                  const string& hashAlgorithm,
+                                  const string& identifier,
+                                  const string& data,
+                                  uint64_t& ticket) {
+   if (m_writeFailed) {
+      ::printf("error: pack store is read-only after a failed write\n");
+      return false;
+   }
+
+   if (m_packFds.empty()) {
+      ::printf("error: pack store is not open\n");
+      return false;
+   }
+
+   const size_t recordLength = RECORD_HEADER_SIZE +
+                               hashAlgorithm.length() +
+                               identifier.length() +
+                               data.length();
+
+   if ((m_activeOffset > 0) && (m_activeOffset + recordLength > m_maxPackSize)) {
+      // start a new pack; everything in the old one has to be durable
+      // first since it won't be covered by later syncs
+      if (!GroupCommit::syncFileData(m_activeFd.load())) {
+         Logger::error("unable to sync pack file");
+         m_writeFailed = true;
+         return false;
+      }
+
+      m_groupCommit->markSynced();
+
+      if (!openPack(static_cast<uint32_t>(m_packFds.size()), true)) {
+         m_writeFailed = true;
+         return false;
+      }
+   }
+
+   string record;
+   record.reserve(recordLength);
+   record.resize(RECORD_HEADER_SIZE);
+
+   char* header = &record[0];
+   BinaryFile::putUint32(header, RECORD_MAGIC);
+   header[4] = static_cast<char>(recordType);
+   header[5] = static_cast<char>(hashAlgorithm.length());
+   BinaryFile::putUint16(header + 6,
+                         static_cast<uint16_t>(identifier.length()));
+   BinaryFile::putUint32(header + 8, static_cast<uint32_t>(data.length()));
+
+   record.append(hashAlgorithm);
+   record.append(identifier);
+
+   BinaryFile::putUint32(&record[12],
+             BinaryFile::checksum(record.data() + RECORD_HEADER_SIZE,
+                                  record.length() - RECORD_HEADER_SIZE,
+                                  BinaryFile::checksum(record.data(), 12)));
+
+   record.append(data);
+
+   if (!BinaryFile::pwriteFully(m_activeFd.load(),
+                                record.data(),
+                                record.length(),
+                                m_activeOffset)) {
+      // nothing after m_activeOffset counts, so the next record simply
+      // overwrites whatever part of this one made it to the file
+      ::printf("error: unable to write to pack file\n");
+      return false;
+   }
+
+   const uint64_t dataOffset = m_activeOffset +
+                               RECORD_HEADER_SIZE +
+                               hashAlgorithm.length() +
+                               identifier.length();
+
+   applyRecord(recordType,
+               identifier,
+               static_cast<uint32_t>(m_packFds.size() - 1),
+               dataOffset,
+               static_cast<uint32_t>(data.length()));
+
+   m_activeOffset += recordLength;
+   ticket = m_groupCommit->registerWrite();
+
+   ++m_recordsSinceCheckpoint;
+   const uint64_t checkpointInterval = m_index.size() / 4;
+   if (m_recordsSinceCheckpoint >= CHECKPOINT_MIN_RECORDS &&
+       m_recordsSinceCheckpoint >= checkpointInterval) {
+      writeCheckpoint();
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::lookupBlock(const string& directory,
+                                 const string& fileName,
+                                 PackEntry& entry,
+                                 int& packFd) {
+   auto it = m_index.find(fileName);
+   if ((it == m_index.end()) ||
+       (directory != directoryForIdentifier(fileName))) {
+      return false;
+   }
+
+   entry = it->second;
+   packFd = m_packFds[entry.packNumber];
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::dirList(vector<string>& listDirectories) {
+   set<string> setDirectories;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+      for (const auto& kv : m_index) {
+         setDirectories.insert(directoryForIdentifier(kv.first));
+      }
+   }
+
+   listDirectories.insert(listDirectories.end(),
+                          setDirectories.begin(),
+                          setDirectories.end());
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::fileAdd(const string& fileName,
+                             const string& fileContents,
+                             string& directory,
+                             string& uniqueIdentifier,
+                             const string& hashAlgorithm) {
+   if (uniqueIdentifier.empty()) {
+      ::printf("fileAdd: uniqueIdentifier empty, returning\n");
+      return false;
+   }
+
+   // blocks are looked up by name, and recovery verifies them by name
+   if (fileName != uniqueIdentifier) {
+      ::printf("error: file name '%s' is not the block's unique identifier\n",
+               fileName.c_str());
+      return false;
+   }
+
+   directory = directoryForIdentifier(uniqueIdentifier);
+
+   bool isStored;
+   {
+      lock_guard<mutex> lock(m_mutex);
+      isStored = (m_index.find(fileName) != m_index.end());
+   }
+
+   // hash outside of the lock; only new blocks need it
+   string nodeUniqueIdentifier;
+   if (!isStored &&
+       !IdentifierMatches(fileContents,
+                          hashAlgorithm,
+                          uniqueIdentifier,
+                          nodeUniqueIdentifier)) {
+      ::printf("error: unique identifier mismatch for file '%s'\n",
+               fileName.c_str());
+      return false;
+   }
+
+   uint64_t ticket = 0;
+   bool isNewBlock = false;
+   PackEntry entry;
+   int packFd = -1;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+
+      if (m_index.find(fileName) != m_index.end()) {
+         if (!appendRecord(RECORD_ADD_REF,
+                           string(),
+                           fileName,
+                           string(),
+                           ticket)) {
+            return false;
+         }
+      } else {
+         // deleted since we looked
+         if (nodeUniqueIdentifier.empty() &&
+             !IdentifierMatches(fileContents,
+                                hashAlgorithm,
+                                uniqueIdentifier,
+                                nodeUniqueIdentifier)) {
+            ::printf("error: unique identifier mismatch for file '%s'\n",
+                     fileName.c_str());
+            return false;
+         }
+
+         if (!appendRecord(RECORD_BLOCK,
+                           hashAlgorithm,
+                           fileName,
+                           fileContents,
+                           ticket)) {
+            return false;
+         }
+
+         isNewBlock = true;
+         lookupBlock(directory, fileName, entry, packFd);
+      }
+   }
+
+   if (!m_groupCommit->waitForSync(ticket)) {
+      lock_guard<mutex> lock(m_mutex);
+      m_writeFailed = true;
+      ::printf("error: unable to sync pack file\n");
+      return false;
+   }
+
+   if (isNewBlock) {
+      if (getVerifyReadBack()) {
+         // paranoid mode: also check what actually landed on disk
+         string readBack(entry.dataLength, '\0');
+         string readBackFileId;
+         if (!BinaryFile::preadFully(packFd,
+                                     &readBack[0],
+                                     readBack.length(),
+                                     entry.dataOffset) ||
+             !IdentifierMatches(readBack,
+                                hashAlgorithm,
+                                nodeUniqueIdentifier,
+                                readBackFileId)) {
+            ::printf("error: read back verification failed for file '%s'\n",
+                     fileName.c_str());
+            fileDelete(directory, fileName);
+            return false;
+         }
+      }
+
+      uniqueIdentifier = nodeUniqueIdentifier;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::fileAddReference(const string& fileName,
+                                     string& directory,
+                                     const string& uniqueIdentifier) {
+   if (fileName != uniqueIdentifier) {
+      return false;
+   }
+
+   directory = directoryForIdentifier(uniqueIdentifier);
+   uint64_t ticket = 0;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+      PackEntry entry;
+      int packFd;
+      if (!lookupBlock(directory, fileName, entry, packFd)) {
+         return false;
+      }
+
+      if (!appendRecord(RECORD_ADD_REF,
+                        string(),
+                        fileName,
+                        string(),
+                        ticket)) {
+         return false;
+      }
+   }
+
+   if (!m_groupCommit->waitForSync(ticket)) {
+      lock_guard<mutex> lock(m_mutex);
+      m_writeFailed = true;
+      ::printf("error: unable to sync pack file\n");
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::fileDelete(const string& directory,
+                                const string& fileName) {
+   uint64_t ticket = 0;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+      PackEntry entry;
+      int packFd;
+      if (!lookupBlock(directory, fileName, entry, packFd)) {
+         return false;
+      }
+
+      if (!appendRecord(RECORD_REMOVE_REF,
+                        string(),
+                        fileName,
+                        string(),
+                        ticket)) {
+         return false;
+      }
+   }
+
+   if (!m_groupCommit->waitForSync(ticket)) {
+      lock_guard<mutex> lock(m_mutex);
+      m_writeFailed = true;
+      ::printf("error: unable to sync pack file\n");
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::fileExists(const string& directory,
+                                const string& fileName) {
+   lock_guard<mutex> lock(m_mutex);
+   PackEntry entry;
+   int packFd;
+   return lookupBlock(directory, fileName, entry, packFd);
+}
+
+//******************************************************************************
+
+void PackBlockStore::filesExist(const vector<string>& fileNames,
+                                vector<bool>& stored) {
+   lock_guard<mutex> lock(m_mutex);
+
+   stored.assign(fileNames.size(), false);
+
+   const size_t numFiles = fileNames.size();
+   for (size_t i = 0; i < numFiles; ++i) {
+      stored[i] = (m_index.find(fileNames[i]) != m_index.end());
+   }
+}
+
+//******************************************************************************
+
+bool PackBlockStore::fileList(const string& directory,
+                              vector<string>& listFiles) {
+   if (directory.empty()) {
+      printf("no directory specified\n");
+      return false;
+   }
+
+   lock_guard<mutex> lock(m_mutex);
+   for (const auto& kv : m_index) {
+      if (directoryForIdentifier(kv.first) == directory) {
+         listFiles.push_back(kv.first);
+      }
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool PackBlockStore::retrieveFileContents(const string& directory,
+                                          const string& fileName,
+                                          string& fileContents) {
+   if (directory.empty()) {
+      ::printf("retrieveFileContents: missing directory\n");
+      return false;
+   }
+
+   if (fileName.empty()) {
+      ::printf("retrieveFileContents: missing file name\n");
+      return false;
+   }
+
+   PackEntry entry;
+   int packFd;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+      if (!lookupBlock(directory, fileName, entry, packFd)) {
+         ::printf("error: file does not exist\n");
+         return false;
+      }
+   }
+
+   // pack files are only ever appended to, so the read needs no lock
+   fileContents.resize(entry.dataLength);
+   if ((entry.dataLength > 0) &&
+       !BinaryFile::preadFully(packFd,
+                               &fileContents[0],
+                               entry.dataLength,
+                               entry.dataOffset)) {
+      ::printf("error: unable to read from pack file\n");
+      fileContents.clear();
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
@@ -0,0 +1,193 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_PACKBLOCKSTORE_H
+#define LACHEPAS_PACKBLOCKSTORE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BlockStore.h"
+
+
+namespace lachepas {
+
+class GroupCommit;
+
+/**
+ * Storage engine that appends blocks to large pack files instead of giving
+ * each block its own file. Every change (new block, added reference, removed
+ * reference) is a checksummed record appended to the active pack, and an
+ * in-memory index maps each block to its (pack, offset, length). The index
+ * is checkpointed to disk from time to time; on open, the checkpoint is
+ * loaded and the pack tails written after it are scanned to bring the index
+ * up to date, dropping any torn record at the end of the last pack.
+ */
+class PackBlockStore : public BlockStore {
+
+public:
+   static const uint64_t DEFAULT_MAX_PACK_SIZE;
+
+   /**
+    * Default constructor
+    */
+   PackBlockStore();
+
+   /**
+    * Destructor
+    */
+   ~PackBlockStore();
+
+   /**
+    * Sets the size at which the active pack is closed and a new one started
+    * @param maxPackSize
+    */
+   void setMaxPackSize(uint64_t maxPackSize);
+
+   /**
+    *
+    * @param baseDir
+    * @return
+    */
+   bool open(const std::string& baseDir);
+
+   /**
+    *
+    */
+   void close();
+
+   /**
+    *
+    * @param listDirectories
+    * @return
+    */
+   bool dirList(std::vector<std::string>& listDirectories);
+
+   /**
+    *
+    * @param fileName
+    * @param fileContents
+    * @param directory
+    * @param uniqueIdentifier
+    * @param hashAlgorithm
+    * @return
+    */
+   bool fileAdd(const std::string& fileName,
+                const std::string& fileContents,
+                std::string& directory,
+                std::string& uniqueIdentifier,
+                const std::string& hashAlgorithm);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   bool fileDelete(const std::string& directory,
+                   const std::string& fileName);
+
+   /**
+    *
+    * @param fileName
+    * @param directory
+    * @param uniqueIdentifier
+    * @return
+    */
+   bool fileAddReference(const std::string& fileName,
+                         std::string& directory,
+                         const std::string& uniqueIdentifier);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @return
+    */
+   bool fileExists(const std::string& directory,
+                   const std::string& fileName);
+
+   /**
+    *
+    * @param fileNames
+    * @param stored
+    */
+   void filesExist(const std::vector<std::string>& fileNames,
+                   std::vector<bool>& stored);
+
+   /**
+    *
+    * @param directory
+    * @param listFiles
+    * @return
+    */
+   bool fileList(const std::string& directory,
+                 std::vector<std::string>& listFiles);
+
+   /**
+    *
+    * @param directory
+    * @param fileName
+    * @param fileContents
+    * @return
+    */
+   bool retrieveFileContents(const std::string& directory,
+                             const std::string& fileName,
+                             std::string& fileContents);
+
+
+private:
+   struct PackEntry {
+      uint32_t packNumber;
+      uint64_t dataOffset;
+      uint32_t dataLength;
+      uint32_t refCount;
+   };
+
+   typedef std::unordered_map<std::string, PackEntry> PackIndex;
+
+   std::string pathForPack(uint32_t packNumber) const;
+   bool openPack(uint32_t packNumber, bool create);
+   bool loadIndex(uint32_t& checkpointPack, uint64_t& checkpointOffset);
+   bool writeIndex();
+   bool writeCheckpoint();
+   bool recoverPack(uint32_t packNumber, uint64_t startOffset);
+   void applyRecord(uint8_t recordType,
+                    const std::string& identifier,
+                    uint32_t packNumber,
+                    uint64_t dataOffset,
+                    uint32_t dataLength);
+   bool appendRecord(uint8_t recordType,
+                     const std::string& hashAlgorithm,
+                     const std::string& identifier,
+                     const std::string& data,
+                     uint64_t& ticket);
+   bool lookupBlock(const std::string& directory,
+                    const std::string& fileName,
+                    PackEntry& entry,
+                    int& packFd);
+
+   std::string m_baseDir;
+   std::string m_packDir;
+   std::mutex m_mutex;
+   PackIndex m_index;
+   std::vector<int> m_packFds;
+   std::atomic<int> m_activeFd;
+   uint64_t m_activeOffset;
+   uint64_t m_maxPackSize;
+   uint64_t m_recordsSinceCheckpoint;
+   GroupCommit* m_groupCommit;
+   bool m_writeFailed;
+
+   // not available
+   PackBlockStore(const PackBlockStore&);
+   PackBlockStore& operator=(const PackBlockStore&);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,406 @@
+// Copyright Paul Dardeau, 2016
+// ReedSolomon.cpp
+
+#include <string.h>
+
+#include "ReedSolomon.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REED_SOLOMON_X86 1
+#include <immintrin.h>
+#endif
+
+// generator polynomial of the field (x^8 + x^4 + x^3 + x^2 + 1)
+#define GF_POLYNOMIAL 0x11d
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+// log and exp tables of the field, plus the products of every constant with
+// each value of the low and high half of a byte (the lookup tables used by
+// the kernels)
+struct GaloisTables {
+   uint8_t exp[512];
+   uint8_t log[256];
+   uint8_t mulLow[256][16];
+   uint8_t mulHigh[256][16];
+
+   GaloisTables() {
+      int value = 1;
+      for (int i = 0; i < 255; ++i) {
+         exp[i] = static_cast<uint8_t>(value);
+         exp[i + 255] = static_cast<uint8_t>(value);
+         log[value] = static_cast<uint8_t>(i);
+         value <<= 1;
+         if (value & 0x100) {
+            value ^= GF_POLYNOMIAL;
+         }
+      }
+      exp[510] = exp[0];
+      exp[511] = exp[1];
+      log[0] = 0;
+
+      for (int c = 0; c < 256; ++c) {
+         for (int n = 0; n < 16; ++n) {
+            mulLow[c][n] = multiply(c, n);
+            mulHigh[c][n] = multiply(c, n << 4);
+         }
+      }
+   }
+
+   uint8_t multiply(int a, int b) const {
+      if ((a == 0) || (b == 0)) {
+         return 0;
+      }
+      return exp[log[a] + log[b]];
+   }
+
+   uint8_t inverse(int a) const {
+      return exp[255 - log[a]];
+   }
+};
+
+//******************************************************************************
+
+static const GaloisTables& Galois() {
+   static const GaloisTables tables;
+   return tables;
+}
+
+//******************************************************************************
+
+#ifdef REED_SOLOMON_X86
+
+// dst ^= c * src, 16 bytes at a time: each source byte is split into its
+// halves, which index the constant's two product tables
+__attribute__((target("ssse3")))
+static size_t MulAddSsse3(const uint8_t* lowTable,
+                          const uint8_t* highTable,
+                          const uint8_t* src,
+                          uint8_t* dst,
+                          size_t length) {
+   const __m128i low = _mm_loadu_si128((const __m128i*) lowTable);
+   const __m128i high = _mm_loadu_si128((const __m128i*) highTable);
+   const __m128i mask = _mm_set1_epi8(0x0f);
+   size_t i = 0;
+
+   for (; i + 16 <= length; i += 16) {
+      const __m128i in = _mm_loadu_si128((const __m128i*) (src + i));
+      const __m128i loNibbles = _mm_and_si128(in, mask);
+      const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi64(in, 4), mask);
+      const __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, loNibbles),
+                                            _mm_shuffle_epi8(high, hiNibbles));
+      const __m128i out = _mm_loadu_si128((const __m128i*) (dst + i));
+      _mm_storeu_si128((__m128i*) (dst + i), _mm_xor_si128(out, product));
+   }
+
+   return i;
+}
+
+//******************************************************************************
+
+// dst ^= c * src, 32 bytes at a time
+__attribute__((target("avx2")))
+static size_t MulAddAvx2(const uint8_t* lowTable,
+                         const uint8_t* highTable,
+                         const uint8_t* src,
+                         uint8_t* dst,
+                         size_t length) {
+   const __m256i low = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) lowTable));
+   const __m256i high = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i*) highTable));
+   const __m256i mask = _mm256_set1_epi8(0x0f);
+   size_t i = 0;
+
+   for (; i + 32 <= length; i += 32) {
+      const __m256i in = _mm256_loadu_si256((const __m256i*) (src + i));
+      const __m256i loNibbles = _mm256_and_si256(in, mask);
+      const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi64(in, 4), mask);
+      const __m256i product =
+         _mm256_xor_si256(_mm256_shuffle_epi8(low, loNibbles),
+                          _mm256_shuffle_epi8(high, hiNibbles));
+      const __m256i out = _mm256_loadu_si256((const __m256i*) (dst + i));
+      _mm256_storeu_si256((__m256i*) (dst + i), _mm256_xor_si256(out, product));
+   }
+
+   return i;
+}
+
+#endif
+
+//******************************************************************************
+
+static bool HaveSsse3() {
+#ifdef REED_SOLOMON_X86
+   static const bool haveSsse3 = __builtin_cpu_supports("ssse3");
+   return haveSsse3;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+static bool HaveAvx2() {
+#ifdef REED_SOLOMON_X86
+   static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+   return haveAvx2;
+#else
+   return false;
+#endif
+}
+
+//******************************************************************************
+
+// dst ^= c * src over length bytes
+static void MulAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+   if (c == 0) {
+      return;
+   }
+
+   size_t i = 0;
+
+   if (c == 1) {
+      for (; i < length; ++i) {
+         dst[i] ^= src[i];
+      }
+      return;
+   }
+
+   const GaloisTables& galois = Galois();
+   const uint8_t* lowTable = galois.mulLow[c];
+   const uint8_t* highTable = galois.mulHigh[c];
+
+#ifdef REED_SOLOMON_X86
+   if (HaveAvx2()) {
+      i = MulAddAvx2(lowTable, highTable, src, dst, length);
+   } else if (HaveSsse3()) {
+      i = MulAddSsse3(lowTable, highTable, src, dst, length);
+   }
+#endif
+
+   for (; i < length; ++i) {
+      dst[i] ^= lowTable[src[i] & 0x0f] ^ highTable[src[i] >> 4];
+   }
+}
+
+//******************************************************************************
+
+// inverts a k x k matrix (row major) in place by Gauss-Jordan elimination
+static bool InvertMatrix(vector<uint8_t>& matrix, int k) {
+   const GaloisTables& galois = Galois();
+   vector<uint8_t> inverse(k * k, 0);
+   for (int i = 0; i < k; ++i) {
+      inverse[i * k + i] = 1;
+   }
+
+   for (int col = 0; col < k; ++col) {
+      int pivot = col;
+      while ((pivot < k) && (matrix[pivot * k + col] == 0)) {
+         ++pivot;
+      }
+
+      if (pivot == k) {
+         return false;
+      }
+
+      if (pivot != col) {
+         for (int j = 0; j < k; ++j) {
+            std::swap(matrix[pivot * k + j], matrix[col * k + j]);
+            std::swap(inverse[pivot * k + j], inverse[col * k + j]);
+         }
+      }
+
+      const uint8_t scale = galois.inverse(matrix[col * k + col]);
+      for (int j = 0; j < k; ++j) {
+         matrix[col * k + j] = galois.multiply(matrix[col * k + j], scale);
+         inverse[col * k + j] = galois.multiply(inverse[col * k + j], scale);
+      }
+
+      for (int row = 0; row < k; ++row) {
+         const uint8_t factor = matrix[row * k + col];
+         if ((row != col) && (factor != 0)) {
+            for (int j = 0; j < k; ++j) {
+               matrix[row * k + j] ^= galois.multiply(factor, matrix[col * k + j]);
+               inverse[row * k + j] ^= galois.multiply(factor, inverse[col * k + j]);
+            }
+         }
+      }
+   }
+
+   matrix.swap(inverse);
+   return true;
+}
+
+//******************************************************************************
+
+const char* ReedSolomon::implementationName() {
+   if (HaveAvx2()) {
+      return "avx2";
+   } else if (HaveSsse3()) {
+      return "ssse3";
+   } else {
+      return "portable";
+   }
+}
+
+//******************************************************************************
+
+ReedSolomon::ReedSolomon(int dataFragments, int parityFragments) :
+   m_dataFragments(dataFragments),
+   m_parityFragments(parityFragments) {
+
+   if (isValid()) {
+      // parity row i, column j is 1 / (x_i + y_j) with x_i = k + i and
+      // y_j = j, which are all distinct so no denominator is zero
+      const GaloisTables& galois = Galois();
+      m_parityMatrix.resize(m_parityFragments * m_dataFragments);
+      for (int i = 0; i < m_parityFragments; ++i) {
+         for (int j = 0; j < m_dataFragments; ++j) {
+            m_parityMatrix[i * m_dataFragments + j] =
+               galois.inverse((m_dataFragments + i) ^ j);
+         }
+      }
+   }
+}
+
+//******************************************************************************
+
+ReedSolomon::~ReedSolomon() {
+}
+
+//******************************************************************************
+
+bool ReedSolomon::isValid() const {
+   return (m_dataFragments > 0) &&
+          (m_parityFragments >= 0) &&
+          (m_dataFragments + m_parityFragments <= MAX_FRAGMENTS);
+}
+
+//******************************************************************************
+
+int ReedSolomon::getDataFragments() const {
+   return m_dataFragments;
+}
+
+//******************************************************************************
+
+int ReedSolomon::getParityFragments() const {
+   return m_parityFragments;
+}
+
+//******************************************************************************
+
+size_t ReedSolomon::fragmentSize(size_t dataSize) const {
+   return (dataSize + m_dataFragments - 1) / m_dataFragments;
+}
+
+//******************************************************************************
+
+void ReedSolomon::encode(const string& data,
+                         vector<string>& fragments) const {
+   const size_t size = fragmentSize(data.size());
+   fragments.resize(m_dataFragments + m_parityFragments);
+
+   for (int j = 0; j < m_dataFragments; ++j) {
+      const size_t offset = j * size;
+      string& fragment = fragments[j];
+      fragment.assign(size, '\0');
+      if (offset < data.size()) {
+         ::memcpy(&fragment[0], data.data() + offset,
+                  min(size, data.size() - offset));
+      }
+   }
+
+   for (int i = 0; i < m_parityFragments; ++i) {
+      string& parity = fragments[m_dataFragments + i];
+      parity.assign(size, '\0');
+      uint8_t* dst = reinterpret_cast<uint8_t*>(&parity[0]);
+
+      for (int j = 0; j < m_dataFragments; ++j) {
+         MulAdd(m_parityMatrix[i * m_dataFragments + j],
+                reinterpret_cast<const uint8_t*>(fragments[j].data()),
+                dst,
+                size);
+      }
+   }
+}
+
+//******************************************************************************
+
+bool ReedSolomon::decode(const vector<const string*>& fragments,
+                         size_t dataSize,
+                         string& data) const {
+   const int k = m_dataFragments;
+   const int numFragments = k + m_parityFragments;
+   const size_t size = fragmentSize(dataSize);
+
+   if (fragments.size() != (size_t) numFragments) {
+      return false;
+   }
+
+   // the first k fragments present, which are the data fragments
+   // themselves whenever they survived
+   vector<int> rows;
+   for (int i = 0; (i < numFragments) && ((int) rows.size() < k); ++i) {
+      if ((fragments[i] != nullptr) && (fragments[i]->size() == size)) {
+         rows.push_back(i);
+      }
+   }
+
+   if ((int) rows.size() < k) {
+      return false;
+   }
+
+   data.assign(size * k, '\0');
+   uint8_t* out = reinterpret_cast<uint8_t*>(&data[0]);
+
+   vector<bool> missing(k, true);
+   for (const auto row : rows) {
+      if (row < k) {
+         ::memcpy(out + row * size, fragments[row]->data(), size);
+         missing[row] = false;
+      }
+   }
+
+   if ((int) rows.back() >= k) {
+      // the rows of the coding matrix for the fragments present; its
+      // inverse turns them back into the data fragments
+      vector<uint8_t> matrix(k * k, 0);
+      for (int r = 0; r < k; ++r) {
+         const int row = rows[r];
+         if (row < k) {
+            matrix[r * k + row] = 1;
+         } else {
+            ::memcpy(&matrix[r * k],
+                     &m_parityMatrix[(row - k) * k],
+                     k);
+         }
+      }
+
+      if (!InvertMatrix(matrix, k)) {
+         return false;
+      }
+
+      for (int j = 0; j < k; ++j) {
+         if (missing[j]) {
+            for (int r = 0; r < k; ++r) {
+               MulAdd(matrix[j * k + r],
+                      reinterpret_cast<const uint8_t*>(fragments[rows[r]]->data()),
+                      out + j * size,
+                      size);
+            }
+         }
+      }
+   }
+
+   data.resize(dataSize);
+
+   return true;
+}
+
+//******************************************************************************
+
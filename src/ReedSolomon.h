@@ -0,0 +1,111 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_REEDSOLOMON_H
+#define LACHEPAS_REEDSOLOMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Systematic Reed-Solomon erasure code over GF(2^8). A block is split into
+ * k data fragments (the block itself, zero padded to a multiple of k) and m
+ * parity fragments, all of the same size, and can be rebuilt from any k of
+ * the k + m. The parity rows of the coding matrix form a Cauchy matrix, so
+ * every choice of k rows can be inverted.
+ *
+ * Fragments are multiplied by a constant 32 (or 16) bytes at a time with
+ * AVX2 (or SSSE3) table lookups on each half of every byte when the
+ * processor has it, chosen at run time, and one byte at a time otherwise.
+ */
+class ReedSolomon {
+
+public:
+   /**
+    * Most fragments (data and parity together) a block can be split into
+    */
+   static const int MAX_FRAGMENTS = 256;
+
+   /**
+    *
+    * @return name of the selected kernel ("avx2", "ssse3" or "portable")
+    */
+   static const char* implementationName();
+
+   /**
+    *
+    * @param dataFragments number of data fragments (k)
+    * @param parityFragments number of parity fragments (m)
+    */
+   ReedSolomon(int dataFragments, int parityFragments);
+
+   /**
+    * Destructor
+    */
+   ~ReedSolomon();
+
+   /**
+    *
+    * @return whether the fragment counts can be used
+    */
+   bool isValid() const;
+
+   /**
+    *
+    * @return
+    */
+   int getDataFragments() const;
+
+   /**
+    *
+    * @return
+    */
+   int getParityFragments() const;
+
+   /**
+    *
+    * @param dataSize size of the block
+    * @return size of each of its fragments
+    */
+   size_t fragmentSize(size_t dataSize) const;
+
+   /**
+    * Splits a block into its data and parity fragments
+    * @param data the block
+    * @param fragments receives the k data fragments followed by the m
+    * parity fragments
+    */
+   void encode(const std::string& data,
+               std::vector<std::string>& fragments) const;
+
+   /**
+    * Rebuilds a block from any k of its fragments
+    * @param fragments the k + m fragments in order, with nullptr for each
+    * one that is missing
+    * @param dataSize size of the block
+    * @param data receives the block
+    * @return false if fewer than k fragments of the right size are present
+    */
+   bool decode(const std::vector<const std::string*>& fragments,
+               size_t dataSize,
+               std::string& data) const;
+
+
+private:
+   int m_dataFragments;
+   int m_parityFragments;
+   std::vector<uint8_t> m_parityMatrix;  // m rows of k coefficients
+
+   // not available
+   ReedSolomon(const ReedSolomon&);
+   ReedSolomon& operator=(const ReedSolomon&);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,781 @@
+// Copyright Paul Dardeau, 2016
+// ReferenceCountIndex.cpp
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "ReferenceCountIndex.h"
+#include "BinaryFile.h"
+#include "GroupCommit.h"
+#include "OSUtils.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+const size_t ReferenceCountIndex::DEFAULT_CACHE_SIZE = 65536;
+
+static const string SNAPSHOT_FILE_NAME      = "refcount.snapshot";
+static const string SNAPSHOT_TEMP_FILE_NAME = "refcount.snapshot.tmp";
+static const string LOG_FILE_NAME           = "refcount.log";
+
+// snapshot: magic, version, then sorted entries (key length (2), key,
+// count (4)), then a zero key length, the entry count (8) and a checksum (4)
+// of everything before it
+static const uint32_t SNAPSHOT_MAGIC        = 0x4e534352;  // "RCSN"
+static const uint32_t SNAPSHOT_VERSION      = 1;
+static const size_t SNAPSHOT_HEADER_SIZE    = 8;
+
+// log record: magic, entry count (4), payload length (4), checksum (4) of
+// the first 12 bytes and the payload, then the payload of entries laid out
+// as in the snapshot. Counts in the log are absolute, so replaying a record
+// twice does no harm.
+static const uint32_t LOG_MAGIC             = 0x474c4352;  // "RCLG"
+static const size_t LOG_RECORD_HEADER_SIZE  = 16;
+
+static const size_t ENTRY_FIXED_SIZE        = 6;
+static const size_t SPARSE_INTERVAL         = 64;
+static const size_t WRITE_BUFFER_SIZE       = 1048576;
+
+// merges rewrite the whole snapshot, so they get further apart as it grows
+static const size_t MERGE_MIN_CHANGES       = 100000;
+static const uint64_t MERGE_MAX_LOG_SIZE    = 64ULL * 1024ULL * 1024ULL;
+
+//******************************************************************************
+
+static void AppendEntry(string& buffer, const string& key, uint32_t count) {
+   char fields[4];
+   BinaryFile::putUint16(fields, static_cast<uint16_t>(key.length()));
+   buffer.append(fields, 2);
+   buffer.append(key);
+   BinaryFile::putUint32(fields, count);
+   buffer.append(fields, 4);
+}
+
+//******************************************************************************
+
+static size_t FilterCapacity(uint64_t snapshotEntries) {
+   // room for the snapshot plus every new key that can arrive before the
+   // next merge rebuilds the filter
+   return static_cast<size_t>(snapshotEntries) +
+          max(MERGE_MIN_CHANGES, static_cast<size_t>(snapshotEntries / 8));
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::exists(const string& dirPath) {
+   return OSUtils::pathExists(OSUtils::pathJoin(dirPath, SNAPSHOT_FILE_NAME));
+}
+
+//******************************************************************************
+
+ReferenceCountIndex::ReferenceCountIndex() :
+   m_cacheSize(DEFAULT_CACHE_SIZE),
+   m_snapshotEntries(0),
+   m_snapshotFd(-1),
+   m_logFd(-1),
+   m_logOffset(0),
+   m_groupCommit(nullptr),
+   m_writeFailed(false) {
+}
+
+//******************************************************************************
+
+ReferenceCountIndex::~ReferenceCountIndex() {
+   close();
+}
+
+//******************************************************************************
+
+void ReferenceCountIndex::setCacheSize(size_t cacheSize) {
+   lock_guard<mutex> lock(m_mutex);
+   m_cacheSize = cacheSize;
+   while (m_cacheList.size() > m_cacheSize) {
+      m_cacheMap.erase(m_cacheList.back().first);
+      m_cacheList.pop_back();
+   }
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::open(const string& dirPath) {
+   lock_guard<mutex> lock(m_mutex);
+
+   m_dirPath = dirPath;
+   m_snapshotPath = OSUtils::pathJoin(dirPath, SNAPSHOT_FILE_NAME);
+   m_logPath = OSUtils::pathJoin(dirPath, LOG_FILE_NAME);
+
+   // keep adjust() and close() away from a half opened index
+   m_writeFailed = true;
+   m_keyFilter.reset(FilterCapacity(0));
+
+   if (!openSnapshot() || !replayLog()) {
+      return false;
+   }
+
+   m_groupCommit = new GroupCommit([this]() {
+      return GroupCommit::syncFileData(m_logFd);
+   });
+
+   m_writeFailed = false;
+   return true;
+}
+
+//******************************************************************************
+
+void ReferenceCountIndex::close() {
+   lock_guard<mutex> lock(m_mutex);
+
+   if ((m_logFd != -1) && !m_writeFailed && (m_logOffset > 0)) {
+      writeSnapshot(nullptr);
+   }
+
+   if (m_snapshotFd != -1) {
+      ::close(m_snapshotFd);
+      m_snapshotFd = -1;
+   }
+
+   if (m_logFd != -1) {
+      ::close(m_logFd);
+      m_logFd = -1;
+   }
+
+   if (m_groupCommit != nullptr) {
+      delete m_groupCommit;
+      m_groupCommit = nullptr;
+   }
+
+   m_changes.clear();
+   m_sparseIndex.clear();
+   m_cacheList.clear();
+   m_cacheMap.clear();
+   m_keyFilter = BloomFilter();
+   m_snapshotEntries = 0;
+   m_logOffset = 0;
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::readSnapshotEntry(FILE* f,
+                                            string& key,
+                                            uint32_t& count,
+                                            uint32_t& checksum) {
+   char fields[4];
+   if (::fread(fields, 1, 2, f) != 2) {
+      return false;
+   }
+
+   checksum = BinaryFile::checksum(fields, 2, checksum);
+   const uint16_t keyLength = BinaryFile::getUint16(fields);
+   if (keyLength == 0) {
+      // end of the entries
+      key.clear();
+      return true;
+   }
+
+   key.resize(keyLength);
+   if ((::fread(&key[0], 1, keyLength, f) != keyLength) ||
+       (::fread(fields, 1, 4, f) != 4)) {
+      return false;
+   }
+
+   checksum = BinaryFile::checksum(key.data(), keyLength, checksum);
+   checksum = BinaryFile::checksum(fields, 4, checksum);
+   count = BinaryFile::getUint32(fields);
+   return true;
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::openSnapshot() {
+   if (!OSUtils::pathExists(m_snapshotPath)) {
+      return true;
+   }
+
+   FILE* f = ::fopen(m_snapshotPath.c_str(), "rb");
+   if (f == nullptr) {
+      Logger::error(string("unable to open reference count snapshot '") +
+                    m_snapshotPath +
+                    string("'"));
+      return false;
+   }
+
+   // the entry count in the trailer sizes the key filter; it is only
+   // trusted as far as the file is big enough to hold that many entries
+   char trailer[12];
+   uint64_t expectedEntries = 0;
+   if ((::fseek(f, -12, SEEK_END) == 0) &&
+       (::fread(trailer, 1, 12, f) == 12)) {
+      expectedEntries = min(BinaryFile::getUint64(trailer),
+                            static_cast<uint64_t>(::ftell(f)) / ENTRY_FIXED_SIZE);
+   }
+   ::rewind(f);
+   m_keyFilter.reset(FilterCapacity(expectedEntries));
+
+   // read through the whole snapshot to check it and to build the sparse
+   // index that cold lookups use to find the right part of the file
+   char header[SNAPSHOT_HEADER_SIZE];
+   bool valid = (::fread(header, 1, SNAPSHOT_HEADER_SIZE, f) ==
+                 SNAPSHOT_HEADER_SIZE) &&
+                (BinaryFile::getUint32(header) == SNAPSHOT_MAGIC) &&
+                (BinaryFile::getUint32(header + 4) == SNAPSHOT_VERSION);
+
+   uint32_t checksum = BinaryFile::checksum(header, SNAPSHOT_HEADER_SIZE);
+   uint64_t offset = SNAPSHOT_HEADER_SIZE;
+   uint64_t entryCount = 0;
+   string key;
+   string previousKey;
+   uint32_t count = 0;
+
+   while (valid) {
+      if (!readSnapshotEntry(f, key, count, checksum)) {
+         valid = false;
+      } else if (key.empty()) {
+         break;
+      } else if (!previousKey.empty() && (key <= previousKey)) {
+         valid = false;
+      } else {
+         if (entryCount % SPARSE_INTERVAL == 0) {
+            if (!m_sparseIndex.empty()) {
+               m_sparseIndex.back().endOffset = offset;
+            }
+            SparseEntry sparseEntry;
+            sparseEntry.firstKey = key;
+            sparseEntry.offset = offset;
+            sparseEntry.endOffset = offset;
+            m_sparseIndex.push_back(sparseEntry);
+         }
+
+         m_keyFilter.add(key);
+         offset += ENTRY_FIXED_SIZE + key.length();
+         ++entryCount;
+         previousKey.swap(key);
+      }
+   }
+
+   if (valid) {
+      valid = (::fread(trailer, 1, 12, f) == 12) &&
+              (BinaryFile::getUint64(trailer) == entryCount) &&
+              (BinaryFile::getUint32(trailer + 8) ==
+               BinaryFile::checksum(trailer, 8, checksum));
+   }
+
+   ::fclose(f);
+
+   if (!valid) {
+      // unlike the pack index this can't be rebuilt, so don't guess
+      Logger::error(string("reference count snapshot '") +
+                    m_snapshotPath +
+                    string("' is corrupt"));
+      m_sparseIndex.clear();
+      return false;
+   }
+
+   if (!m_sparseIndex.empty()) {
+      m_sparseIndex.back().endOffset = offset;
+   }
+
+   m_snapshotEntries = entryCount;
+   m_snapshotFd = ::open(m_snapshotPath.c_str(), O_RDONLY);
+   return (m_snapshotFd != -1);
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::replayLog() {
+   const bool logExists = OSUtils::pathExists(m_logPath);
+
+   m_logFd = ::open(m_logPath.c_str(), O_RDWR | O_CREAT, 0600);
+   if (m_logFd == -1) {
+      Logger::error(string("unable to open reference count log '") +
+                    m_logPath +
+                    string("'"));
+      return false;
+   }
+
+   if (!logExists) {
+      BinaryFile::syncDirectory(m_dirPath);
+   }
+
+   struct stat st;
+   if (::fstat(m_logFd, &st) != 0) {
+      return false;
+   }
+
+   const uint64_t logSize = st.st_size;
+   string logContents(logSize, '\0');
+   if ((logSize > 0) &&
+       !BinaryFile::preadFully(m_logFd, &logContents[0], logSize, 0)) {
+      Logger::error("unable to read reference count log");
+      return false;
+   }
+
+   const char* p = logContents.data();
+   uint64_t offset = 0;
+
+   while (offset + LOG_RECORD_HEADER_SIZE <= logSize) {
+      const char* header = p + offset;
+      const uint32_t entryCount = BinaryFile::getUint32(header + 4);
+      const uint32_t payloadLength = BinaryFile::getUint32(header + 8);
+
+      if ((BinaryFile::getUint32(header) != LOG_MAGIC) ||
+          (offset + LOG_RECORD_HEADER_SIZE + payloadLength > logSize)) {
+         break;
+      }
+
+      const char* payload = header + LOG_RECORD_HEADER_SIZE;
+      const uint32_t checksum =
+         BinaryFile::checksum(payload,
+                              payloadLength,
+                              BinaryFile::checksum(header, 12));
+      if (checksum != BinaryFile::getUint32(header + 12)) {
+         break;
+      }
+
+      // the checksum matched, so the entries are as they were written
+      size_t pos = 0;
+      for (uint32_t i = 0; i < entryCount; ++i) {
+         const uint16_t keyLength = BinaryFile::getUint16(payload + pos);
+         const string key(payload + pos + 2, keyLength);
+         m_changes[key] = BinaryFile::getUint32(payload + pos + 2 + keyLength);
+         m_keyFilter.add(key);
+         pos += ENTRY_FIXED_SIZE + keyLength;
+      }
+
+      offset += LOG_RECORD_HEADER_SIZE + payloadLength;
+   }
+
+   if (offset < logSize) {
+      // the last batch before a crash; nobody was told it succeeded
+      Logger::warning(string("truncating incomplete record at offset ") +
+                      to_string(offset) +
+                      string(" of reference count log"));
+      if ((::ftruncate(m_logFd, offset) != 0) ||
+          !GroupCommit::syncFileData(m_logFd)) {
+         Logger::error("unable to truncate reference count log");
+         return false;
+      }
+   }
+
+   m_logOffset = offset;
+   return true;
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::writeSnapshot(
+   const map<string, uint32_t>* replacement) {
+   const string tempPath = OSUtils::pathJoin(m_dirPath, SNAPSHOT_TEMP_FILE_NAME);
+
+   FILE* out = ::fopen(tempPath.c_str(), "wb");
+   if (out == nullptr) {
+      Logger::error(string("unable to create reference count snapshot '") +
+                    tempPath +
+                    string("'"));
+      return false;
+   }
+
+   // merge the old snapshot with the changes (or take the replacement)
+   FILE* in = nullptr;
+   if ((replacement == nullptr) && (m_snapshotFd != -1)) {
+      in = ::fopen(m_snapshotPath.c_str(), "rb");
+      char header[SNAPSHOT_HEADER_SIZE];
+      if ((in == nullptr) ||
+          (::fread(header, 1, SNAPSHOT_HEADER_SIZE, in) != SNAPSHOT_HEADER_SIZE)) {
+         Logger::error("unable to read reference count snapshot");
+         if (in != nullptr) {
+            ::fclose(in);
+         }
+         ::fclose(out);
+         ::unlink(tempPath.c_str());
+         return false;
+      }
+   }
+
+   const map<string, uint32_t>& changes =
+      (replacement != nullptr) ? *replacement : m_changes;
+   auto itChange = changes.begin();
+
+   string buffer;
+   buffer.reserve(WRITE_BUFFER_SIZE + 65536);
+   buffer.resize(SNAPSHOT_HEADER_SIZE);
+   BinaryFile::putUint32(&buffer[0], SNAPSHOT_MAGIC);
+   BinaryFile::putUint32(&buffer[4], SNAPSHOT_VERSION);
+
+   vector<SparseEntry> sparseIndex;
+   BloomFilter keyFilter;
+   keyFilter.reset(FilterCapacity((replacement != nullptr) ?
+                                  changes.size() :
+                                  m_snapshotEntries + changes.size()));
+   uint32_t outChecksum = BinaryFile::CHECKSUM_INITIAL_VALUE;
+   uint32_t inChecksum = BinaryFile::CHECKSUM_INITIAL_VALUE;
+   uint64_t offset = SNAPSHOT_HEADER_SIZE;
+   uint64_t entryCount = 0;
+   bool success = true;
+
+   string inKey;
+   uint32_t inCount = 0;
+   bool haveIn = false;
+
+   if (in != nullptr) {
+      success = readSnapshotEntry(in, inKey, inCount, inChecksum);
+      haveIn = success && !inKey.empty();
+   }
+
+   while (success && (haveIn || (itChange != changes.end()))) {
+      string key;
+      uint32_t count;
+
+      if (haveIn &&
+          ((itChange == changes.end()) || (inKey < itChange->first))) {
+         key = inKey;
+         count = inCount;
+         success = readSnapshotEntry(in, inKey, inCount, inChecksum);
+         haveIn = success && !inKey.empty();
+      } else {
+         key = itChange->first;
+         count = itChange->second;
+         if (haveIn && (inKey == itChange->first)) {
+            success = readSnapshotEntry(in, inKey, inCount, inChecksum);
+            haveIn = success && !inKey.empty();
+         }
+         ++itChange;
+      }
+
+      if (count == 0) {
+         continue;
+      }
+
+      if (entryCount % SPARSE_INTERVAL == 0) {
+         if (!sparseIndex.empty()) {
+            sparseIndex.back().endOffset = offset;
+         }
+         SparseEntry sparseEntry;
+         sparseEntry.firstKey = key;
+         sparseEntry.offset = offset;
+         sparseEntry.endOffset = offset;
+         sparseIndex.push_back(sparseEntry);
+      }
+
+      AppendEntry(buffer, key, count);
+      keyFilter.add(key);
+      offset += ENTRY_FIXED_SIZE + key.length();
+      ++entryCount;
+
+      if (buffer.length() >= WRITE_BUFFER_SIZE) {
+         outChecksum =
+            BinaryFile::checksum(buffer.data(), buffer.length(), outChecksum);
+         success = (::fwrite(buffer.data(), 1, buffer.length(), out) ==
+                    buffer.length());
+         buffer.clear();
+      }
+   }
+
+   if (in != nullptr) {
+      ::fclose(in);
+   }
+
+   if (!sparseIndex.empty()) {
+      sparseIndex.back().endOffset = offset;
+   }
+
+   if (success) {
+      char trailer[14];
+      BinaryFile::putUint16(trailer, 0);
+      BinaryFile::putUint64(trailer + 2, entryCount);
+      buffer.append(trailer, 10);
+      outChecksum =
+         BinaryFile::checksum(buffer.data(), buffer.length(), outChecksum);
+      BinaryFile::putUint32(trailer, outChecksum);
+      buffer.append(trailer, 4);
+
+      success = (::fwrite(buffer.data(), 1, buffer.length(), out) ==
+                 buffer.length()) &&
+                (::fflush(out) == 0) &&
+                (::fsync(::fileno(out)) == 0);
+   }
+
+   if ((::fclose(out) != 0) || !success) {
+      ::unlink(tempPath.c_str());
+      Logger::error("unable to write reference count snapshot");
+      return false;
+   }
+
+   if ((::rename(tempPath.c_str(), m_snapshotPath.c_str()) != 0) ||
+       !BinaryFile::syncDirectory(m_dirPath)) {
+      Logger::error("unable to replace reference count snapshot");
+      return false;
+   }
+
+   if (m_snapshotFd != -1) {
+      ::close(m_snapshotFd);
+   }
+   m_snapshotFd = ::open(m_snapshotPath.c_str(), O_RDONLY);
+   m_sparseIndex.swap(sparseIndex);
+   m_snapshotEntries = entryCount;
+
+   // keys whose count dropped to zero leave the filter here
+   m_keyFilter = keyFilter;
+
+   // everything in the log is now in the durable snapshot
+   m_changes.clear();
+   if (m_groupCommit != nullptr) {
+      m_groupCommit->markSynced();
+   }
+
+   if ((::ftruncate(m_logFd, 0) != 0) ||
+       !GroupCommit::syncFileData(m_logFd)) {
+      // harmless to replay later since the log holds absolute counts
+      Logger::error("unable to truncate reference count log");
+   } else {
+      m_logOffset = 0;
+   }
+
+   return (m_snapshotFd != -1);
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::importCounts(const map<string, uint32_t>& counts) {
+   lock_guard<mutex> lock(m_mutex);
+
+   if (m_logFd == -1) {
+      return false;
+   }
+
+   m_cacheList.clear();
+   m_cacheMap.clear();
+   m_changes.clear();
+
+   return writeSnapshot(&counts);
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::lookupSnapshot(const string& key, uint32_t& count) {
+   if (m_sparseIndex.empty() || (m_snapshotFd == -1)) {
+      return false;
+   }
+
+   auto it = upper_bound(m_sparseIndex.begin(),
+                         m_sparseIndex.end(),
+                         key,
+                         [](const string& k, const SparseEntry& entry) {
+                            return k < entry.firstKey;
+                         });
+   if (it == m_sparseIndex.begin()) {
+      return false;
+   }
+   --it;
+
+   const size_t length = it->endOffset - it->offset;
+   string block(length, '\0');
+   if (!BinaryFile::preadFully(m_snapshotFd, &block[0], length, it->offset)) {
+      Logger::error("unable to read reference count snapshot");
+      return false;
+   }
+
+   const char* p = block.data();
+   size_t pos = 0;
+   while (pos + ENTRY_FIXED_SIZE <= length) {
+      const uint16_t keyLength = BinaryFile::getUint16(p + pos);
+      const int cmp = key.compare(0, string::npos, p + pos + 2, keyLength);
+      if (cmp == 0) {
+         count = BinaryFile::getUint32(p + pos + 2 + keyLength);
+         return true;
+      } else if (cmp < 0) {
+         break;
+      }
+      pos += ENTRY_FIXED_SIZE + keyLength;
+   }
+
+   return false;
+}
+
+//******************************************************************************
+
+void ReferenceCountIndex::cachePut(const string& key, uint32_t count) {
+   if (m_cacheSize == 0) {
+      return;
+   }
+
+   auto it = m_cacheMap.find(key);
+   if (it != m_cacheMap.end()) {
+      it->second->second = count;
+      m_cacheList.splice(m_cacheList.begin(), m_cacheList, it->second);
+      return;
+   }
+
+   m_cacheList.push_front(make_pair(key, count));
+   m_cacheMap[key] = m_cacheList.begin();
+
+   if (m_cacheList.size() > m_cacheSize) {
+      m_cacheMap.erase(m_cacheList.back().first);
+      m_cacheList.pop_back();
+   }
+}
+
+//******************************************************************************
+
+uint32_t ReferenceCountIndex::lookup(const string& key) {
+   // the cache is kept current by every change, so it is checked first
+   auto itCache = m_cacheMap.find(key);
+   if (itCache != m_cacheMap.end()) {
+      m_cacheList.splice(m_cacheList.begin(), m_cacheList, itCache->second);
+      return itCache->second->second;
+   }
+
+   uint32_t count = 0;
+   auto itChange = m_changes.find(key);
+   if (itChange != m_changes.end()) {
+      count = itChange->second;
+   } else if (!lookupSnapshot(key, count)) {
+      count = 0;
+   }
+
+   cachePut(key, count);
+   return count;
+}
+
+//******************************************************************************
+
+uint32_t ReferenceCountIndex::referenceCount(const string& key) {
+   lock_guard<mutex> lock(m_mutex);
+   return lookup(key);
+}
+
+//******************************************************************************
+
+void ReferenceCountIndex::hasReferences(const vector<string>& keys,
+                                        vector<bool>& referenced) {
+   lock_guard<mutex> lock(m_mutex);
+
+   referenced.assign(keys.size(), false);
+
+   // most keys asked about by a client are new, and the filter rules those
+   // out without touching the snapshot
+   const size_t numKeys = keys.size();
+   for (size_t i = 0; i < numKeys; ++i) {
+      if (m_keyFilter.mayContain(keys[i])) {
+         referenced[i] = (lookup(keys[i]) > 0);
+      }
+   }
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::adjust(const vector<Change>& changes,
+                                 vector<uint32_t>* newCounts) {
+   uint64_t ticket = 0;
+   vector<uint32_t> counts;
+   counts.reserve(changes.size());
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+
+      if ((m_logFd == -1) || m_writeFailed) {
+         ::printf("error: reference count index is not writable\n");
+         return false;
+      }
+
+      // work out every new count before changing anything
+      map<string, uint32_t> batch;
+      for (const Change& change : changes) {
+         auto it = batch.find(change.first);
+         const long long current =
+            (it != batch.end()) ? it->second : lookup(change.first);
+         const long long updated = current + change.second;
+         if ((updated < 0) || (updated > 0xffffffffLL)) {
+            return false;
+         }
+         batch[change.first] = static_cast<uint32_t>(updated);
+         counts.push_back(static_cast<uint32_t>(updated));
+      }
+
+      if (batch.empty()) {
+         if (newCounts != nullptr) {
+            newCounts->clear();
+         }
+         return true;
+      }
+
+      string record(LOG_RECORD_HEADER_SIZE, '\0');
+      for (const auto& kv : batch) {
+         AppendEntry(record, kv.first, kv.second);
+      }
+
+      const uint32_t payloadLength =
+         static_cast<uint32_t>(record.length() - LOG_RECORD_HEADER_SIZE);
+      BinaryFile::putUint32(&record[0], LOG_MAGIC);
+      BinaryFile::putUint32(&record[4], static_cast<uint32_t>(batch.size()));
+      BinaryFile::putUint32(&record[8], payloadLength);
+      BinaryFile::putUint32(&record[12],
+         BinaryFile::checksum(record.data() + LOG_RECORD_HEADER_SIZE,
+                              payloadLength,
+                              BinaryFile::checksum(record.data(), 12)));
+
+      if (!BinaryFile::pwriteFully(m_logFd,
+                                   record.data(),
+                                   record.length(),
+                                   m_logOffset)) {
+         ::printf("error: unable to write to reference count log\n");
+         return false;
+      }
+
+      for (const auto& kv : batch) {
+         m_changes[kv.first] = kv.second;
+         cachePut(kv.first, kv.second);
+         if (kv.second > 0) {
+            m_keyFilter.add(kv.first);
+         }
+      }
+
+      m_logOffset += record.length();
+      ticket = m_groupCommit->registerWrite();
+
+      const size_t mergeThreshold =
+         max(MERGE_MIN_CHANGES, static_cast<size_t>(m_snapshotEntries / 8));
+      if ((m_changes.size() >= mergeThreshold) ||
+          (m_logOffset >= MERGE_MAX_LOG_SIZE)) {
+         writeSnapshot(nullptr);
+      }
+   }
+
+   if (!m_groupCommit->waitForSync(ticket)) {
+      lock_guard<mutex> lock(m_mutex);
+      m_writeFailed = true;
+      ::printf("error: unable to sync reference count log\n");
+      return false;
+   }
+
+   if (newCounts != nullptr) {
+      newCounts->swap(counts);
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+bool ReferenceCountIndex::adjust(const string& key,
+                                 int delta,
+                                 uint32_t& newCount) {
+   vector<Change> changes;
+   changes.push_back(make_pair(key, delta));
+
+   vector<uint32_t> newCounts;
+   if (!adjust(changes, &newCounts)) {
+      return false;
+   }
+
+   newCount = newCounts[0];
+   return true;
+}
+
+//******************************************************************************
+
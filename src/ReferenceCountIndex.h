@@ -0,0 +1,166 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_REFERENCECOUNTINDEX_H
+#define LACHEPAS_REFERENCECOUNTINDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "BloomFilter.h"
+
+
+namespace lachepas {
+
+class GroupCommit;
+
+/**
+ * Node-local store of block reference counts. Counts live in a sorted
+ * snapshot file plus an append-only log of changes made since the snapshot.
+ * Each call to adjust is one checksummed log record, so a batch of changes
+ * is applied all-or-nothing, and concurrent callers share the sync of the
+ * log. Changes since the snapshot are held in memory, as are the counts of
+ * recently used blocks; other counts are read from the snapshot with the
+ * help of a sparse in-memory index. When enough changes build up they are
+ * merged into a new snapshot and the log starts over.
+ */
+class ReferenceCountIndex {
+
+public:
+   typedef std::pair<std::string, int> Change;
+
+   static const size_t DEFAULT_CACHE_SIZE;
+
+   /**
+    *
+    * @param dirPath
+    * @return boolean indicating whether an index has been created in dirPath
+    */
+   static bool exists(const std::string& dirPath);
+
+   /**
+    * Default constructor
+    */
+   ReferenceCountIndex();
+
+   /**
+    * Destructor
+    */
+   ~ReferenceCountIndex();
+
+   /**
+    * Sets the number of counts kept in memory for recently used blocks
+    * @param cacheSize
+    */
+   void setCacheSize(size_t cacheSize);
+
+   /**
+    * Opens the index in the specified directory, replaying any changes
+    * logged since the last snapshot
+    * @param dirPath
+    * @return
+    */
+   bool open(const std::string& dirPath);
+
+   /**
+    * Merges logged changes into the snapshot and closes the index
+    */
+   void close();
+
+   /**
+    * Replaces the contents of the index, e.g. with counts imported from
+    * another store. Writes a new snapshot before returning.
+    * @param counts
+    * @return
+    */
+   bool importCounts(const std::map<std::string, uint32_t>& counts);
+
+   /**
+    *
+    * @param key
+    * @return reference count (0 if the key isn't known)
+    */
+   uint32_t referenceCount(const std::string& key);
+
+   /**
+    * Checks many keys at once. A Bloom filter of the known keys answers for
+    * keys that have never been counted, so only likely matches are looked up.
+    * @param keys
+    * @param referenced receives, for each key, whether its count is above zero
+    */
+   void hasReferences(const std::vector<std::string>& keys,
+                      std::vector<bool>& referenced);
+
+   /**
+    * Applies a batch of increments and decrements atomically. Nothing is
+    * applied if any count would go below zero. Returns once the changes are
+    * on stable storage.
+    * @param changes
+    * @param newCounts receives the resulting count for each change (optional)
+    * @return
+    */
+   bool adjust(const std::vector<Change>& changes,
+               std::vector<uint32_t>* newCounts = nullptr);
+
+   /**
+    * Applies a single increment or decrement
+    * @param key
+    * @param delta
+    * @param newCount
+    * @return
+    */
+   bool adjust(const std::string& key, int delta, uint32_t& newCount);
+
+
+private:
+   struct SparseEntry {
+      std::string firstKey;
+      uint64_t offset;
+      uint64_t endOffset;
+   };
+
+   typedef std::list<std::pair<std::string, uint32_t> > CacheList;
+
+   bool openSnapshot();
+   bool replayLog();
+   bool writeSnapshot(const std::map<std::string, uint32_t>* replacement);
+   bool readSnapshotEntry(FILE* f,
+                          std::string& key,
+                          uint32_t& count,
+                          uint32_t& checksum);
+   bool lookupSnapshot(const std::string& key, uint32_t& count);
+   uint32_t lookup(const std::string& key);
+   void cachePut(const std::string& key, uint32_t count);
+
+   std::string m_dirPath;
+   std::string m_snapshotPath;
+   std::string m_logPath;
+   std::mutex m_mutex;
+   std::map<std::string, uint32_t> m_changes;
+   std::vector<SparseEntry> m_sparseIndex;
+   BloomFilter m_keyFilter;
+   CacheList m_cacheList;
+   std::unordered_map<std::string, CacheList::iterator> m_cacheMap;
+   size_t m_cacheSize;
+   uint64_t m_snapshotEntries;
+   int m_snapshotFd;
+   int m_logFd;
+   uint64_t m_logOffset;
+   GroupCommit* m_groupCommit;
+   bool m_writeFailed;
+
+   // not available
+   ReferenceCountIndex(const ReferenceCountIndex&);
+   ReferenceCountIndex& operator=(const ReferenceCountIndex&);
+};
+
+}
+
+#endif
+
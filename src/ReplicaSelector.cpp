@@ -0,0 +1,392 @@
+// Copyright Paul Dardeau, 2016
+// ReplicaSelector.cpp
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+
+#include "ReplicaSelector.h"
+
+// fetches in a row that a node may fail before it is passed over
+#define UNHEALTHY_FAILURES 3
+
+// how long an unhealthy node is passed over (doubling with each further
+// failure, up to the maximum)
+#define UNHEALTHY_BACKOFF_MILLIS 1000
+#define UNHEALTHY_MAX_BACKOFF_MILLIS 30000
+
+// weight of the newest fetch in a node's moving averages
+#define STATS_SMOOTHING 0.2
+
+// recent fetch latencies kept for the hedge percentile, how many are
+// needed before any fetch is hedged, and how many new ones cause the
+// percentile to be recomputed
+#define LATENCY_SAMPLES 512
+#define MIN_HEDGE_SAMPLES 64
+#define HEDGE_RECOMPUTE_SAMPLES 64
+
+// one fetch in this many goes to the second best replica, so that the
+// statistics of a node that is being passed over stay current
+#define EXPLORE_INTERVAL 64
+
+using namespace std;
+using namespace lachepas;
+
+const int ReplicaSelector::DEFAULT_HEDGE_PERCENTILE = 95;
+
+//******************************************************************************
+
+// the requests for one block that are racing each other
+struct ReplicaSelector::HedgeState {
+   mutex stateMutex;
+   condition_variable stateChanged;
+   string contents;  // of the winner
+   int winner;
+   int inFlight;
+
+   HedgeState() :
+      winner(-1),
+      inFlight(0) {
+   }
+};
+
+//******************************************************************************
+
+ReplicaSelector::ReplicaSelector(int numNodes) :
+   m_nodeStats(numNodes > 0 ? numNodes : 0),
+   m_hedgeDelay(0),
+   m_hedgedFetches(0),
+   m_failovers(0),
+   m_nextSample(0),
+   m_samplesSinceDelay(0),
+   m_fetchCount(0),
+   m_hedgePercentile(DEFAULT_HEDGE_PERCENTILE) {
+   m_latencySamples.reserve(LATENCY_SAMPLES);
+}
+
+//******************************************************************************
+
+ReplicaSelector::~ReplicaSelector() {
+   lock_guard<mutex> lock(m_stragglerMutex);
+   for (auto& straggler : m_stragglers) {
+      straggler.wait();
+   }
+   m_stragglers.clear();
+}
+
+//******************************************************************************
+
+void ReplicaSelector::setHedgePercentile(int hedgePercentile) {
+   lock_guard<mutex> lock(m_mutex);
+   m_hedgePercentile = max(0, min(hedgePercentile, 99));
+   m_hedgeDelay = chrono::microseconds(0);
+}
+
+//******************************************************************************
+
+int ReplicaSelector::fetch(const vector<int>& replicaNodes,
+                           size_t blockSize,
+                           const ReplicaFetch& fetch,
+                           string& contents) {
+   vector<int> order;
+   orderReplicas(replicaNodes, blockSize, order);
+
+   const int numReplicas = order.size();
+   if (numReplicas == 0) {
+      return -1;
+   }
+
+   const chrono::microseconds hedgeDelay =
+      (numReplicas > 1) ? getHedgeDelay() : chrono::microseconds(0);
+
+   if (hedgeDelay.count() == 0) {
+      // nothing to hedge with (or too little known to hedge yet), so the
+      // replicas are tried one after another on this thread
+      for (int i = 0; i < numReplicas; ++i) {
+         const int replica = order[i];
+         if (timedFetch(fetch, replica, replicaNodes[replica], contents)) {
+            if (i > 0) {
+               ++m_failovers;
+            }
+            return replica;
+         }
+      }
+
+      return -1;
+   }
+
+   // each request runs on its own thread so that this one can wait for
+   // whichever finishes first. the state is shared with the requests,
+   // which may outlive this call.
+   shared_ptr<HedgeState> state = make_shared<HedgeState>();
+   vector<future<void>> requests;
+   int next = 0;
+   bool hedged = false;
+   bool failedOver = false;
+   chrono::steady_clock::time_point deadline;
+
+   unique_lock<mutex> lock(state->stateMutex);
+
+   while (state->winner < 0) {
+      bool launchNext = false;
+
+      if (state->inFlight == 0) {
+         if (next == numReplicas) {
+            break;  // every replica failed
+         }
+
+         failedOver = (next > 0);
+         launchNext = true;
+      } else if (!hedged && (next < numReplicas)) {
+         if ((state->stateChanged.wait_until(lock, deadline) == cv_status::timeout) &&
+             (state->winner < 0) &&
+             (state->inFlight > 0)) {
+            hedged = true;
+            ++m_hedgedFetches;
+            launchNext = true;
+         }
+      } else {
+         state->stateChanged.wait(lock);
+      }
+
+      if (launchNext) {
+         const int replica = order[next++];
+         const int nodeIndex = replicaNodes[replica];
+         ++state->inFlight;
+         deadline = chrono::steady_clock::now() + hedgeDelay;
+
+         requests.push_back(async(launch::async,
+                                  [this, state, fetch, replica, nodeIndex]() {
+            string replicaContents;
+            const bool fetched =
+               timedFetch(fetch, replica, nodeIndex, replicaContents);
+
+            lock_guard<mutex> stateLock(state->stateMutex);
+            --state->inFlight;
+            if (fetched && (state->winner < 0)) {
+               state->winner = replica;
+               state->contents.swap(replicaContents);
+            }
+            state->stateChanged.notify_all();
+         }));
+      }
+   }
+
+   const int winner = state->winner;
+   if (winner > -1) {
+      contents.swap(state->contents);
+      if (failedOver) {
+         ++m_failovers;
+      }
+   }
+
+   lock.unlock();
+
+   // the request that lost the race is left to finish on its own
+   keepStragglers(requests);
+
+   return winner;
+}
+
+//******************************************************************************
+
+void ReplicaSelector::orderReplicas(const vector<int>& replicaNodes,
+                                    size_t blockSize,
+                                    vector<int>& order) {
+   struct Candidate {
+      int replica;
+      bool healthy;
+      double estimateMicros;
+   };
+
+   const int numReplicas = replicaNodes.size();
+   const auto now = chrono::steady_clock::now();
+   vector<Candidate> candidates;
+   candidates.reserve(numReplicas);
+   bool explore = false;
+
+   {
+      lock_guard<mutex> lock(m_mutex);
+      const int numNodes = m_nodeStats.size();
+
+      for (int i = 0; i < numReplicas; ++i) {
+         Candidate candidate;
+         candidate.replica = i;
+         candidate.healthy = true;
+         candidate.estimateMicros = 0.0;  // untried nodes go first
+
+         const int nodeIndex = replicaNodes[i];
+         if ((nodeIndex > -1) && (nodeIndex < numNodes)) {
+            const NodeStats& stats = m_nodeStats[nodeIndex];
+            candidate.healthy =
+               (stats.consecutiveFailures < UNHEALTHY_FAILURES) ||
+               (now >= stats.retryTime);
+
+            if (stats.fetches > 0) {
+               candidate.estimateMicros = (stats.bytesPerMicro > 0.0) ?
+                  (blockSize / stats.bytesPerMicro) : stats.latencyMicros;
+            }
+         }
+
+         candidates.push_back(candidate);
+      }
+
+      explore = ((++m_fetchCount % EXPLORE_INTERVAL) == 0);
+   }
+
+   stable_sort(candidates.begin(),
+               candidates.end(),
+               [](const Candidate& a, const Candidate& b) {
+                  if (a.healthy != b.healthy) {
+                     return a.healthy;
+                  }
+                  return a.estimateMicros < b.estimateMicros;
+               });
+
+   if (explore && (numReplicas > 1) && candidates[1].healthy) {
+      swap(candidates[0], candidates[1]);
+   }
+
+   order.clear();
+   for (const auto& candidate : candidates) {
+      order.push_back(candidate.replica);
+   }
+}
+
+//******************************************************************************
+
+int ReplicaSelector::getHedgedFetches() const {
+   return m_hedgedFetches;
+}
+
+//******************************************************************************
+
+int ReplicaSelector::getFailovers() const {
+   return m_failovers;
+}
+
+//******************************************************************************
+
+bool ReplicaSelector::timedFetch(const ReplicaFetch& fetch,
+                                 int replica,
+                                 int nodeIndex,
+                                 string& contents) {
+   const auto startTime = chrono::steady_clock::now();
+   const bool fetched = fetch(replica, contents);
+   const auto elapsed =
+      chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() -
+                                                  startTime);
+
+   if (fetched) {
+      recordSuccess(nodeIndex, contents.size(), elapsed);
+   } else {
+      recordFailure(nodeIndex);
+   }
+
+   return fetched;
+}
+
+//******************************************************************************
+
+void ReplicaSelector::recordSuccess(int nodeIndex,
+                                    size_t bytes,
+                                    chrono::microseconds elapsed) {
+   lock_guard<mutex> lock(m_mutex);
+
+   if ((nodeIndex < 0) || (nodeIndex >= (int) m_nodeStats.size())) {
+      return;
+   }
+
+   const long micros = max(1L, (long) elapsed.count());
+   const double bytesPerMicro = (double) bytes / micros;
+
+   NodeStats& stats = m_nodeStats[nodeIndex];
+   if (stats.fetches == 0) {
+      stats.latencyMicros = micros;
+      stats.bytesPerMicro = bytesPerMicro;
+   } else {
+      stats.latencyMicros += STATS_SMOOTHING * (micros - stats.latencyMicros);
+      stats.bytesPerMicro += STATS_SMOOTHING * (bytesPerMicro - stats.bytesPerMicro);
+   }
+
+   ++stats.fetches;
+   stats.consecutiveFailures = 0;
+
+   if (m_latencySamples.size() < LATENCY_SAMPLES) {
+      m_latencySamples.push_back(micros);
+   } else {
+      m_latencySamples[m_nextSample] = micros;
+      m_nextSample = (m_nextSample + 1) % LATENCY_SAMPLES;
+   }
+
+   ++m_samplesSinceDelay;
+}
+
+//******************************************************************************
+
+void ReplicaSelector::recordFailure(int nodeIndex) {
+   lock_guard<mutex> lock(m_mutex);
+
+   if ((nodeIndex < 0) || (nodeIndex >= (int) m_nodeStats.size())) {
+      return;
+   }
+
+   NodeStats& stats = m_nodeStats[nodeIndex];
+   ++stats.consecutiveFailures;
+
+   if (stats.consecutiveFailures >= UNHEALTHY_FAILURES) {
+      const int doublings =
+         min(stats.consecutiveFailures - UNHEALTHY_FAILURES, 5);
+      const long backoffMillis =
+         min((long) UNHEALTHY_BACKOFF_MILLIS << doublings,
+             (long) UNHEALTHY_MAX_BACKOFF_MILLIS);
+      stats.retryTime =
+         chrono::steady_clock::now() + chrono::milliseconds(backoffMillis);
+   }
+}
+
+//******************************************************************************
+
+chrono::microseconds ReplicaSelector::getHedgeDelay() {
+   lock_guard<mutex> lock(m_mutex);
+
+   if ((m_hedgePercentile <= 0) ||
+       (m_latencySamples.size() < MIN_HEDGE_SAMPLES)) {
+      return chrono::microseconds(0);
+   }
+
+   if ((m_hedgeDelay.count() == 0) ||
+       (m_samplesSinceDelay >= HEDGE_RECOMPUTE_SAMPLES)) {
+      vector<long> samples(m_latencySamples);
+      const size_t index = samples.size() * m_hedgePercentile / 100;
+      nth_element(samples.begin(), samples.begin() + index, samples.end());
+      m_hedgeDelay = chrono::microseconds(max(1L, samples[index]));
+      m_samplesSinceDelay = 0;
+   }
+
+   return m_hedgeDelay;
+}
+
+//******************************************************************************
+
+void ReplicaSelector::keepStragglers(vector<future<void>>& requests) {
+   lock_guard<mutex> lock(m_stragglerMutex);
+
+   // forget the stragglers that have finished since
+   m_stragglers.erase(remove_if(m_stragglers.begin(),
+                                m_stragglers.end(),
+                                [](const future<void>& straggler) {
+                                   return straggler.wait_for(chrono::seconds(0)) ==
+                                          future_status::ready;
+                                }),
+                      m_stragglers.end());
+
+   for (auto& request : requests) {
+      if (request.wait_for(chrono::seconds(0)) != future_status::ready) {
+         m_stragglers.push_back(std::move(request));
+      }
+   }
+}
+
+//******************************************************************************
+
@@ -0,0 +1,155 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_REPLICASELECTOR_H
+#define LACHEPAS_REPLICASELECTOR_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace lachepas {
+
+/**
+ * Chooses which of the nodes holding a copy of a block a restore fetches it
+ * from. The latency and throughput of every fetch are recorded per node
+ * during the run, and the replicas of a block are tried fastest first. A
+ * node that fails several fetches in a row is passed over (it is only
+ * tried when no other copy is left) until a backoff has expired.
+ *
+ * A fetch that is still running after the configured percentile of recent
+ * fetch latencies is hedged: the next replica is requested as well, and
+ * whichever copy arrives first is used. A replica that fails (including
+ * failing its integrity check) is replaced by the next one.
+ *
+ * Safe to use from many fetch workers at once.
+ */
+class ReplicaSelector {
+
+public:
+   /**
+    * Percentile of recent fetch latencies after which a fetch is hedged
+    */
+   static const int DEFAULT_HEDGE_PERCENTILE;
+
+   /**
+    * Retrieves (and checks) one replica of a block
+    * @param replica index of the replica (into the replica nodes given to
+    * fetch)
+    * @param contents receives the replica
+    * @return false if the replica could not be retrieved or is damaged
+    */
+   typedef std::function<bool(int replica, std::string& contents)> ReplicaFetch;
+
+   /**
+    * Constructor
+    * @param numNodes number of nodes (nodes are identified by index)
+    */
+   explicit ReplicaSelector(int numNodes);
+
+   /**
+    * Destructor. Waits for hedged requests that lost their race.
+    */
+   ~ReplicaSelector();
+
+   /**
+    * Sets the latency percentile after which a fetch is hedged
+    * @param hedgePercentile 1 to 99 (0 = never hedge)
+    */
+   void setHedgePercentile(int hedgePercentile);
+
+   /**
+    * Fetches a block from the best of its replicas, hedging and failing
+    * over as needed
+    * @param replicaNodes node holding each replica
+    * @param blockSize expected size of the block (used to rank the nodes)
+    * @param fetch retrieves one replica. a hedged request may still be
+    * running when this returns, so the fetch must not refer to anything
+    * that the caller releases before the selector.
+    * @param contents receives the block
+    * @return index of the replica used (-1 if no replica could be fetched)
+    */
+   int fetch(const std::vector<int>& replicaNodes,
+             size_t blockSize,
+             const ReplicaFetch& fetch,
+             std::string& contents);
+
+   /**
+    * Orders replicas from the most to the least promising
+    * @param replicaNodes node holding each replica
+    * @param blockSize
+    * @param order receives the indexes of the replicas
+    */
+   void orderReplicas(const std::vector<int>& replicaNodes,
+                      size_t blockSize,
+                      std::vector<int>& order);
+
+   /**
+    *
+    * @return number of fetches that were hedged
+    */
+   int getHedgedFetches() const;
+
+   /**
+    *
+    * @return number of blocks taken from another replica after a failure
+    */
+   int getFailovers() const;
+
+
+private:
+   struct NodeStats {
+      double latencyMicros;      // moving average
+      double bytesPerMicro;      // moving average
+      std::chrono::steady_clock::time_point retryTime;  // while unhealthy
+      int fetches;
+      int consecutiveFailures;
+
+      NodeStats() :
+         latencyMicros(0.0),
+         bytesPerMicro(0.0),
+         fetches(0),
+         consecutiveFailures(0) {
+      }
+   };
+
+   struct HedgeState;
+
+   bool timedFetch(const ReplicaFetch& fetch,
+                   int replica,
+                   int nodeIndex,
+                   std::string& contents);
+   void recordSuccess(int nodeIndex,
+                      size_t bytes,
+                      std::chrono::microseconds elapsed);
+   void recordFailure(int nodeIndex);
+   std::chrono::microseconds getHedgeDelay();
+   void keepStragglers(std::vector<std::future<void>>& requests);
+
+   mutable std::mutex m_mutex;
+   std::vector<NodeStats> m_nodeStats;
+   std::vector<long> m_latencySamples;  // recent, in microseconds
+   std::chrono::microseconds m_hedgeDelay;
+   std::mutex m_stragglerMutex;
+   std::vector<std::future<void>> m_stragglers;
+   std::atomic<int> m_hedgedFetches;
+   std::atomic<int> m_failovers;
+   size_t m_nextSample;
+   long m_samplesSinceDelay;
+   long m_fetchCount;
+   int m_hedgePercentile;
+
+   // not available
+   ReplicaSelector(const ReplicaSelector&);
+   ReplicaSelector& operator=(const ReplicaSelector&);
+};
+
+}
+
+#endif
+
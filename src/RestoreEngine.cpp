@@ -0,0 +1,276 @@
+// Copyright Paul Dardeau, 2016
+// RestoreEngine.cpp
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "RestoreEngine.h"
+#include "BinaryFile.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+const int RestoreEngine::DEFAULT_FETCH_WORKERS = 32;
+
+// appended (with the process id) to the name of a file being restored
+static const string TEMP_FILE_SUFFIX = ".restoring-";
+
+//******************************************************************************
+
+static bool ReserveFileSize(int fd, uint64_t fileSize) {
+   if (fileSize == 0) {
+      return true;
+   }
+
+#ifdef __linux__
+   // allocate the blocks now so that out of order writes don't fragment
+   // the file. not every file system supports it.
+   if (::fallocate(fd, 0, 0, fileSize) == 0) {
+      return true;
+   }
+#endif
+
+   return (::ftruncate(fd, fileSize) == 0);
+}
+
+//******************************************************************************
+
+RestoreEngine::RestoreEngine(int numFetchWorkers, int queueDepth) :
+   m_blockQueue(queueDepth > 0 ? queueDepth : 1),
+   m_filesRestored(0),
+   m_filesFailed(0),
+   m_bytesRestored(0),
+   m_numFetchWorkers(numFetchWorkers > 0 ? numFetchWorkers : 1),
+   m_started(false) {
+}
+
+//******************************************************************************
+
+RestoreEngine::~RestoreEngine() {
+   finish();
+}
+
+//******************************************************************************
+
+int RestoreEngine::getFetchWorkers() const {
+   return m_numFetchWorkers;
+}
+
+//******************************************************************************
+
+void RestoreEngine::start() {
+   if (m_started) {
+      return;
+   }
+
+   m_started = true;
+
+   for (int i = 0; i < m_numFetchWorkers; ++i) {
+      m_workers.push_back(thread(&RestoreEngine::runFetchWorker, this, i));
+   }
+}
+
+//******************************************************************************
+
+bool RestoreEngine::beginFile(const string& filePath,
+                              mode_t fileMode,
+                              uint64_t fileSize) {
+   if (m_currentFile) {
+      endFile(true);
+   }
+
+   // an existing file of the same name is only replaced once the new one
+   // is complete
+   const string tempFilePath =
+      filePath + TEMP_FILE_SUFFIX + to_string(::getpid());
+
+   const int fd =
+      ::open(tempFilePath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+   if (fd == -1) {
+      Logger::error("unable to create file '" + tempFilePath + "': " +
+                    string(::strerror(errno)));
+      ++m_filesFailed;
+      return false;
+   }
+
+   if (::fchmod(fd, fileMode) != 0) {
+      Logger::warning("unable to set permissions on '" + filePath + "'");
+   }
+
+   if (!ReserveFileSize(fd, fileSize)) {
+      Logger::error("unable to allocate " + to_string(fileSize) +
+                    " bytes for '" + filePath + "'");
+      ::close(fd);
+      ::unlink(tempFilePath.c_str());
+      ++m_filesFailed;
+      return false;
+   }
+
+   m_currentFile = make_shared<RestoreFile>();
+   m_currentFile->filePath = filePath;
+   m_currentFile->tempFilePath = tempFilePath;
+   m_currentFile->fd = fd;
+
+   return true;
+}
+
+//******************************************************************************
+
+bool RestoreEngine::addBlock(uint64_t offset,
+                             size_t blockSize,
+                             const BlockFetch& fetch) {
+   if (!m_currentFile || !m_started) {
+      return false;
+   }
+
+   BlockJob job;
+   job.file = m_currentFile;
+   job.fetch = fetch;
+   job.offset = offset;
+   job.blockSize = blockSize;
+
+   ++m_currentFile->references;
+
+   if (!m_blockQueue.push(std::move(job))) {
+      --m_currentFile->references;
+      return false;
+   }
+
+   return true;
+}
+
+//******************************************************************************
+
+void RestoreEngine::endFile(bool complete) {
+   if (!m_currentFile) {
+      return;
+   }
+
+   if (!complete) {
+      m_currentFile->failed = true;
+   }
+
+   // the workers may still hold blocks of the file; the last one closes it
+   shared_ptr<RestoreFile> file = m_currentFile;
+   m_currentFile.reset();
+   releaseFile(*file);
+}
+
+//******************************************************************************
+
+void RestoreEngine::fileSkipped() {
+   ++m_filesFailed;
+}
+
+//******************************************************************************
+
+bool RestoreEngine::finish() {
+   endFile(true);
+
+   if (m_started) {
+      m_blockQueue.close();
+
+      for (auto& t : m_workers) {
+         t.join();
+      }
+
+      m_workers.clear();
+      m_started = false;
+   }
+
+   return (m_filesFailed == 0);
+}
+
+//******************************************************************************
+
+int RestoreEngine::getFilesRestored() const {
+   return m_filesRestored;
+}
+
+//******************************************************************************
+
+int RestoreEngine::getFilesFailed() const {
+   return m_filesFailed;
+}
+
+//******************************************************************************
+
+uint64_t RestoreEngine::getBytesRestored() const {
+   return m_bytesRestored;
+}
+
+//******************************************************************************
+
+void RestoreEngine::runFetchWorker(int workerIndex) {
+   BlockJob job;
+   string contents;
+
+   while (m_blockQueue.pop(job)) {
+      RestoreFile& file = *job.file;
+
+      // no point fetching the rest of a file that is already lost
+      if (!file.failed) {
+         contents.clear();
+
+         if (!job.fetch(workerIndex, contents)) {
+            file.failed = true;
+         } else if (contents.size() != job.blockSize) {
+            Logger::error("restored block at offset " +
+                          to_string(job.offset) + " of '" + file.filePath +
+                          "' has wrong size");
+            file.failed = true;
+         } else if (!BinaryFile::pwriteFully(file.fd,
+                                             contents.data(),
+                                             contents.size(),
+                                             job.offset)) {
+            Logger::error("unable to write block at offset " +
+                          to_string(job.offset) + " of '" + file.filePath +
+                          "'");
+            file.failed = true;
+         } else {
+            m_bytesRestored += contents.size();
+         }
+      }
+
+      releaseFile(file);
+      job = BlockJob();
+   }
+}
+
+//******************************************************************************
+
+void RestoreEngine::releaseFile(RestoreFile& file) {
+   if (--file.references > 0) {
+      return;
+   }
+
+   if (::close(file.fd) != 0) {
+      file.failed = true;
+   }
+
+   file.fd = -1;
+
+   if (!file.failed &&
+       (::rename(file.tempFilePath.c_str(), file.filePath.c_str()) != 0)) {
+      Logger::error("unable to rename '" + file.tempFilePath + "': " +
+                    string(::strerror(errno)));
+      file.failed = true;
+   }
+
+   if (file.failed) {
+      ::unlink(file.tempFilePath.c_str());
+      Logger::error("unable to restore file '" + file.filePath + "'");
+      ++m_filesFailed;
+   } else {
+      ++m_filesRestored;
+   }
+}
+
+//******************************************************************************
+
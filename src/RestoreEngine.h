@@ -0,0 +1,188 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_RESTOREENGINE_H
+#define LACHEPAS_RESTOREENGINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+
+
+namespace lachepas {
+
+/**
+ * Restores the blocks of many files at once. Each file is created at its
+ * full size up front (fallocate where available) under a temporary name,
+ * which only becomes the file's own once every block has been written, so
+ * a file that fails part way never looks restored. Fetch workers
+ * retrieve blocks from any of the files concurrently, writing each one
+ * with pwrite at its offset as soon as it arrives, so blocks may complete
+ * in any order. The number of workers is the number of block fetches in
+ * flight, which is what keeps the link busy when each fetch is a round
+ * trip to a storage node.
+ *
+ * Files are added one after another on the caller's thread (beginFile,
+ * addBlock for each of its blocks, endFile). Adding a block waits while the
+ * queue is full, so at most the queue depth plus one block per worker is
+ * held in memory, and only the files those blocks belong to are open. A
+ * file is closed by whichever thread finishes with it last.
+ */
+class RestoreEngine {
+
+public:
+   /**
+    * Number of block fetches in flight when none is configured
+    */
+   static const int DEFAULT_FETCH_WORKERS;
+
+   /**
+    * Retrieves one block and turns it back into the original bytes
+    * (called on a fetch worker)
+    * @param workerIndex index of the fetch worker (0 to workers - 1)
+    * @param contents receives the block
+    * @return false if the block could not be restored
+    */
+   typedef std::function<bool(int workerIndex,
+                              std::string& contents)> BlockFetch;
+
+   /**
+    *
+    * @param numFetchWorkers number of blocks fetched at once
+    * @param queueDepth number of blocks queued ahead of the workers
+    */
+   RestoreEngine(int numFetchWorkers, int queueDepth);
+
+   /**
+    * Destructor. Waits for the queued blocks (see finish).
+    */
+   ~RestoreEngine();
+
+   /**
+    *
+    * @return number of fetch workers
+    */
+   int getFetchWorkers() const;
+
+   /**
+    * Starts the fetch workers
+    */
+   void start();
+
+   /**
+    * Creates the next file (under a temporary name until it is complete)
+    * and reserves its full size
+    * @param filePath
+    * @param fileMode permissions of the file
+    * @param fileSize size of the file once restored
+    * @return false if the file could not be created
+    */
+   bool beginFile(const std::string& filePath,
+                  mode_t fileMode,
+                  uint64_t fileSize);
+
+   /**
+    * Queues a block of the file begun last, waiting while the queue is full
+    * @param offset where the block goes in the file
+    * @param blockSize size of the block once restored
+    * @param fetch retrieves the block
+    * @return false if there is no file or the engine is not running
+    */
+   bool addBlock(uint64_t offset,
+                 size_t blockSize,
+                 const BlockFetch& fetch);
+
+   /**
+    * Marks the file begun last as having all of its blocks queued (it is
+    * closed once they have been written)
+    * @param complete false if some of the file's blocks could not be
+    * queued, which counts the file as failed
+    */
+   void endFile(bool complete);
+
+   /**
+    * Counts a file that can't be restored at all (e.g., some of its blocks
+    * are missing from the catalog) as failed
+    */
+   void fileSkipped();
+
+   /**
+    * Waits for every queued block to be written and stops the workers
+    * @return false if any file was not fully restored
+    */
+   bool finish();
+
+   /**
+    *
+    * @return number of files fully restored
+    */
+   int getFilesRestored() const;
+
+   /**
+    *
+    * @return number of files with a block that could not be restored, or
+    * that were skipped
+    */
+   int getFilesFailed() const;
+
+   /**
+    *
+    * @return number of bytes written
+    */
+   uint64_t getBytesRestored() const;
+
+
+private:
+   struct RestoreFile {
+      std::string filePath;
+      std::string tempFilePath;     // written until complete
+      int fd;
+      std::atomic<int> references;  // queued blocks, plus one until endFile
+      std::atomic<bool> failed;
+
+      RestoreFile() :
+         fd(-1),
+         references(1),
+         failed(false) {
+      }
+   };
+
+   struct BlockJob {
+      std::shared_ptr<RestoreFile> file;
+      BlockFetch fetch;
+      uint64_t offset;
+      size_t blockSize;
+
+      BlockJob() :
+         offset(0),
+         blockSize(0) {
+      }
+   };
+
+   void runFetchWorker(int workerIndex);
+   void releaseFile(RestoreFile& file);
+
+   BoundedQueue<BlockJob> m_blockQueue;
+   std::vector<std::thread> m_workers;
+   std::shared_ptr<RestoreFile> m_currentFile;
+   std::atomic<int> m_filesRestored;
+   std::atomic<int> m_filesFailed;
+   std::atomic<uint64_t> m_bytesRestored;
+   int m_numFetchWorkers;
+   bool m_started;
+
+   // not available
+   RestoreEngine(const RestoreEngine&);
+   RestoreEngine& operator=(const RestoreEngine&);
+};
+
+}
+
+#endif
+
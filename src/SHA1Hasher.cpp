@@ -0,0 +1,85 @@
+// Copyright Paul Dardeau, 2016
+// SHA1Hasher.cpp
+
+#include <stdio.h>
+
+#include <openssl/evp.h>
+
+#include "SHA1Hasher.h"
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+SHA1Hasher::SHA1Hasher() :
+   m_mdctx(::EVP_MD_CTX_create()),
+   m_initialized(false) {
+   reset();
+}
+
+//******************************************************************************
+
+SHA1Hasher::~SHA1Hasher() {
+   if (m_mdctx != nullptr) {
+      ::EVP_MD_CTX_destroy(m_mdctx);
+   }
+}
+
+//******************************************************************************
+
+const string& SHA1Hasher::getAlgorithm() const {
+   return ALGORITHM_SHA1;
+}
+
+//******************************************************************************
+
+void SHA1Hasher::reset() {
+   m_initialized = false;
+
+   if (m_mdctx == nullptr) {
+      ::printf("error: EVP_MD_CTX_create returned null\n");
+      return;
+   }
+
+   if (1 != ::EVP_DigestInit_ex(m_mdctx, ::EVP_sha1(), nullptr)) {
+      ::printf("error: EVP_DigestInit_ex failed\n");
+      return;
+   }
+
+   m_initialized = true;
+}
+
+//******************************************************************************
+
+void SHA1Hasher::update(const void* data, size_t length) {
+   if (m_initialized && (length > 0)) {
+      if (1 != ::EVP_DigestUpdate(m_mdctx, data, length)) {
+         ::printf("error: EVP_DigestUpdate failed\n");
+         m_initialized = false;
+      }
+   }
+}
+
+//******************************************************************************
+
+string SHA1Hasher::finalHex() {
+   if (!m_initialized) {
+      return string();
+   }
+
+   unsigned char md_value[EVP_MAX_MD_SIZE];
+   unsigned int md_len = 0;
+
+   m_initialized = false;
+
+   if (1 != ::EVP_DigestFinal_ex(m_mdctx, md_value, &md_len)) {
+      ::printf("error: EVP_DigestFinal_ex failed\n");
+      return string();
+   }
+
+   return toHexString(md_value, md_len);
+}
+
+//******************************************************************************
+
@@ -0,0 +1,66 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_SHA1HASHER_H
+#define LACHEPAS_SHA1HASHER_H
+
+#include "ContentHasher.h"
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+
+namespace lachepas {
+
+/**
+ * SHA-1 (via OpenSSL EVP), kept for vaults whose identifiers were computed
+ * with it
+ */
+class SHA1Hasher : public ContentHasher {
+
+public:
+   /**
+    * Default constructor
+    */
+   SHA1Hasher();
+
+   /**
+    * Destructor
+    */
+   ~SHA1Hasher();
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getAlgorithm() const;
+
+   /**
+    *
+    */
+   void reset();
+
+   /**
+    *
+    * @param data
+    * @param length
+    */
+   void update(const void* data, size_t length);
+
+   /**
+    *
+    * @return
+    */
+   std::string finalHex();
+
+
+private:
+   EVP_MD_CTX* m_mdctx;
+   bool m_initialized;
+
+   // not available
+   SHA1Hasher(const SHA1Hasher&);
+   SHA1Hasher& operator=(const SHA1Hasher&);
+};
+
+}
+
+#endif
+
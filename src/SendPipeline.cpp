@@ -0,0 +1,326 @@
+// Copyright Paul Dardeau, 2016
+// SendPipeline.cpp
+
+#include "SendPipeline.h"
+
+using namespace std;
+using namespace lachepas;
+
+//******************************************************************************
+
+SendPipeline::SendPipeline(int numTransformWorkers, int queueDepth) :
+   m_readQueue(queueDepth),
+   m_resultQueue(queueDepth),
+   m_activeTransformWorkers(0),
+   m_activeSenders(0),
+   m_blocksRead(0),
+   m_aborted(false),
+   m_numFailedNodes(0),
+   m_numTransformWorkers(numTransformWorkers > 0 ? numTransformWorkers : 1),
+   m_queueDepth(queueDepth > 0 ? queueDepth : 1),
+   m_nodeQueueDepth(m_queueDepth),
+   m_batchSize(1) {
+}
+
+//******************************************************************************
+
+SendPipeline::~SendPipeline() {
+}
+
+//******************************************************************************
+
+void SendPipeline::setNodeQueueDepth(int nodeQueueDepth) {
+   m_nodeQueueDepth = (nodeQueueDepth > 0) ? nodeQueueDepth : 1;
+}
+
+//******************************************************************************
+
+void SendPipeline::setReader(const BlockReader& reader) {
+   m_reader = reader;
+}
+
+//******************************************************************************
+
+void SendPipeline::setTransform(const BlockTransform& transform) {
+   m_transform = transform;
+}
+
+//******************************************************************************
+
+void SendPipeline::setPlacementCheck(const BlockPlacementCheck& placementCheck) {
+   m_placementCheck = placementCheck;
+}
+
+//******************************************************************************
+
+void SendPipeline::setSender(const BlockSender& sender) {
+   m_sender = sender;
+}
+
+//******************************************************************************
+
+void SendPipeline::setExistenceCheck(const ExistenceCheck& existenceCheck,
+                                     int batchSize) {
+   m_existenceCheck = existenceCheck;
+   m_batchSize = (batchSize > 0) ? batchSize : 1;
+}
+
+//******************************************************************************
+
+void SendPipeline::setResultHandler(const ResultHandler& resultHandler) {
+   m_resultHandler = resultHandler;
+}
+
+//******************************************************************************
+
+int SendPipeline::getBlocksRead() const {
+   return m_blocksRead;
+}
+
+//******************************************************************************
+
+bool SendPipeline::run(const vector<int>& nodeIndexes) {
+   if (!m_reader || !m_transform || !m_sender || !m_resultHandler) {
+      return false;
+   }
+
+   if (nodeIndexes.empty()) {
+      return true;
+   }
+
+   const int numNodes = nodeIndexes.size();
+
+   m_nodeIndexes = nodeIndexes;
+   m_failedNodes.reset(new atomic<bool>[numNodes]);
+   m_numFailedNodes = 0;
+
+   for (int i = 0; i < numNodes; ++i) {
+      m_failedNodes[i] = false;
+      m_nodeQueues.push_back(
+         unique_ptr<BoundedQueue<ConstBlockPtr>>(
+            new BoundedQueue<ConstBlockPtr>(m_nodeQueueDepth)));
+   }
+
+   m_activeTransformWorkers = m_numTransformWorkers;
+   m_activeSenders = numNodes;
+
+   vector<thread> threads;
+   threads.push_back(thread(&SendPipeline::runReader, this));
+
+   for (int i = 0; i < m_numTransformWorkers; ++i) {
+      threads.push_back(thread(&SendPipeline::runTransformWorker, this));
+   }
+
+   for (int i = 0; i < numNodes; ++i) {
+      threads.push_back(thread(&SendPipeline::runSender,
+                               this,
+                               i,
+                               nodeIndexes[i]));
+   }
+
+   // results are consumed here so that the handler never runs concurrently
+   // with itself. keep draining after an abort so no sender stays blocked.
+   BlockSendResult result;
+   while (m_resultQueue.pop(result)) {
+      const int nodeQueueIndex = nodeQueueIndexFor(result.nodeIndex);
+      if (!m_aborted &&
+          !m_failedNodes[nodeQueueIndex] &&
+          !m_resultHandler(result)) {
+         failNode(nodeQueueIndex);
+      }
+      result = BlockSendResult();
+   }
+
+   for (auto& t : threads) {
+      t.join();
+   }
+
+   m_nodeQueues.clear();
+
+   return !m_aborted;
+}
+
+//******************************************************************************
+
+bool SendPipeline::hasNodeFailed(int nodeIndex) const {
+   if (m_aborted) {
+      return true;
+   }
+
+   const int nodeQueueIndex = nodeQueueIndexFor(nodeIndex);
+   return (nodeQueueIndex < 0) || m_failedNodes[nodeQueueIndex];
+}
+
+//******************************************************************************
+
+int SendPipeline::nodeQueueIndexFor(int nodeIndex) const {
+   const int numNodes = m_nodeIndexes.size();
+   for (int i = 0; i < numNodes; ++i) {
+      if (m_nodeIndexes[i] == nodeIndex) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+//******************************************************************************
+
+void SendPipeline::failNode(int nodeQueueIndex) {
+   if (m_failedNodes[nodeQueueIndex].exchange(true)) {
+      return;
+   }
+
+   // the node's sender drains what is left without sending it, and the
+   // transform workers stop handing it blocks
+   m_nodeQueues[nodeQueueIndex]->close();
+
+   if (++m_numFailedNodes == static_cast<int>(m_nodeQueues.size())) {
+      abort();
+   }
+}
+
+//******************************************************************************
+
+void SendPipeline::abort() {
+   m_aborted = true;
+   m_readQueue.close();
+
+   for (auto& nodeQueue : m_nodeQueues) {
+      nodeQueue->close();
+   }
+}
+
+//******************************************************************************
+
+void SendPipeline::runReader() {
+   int sequenceNumber = 0;
+   bool endOfFile = false;
+
+   while (!m_aborted) {
+      BlockPtr block(new FileBlock);
+      block->blockSequenceNumber = sequenceNumber + 1;
+
+      if (!m_reader(*block, endOfFile)) {
+         abort();
+         break;
+      }
+
+      if (endOfFile && block->data.empty()) {
+         break;
+      }
+
+      ++sequenceNumber;
+      ++m_blocksRead;
+
+      // blocks here while the transform workers are behind
+      if (!m_readQueue.push(std::move(block)) || endOfFile) {
+         break;
+      }
+   }
+
+   m_readQueue.close();
+}
+
+//******************************************************************************
+
+void SendPipeline::runTransformWorker() {
+   BlockPtr block;
+
+   while (m_readQueue.pop(block)) {
+      if (m_aborted) {
+         continue;
+      }
+
+      if (!m_transform(*block)) {
+         abort();
+         continue;
+      }
+
+      ConstBlockPtr transformed(block);
+      block.reset();
+
+      // every node the block is placed on gets the same (shared, read-only)
+      // block. the queue of a node that failed is closed and refuses it.
+      const int numNodes = m_nodeQueues.size();
+      for (int i = 0; i < numNodes; ++i) {
+         if (!m_placementCheck ||
+             m_placementCheck(m_nodeIndexes[i], *transformed)) {
+            m_nodeQueues[i]->push(transformed);
+         }
+      }
+   }
+
+   if (--m_activeTransformWorkers == 0) {
+      for (auto& nodeQueue : m_nodeQueues) {
+         nodeQueue->close();
+      }
+   }
+}
+
+//******************************************************************************
+
+void SendPipeline::runSender(int nodeQueueIndex, int nodeIndex) {
+   BoundedQueue<ConstBlockPtr>& nodeQueue = *m_nodeQueues[nodeQueueIndex];
+   const atomic<bool>& nodeFailed = m_failedNodes[nodeQueueIndex];
+   vector<ConstBlockPtr> batch;
+   vector<const FileBlock*> batchBlocks;
+   vector<bool> stored;
+   ConstBlockPtr block;
+   bool moreBlocks = true;
+
+   while (moreBlocks) {
+      // one existence check covers the whole batch. filling it only waits
+      // on the transform stage, which keeps running meanwhile.
+      batch.clear();
+      while (batch.size() < m_batchSize) {
+         if (!nodeQueue.pop(block)) {
+            moreBlocks = false;
+            break;
+         }
+
+         if (!m_aborted && !nodeFailed) {
+            batch.push_back(std::move(block));
+         }
+      }
+
+      if (batch.empty() || m_aborted || nodeFailed) {
+         continue;
+      }
+
+      stored.clear();
+      if (m_existenceCheck) {
+         batchBlocks.clear();
+         for (const auto& batchBlock : batch) {
+            batchBlocks.push_back(batchBlock.get());
+         }
+         m_existenceCheck(nodeIndex, batchBlocks, stored);
+      }
+
+      if (stored.size() != batch.size()) {
+         stored.assign(batch.size(), false);
+      }
+
+      const size_t numBlocks = batch.size();
+      for (size_t i = 0; (i < numBlocks) && !m_aborted && !nodeFailed; ++i) {
+         BlockSendResult result;
+         result.nodeIndex = nodeIndex;
+         result.block = batch[i];
+         m_sender(nodeIndex, *batch[i], stored[i], result);
+
+         if (!m_resultQueue.push(std::move(result))) {
+            moreBlocks = false;
+            break;
+         }
+      }
+   }
+
+   batch.clear();
+
+   if (--m_activeSenders == 0) {
+      m_resultQueue.close();
+   }
+}
+
+//******************************************************************************
+
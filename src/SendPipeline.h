@@ -0,0 +1,392 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_SENDPIPELINE_H
+#define LACHEPAS_SENDPIPELINE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "GFS.h"
+
+
+namespace lachepas {
+
+/**
+ * A block of a local file as it moves through the send pipeline. The reader
+ * fills in data, offset and the sequence number; the transform stage replaces
+ * data with the payloads that are sent to the storage nodes (one per
+ * compression and cipher pair the vaults use, as raw bytes plus a base64 copy
+ * if any of those vaults is in text mode) and computes its placement key and
+ * its unique identifier for each combination of compression, cipher, payload
+ * encoding and hash algorithm.
+ *
+ * When the block is erasure coded each payload is split into fragments, each
+ * node is sent only its own fragment, and the identifiers are those of the
+ * fragments. Accessors take the fragment index of the node (-1 for the whole
+ * payload).
+ */
+struct FileBlock {
+   /**
+    * How a vault stores its blocks
+    */
+   struct Format {
+      std::string compression;      // empty when not compressed
+      std::string cipher;           // empty when not encrypted
+      std::string payloadEncoding;
+      std::string hashAlgorithm;
+
+      Format() {
+      }
+
+      Format(const std::string& aCompression,
+             const std::string& aCipher,
+             const std::string& aPayloadEncoding,
+             const std::string& aHashAlgorithm) :
+         compression(aCompression),
+         cipher(aCipher),
+         payloadEncoding(aPayloadEncoding),
+         hashAlgorithm(aHashAlgorithm) {
+      }
+
+      std::pair<std::string, std::string> payloadKey() const {
+         return std::make_pair(compression, cipher);
+      }
+
+      bool operator<(const Format& other) const {
+         return std::tie(compression, cipher, payloadEncoding, hashAlgorithm) <
+                std::tie(other.compression, other.cipher,
+                         other.payloadEncoding, other.hashAlgorithm);
+      }
+   };
+
+   /**
+    * The block as compressed with one codec and encrypted with one cipher
+    */
+   struct Payload {
+      std::string bytes;
+      std::string text;         // base64 of bytes, only if needed
+      std::string compression;  // empty if the block did not compress
+      std::vector<std::string> fragments;      // only when erasure coded
+      std::vector<std::string> fragmentTexts;  // base64 of each, only if needed
+      int padCharCount;
+      int payloadSize;                         // of bytes, before splitting
+
+      Payload() :
+         padCharCount(0),
+         payloadSize(0) {
+      }
+   };
+
+   std::string data;
+   // by Format::payloadKey (compression and cipher)
+   std::map<std::pair<std::string, std::string>, Payload> payloads;
+   std::map<Format, std::string> uniqueIdentifiers;
+   std::map<Format, std::vector<std::string>> fragmentIdentifiers;
+   std::vector<int> fragmentNodes;  // node holding each fragment
+   std::string placementKey;
+   int blockSequenceNumber;
+   int64_t blockOffset;
+   int originBlockSize;
+   int dataFragments;               // 0 when not erasure coded
+   int parityFragments;
+
+   FileBlock() :
+      blockSequenceNumber(0),
+      blockOffset(0),
+      originBlockSize(0),
+      dataFragments(0),
+      parityFragments(0) {
+   }
+
+   int fragmentIndexFor(int nodeIndex) const {
+      const int numFragments = fragmentNodes.size();
+      for (int i = 0; i < numFragments; ++i) {
+         if (fragmentNodes[i] == nodeIndex) {
+            return i;
+         }
+      }
+      return -1;
+   }
+
+   const std::string& payloadFor(const Format& format,
+                                 int fragmentIndex) const {
+      static const std::string EMPTY;
+      auto it = payloads.find(format.payloadKey());
+      if (it == payloads.end()) {
+         return EMPTY;
+      }
+
+      const Payload& payload = (*it).second;
+      const bool text = (format.payloadEncoding == GFS::PAYLOAD_ENCODING_BASE64);
+
+      if (fragmentIndex < 0) {
+         return text ? payload.text : payload.bytes;
+      }
+
+      const std::vector<std::string>& fragments =
+         text ? payload.fragmentTexts : payload.fragments;
+      return (fragmentIndex < (int) fragments.size()) ?
+         fragments[fragmentIndex] : EMPTY;
+   }
+
+   int payloadSizeFor(const Format& format) const {
+      auto it = payloads.find(format.payloadKey());
+      return (it != payloads.end()) ? (*it).second.payloadSize : 0;
+   }
+
+   int padCharCountFor(const Format& format) const {
+      auto it = payloads.find(format.payloadKey());
+      return (it != payloads.end()) ? (*it).second.padCharCount : 0;
+   }
+
+   const std::string& compressionFor(const Format& format) const {
+      static const std::string EMPTY;
+      auto it = payloads.find(format.payloadKey());
+      return (it != payloads.end()) ? (*it).second.compression : EMPTY;
+   }
+
+   const std::string& uniqueIdentifierFor(const Format& format,
+                                          int fragmentIndex) const {
+      static const std::string EMPTY;
+      if (fragmentIndex < 0) {
+         auto it = uniqueIdentifiers.find(format);
+         return (it != uniqueIdentifiers.end()) ? (*it).second : EMPTY;
+      }
+
+      auto it = fragmentIdentifiers.find(format);
+      if ((it == fragmentIdentifiers.end()) ||
+          (fragmentIndex >= (int) (*it).second.size())) {
+         return EMPTY;
+      }
+      return (*it).second[fragmentIndex];
+   }
+};
+
+/**
+ * Outcome of sending one block to one storage node. carriedForward means the
+ * file already had the block on the node and nothing was sent.
+ */
+struct BlockSendResult {
+   std::string nodeUniqueIdentifier;
+   std::string nodeDirectory;
+   std::string nodeFile;
+   std::string error;
+   std::shared_ptr<const FileBlock> block;
+   int nodeIndex;
+   bool success;
+   bool carriedForward;
+
+   BlockSendResult() :
+      nodeIndex(-1),
+      success(false),
+      carriedForward(false) {
+   }
+};
+
+/**
+ * Streams the blocks of one file through reader, transform and per-node
+ * sender stages that run on their own threads and are connected by bounded
+ * queues. Every node has its own queue and sender, so a block goes out to
+ * all of its nodes at once and a node that is slower than the others only
+ * holds them back once it is a whole node queue behind. Each stage blocks
+ * when the next one falls behind, so at most (queueDepth * 2 + nodeQueueDepth
+ * * number of nodes + transform workers) blocks are in memory at once no
+ * matter how large the file is, plus up to a batch per node when an
+ * existence check is set. Results are handed back on the thread that called
+ * run(), which keeps catalog updates single-threaded; they arrive in
+ * completion order, so consumers must use the block's sequence number rather
+ * than arrival order.
+ *
+ * A node whose result is rejected is dropped from the rest of the file while
+ * the other nodes carry on.
+ */
+class SendPipeline {
+
+public:
+   /**
+    * Produces the next block of the file
+    * @param block receives the block data and sequence number
+    * @param endOfFile set to true when there are no more blocks
+    * @return false on a read error
+    */
+   typedef std::function<bool(FileBlock& block, bool& endOfFile)> BlockReader;
+
+   /**
+    * Turns the block data into the payload to send (may run concurrently)
+    * @param block the block to transform in place
+    * @return false if the block could not be transformed
+    */
+   typedef std::function<bool(FileBlock& block)> BlockTransform;
+
+   /**
+    * Decides whether a storage node receives a transformed block (called
+    * on the transform threads)
+    * @param nodeIndex index of the storage node
+    * @param block the transformed block
+    * @return false to leave the block off the node
+    */
+   typedef std::function<bool(int nodeIndex,
+                              const FileBlock& block)> BlockPlacementCheck;
+
+   /**
+    * Asks a storage node which of a batch of blocks it already has (called
+    * on that node's sender thread before the batch is sent)
+    * @param nodeIndex index of the storage node
+    * @param blocks the blocks about to be sent
+    * @param stored receives, for each block, whether the node has it
+    */
+   typedef std::function<void(int nodeIndex,
+                              const std::vector<const FileBlock*>& blocks,
+                              std::vector<bool>& stored)> ExistenceCheck;
+
+   /**
+    * Sends a block to a storage node (called on that node's sender thread)
+    * @param nodeIndex index of the destination storage node
+    * @param block the block to send
+    * @param storedOnNode whether the existence check found it on the node
+    * @param result receives the outcome
+    */
+   typedef std::function<void(int nodeIndex,
+                              const FileBlock& block,
+                              bool storedOnNode,
+                              BlockSendResult& result)> BlockSender;
+
+   /**
+    * Consumes a send result on the thread that called run()
+    * @param result the outcome of one block on one node
+    * @return false to stop sending the rest of the file to that node
+    */
+   typedef std::function<bool(const BlockSendResult& result)> ResultHandler;
+
+   /**
+    *
+    * @param numTransformWorkers number of threads running the transform stage
+    * @param queueDepth capacity (in blocks) of each queue between stages
+    */
+   SendPipeline(int numTransformWorkers, int queueDepth);
+
+   /**
+    * Destructor
+    */
+   ~SendPipeline();
+
+   /**
+    * Sets how many blocks may wait for each node, i.e., how far one node
+    * may fall behind before it holds back the others (defaults to
+    * queueDepth)
+    * @param nodeQueueDepth
+    */
+   void setNodeQueueDepth(int nodeQueueDepth);
+
+   /**
+    *
+    * @param reader
+    */
+   void setReader(const BlockReader& reader);
+
+   /**
+    *
+    * @param transform
+    */
+   void setTransform(const BlockTransform& transform);
+
+   /**
+    * Limits each block to some of the nodes (optional; by default every
+    * node receives every block)
+    * @param placementCheck
+    */
+   void setPlacementCheck(const BlockPlacementCheck& placementCheck);
+
+   /**
+    *
+    * @param sender
+    */
+   void setSender(const BlockSender& sender);
+
+   /**
+    * Has each sender collect blocks into batches and check them with the
+    * node before sending any of them (optional)
+    * @param existenceCheck
+    * @param batchSize number of blocks checked at once
+    */
+   void setExistenceCheck(const ExistenceCheck& existenceCheck,
+                          int batchSize);
+
+   /**
+    *
+    * @param resultHandler
+    */
+   void setResultHandler(const ResultHandler& resultHandler);
+
+   /**
+    * Runs the pipeline to completion for the specified storage nodes
+    * @param nodeIndexes indexes of the storage nodes that receive every block
+    * @return false if the file could not be read or transformed, or every
+    * node failed
+    */
+   bool run(const std::vector<int>& nodeIndexes);
+
+   /**
+    *
+    * @param nodeIndex index of a storage node passed to run()
+    * @return whether the node was dropped before the whole file was sent
+    */
+   bool hasNodeFailed(int nodeIndex) const;
+
+   /**
+    *
+    * @return number of blocks produced by the reader
+    */
+   int getBlocksRead() const;
+
+
+private:
+   typedef std::shared_ptr<FileBlock> BlockPtr;
+   typedef std::shared_ptr<const FileBlock> ConstBlockPtr;
+
+   void runReader();
+   void runTransformWorker();
+   void runSender(int nodeQueueIndex, int nodeIndex);
+   int nodeQueueIndexFor(int nodeIndex) const;
+   void failNode(int nodeQueueIndex);
+   void abort();
+
+   BlockReader m_reader;
+   BlockTransform m_transform;
+   BlockPlacementCheck m_placementCheck;
+   BlockSender m_sender;
+   ExistenceCheck m_existenceCheck;
+   ResultHandler m_resultHandler;
+   BoundedQueue<BlockPtr> m_readQueue;
+   std::vector<std::unique_ptr<BoundedQueue<ConstBlockPtr>>> m_nodeQueues;
+   std::vector<int> m_nodeIndexes;
+   std::unique_ptr<std::atomic<bool>[]> m_failedNodes;  // by node queue
+   BoundedQueue<BlockSendResult> m_resultQueue;
+   std::atomic<int> m_activeTransformWorkers;
+   std::atomic<int> m_activeSenders;
+   std::atomic<int> m_blocksRead;
+   std::atomic<bool> m_aborted;
+   std::atomic<int> m_numFailedNodes;
+   int m_numTransformWorkers;
+   int m_queueDepth;
+   int m_nodeQueueDepth;
+   size_t m_batchSize;
+
+   // not available
+   SendPipeline(const SendPipeline&);
+   SendPipeline& operator=(const SendPipeline&);
+};
+
+}
+
+#endif
+
@@ -10,6 +10,7 @@ using namespace lachepas;
 
 StorageNode::StorageNode() :
    m_storageNodeId(-1),
+   m_capacity(1),
    m_active(true),
    m_compress(false),
    m_encrypt(false) {
@@ -23,6 +24,7 @@ StorageNode::StorageNode(const StorageNode& copy) :
    m_copyTime(copy.m_copyTime),
    m_nodeName(copy.m_nodeName),
    m_storageNodeId(copy.m_storageNodeId),
+   m_capacity(copy.m_capacity),
    m_active(copy.m_active),
    m_compress(copy.m_compress),
    m_encrypt(copy.m_encrypt) {
@@ -40,6 +42,7 @@ StorageNode& StorageNode::operator=(const StorageNode& copy) {
    m_copyTime = copy.m_copyTime;
    m_nodeName = copy.m_nodeName;
    m_storageNodeId = copy.m_storageNodeId;
+   m_capacity = copy.m_capacity;
    m_compress = copy.m_compress;
    m_encrypt = copy.m_encrypt;
    m_active = copy.m_active;
@@ -109,6 +112,18 @@ int StorageNode::getStorageNodeId() const {
 
 //******************************************************************************
 
+void StorageNode::setCapacity(int capacity) {
+   m_capacity = capacity;
+}
+
+//******************************************************************************
+
+int StorageNode::getCapacity() const {
+   return m_capacity;
+}
+
+//******************************************************************************
+
 void StorageNode::setCompress(bool compress) {
    m_compress = compress;
 }
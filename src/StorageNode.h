@@ -20,6 +20,7 @@ private:
    chaudiere::DateTime m_copyTime;
    std::string m_nodeName;
    int m_storageNodeId;
+   int m_capacity;
    bool m_active;
    bool m_compress;
    bool m_encrypt;
@@ -109,6 +110,19 @@ public:
     */
    int getStorageNodeId() const;
 
+   /**
+    * Sets the node's share of the blocks of directories that keep fewer
+    * copies than there are nodes
+    * @param capacity relative amount of storage (e.g., in GB)
+    */
+   void setCapacity(int capacity);
+
+   /**
+    *
+    * @return
+    */
+   int getCapacity() const;
+
    /**
     *
     * @param compress
@@ -0,0 +1,184 @@
+// Copyright Paul Dardeau, 2016
+// SyncTransaction.cpp
+
+#include <string>
+#include <thread>
+
+#include "SyncTransaction.h"
+#include "DataAccess.h"
+#include "Logger.h"
+
+// attempts at committing a batch before it is rolled back (e.g., while
+// another process holds the catalog locked), and the pause before the first
+// retry (growing with each further one)
+#define COMMIT_ATTEMPTS 5
+#define COMMIT_RETRY_MILLIS 100
+
+using namespace std;
+using namespace lachepas;
+using namespace chaudiere;
+
+//******************************************************************************
+
+SyncTransaction::SyncTransaction(DataAccess& dataAccess) :
+   m_dataAccess(dataAccess),
+   m_filesCommitted(0),
+   m_batchSize(1),
+   m_maxDelayMillis(0),
+   m_filesInBatch(0),
+   m_active(false) {
+}
+
+//******************************************************************************
+
+SyncTransaction::~SyncTransaction() {
+   if (m_active && m_dataAccess.inTransaction()) {
+      m_dataAccess.rollback();
+   }
+
+   discardCommitActions();
+}
+
+//******************************************************************************
+
+void SyncTransaction::setBatchSize(unsigned int batchSize) {
+   m_batchSize = (batchSize > 0) ? batchSize : 1;
+}
+
+//******************************************************************************
+
+void SyncTransaction::setMaxDelay(unsigned int maxDelayMillis) {
+   m_maxDelayMillis = maxDelayMillis;
+}
+
+//******************************************************************************
+
+bool SyncTransaction::begin() {
+   m_active = m_dataAccess.beginTransaction();
+   m_filesInBatch = 0;
+   m_batchStartTime = chrono::steady_clock::now();
+   return m_active;
+}
+
+//******************************************************************************
+
+bool SyncTransaction::fileFinished() {
+   if (!m_active) {
+      // changes are being committed as they are made
+      ++m_filesCommitted;
+      runCommitActions();
+      return true;
+   }
+
+   ++m_filesInBatch;
+
+   bool batchDue = (m_filesInBatch >= m_batchSize);
+
+   if (!batchDue && (m_maxDelayMillis > 0)) {
+      const auto elapsed = chrono::steady_clock::now() - m_batchStartTime;
+      batchDue = (elapsed >= chrono::milliseconds(m_maxDelayMillis));
+   }
+
+   if (!batchDue) {
+      return true;
+   }
+
+   const bool committed = commitBatch();
+
+   if (!begin()) {
+      Logger::warning("unable to begin transaction, committing each change");
+   }
+
+   return committed;
+}
+
+//******************************************************************************
+
+bool SyncTransaction::commit() {
+   if (!m_active) {
+      runCommitActions();
+      return true;
+   }
+
+   const bool committed = commitBatch();
+   m_active = false;
+   return committed;
+}
+
+//******************************************************************************
+
+void SyncTransaction::afterCommit(const CommitAction& action) {
+   m_commitActions.push_back(action);
+}
+
+//******************************************************************************
+
+unsigned long SyncTransaction::getFilesCommitted() const {
+   return m_filesCommitted;
+}
+
+//******************************************************************************
+
+bool SyncTransaction::commitBatch() {
+   for (int attempt = 1; attempt <= COMMIT_ATTEMPTS; ++attempt) {
+      if (m_dataAccess.commit()) {
+         m_filesCommitted += m_filesInBatch;
+         m_filesInBatch = 0;
+         runCommitActions();
+         return true;
+      }
+
+      if (attempt < COMMIT_ATTEMPTS) {
+         Logger::warning("unable to commit catalog changes, retrying");
+         this_thread::sleep_for(chrono::milliseconds(COMMIT_RETRY_MILLIS * attempt));
+      }
+   }
+
+   // the files of a batch that can't be committed are sent again by the
+   // next sync, just as if we had crashed
+   Logger::error("unable to commit catalog changes for " +
+                 to_string(m_filesInBatch) +
+                 " file(s), rolling back");
+   m_dataAccess.rollback();
+   m_filesInBatch = 0;
+   discardCommitActions();
+
+   return false;
+}
+
+//******************************************************************************
+
+void SyncTransaction::runCommitActions() {
+   if (m_commitActions.empty()) {
+      return;
+   }
+
+   // a commit only reaches the log until it is synced, and power loss
+   // could still bring the rows back
+   if (!m_dataAccess.syncCommitted()) {
+      Logger::error("unable to sync catalog changes to disk");
+      discardCommitActions();
+      return;
+   }
+
+   vector<CommitAction> commitActions;
+   commitActions.swap(m_commitActions);
+
+   for (const auto& action : commitActions) {
+      action();
+   }
+}
+
+//******************************************************************************
+
+void SyncTransaction::discardCommitActions() {
+   if (!m_commitActions.empty()) {
+      Logger::warning("discarding " +
+                      to_string(m_commitActions.size()) +
+                      " action(s) waiting for a commit");
+      m_commitActions.clear();
+   }
+}
+
+//******************************************************************************
+
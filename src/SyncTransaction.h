@@ -0,0 +1,124 @@
+// Copyright Paul Dardeau, 2016
+#ifndef LACHEPAS_SYNCTRANSACTION_H
+#define LACHEPAS_SYNCTRANSACTION_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+
+namespace lachepas {
+
+class DataAccess;
+
+/**
+ * Groups the catalog changes of a sync into transactions spanning many
+ * files, so that the database is synced once per batch instead of once per
+ * row. The sync calls fileFinished after each file; the transaction is
+ * committed (and the next one begun) once the batch holds the configured
+ * number of files or has been open for the maximum delay.
+ *
+ * A commit only ever happens between files. Block rows are only inserted
+ * once a node has acknowledged the block, and a file that didn't reach a
+ * node has its rows for that node undone before the file is finished, so a
+ * crash loses at most the current batch, whose files the next sync sends
+ * again. A batch that can't be committed (after a few attempts) is rolled
+ * back the same way.
+ *
+ * Releasing a block on a storage node can't be undone, so it waits (as a
+ * commit action) until the batch that dropped the block's rows has been
+ * committed and synced to disk. If the batch is lost instead, its rows
+ * come back and so the releases are discarded. References are only ever
+ * added ahead of the catalog, so a lost batch (or a crash between a commit
+ * and its releases) can leave a node holding a block that no file needs
+ * any more, but a block is not released while a committed row still
+ * refers to it.
+ */
+class SyncTransaction {
+
+public:
+   typedef std::function<void()> CommitAction;
+   /**
+    * Constructor
+    * @param dataAccess catalog being written (must outlive the transaction)
+    */
+   explicit SyncTransaction(DataAccess& dataAccess);
+
+   /**
+    * Destructor. Rolls back the files finished since the last commit (and
+    * discards their commit actions) if commit hasn't been called.
+    */
+   ~SyncTransaction();
+
+   /**
+    * Sets how many files are committed together
+    * @param batchSize
+    */
+   void setBatchSize(unsigned int batchSize);
+
+   /**
+    * Sets how long a batch may stay open (0 = only commit full batches)
+    * @param maxDelayMillis
+    */
+   void setMaxDelay(unsigned int maxDelayMillis);
+
+   /**
+    * Begins the first batch
+    * @return false if no transaction could be started (each change is then
+    * committed on its own)
+    */
+   bool begin();
+
+   /**
+    * Records that all of the changes for a file have been made, committing
+    * the batch if it is full or has been open long enough
+    * @return false if the batch could not be committed, even after retrying
+    * (its changes are rolled back)
+    */
+   bool fileFinished();
+
+   /**
+    * Runs an action once the changes made so far are committed and synced
+    * (with the batch that holds them). Actions of a batch that is rolled
+    * back are discarded.
+    * @param action
+    */
+   void afterCommit(const CommitAction& action);
+
+   /**
+    * Commits the files finished since the last commit and ends the
+    * transaction
+    * @return
+    */
+   bool commit();
+
+   /**
+    *
+    * @return number of files committed so far
+    */
+   unsigned long getFilesCommitted() const;
+
+
+private:
+   bool commitBatch();
+   void runCommitActions();
+   void discardCommitActions();
+
+   DataAccess& m_dataAccess;
+   std::vector<CommitAction> m_commitActions;
+   std::chrono::steady_clock::time_point m_batchStartTime;
+   unsigned long m_filesCommitted;
+   unsigned int m_batchSize;
+   unsigned int m_maxDelayMillis;
+   unsigned int m_filesInBatch;
+   bool m_active;
+
+   // not available
+   SyncTransaction(const SyncTransaction&);
+   SyncTransaction& operator=(const SyncTransaction&);
+};
+
+}
+
+#endif
+
@@ -2,7 +2,12 @@
 // Vault.cpp
 
 #include "Vault.h"
+#include "ContentHasher.h"
+#include "GFS.h"
+#include "BlockCipher.h"
+#include "BlockCompressor.h"
 
+using namespace std;
 using namespace lachepas;
 
 //******************************************************************************
@@ -12,7 +17,11 @@ Vault::Vault() :
    m_storageNodeId(-1),
    m_localDirectoryId(-1),
    m_compress(false),
-   m_encrypt(false) {
+   m_encrypt(false),
+   m_hashAlgorithm(ContentHasher::DEFAULT_ALGORITHM),
+   m_payloadEncoding(GFS::DEFAULT_PAYLOAD_ENCODING),
+   m_cipher(BlockCipher::DEFAULT_CIPHER),
+   m_compression(BlockCompressor::DEFAULT_COMPRESSION) {
 }
 
 //******************************************************************************
@@ -22,7 +31,11 @@ Vault::Vault(const Vault& copy) :
    m_storageNodeId(copy.m_storageNodeId),
    m_localDirectoryId(copy.m_localDirectoryId),
    m_compress(copy.m_compress),
-   m_encrypt(copy.m_encrypt) {
+   m_encrypt(copy.m_encrypt),
+   m_hashAlgorithm(copy.m_hashAlgorithm),
+   m_payloadEncoding(copy.m_payloadEncoding),
+   m_cipher(copy.m_cipher),
+   m_compression(copy.m_compression) {
 }
 
 //******************************************************************************
@@ -37,6 +50,10 @@ Vault& Vault::operator=(const Vault& copy) {
    m_localDirectoryId = copy.m_localDirectoryId;
    m_compress = copy.m_compress;
    m_encrypt = copy.m_encrypt;
+   m_hashAlgorithm = copy.m_hashAlgorithm;
+   m_payloadEncoding = copy.m_payloadEncoding;
+   m_cipher = copy.m_cipher;
+   m_compression = copy.m_compression;
 
    return *this;
 }
@@ -103,3 +120,51 @@ bool Vault::getEncrypt() const {
 
 //******************************************************************************
 
+void Vault::setHashAlgorithm(const string& hashAlgorithm) {
+   m_hashAlgorithm = hashAlgorithm;
+}
+
+//******************************************************************************
+
+const string& Vault::getHashAlgorithm() const {
+   return m_hashAlgorithm;
+}
+
+//******************************************************************************
+
+void Vault::setPayloadEncoding(const string& payloadEncoding) {
+   m_payloadEncoding = payloadEncoding;
+}
+
+//******************************************************************************
+
+const string& Vault::getPayloadEncoding() const {
+   return m_payloadEncoding;
+}
+
+//******************************************************************************
+
+void Vault::setCipher(const string& cipher) {
+   m_cipher = cipher;
+}
+
+//******************************************************************************
+
+const string& Vault::getCipher() const {
+   return m_cipher;
+}
+
+//******************************************************************************
+
+void Vault::setCompression(const string& compression) {
+   m_compression = compression;
+}
+
+//******************************************************************************
+
+const string& Vault::getCompression() const {
+   return m_compression;
+}
+
+//******************************************************************************
+
@@ -2,6 +2,7 @@
 #ifndef LACHEPAS_VAULT_H
 #define LACHEPAS_VAULT_H
 
+#include <string>
 
 namespace lachepas {
 
@@ -89,12 +90,66 @@ public:
     */
    bool getEncrypt() const;
 
+   /**
+    * Sets the algorithm used for the unique identifiers of the vault's blocks
+    * @param hashAlgorithm name of the hash algorithm
+    */
+   void setHashAlgorithm(const std::string& hashAlgorithm);
+
+   /**
+    * Retrieves the algorithm used for the unique identifiers of the vault's blocks
+    * @return name of the hash algorithm
+    */
+   const std::string& getHashAlgorithm() const;
+
+   /**
+    * Sets how the vault's blocks are encoded when sent to and kept on the node
+    * @param payloadEncoding raw bytes or (legacy) base64 text
+    */
+   void setPayloadEncoding(const std::string& payloadEncoding);
+
+   /**
+    * Retrieves how the vault's blocks are encoded
+    * @return name of the payload encoding
+    */
+   const std::string& getPayloadEncoding() const;
+
+   /**
+    * Sets the cipher and mode the vault's blocks are encrypted with
+    * @param cipher
+    */
+   void setCipher(const std::string& cipher);
+
+   /**
+    * Retrieves the cipher and mode of the vault's blocks (only meaningful
+    * for an encrypted vault)
+    * @return name of the cipher
+    */
+   const std::string& getCipher() const;
+
+   /**
+    * Sets the codec the vault's blocks are compressed with
+    * @param compression
+    */
+   void setCompression(const std::string& compression);
+
+   /**
+    * Retrieves the codec of the vault's blocks (only meaningful for a
+    * compressed vault; empty if its blocks predate compression)
+    * @return name of the compression codec
+    */
+   const std::string& getCompression() const;
+
 private:
    int m_vaultId;
    int m_storageNodeId;
    int m_localDirectoryId;
    bool m_compress;
    bool m_encrypt;
+   std::string m_hashAlgorithm;
+   std::string m_payloadEncoding;
+   std::string m_cipher;
+   std::string m_compression;
 
 };
 
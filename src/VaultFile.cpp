@@ -21,7 +21,8 @@ VaultFile::VaultFile() :
    m_localFileId(-1),
    m_vaultId(-1),
    m_originFileSize(0),
-   m_blockCount(0) {
+   m_blockCount(0),
+   m_needsResend(false) {
 }
 
 //******************************************************************************
@@ -36,7 +37,8 @@ VaultFile::VaultFile(const VaultFile& copy) :
    m_localFileId(copy.m_localFileId),
    m_vaultId(copy.m_vaultId),
    m_originFileSize(copy.m_originFileSize),
-   m_blockCount(copy.m_blockCount) {
+   m_blockCount(copy.m_blockCount),
+   m_needsResend(copy.m_needsResend) {
 }
 
 //******************************************************************************
@@ -56,6 +58,7 @@ VaultFile& VaultFile::operator=(const VaultFile& copy) {
    m_vaultId = copy.m_vaultId;
    m_originFileSize = copy.m_originFileSize;
    m_blockCount = copy.m_blockCount;
+   m_needsResend = copy.m_needsResend;
 
    return *this;
 }
@@ -122,13 +125,13 @@ int VaultFile::getVaultId() const {
 
 //******************************************************************************
 
-void VaultFile::setOriginFileSize(int originFileSize) {
+void VaultFile::setOriginFileSize(int64_t originFileSize) {
    m_originFileSize = originFileSize;
 }
 
 //******************************************************************************
 
-int VaultFile::getOriginFileSize() const {
+int64_t VaultFile::getOriginFileSize() const {
    return m_originFileSize;
 }
 
@@ -182,3 +185,15 @@ const FilePermissions& VaultFile::getOtherPermissions() const {
 
 //******************************************************************************
 
+void VaultFile::setNeedsResend(bool needsResend) {
+   m_needsResend = needsResend;
+}
+
+//******************************************************************************
+
+bool VaultFile::getNeedsResend() const {
+   return m_needsResend;
+}
+
+//******************************************************************************
+
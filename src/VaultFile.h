@@ -2,6 +2,8 @@
 #ifndef LACHEPAS_VAULTFILE_H
 #define LACHEPAS_VAULTFILE_H
 
+#include <stdint.h>
+
 #include "DateTime.h"
 #include "FilePermissions.h"
 
@@ -99,13 +101,13 @@ public:
     *
     * @param originFileSize
     */
-   void setOriginFileSize(int originFileSize);
+   void setOriginFileSize(int64_t originFileSize);
 
    /**
     *
     * @return
     */
-   int getOriginFileSize() const;
+   int64_t getOriginFileSize() const;
 
    /**
     *
@@ -155,6 +157,19 @@ public:
     */
    const FilePermissions& getOtherPermissions() const;
 
+   /**
+    * Sets whether the next sync has to send the file to the vault's node
+    * again (e.g., after its blocks were moved to other nodes)
+    * @param needsResend
+    */
+   void setNeedsResend(bool needsResend);
+
+   /**
+    *
+    * @return
+    */
+   bool getNeedsResend() const;
+
 
 private:
    chaudiere::DateTime m_createTime;
@@ -165,8 +180,9 @@ private:
    int m_vaultFileId;
    int m_localFileId;
    int m_vaultId;
-   int m_originFileSize;
+   int64_t m_originFileSize;
    int m_blockCount;
+   bool m_needsResend;
 
 };
 
@@ -14,7 +14,12 @@ VaultFileBlock::VaultFileBlock() :
    m_originFileSize(0),
    m_storedFileSize(0),
    m_blockSequenceNumber(0),
-   m_padCharCount(0) {
+   m_blockOffset(0),
+   m_padCharCount(0),
+   m_fragmentIndex(-1),
+   m_dataFragments(0),
+   m_parityFragments(0),
+   m_payloadSize(0) {
 }
 
 //******************************************************************************
@@ -26,12 +31,19 @@ VaultFileBlock::VaultFileBlock(const VaultFileBlock& copy) :
    m_uniqueIdentifier(copy.m_uniqueIdentifier),
    m_nodeDirectory(copy.m_nodeDirectory),
    m_nodeFile(copy.m_nodeFile),
+   m_compression(copy.m_compression),
+   m_placementKey(copy.m_placementKey),
    m_vaultFileBlockId(copy.m_vaultFileBlockId),
    m_vaultFileId(copy.m_vaultFileId),
    m_originFileSize(copy.m_originFileSize),
    m_storedFileSize(copy.m_storedFileSize),
    m_blockSequenceNumber(copy.m_blockSequenceNumber),
-   m_padCharCount(copy.m_padCharCount) {
+   m_blockOffset(copy.m_blockOffset),
+   m_padCharCount(copy.m_padCharCount),
+   m_fragmentIndex(copy.m_fragmentIndex),
+   m_dataFragments(copy.m_dataFragments),
+   m_parityFragments(copy.m_parityFragments),
+   m_payloadSize(copy.m_payloadSize) {
 }
 
 //******************************************************************************
@@ -47,12 +59,19 @@ VaultFileBlock& VaultFileBlock::operator=(const VaultFileBlock& copy) {
    m_uniqueIdentifier = copy.m_uniqueIdentifier;
    m_nodeDirectory = copy.m_nodeDirectory;
    m_nodeFile = copy.m_nodeFile;
+   m_compression = copy.m_compression;
+   m_placementKey = copy.m_placementKey;
    m_vaultFileBlockId = copy.m_vaultFileBlockId;
    m_vaultFileId = copy.m_vaultFileId;
    m_originFileSize = copy.m_originFileSize;
    m_storedFileSize = copy.m_storedFileSize;
    m_blockSequenceNumber = copy.m_blockSequenceNumber;
+   m_blockOffset = copy.m_blockOffset;
    m_padCharCount = copy.m_padCharCount;
+   m_fragmentIndex = copy.m_fragmentIndex;
+   m_dataFragments = copy.m_dataFragments;
+   m_parityFragments = copy.m_parityFragments;
+   m_payloadSize = copy.m_payloadSize;
 
    return *this;
 }
@@ -155,6 +174,18 @@ int VaultFileBlock::getBlockSequenceNumber() const {
 
 //******************************************************************************
 
+void VaultFileBlock::setBlockOffset(int64_t blockOffset) {
+   m_blockOffset = blockOffset;
+}
+
+//******************************************************************************
+
+int64_t VaultFileBlock::getBlockOffset() const {
+   return m_blockOffset;
+}
+
+//******************************************************************************
+
 void VaultFileBlock::setPadCharCount(int padCharCount) {
    m_padCharCount = padCharCount;
 }
@@ -167,6 +198,73 @@ int VaultFileBlock::getPadCharCount() const {
 
 //******************************************************************************
 
+void VaultFileBlock::setCompression(const string& compression) {
+   m_compression = compression;
+}
+
+//******************************************************************************
+
+const string& VaultFileBlock::getCompression() const {
+   return m_compression;
+}
+
+//******************************************************************************
+
+void VaultFileBlock::setPlacementKey(const string& placementKey) {
+   m_placementKey = placementKey;
+}
+
+//******************************************************************************
+
+const string& VaultFileBlock::getPlacementKey() const {
+   return m_placementKey;
+}
+
+//******************************************************************************
+
+void VaultFileBlock::setFragmentIndex(int fragmentIndex) {
+   m_fragmentIndex = fragmentIndex;
+}
+
+//******************************************************************************
+
+int VaultFileBlock::getFragmentIndex() const {
+   return m_fragmentIndex;
+}
+
+//******************************************************************************
+
+void VaultFileBlock::setErasureCoding(int dataFragments, int parityFragments) {
+   m_dataFragments = dataFragments;
+   m_parityFragments = parityFragments;
+}
+
+//******************************************************************************
+
+int VaultFileBlock::getDataFragments() const {
+   return m_dataFragments;
+}
+
+//******************************************************************************
+
+int VaultFileBlock::getParityFragments() const {
+   return m_parityFragments;
+}
+
+//******************************************************************************
+
+void VaultFileBlock::setPayloadSize(int payloadSize) {
+   m_payloadSize = payloadSize;
+}
+
+//******************************************************************************
+
+int VaultFileBlock::getPayloadSize() const {
+   return m_payloadSize;
+}
+
+//******************************************************************************
+
 void VaultFileBlock::setUniqueIdentifier(const string& uniqueIdentifier) {
    m_uniqueIdentifier = uniqueIdentifier;
 }
@@ -2,6 +2,8 @@
 #ifndef LACHEPAS_VAULTFILEBLOCK_H
 #define LACHEPAS_VAULTFILEBLOCK_H
 
+#include <stdint.h>
+
 #include "DateTime.h"
 
 namespace lachepas {
@@ -168,6 +170,18 @@ public:
     */
    int getBlockSequenceNumber() const;
 
+   /**
+    * Sets the position (in bytes) of the block within the local file
+    * @param blockOffset
+    */
+   void setBlockOffset(int64_t blockOffset);
+
+   /**
+    *
+    * @return
+    */
+   int64_t getBlockOffset() const;
+
    /**
     *
     * @param padCharCount
@@ -180,6 +194,77 @@ public:
     */
    int getPadCharCount() const;
 
+   /**
+    * Sets the codec the block was compressed with
+    * @param compression codec name, or empty if the block is stored as is
+    */
+   void setCompression(const std::string& compression);
+
+   /**
+    *
+    * @return
+    */
+   const std::string& getCompression() const;
+
+   /**
+    * Sets the key that decides which storage nodes hold the block
+    * @param placementKey
+    * @see BlockPlacement::placementKeyForBlock()
+    */
+   void setPlacementKey(const std::string& placementKey);
+
+   /**
+    *
+    * @return placement key, or empty for blocks stored before placement
+    */
+   const std::string& getPlacementKey() const;
+
+   /**
+    * Sets which fragment of an erasure coded block this is
+    * @param fragmentIndex position among the data fragments followed by the
+    * parity fragments, or -1 if the whole block is stored
+    */
+   void setFragmentIndex(int fragmentIndex);
+
+   /**
+    *
+    * @return
+    */
+   int getFragmentIndex() const;
+
+   /**
+    * Sets how the block was erasure coded
+    * @param dataFragments number of data fragments
+    * @param parityFragments number of parity fragments
+    * @see ReedSolomon
+    */
+   void setErasureCoding(int dataFragments, int parityFragments);
+
+   /**
+    *
+    * @return
+    */
+   int getDataFragments() const;
+
+   /**
+    *
+    * @return
+    */
+   int getParityFragments() const;
+
+   /**
+    * Sets the size of the (compressed and encrypted) block that was split
+    * into fragments
+    * @param payloadSize
+    */
+   void setPayloadSize(int payloadSize);
+
+   /**
+    *
+    * @return
+    */
+   int getPayloadSize() const;
+
 
 private:
    chaudiere::DateTime m_createTime;
@@ -188,12 +273,19 @@ private:
    std::string m_uniqueIdentifier;
    std::string m_nodeDirectory;
    std::string m_nodeFile;
+   std::string m_compression;
+   std::string m_placementKey;
    int m_vaultFileBlockId;
    int m_vaultFileId;
    int m_originFileSize;
    int m_storedFileSize;
    int m_blockSequenceNumber;
+   int64_t m_blockOffset;
    int m_padCharCount;
+   int m_fragmentIndex;
+   int m_dataFragments;
+   int m_parityFragments;
+   int m_payloadSize;
 
 };
 